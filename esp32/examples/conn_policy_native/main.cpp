@@ -0,0 +1,230 @@
+// BleLinkConnPolicy på Linux, drevet af spor: samples (kødybder og bytes/s)
+// fodres til update() i BL_CP_SAMPLE_MS-takt, og tilstandsskift, anmodninger
+// og udskudte skift skrives ud. Uden argumenter køres de indbyggede spor med
+// forventninger til hysteresen (Burst holdes, til trafikken har været rolig i
+// holdMs) og back-off (højst én anmodning pr. minGapMs); exit 1 ved afvigelse.
+//
+//   g++ -std=c++17 -O2 -I../../src -o conn_policy_native main.cpp
+//       ../../src/BleLinkConnPolicy.cpp                           (én kommando)
+//   ./conn_policy_native                      # indbyggede spor, PASS/FAIL pr. spor
+//   ./conn_policy_native --trace spor.csv     # eget spor, fx målt mod fleet_native
+//   ./conn_policy_native --trace - --hold-ms 4000 < spor.csv
+//
+// Sporfil: én linje pr. sample, "t_ms,tx_depth,rx_depth,tx_bps,rx_bps"
+// (linjer med # og en evt. overskrift springes over). t_ms er tid siden
+// connect; reset() kaldes ved t = 0. --burst-depth, --burst-bps, --calm-bps,
+// --idle-bps, --hold-ms, --idle-ms og --min-gap-ms ændrer Config.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include "BleLinkConnPolicy.h"
+
+static const uint32_t kSampleMs = 250;   // som BL_CP_SAMPLE_MS
+
+using Mode = BleLinkConnPolicy::Mode;
+
+// Ét trin i et syntetisk spor: så længe, med denne trafik
+struct Seg {
+  uint32_t ms;
+  uint16_t depth;
+  uint32_t bps;
+};
+
+// Et skift, som politikken bad om
+struct Change {
+  uint32_t t;
+  Mode     mode;
+};
+
+struct Run {
+  std::vector<Change> changes;
+  BleLinkConnPolicy::Stats stats;
+  Mode     final = Mode::Normal;
+};
+
+static void printChange(uint32_t t, const BleLinkConnPolicy& cp) {
+  const BleLinkConnPolicy::Params& p = cp.params();
+  printf("%8lu ms  -> %-6s interval %u-%u latency %u timeout %u\n", (unsigned long)t,
+         BleLinkConnPolicy::modeName(cp.mode()), (unsigned)p.minInterval, (unsigned)p.maxInterval,
+         (unsigned)p.latency, (unsigned)p.timeout);
+}
+
+static bool feed(BleLinkConnPolicy& cp, const BleLinkConnPolicy::Sample& s, Run& run, bool verbose) {
+  if (!cp.update(s)) return false;
+  run.changes.push_back({ s.nowMs, cp.mode() });
+  if (verbose) printChange(s.nowMs, cp);
+  return true;
+}
+
+static Run play(const BleLinkConnPolicy::Config& cfg, const std::vector<Seg>& segs, bool verbose) {
+  BleLinkConnPolicy cp;
+  cp.setConfig(cfg);
+  cp.reset(0);
+  Run      run;
+  uint32_t t = 0;
+  for (const Seg& g : segs) {
+    for (uint32_t end = t + g.ms; t < end; t += kSampleMs) {
+      BleLinkConnPolicy::Sample s;
+      s.nowMs   = t;
+      s.txDepth = g.depth;
+      s.txBps   = g.bps;
+      feed(cp, s, run, verbose);
+    }
+  }
+  run.stats = cp.stats();
+  run.final = cp.mode();
+  return run;
+}
+
+// Første skift til m (ellers UINT32_MAX)
+static uint32_t firstTo(const Run& r, Mode m) {
+  for (const Change& c : r.changes) {
+    if (c.mode == m) return c.t;
+  }
+  return UINT32_MAX;
+}
+
+static bool gapsOk(const Run& r, uint32_t minGapMs) {
+  uint32_t last = 0;                     // reset() tæller som anmodning
+  for (const Change& c : r.changes) {
+    if (c.t - last < minGapMs) return false;
+    last = c.t;
+  }
+  return true;
+}
+
+struct Case {
+  const char*      name;
+  std::vector<Seg> segs;
+  std::function<const char*(const Run&, const BleLinkConnPolicy::Config&)> check;   // nullptr = ok
+};
+
+static std::vector<Case> builtinCases(const BleLinkConnPolicy::Config& c) {
+  uint32_t calm = c.calmBps / 2, mid = (c.calmBps + c.burstBps) / 2, keep = c.idleBps / 2;
+  return {
+    { "idle efter tomgang", { { c.idleMs + 2000, 0, 0 } },
+      [](const Run& r, const BleLinkConnPolicy::Config& k) -> const char* {
+        if (r.final != Mode::Idle) return "ikke idle";
+        if (firstTo(r, Mode::Idle) != k.idleMs) return "idle ikke efter idleMs";
+        return r.stats.requests == 1 ? nullptr : "mere end én anmodning";
+      } },
+    { "keepalives under idleBps", { { c.idleMs + 2000, 0, keep } },
+      [](const Run& r, const BleLinkConnPolicy::Config&) -> const char* {
+        return r.final == Mode::Idle ? nullptr : "keepalives holdt linket vågent";
+      } },
+    { "burst og hysterese", { { 3000, 0, calm }, { 2000, (uint16_t)(c.burstDepth + 2), c.burstBps },
+                              { 3000, 0, mid }, { c.holdMs + 1000, 0, calm } },
+      [](const Run& r, const BleLinkConnPolicy::Config& k) -> const char* {
+        uint32_t b = firstTo(r, Mode::Burst);
+        if (b != 3000) return "burst ikke straks";
+        uint32_t n = firstTo(r, Mode::Normal);
+        if (n == UINT32_MAX) return "burst aldrig forladt";
+        if (n < 8000 + k.holdMs) return "burst forladt over calm-tærsklen eller før holdMs";
+        return r.final == Mode::Normal ? nullptr : "ikke normal til sidst";
+      } },
+    { "kort pause i burst", { { 2000, 0, 0 }, { 2000, 0, c.burstBps },
+                              { c.holdMs / 2, 0, calm }, { 2000, 0, c.burstBps } },
+      [](const Run& r, const BleLinkConnPolicy::Config&) -> const char* {
+        return r.stats.requests == 1 && r.final == Mode::Burst ? nullptr : "pausen gav et skift";
+      } },
+    { "burst lige efter connect", { { 5000, (uint16_t)(c.burstDepth + 2), c.burstBps } },
+      [](const Run& r, const BleLinkConnPolicy::Config& k) -> const char* {
+        uint32_t b = firstTo(r, Mode::Burst);
+        if (b != (k.minGapMs + kSampleMs - 1) / kSampleMs * kSampleMs) return "burst ikke ved minGapMs";
+        return r.stats.deferred > 0 ? nullptr : "skiftet blev ikke udskudt";
+      } },
+    { "flimrende trafik (back-off)", [&] {
+        std::vector<Seg> v;
+        for (int i = 0; i < 80; ++i) v.push_back({ kSampleMs, 0, i % 2 ? c.burstBps : 0 });
+        return v;
+      }(),
+      [](const Run& r, const BleLinkConnPolicy::Config& k) -> const char* {
+        if (!gapsOk(r, k.minGapMs)) return "to anmodninger inden for minGapMs";
+        return r.stats.requests == 1 ? nullptr : "flimren gav flere skift";
+      } },
+    { "idle vækkes", { { c.idleMs + 1000, 0, 0 }, { kSampleMs, 0, c.idleBps }, { c.minGapMs, 0, 0 } },
+      [](const Run& r, const BleLinkConnPolicy::Config& k) -> const char* {
+        if (firstTo(r, Mode::Idle) == UINT32_MAX) return "aldrig idle";
+        if (firstTo(r, Mode::Normal) != k.idleMs + 1000) return "trafik vækkede ikke straks";
+        return r.final == Mode::Normal ? nullptr : "faldt i søvn før idleMs";
+      } },
+  };
+}
+
+static int runBuiltin(const BleLinkConnPolicy::Config& cfg, bool verbose) {
+  int fails = 0;
+  for (const Case& k : builtinCases(cfg)) {
+    if (verbose) printf("-- %s\n", k.name);
+    Run         r   = play(cfg, k.segs, verbose);
+    const char* err = k.check(r, cfg);
+    if (!err && !gapsOk(r, cfg.minGapMs)) err = "to anmodninger inden for minGapMs";
+    printf("%-4s %-28s anmodninger %lu, udskudt %lu, slut %s%s%s\n", err ? "FAIL" : "PASS", k.name,
+           (unsigned long)r.stats.requests, (unsigned long)r.stats.deferred,
+           BleLinkConnPolicy::modeName(r.final), err ? ": " : "", err ? err : "");
+    if (err) fails++;
+  }
+  return fails ? 1 : 0;
+}
+
+static int runTrace(const BleLinkConnPolicy::Config& cfg, const char* path) {
+  FILE* f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  BleLinkConnPolicy cp;
+  cp.setConfig(cfg);
+  cp.reset(0);
+  Run      run;
+  char     line[256];
+  uint32_t samples = 0;
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long t, txd, rxd, txb, rxb;
+    if (line[0] == '#' || sscanf(line, "%lu,%lu,%lu,%lu,%lu", &t, &txd, &rxd, &txb, &rxb) != 5) continue;
+    BleLinkConnPolicy::Sample s;
+    s.nowMs   = (uint32_t)t;
+    s.txDepth = (uint16_t)txd;
+    s.rxDepth = (uint16_t)rxd;
+    s.txBps   = (uint32_t)txb;
+    s.rxBps   = (uint32_t)rxb;
+    feed(cp, s, run, true);
+    samples++;
+  }
+  if (f != stdin) fclose(f);
+  BleLinkConnPolicy::Stats st = cp.stats();
+  printf("%lu samples, anmodninger %lu (normal %lu, burst %lu, idle %lu), udskudt %lu, slut %s\n",
+         (unsigned long)samples, (unsigned long)st.requests,
+         (unsigned long)st.entered[(uint8_t)Mode::Normal], (unsigned long)st.entered[(uint8_t)Mode::Burst],
+         (unsigned long)st.entered[(uint8_t)Mode::Idle], (unsigned long)st.deferred,
+         BleLinkConnPolicy::modeName(cp.mode()));
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  BleLinkConnPolicy::Config cfg;
+  const char* trace   = nullptr;
+  bool        verbose = false;
+  for (int i = 1; i < argc; ++i) {
+    const char* k = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : "";
+    if (!strcmp(k, "-v"))                 { verbose = true; continue; }
+    if (!strcmp(k, "--trace"))            trace = v;
+    else if (!strcmp(k, "--burst-depth")) cfg.burstDepth = (uint16_t)atoi(v);
+    else if (!strcmp(k, "--burst-bps"))   cfg.burstBps = (uint32_t)atol(v);
+    else if (!strcmp(k, "--calm-bps"))    cfg.calmBps = (uint32_t)atol(v);
+    else if (!strcmp(k, "--idle-bps"))    cfg.idleBps = (uint32_t)atol(v);
+    else if (!strcmp(k, "--hold-ms"))     cfg.holdMs = (uint32_t)atol(v);
+    else if (!strcmp(k, "--idle-ms"))     cfg.idleMs = (uint32_t)atol(v);
+    else if (!strcmp(k, "--min-gap-ms"))  cfg.minGapMs = (uint32_t)atol(v);
+    else {
+      fprintf(stderr, "ukendt argument: %s\n", k);
+      return 2;
+    }
+    i++;
+  }
+  return trace ? runTrace(cfg, trace) : runBuiltin(cfg, verbose);
+}
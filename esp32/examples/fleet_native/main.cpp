@@ -0,0 +1,443 @@
+// Enhedsflåde på Linux med BleLinks egen kerne: mange enheder i én proces,
+// hver med sin pulje (BleLinkPool), sine DRR-køer (BleLinkTxSched),
+// RX-køer (BleLinkRxQueue) og sessionsvindue (BleLinkSession), bag
+// python/fleet_sim.py's TCP-protokol. fleet_sim.py load (og gateway.py)
+// forbinder uændret; forskellen til fleet_sim.py serve er, at køer, puljens
+// grænser og DRR-rækkefølgen er firmwarens, ikke en Python-kopi.
+//
+//   g++ -std=c++17 -O2 -pthread -I../native -I../../src -o fleet_native main.cpp
+//       ../../src/BleLinkPool.cpp ../../src/BleLinkTxSched.cpp
+//       ../../src/BleLinkRxQueue.cpp ../../src/BleLinkSession.cpp
+//   ./fleet_native --devices 50 --rate 10 --burst 3 --latency-ms 15
+//   python fleet_sim.py load --devices 50 --duration 30            (anden terminal)
+//
+// Samme muligheder som fleet_sim.py serve (--prefix, --rate, --burst, --size,
+// --mtu, --chunk, --link-bps, --latency-ms, --jitter). Hver forbundet enhed
+// kører sin loop() i sin egen tråd. Kontrolbeskederne (hello, time, stats)
+// og app-kommandoerne ({"op":"echo"}, "PING") besvares som i fleet_sim.py;
+// JSON læses med strengsøgning, da ArduinoJson ikke bygges native.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BleLinkPool.h"
+#include "BleLinkTxSched.h"
+#include "BleLinkRxQueue.h"
+#include "BleLinkSession.h"
+
+// fleet_sim.py: [type u8][len u16 LE][payload]
+enum : uint8_t { P_LIST = 0x01, P_NAMES, P_OPEN, P_ACCEPT, P_REJECT,
+                 P_WRITE_REQ, P_WRITE_CMD, P_ACK, P_NOTIFY };
+
+static const size_t   kFrameHdr    = 4;       // [0x00][type][len u16 LE]
+static const size_t   kFrameMaxRx  = 2048;    // som BL_FRAME_MAX_RX
+static const uint32_t kHelloWaitMs = 3000;    // som BL_HELLO_WAIT_MS
+static const uint8_t  kChControl   = 0;       // svar på kontrolbeskeder
+static const uint8_t  kChStatus    = 1;       // appens status-linjer
+
+// --- TCP-pakker ---
+static bool readExact(int fd, void* p, size_t n) {
+  uint8_t* d = (uint8_t*)p;
+  while (n > 0) {
+    ssize_t r = recv(fd, d, n, 0);
+    if (r <= 0) return false;
+    d += r;
+    n -= (size_t)r;
+  }
+  return true;
+}
+
+static bool readPacket(int fd, uint8_t* kind, std::string& data) {
+  uint8_t h[3];
+  if (!readExact(fd, h, 3)) return false;
+  *kind = h[0];
+  data.resize((size_t)(h[1] | h[2] << 8));
+  return data.empty() || readExact(fd, &data[0], data.size());
+}
+
+static bool sendPacket(int fd, uint8_t kind, const void* p, size_t n) {
+  uint8_t h[3] = { kind, (uint8_t)(n & 0xFF), (uint8_t)(n >> 8) };
+  return send(fd, h, 3, MSG_NOSIGNAL) == 3 &&
+         (n == 0 || send(fd, p, n, MSG_NOSIGNAL) == (ssize_t)n);
+}
+
+// --- kontrolbeskeder (kun de få felter, der bruges her) ---
+static std::string jsonStr(const std::string& line, const char* key) {
+  std::string k = std::string("\"") + key + "\":\"";
+  size_t a = line.find(k);
+  if (a == std::string::npos) return "";
+  a += k.size();
+  size_t b = line.find('"', a);
+  return b == std::string::npos ? "" : line.substr(a, b - a);
+}
+
+static double wallMs() {
+  return std::chrono::duration<double, std::milli>(
+           std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void releaseToPool(void* ctx, char* buf) { static_cast<BleLinkPool*>(ctx)->release(buf); }
+
+struct Profile {
+  double rateHz = 10.0;                // status-bursts pr. sekund
+  int    burst  = 1;                   // linjer pr. burst
+  int    size   = 80;                  // ca. linjestørrelse i bytes
+};
+
+struct LinkModel {
+  uint16_t mtu       = 247;
+  size_t   chunk     = 0;              // bytes pr. notifikation; 0 = MTU - 3 (firmwarens _sendLine)
+  uint32_t rateBps   = 20000;          // notifikations-throughput
+  double   latencyMs = 10.0;           // envejs
+};
+
+// Én enhed: kernen fra BleLink.cpp og en loop(), mens en vært er forbundet
+class Device {
+public:
+  Device(std::string name, Profile p, LinkModel l) : name(std::move(name)), _prof(p), _link(l) {}
+
+  const std::string name;
+  std::atomic<bool> busy{false};
+
+  uint16_t mtu() const { return _link.mtu; }
+  void     serve(int fd);
+
+private:
+  struct Notify {
+    uint64_t    dueUs;
+    std::string data;
+  };
+
+  static uint64_t nowUs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  bool _enqueue(uint8_t ch, const char* s, size_t n);
+  void _parseUnits();
+  void _onLine(const char* s, size_t n);
+  void _pumpRx();
+  void _pumpStatus();
+  void _pumpTx();
+  void _flushNotify();
+
+  Profile   _prof;
+  LinkModel _link;
+
+  BleLinkPool    _pool;
+  BleLinkTxSched _txq;
+  BleLinkRxQueue _rxq;
+  BleLinkSession _sess;
+  std::string    _rxBuf;
+
+  int      _fd = -1;
+  bool     _awaitHello = false;
+  uint32_t _connAt     = 0;
+  uint64_t _nextStatusUs = 0;
+  uint64_t _nextTxUs   = 0;            // linkets takt: næste chunk må sendes da
+  std::deque<Notify> _inAir;           // sendt, men ikke fremme endnu (latens)
+  std::string _unit;                   // enheden, der er ved at blive sendt
+  size_t   _unitOff = 0;
+  uint32_t _seq = 0;
+
+  uint32_t _connects = 0, _rxMsgs = 0, _txMsgs = 0, _txDrops = 0, _rxDrops = 0;
+};
+
+// Som _acquireTx + _enqueueTx: puljen (vinduet viger under pres), så køen
+bool Device::_enqueue(uint8_t ch, const char* s, size_t n) {
+  size_t cap = 0;
+  char*  buf = _pool.acquire(n + 1, &cap);
+  if (!buf && _sess.retained()) {
+    _sess.reclaim(releaseToPool, &_pool);
+    buf = _pool.acquire(n + 1, &cap);
+  }
+  if (!buf) {
+    _txq.noteDrop(ch);
+    _txDrops++;
+    return false;
+  }
+  memcpy(buf, s, n);
+  buf[n] = '\0';
+  if (!_txq.push(ch, buf, (uint16_t)n, millis())) {
+    _pool.release(buf);
+    _txq.noteDrop(ch);
+    _txDrops++;
+    return false;
+  }
+  return true;
+}
+
+// parseUnits() i BleLink.cpp; frames ignoreres af flåden (som fleet_sim.py)
+void Device::_parseUnits() {
+  while (!_rxBuf.empty()) {
+    if ((uint8_t)_rxBuf[0] == 0x00) {
+      if (_rxBuf.size() < kFrameHdr) break;
+      size_t n = (uint8_t)_rxBuf[2] | ((size_t)(uint8_t)_rxBuf[3] << 8);
+      if (n > kFrameMaxRx) { _rxBuf.clear(); break; }
+      if (_rxBuf.size() < kFrameHdr + n) break;
+      _rxMsgs++;
+      _rxBuf.erase(0, kFrameHdr + n);
+      continue;
+    }
+    size_t pos = _rxBuf.find('\n');
+    if (pos == std::string::npos) break;
+    _rxMsgs++;
+    const uint8_t* p = (const uint8_t*)_rxBuf.data();
+    size_t skip = 0;
+    BleLinkRxQueue::Prio pr = BleLinkRxQueue::classify(true, p, pos, &skip);
+    if (!_rxq.push(pr, BleLinkRxQueue::kLine, p + skip, pos - skip, micros())) {
+      _rxq.noteDrop(pr);
+      _rxDrops++;
+    }
+    _rxBuf.erase(0, pos + 1);
+  }
+}
+
+void Device::_onLine(const char* s, size_t n) {
+  std::string line(s, n);
+  char r[256];
+  int  k = 0;
+  if (line == "PING") {
+    k = snprintf(r, sizeof(r), "PONG\n");
+  } else {
+    std::string op = jsonStr(line, "_bl");
+    if (op == "hello") {               // flåden genoptager ikke: altid ny session
+      _sess.fresh(releaseToPool, &_pool);
+      _awaitHello = false;
+      k = snprintf(r, sizeof(r), "{\"_bl\":\"hello\",\"tok\":\"%s\",\"resumed\":false,\"rx\":0}\n",
+                   _sess.token());
+    } else if (op == "time") {
+      k = snprintf(r, sizeof(r), "{\"_bl\":\"time\",\"ms\":%lu}\n", (unsigned long)millis());
+    } else if (op == "stats") {
+      BleLinkPool::Stats ps = _pool.stats();
+      k = snprintf(r, sizeof(r),
+                   "{\"_bl\":\"stats\",\"up\":%lu,\"rx\":[%lu,0,0],\"tx\":[%lu,0,%lu],\"con\":%lu,"
+                   "\"mtu\":%u,\"pmiss\":%lu,\"q\":{\"tx\":%u}}\n",
+                   (unsigned long)millis(), (unsigned long)_rxMsgs, (unsigned long)_txMsgs,
+                   (unsigned long)_txDrops, (unsigned long)_connects, (unsigned)_link.mtu,
+                   (unsigned long)ps.misses, (unsigned)_txq.depth());
+    } else if (op.empty() && jsonStr(line, "op") == "echo") {
+      k = snprintf(r, sizeof(r), "{\"from\":\"%s\",\"echo\":\"%s\"}\n",
+                   name.c_str(), jsonStr(line, "msg").c_str());
+    }
+  }
+  if (k > 0 && (size_t)k < sizeof(r)) _enqueue(kChControl, r, (size_t)k);
+}
+
+// loop(): RX-køerne tømmes efter prioritet (front() ser efter høj prioritet først)
+void Device::_pumpRx() {
+  BleLinkRxQueue::Unit u;
+  while (_rxq.front(u)) {
+    uint32_t now = micros();
+    if (u.kind == BleLinkRxQueue::kLine) _onLine((const char*)u.data, u.len);
+    _rxq.pop(u, now);
+  }
+}
+
+void Device::_pumpStatus() {
+  if (_awaitHello || _prof.rateHz <= 0) return;
+  uint64_t now = nowUs();
+  if (now < _nextStatusUs) return;
+  _nextStatusUs = (_nextStatusUs ? _nextStatusUs : now) + (uint64_t)(1e6 / _prof.rateHz);
+  if (_nextStatusUs < now) _nextStatusUs = now;      // indhent ikke en efterslæbning
+
+  char pad[512];
+  size_t np = _prof.size > 70 ? (size_t)_prof.size - 70 : 0;
+  if (np >= sizeof(pad)) np = sizeof(pad) - 1;
+  memset(pad, 'x', np);
+  pad[np] = '\0';
+  for (int i = 0; i < _prof.burst; ++i) {
+    char line[640];
+    int  k = snprintf(line, sizeof(line),
+                      "{\"event\":\"status\",\"dev\":\"%s\",\"seq\":%lu,\"t\":%.3f,\"pad\":\"%s\"}\n",
+                      name.c_str(), (unsigned long)++_seq, wallMs(), pad);
+    if (k > 0 && (size_t)k < sizeof(line)) _enqueue(kChStatus, line, (size_t)k);
+  }
+}
+
+// Som _pumpTx + _sendLine: én enhed ad gangen fra DRR-køerne i chunks á
+// link.chunk bytes, i linkets takt; sendte enheder bliver i sessionens vindue
+void Device::_pumpTx() {
+  if (_awaitHello) return;
+  uint64_t now = nowUs();
+  while (now >= _nextTxUs) {
+    if (_unitOff >= _unit.size()) {
+      BleLinkTxSched::Item it;
+      if (!_txq.pop(millis(), it)) return;
+      _unit.assign(it.buf, it.len);
+      _unitOff = 0;
+      _txMsgs++;
+      if (char* old = _sess.retain(it.buf, it.len)) _pool.release(old);
+    }
+    size_t n = _unit.size() - _unitOff < _link.chunk ? _unit.size() - _unitOff : _link.chunk;
+    _inAir.push_back({ now + (uint64_t)(_link.latencyMs * 1000.0), _unit.substr(_unitOff, n) });
+    _unitOff += n;
+    _nextTxUs = (_nextTxUs > now ? _nextTxUs : now) + 1000000ULL * n / _link.rateBps;
+  }
+}
+
+void Device::_flushNotify() {
+  uint64_t now = nowUs();
+  while (!_inAir.empty() && _inAir.front().dueUs <= now) {
+    sendPacket(_fd, P_NOTIFY, _inAir.front().data.data(), _inAir.front().data.size());
+    _inAir.pop_front();
+  }
+}
+
+void Device::serve(int fd) {
+  _fd = fd;
+  _rxBuf.clear();                      // som onServerConnected(): ny forbindelse
+  _txq.clear(releaseToPool, &_pool);
+  _sess.reclaim(releaseToPool, &_pool);
+  _inAir.clear();
+  _unit.clear();
+  _unitOff      = 0;
+  _awaitHello   = true;
+  _connAt       = millis();
+  _nextStatusUs = 0;
+  _nextTxUs     = 0;
+  _connects++;
+
+  std::string data;
+  for (;;) {
+    if (_awaitHello && millis() - _connAt >= kHelloWaitMs) _awaitHello = false;
+    _pumpRx();
+    _pumpStatus();
+    _pumpTx();
+    _flushNotify();
+
+    pollfd pf = { fd, POLLIN, 0 };
+    int busyWork = !_inAir.empty() || _txq.depth() > 0 || _unitOff < _unit.size();
+    if (::poll(&pf, 1, busyWork ? 0 : 1) <= 0) {
+      if (busyWork) std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+    uint8_t kind;
+    if (!readPacket(fd, &kind, data)) break;
+    if (kind != P_WRITE_REQ && kind != P_WRITE_CMD) continue;
+    if (_link.latencyMs > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)(_link.latencyMs * 1000.0)));
+    }
+    if (kind == P_WRITE_REQ) sendPacket(fd, P_ACK, nullptr, 0);
+    _rxBuf += data;
+    _parseUnits();
+  }
+  _fd = -1;
+}
+
+struct Opts {
+  std::string host    = "127.0.0.1";
+  int         port    = 7500;
+  int         devices = 20;
+  std::string prefix  = "SIM-";
+  Profile     prof;
+  LinkModel   link;
+  double      jitter  = 0.2;
+  unsigned    seed    = 1;
+};
+
+int main(int argc, char** argv) {
+  Opts o;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char* k = argv[i];
+    const char* v = argv[i + 1];
+    if (!strcmp(k, "--host"))            o.host = v;
+    else if (!strcmp(k, "--port"))       o.port = atoi(v);
+    else if (!strcmp(k, "--devices"))    o.devices = atoi(v);
+    else if (!strcmp(k, "--prefix"))     o.prefix = v;
+    else if (!strcmp(k, "--rate"))       o.prof.rateHz = atof(v);
+    else if (!strcmp(k, "--burst"))      o.prof.burst = atoi(v);
+    else if (!strcmp(k, "--size"))       o.prof.size = atoi(v);
+    else if (!strcmp(k, "--mtu"))        o.link.mtu = (uint16_t)atoi(v);
+    else if (!strcmp(k, "--chunk"))      o.link.chunk = (size_t)atoi(v);
+    else if (!strcmp(k, "--link-bps"))   o.link.rateBps = (uint32_t)atoi(v);
+    else if (!strcmp(k, "--latency-ms")) o.link.latencyMs = atof(v);
+    else if (!strcmp(k, "--jitter"))     o.jitter = atof(v);
+    else if (!strcmp(k, "--seed"))       o.seed = (unsigned)atoi(v);
+  }
+  if (o.link.chunk == 0) o.link.chunk = o.link.mtu > 23 ? o.link.mtu - 3 : 20;
+  if (o.link.rateBps == 0) o.link.rateBps = 1;
+
+  // Som make_fleet(): jitter varierer rate/burst/latens pr. enhed
+  std::mt19937 rnd(o.seed);
+  std::uniform_real_distribution<double> j(-o.jitter, o.jitter);
+  std::vector<std::unique_ptr<Device>> fleet;
+  for (int i = 0; i < o.devices; ++i) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s%03d", o.prefix.c_str(), i);
+    Profile   p = o.prof;
+    LinkModel l = o.link;
+    p.rateHz *= 1.0 + j(rnd);
+    p.burst   = (int)(p.burst * (1.0 + j(rnd)) + 0.5);
+    if (p.burst < 1) p.burst = 1;
+    l.latencyMs *= 1.0 + j(rnd);
+    fleet.emplace_back(new Device(name, p, l));
+  }
+
+  int srv = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in a = {};
+  a.sin_family = AF_INET;
+  a.sin_port   = htons((uint16_t)o.port);
+  if (inet_pton(AF_INET, o.host.c_str(), &a.sin_addr) != 1 ||
+      bind(srv, (sockaddr*)&a, sizeof(a)) != 0 || listen(srv, 64) != 0) {
+    perror("bind");
+    return 1;
+  }
+  printf("[fleet] %d enheder (%s..%s) på %s:%d (BleLink-kernen)\n", o.devices,
+         fleet.empty() ? "" : fleet.front()->name.c_str(),
+         fleet.empty() ? "" : fleet.back()->name.c_str(), o.host.c_str(), o.port);
+  fflush(stdout);
+
+  for (;;) {
+    int fd = accept(srv, nullptr, nullptr);
+    if (fd < 0) continue;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    uint8_t     kind;
+    std::string data;
+    if (!readPacket(fd, &kind, data)) {
+      close(fd);
+      continue;
+    }
+    if (kind == P_LIST) {
+      std::string names = "[";
+      for (size_t i = 0; i < fleet.size(); ++i) names += (i ? ",\"" : "\"") + fleet[i]->name + "\"";
+      names += "]";
+      sendPacket(fd, P_NAMES, names.data(), names.size());
+      close(fd);
+      continue;
+    }
+    Device* dev = nullptr;
+    for (auto& d : fleet) {
+      if (kind == P_OPEN && d->name == data) dev = d.get();
+    }
+    bool idle = false;
+    if (!dev || !dev->busy.compare_exchange_strong(idle, true)) {   // ukendt eller optaget
+      sendPacket(fd, P_REJECT, nullptr, 0);
+      close(fd);
+      continue;
+    }
+    uint8_t mtu[2] = { (uint8_t)(dev->mtu() & 0xFF), (uint8_t)(dev->mtu() >> 8) };
+    sendPacket(fd, P_ACCEPT, mtu, 2);
+    std::thread([dev, fd] {
+      dev->serve(fd);
+      close(fd);
+      dev->busy = false;
+    }).detach();
+  }
+}
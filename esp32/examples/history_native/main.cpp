@@ -0,0 +1,289 @@
+// Historik uden ESP32: BleLinkHistory bag samme TCP-protokol som
+// python/fleet_sim.py, så python/history.py kører range-forespørgsler,
+// sider, annullering og genhentning af sider med tabte frames på Linux.
+// Frames fyldes og sendes som i BleLink::_pumpHistory (BL_HIST_FRAME);
+// --link-bps giver linket BLE-agtig throughput (notifikationer á MTU - 3);
+// --chunk 20 --gap-ms 2 efterligner den gamle _sendLine til sammenligning.
+//
+//   g++ -std=c++17 -O2 -I../../src -o history_native main.cpp
+//       ../../src/BleLinkHistory.cpp                              (én kommando)
+//   ./history_native --records 1365 --every-ms 3000 --link-bps 60000 --file /tmp/hist.bin
+//   python history.py HIST-NATIVE --since 3600 --sim 127.0.0.1:7601 (anden terminal)
+//
+// Ringen fyldes med --records samples (tid = 0, every-ms, ...; "nu" er lige
+// efter det sidste), og der kommer et nyt til hvert --every-ms. --loss PCT
+// kasserer tilfældige historik-frames, --file genindlæser ringen ved start
+// og synkroniserer den hvert 10. sekund.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include "BleLinkHistory.h"
+
+// fleet_sim.py: [type u8][len u16 LE][payload]
+enum : uint8_t { P_LIST = 0x01, P_NAMES, P_OPEN, P_ACCEPT, P_REJECT,
+                 P_WRITE_REQ, P_WRITE_CMD, P_ACK, P_NOTIFY };
+
+static const char*    kName      = "HIST-NATIVE";
+static const size_t   kFrameHdr  = 4;      // [0x00][type][len u16 LE]
+static const size_t   kHistFrame = 508;    // som BL_HIST_FRAME
+static const uint32_t kSyncMs    = 10000;  // kort til test; på flash sjældnere (BleLinkHistory.h)
+
+struct Sample {                            // som HistSample i src/main.cpp
+  float    temp;
+  uint32_t freeHeap;
+};
+
+static BleLinkHistory g_hist;
+static uint32_t       g_base = 0;          // millis() starter efter de forudfyldte samples
+
+static uint32_t millis() {
+  static auto t0 = std::chrono::steady_clock::now();
+  return g_base + (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - t0).count();
+}
+
+// --- TCP-pakker ---
+static bool readExact(int fd, void* p, size_t n) {
+  uint8_t* d = (uint8_t*)p;
+  while (n > 0) {
+    ssize_t r = recv(fd, d, n, 0);
+    if (r <= 0) return false;
+    d += r;
+    n -= (size_t)r;
+  }
+  return true;
+}
+
+static bool readPacket(int fd, uint8_t* kind, std::string& data) {
+  uint8_t h[3];
+  if (!readExact(fd, h, 3)) return false;
+  *kind = h[0];
+  data.resize((size_t)(h[1] | h[2] << 8));
+  return data.empty() || readExact(fd, &data[0], data.size());
+}
+
+static bool sendPacket(int fd, uint8_t kind, const void* p, size_t n) {
+  uint8_t h[3] = { kind, (uint8_t)(n & 0xFF), (uint8_t)(n >> 8) };
+  return send(fd, h, 3, MSG_NOSIGNAL) == 3 &&
+         (n == 0 || send(fd, p, n, MSG_NOSIGNAL) == (ssize_t)n);
+}
+
+// --- kontrolbeskeder (kun de få felter, der bruges her) ---
+static std::string jsonStr(const std::string& line, const char* key) {
+  std::string k = std::string("\"") + key + "\":\"";
+  size_t a = line.find(k);
+  if (a == std::string::npos) return "";
+  a += k.size();
+  size_t b = line.find('"', a);
+  return b == std::string::npos ? "" : line.substr(a, b - a);
+}
+
+static uint32_t jsonNum(const std::string& line, const char* key, uint32_t def = 0) {
+  std::string k = std::string("\"") + key + "\":";
+  size_t a = line.find(k);
+  return a == std::string::npos ? def : (uint32_t)strtoul(line.c_str() + a + k.size(), nullptr, 10);
+}
+
+struct Opts {
+  int         port     = 7601;
+  uint32_t    records  = 1365;
+  uint32_t    everyMs  = 3000;
+  uint32_t    linkBps  = 0;                // 0 = intet loft
+  uint16_t    mtu      = 247;
+  size_t      chunk    = 0;                // bytes pr. notifikation; 0 = MTU - 3
+  uint32_t    gapMs    = 0;                // pause efter hver notifikation
+  double      loss     = 0;                // procent
+  std::string file;
+};
+
+// Én enhed (linje eller frame) ud som notifikationer á MTU - 3, i linkets takt
+static void sendUnit(int fd, const Opts& o, const uint8_t* p, size_t n) {
+  size_t chunk = o.chunk ? o.chunk : o.mtu - 3;
+  for (size_t i = 0; i < n; i += chunk) {
+    size_t k = n - i < chunk ? n - i : chunk;
+    sendPacket(fd, P_NOTIFY, p + i, k);
+    if (o.linkBps) std::this_thread::sleep_for(std::chrono::microseconds(1000000ULL * k / o.linkBps));
+    if (o.gapMs)   std::this_thread::sleep_for(std::chrono::milliseconds(o.gapMs));
+  }
+}
+
+static void sendLine(int fd, const Opts& o, const char* s) { sendUnit(fd, o, (const uint8_t*)s, strlen(s)); }
+
+static void onLine(int fd, const Opts& o, const std::string& line) {
+  std::string op = jsonStr(line, "_bl");
+  char r[192];
+  if (op == "hello") {                   // ingen sessioner her: altid ny
+    snprintf(r, sizeof(r), "{\"_bl\":\"hello\",\"tok\":\"%08lx\",\"resumed\":false,\"rx\":0}\n",
+             (unsigned long)rand());
+    sendLine(fd, o, r);
+  } else if (op == "time") {
+    snprintf(r, sizeof(r), "{\"_bl\":\"time\",\"ms\":%lu}\n", (unsigned long)millis());
+    sendLine(fd, o, r);
+  } else if (op == "hist") {
+    g_hist.query((uint16_t)jsonNum(line, "id"), jsonNum(line, "from"),
+                 jsonNum(line, "to", BleLinkHistory::kNoLimit), jsonNum(line, "max"),
+                 jsonNum(line, "cur", BleLinkHistory::kNoLimit));
+  } else if (op == "hist_cancel") {
+    g_hist.cancel((uint16_t)jsonNum(line, "id"));
+  } else if (op == "hist_info") {
+    uint32_t n = (uint32_t)g_hist.size();
+    snprintf(r, sizeof(r),
+             "{\"_bl\":\"hist_info\",\"n\":%lu,\"cap\":%lu,\"rec\":%u,\"seq\":%lu,\"end\":%lu,\"t0\":%lu,\"t1\":%lu}\n",
+             (unsigned long)n, (unsigned long)g_hist.capacity(), (unsigned)g_hist.recSize(),
+             (unsigned long)g_hist.firstSeq(), (unsigned long)g_hist.endSeq(),
+             (unsigned long)(n ? g_hist.timeAt(g_hist.firstSeq()) : 0),
+             (unsigned long)(n ? g_hist.timeAt(g_hist.endSeq() - 1) : 0));
+    sendLine(fd, o, r);
+  }
+}
+
+// Som BleLink::_pumpHistory: én frame pr. runde, hist_end efter sidste
+static void pumpHistory(int fd, const Opts& o, std::mt19937& rnd) {
+  if (!g_hist.active()) return;
+  uint8_t buf[kFrameHdr + kHistFrame];
+  size_t n = g_hist.fill(buf + kFrameHdr, kHistFrame);
+  if (n > 0) {
+    buf[0] = 0x00;
+    buf[1] = BleLinkHistory::kFrameType;
+    buf[2] = n & 0xFF;
+    buf[3] = n >> 8;
+    if (std::uniform_real_distribution<double>(0, 100)(rnd) >= o.loss) sendUnit(fd, o, buf, kFrameHdr + n);
+    return;
+  }
+  BleLinkHistory::End e = g_hist.finish();
+  char r[160];
+  snprintf(r, sizeof(r),
+           "{\"_bl\":\"hist_end\",\"id\":%u,\"n\":%lu,\"next\":%lu,\"more\":%s,\"lost\":%lu%s}\n",
+           (unsigned)e.id, (unsigned long)e.n, (unsigned long)e.next, e.more ? "true" : "false",
+           (unsigned long)e.lost, e.cancelled ? ",\"cancelled\":true" : "");
+  sendLine(fd, o, r);
+}
+
+static void addSample(uint32_t t) {
+  Sample s = { 20.0f + (float)(t / 1000 % 600) / 100.0f, 200000u - t / 1000 % 5000 };
+  g_hist.add(t, &s);
+}
+
+// Som appens loop(): nye samples og periodisk sync, også uden forbindelse
+static void tick(const Opts& o) {
+  static uint32_t lastAdd = g_base - o.everyMs, lastSync = millis();
+  while (millis() - lastAdd >= o.everyMs) {
+    lastAdd += o.everyMs;
+    addSample(lastAdd);
+  }
+  if (!o.file.empty() && millis() - lastSync >= kSyncMs) {
+    lastSync = millis();
+    if (!g_hist.sync(o.file.c_str())) perror("[hist] sync");
+  }
+}
+
+// Én forbindelse: del RX i linjer/frames som BleLink.cpp's parseUnits
+static void serve(int fd, const Opts& o, std::mt19937& rnd) {
+  std::string buf, data;
+  for (;;) {
+    tick(o);
+    pumpHistory(fd, o, rnd);
+
+    pollfd pf = { fd, POLLIN, 0 };
+    if (::poll(&pf, 1, g_hist.active() ? 0 : 2) <= 0) continue;
+    uint8_t kind;
+    if (!readPacket(fd, &kind, data)) break;
+    if (kind == P_WRITE_REQ) sendPacket(fd, P_ACK, nullptr, 0);
+    if (kind != P_WRITE_REQ && kind != P_WRITE_CMD) continue;
+    buf += data;
+
+    while (!buf.empty()) {
+      if (buf[0] == '\0') {              // ingen frames fra værten her
+        if (buf.size() < 4) break;
+        size_t n = (uint8_t)buf[2] | (uint8_t)buf[3] << 8;
+        if (buf.size() < 4 + n) break;
+        buf.erase(0, 4 + n);
+        continue;
+      }
+      size_t nl = buf.find('\n');
+      if (nl == std::string::npos) break;
+      onLine(fd, o, buf.substr(0, nl));
+      buf.erase(0, nl + 1);
+    }
+  }
+  if (g_hist.active()) g_hist.finish();  // ny vært spørger igen med sin cursor
+}
+
+int main(int argc, char** argv) {
+  Opts o;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--port"))          o.port    = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--records"))  o.records = (uint32_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--every-ms")) o.everyMs = (uint32_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--link-bps")) o.linkBps = (uint32_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--mtu"))      o.mtu     = (uint16_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--chunk"))    o.chunk   = (size_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--gap-ms"))   o.gapMs   = (uint32_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--loss"))     o.loss    = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--file"))     o.file    = argv[i + 1];
+  }
+  if (o.everyMs == 0) o.everyMs = 1;
+
+  g_hist.begin(sizeof(Sample));
+  if (!o.file.empty() && g_hist.load(o.file.c_str())) {
+    g_base = g_hist.timeAt(g_hist.endSeq() - 1) + o.everyMs;   // fortsæt tiden fra filen
+    printf("[hist] %zu poster indlæst fra %s\n", g_hist.size(), o.file.c_str());
+  } else {
+    for (uint32_t i = 0; i < o.records; ++i) addSample(i * o.everyMs);
+    g_base = o.records * o.everyMs;
+  }
+
+  int srv = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in a = {};
+  a.sin_family      = AF_INET;
+  a.sin_port        = htons((uint16_t)o.port);
+  a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(srv, (sockaddr*)&a, sizeof(a)) != 0 || listen(srv, 4) != 0) {
+    perror("bind");
+    return 1;
+  }
+  printf("[hist] %s på 127.0.0.1:%d: %zu/%zu poster á %u B, t = %lu ms\n", kName, o.port,
+         g_hist.size(), g_hist.capacity(), (unsigned)(4 + g_hist.recSize()), (unsigned long)millis());
+  fflush(stdout);
+
+  std::mt19937 rnd(1);
+  for (;;) {
+    tick(o);
+    pollfd pf = { srv, POLLIN, 0 };
+    if (::poll(&pf, 1, 100) <= 0) continue;
+    int fd = accept(srv, nullptr, nullptr);
+    if (fd < 0) continue;
+    uint8_t kind;
+    std::string data;
+    if (readPacket(fd, &kind, data)) {
+      if (kind == P_LIST) {
+        std::string names = std::string("[\"") + kName + "\"]";
+        sendPacket(fd, P_NAMES, names.data(), names.size());
+      } else if (kind == P_OPEN && data == kName) {
+        uint8_t mtu[2] = { (uint8_t)(o.mtu & 0xFF), (uint8_t)(o.mtu >> 8) };
+        sendPacket(fd, P_ACCEPT, mtu, 2);
+        serve(fd, o, rnd);
+        BleLinkHistory::Stats s = g_hist.stats();
+        printf("[hist] afbrudt: forespørgsler=%lu frames=%lu poster=%lu annulleret=%lu tabt=%lu\n",
+               (unsigned long)s.queries, (unsigned long)s.frames, (unsigned long)s.records,
+               (unsigned long)s.cancelled, (unsigned long)s.lost);
+        fflush(stdout);
+      } else {
+        sendPacket(fd, P_REJECT, nullptr, 0);
+      }
+    }
+    close(fd);
+  }
+}
@@ -0,0 +1,463 @@
+// Throughput-test uden ESP32: BleLinkTest bag samme TCP-protokol som
+// python/fleet_sim.py, så python/throughput.py kører source, sink og echo
+// mod firmwarens testkode på Linux. Kontrolbeskederne besvares som i
+// BleLink::_handleControl ({"_bl":"test"} -> test_ack/test_done), og
+// source sender højst 8 linjer pr. runde som BleLink::loop().
+//
+//   g++ -std=c++17 -O2 -I../native -I../../src -o loopback_native main.cpp
+//       ../../src/BleLinkTest.cpp ../../src/BleLinkCrypto.cpp -lmbedcrypto   (én kommando)
+//   ./loopback_native --link-bps 60000 --mtu 247 --loss 1
+//   python throughput.py source --bytes 200000 --size 240 --sim 127.0.0.1:7602 (anden terminal)
+//   ./loopback_native --psk 000102030405060708090a0b0c0d0e0f     # krypteret som esp32dev-secure
+//   python throughput.py source --sim 127.0.0.1:7602 --psk 000102030405060708090a0b0c0d0e0f
+//   ./loopback_native --bench-crypto 240                          # seal/open mod memcpy, så exit
+//
+// --link-bps giver linket BLE-agtig throughput i begge retninger
+// (notifikationer á MTU - 3, writes kvitteres i linkets takt), --latency-ms
+// en fast envejsforsinkelse, og --loss PCT kasserer tilfældige testlinjer
+// (enhed -> vært i source/echo, vært -> enhed i sink), så tab og
+// CRC-tjek i throughput.py kan afprøves.
+//
+// Med --psk kræves handshaket (sec_hello) som i BleLink::_plainOk, og alt
+// derefter går som krypterede frames (BleLinkCrypto, BL_SEC_MAX klartekst pr.
+// frame), så throughput.py med og uden --psk viser prisen på samme link. Ved
+// afbrydelse skrives tiden pr. seal/open. --bench-crypto SIZE måler seal og
+// open (værtens frames, retning 2) af SIZE bytes mod memcpy uden link.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <mbedtls/ccm.h>
+#include <mbedtls/md.h>
+#include "BleLinkCrypto.h"
+#include "BleLinkTest.h"
+
+// fleet_sim.py: [type u8][len u16 LE][payload]
+enum : uint8_t { P_LIST = 0x01, P_NAMES, P_OPEN, P_ACCEPT, P_REJECT,
+                 P_WRITE_REQ, P_WRITE_CMD, P_ACK, P_NOTIFY };
+
+static const size_t  kPollLines   = 8;      // som _test.poll(8) i BleLink::loop()
+static const size_t  kSecMax      = 2048;   // som BL_SEC_MAX
+static const uint8_t kFrameSecure = 0x03;
+
+// --- TCP-pakker ---
+static bool readExact(int fd, void* p, size_t n) {
+  uint8_t* d = (uint8_t*)p;
+  while (n > 0) {
+    ssize_t r = recv(fd, d, n, 0);
+    if (r <= 0) return false;
+    d += r;
+    n -= (size_t)r;
+  }
+  return true;
+}
+
+static bool readPacket(int fd, uint8_t* kind, std::string& data) {
+  uint8_t h[3];
+  if (!readExact(fd, h, 3)) return false;
+  *kind = h[0];
+  data.resize((size_t)(h[1] | h[2] << 8));
+  return data.empty() || readExact(fd, &data[0], data.size());
+}
+
+static bool sendPacket(int fd, uint8_t kind, const void* p, size_t n) {
+  uint8_t h[3] = { kind, (uint8_t)(n & 0xFF), (uint8_t)(n >> 8) };
+  return send(fd, h, 3, MSG_NOSIGNAL) == 3 &&
+         (n == 0 || send(fd, p, n, MSG_NOSIGNAL) == (ssize_t)n);
+}
+
+// --- kontrolbeskeder (kun de få felter, der bruges her) ---
+static std::string jsonStr(const std::string& line, const char* key) {
+  std::string k = std::string("\"") + key + "\":\"";
+  size_t a = line.find(k);
+  if (a == std::string::npos) return "";
+  a += k.size();
+  size_t b = line.find('"', a);
+  return b == std::string::npos ? "" : line.substr(a, b - a);
+}
+
+static uint32_t jsonNum(const std::string& line, const char* key, uint32_t def = 0) {
+  std::string k = std::string("\"") + key + "\":";
+  size_t a = line.find(k);
+  return a == std::string::npos ? def : (uint32_t)strtoul(line.c_str() + a + k.size(), nullptr, 10);
+}
+
+// Som toHex/fromHex i BleLink.cpp
+static std::string toHex(const uint8_t* p, size_t n) {
+  static const char* d = "0123456789abcdef";
+  std::string s;
+  for (size_t i = 0; i < n; ++i) {
+    s += d[p[i] >> 4];
+    s += d[p[i] & 15];
+  }
+  return s;
+}
+
+static bool fromHex(const std::string& s, uint8_t* out, size_t n) {
+  if (s.size() != 2 * n) return false;
+  for (size_t i = 0; i < 2 * n; ++i) {
+    char c = s[i];
+    int  v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+           : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    if (v < 0) return false;
+    out[i / 2] = (i & 1) ? (out[i / 2] | v) : (v << 4);
+  }
+  return true;
+}
+
+static uint64_t nowUs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Opts {
+  int         port      = 7602;
+  std::string name      = "TEST-NATIVE";
+  uint32_t    linkBps   = 0;               // 0 = intet loft
+  uint32_t    latencyMs = 0;
+  uint16_t    mtu       = 247;
+  double      loss      = 0;               // procent
+  bool        secure    = false;           // --psk
+  uint8_t     psk[BleLinkCrypto::kKeyLen] = {0};
+  uint32_t    benchSize = 0;               // --bench-crypto
+  uint32_t    benchN    = 5000;
+};
+
+struct Conn {
+  int          fd = -1;
+  const Opts*  o  = nullptr;
+  std::mt19937 rnd{1};
+  uint32_t     rxMsgs = 0, rxBytes = 0, txMsgs = 0, txBytes = 0;
+  BleLinkCrypto crypto;
+  std::string   secBuf;                  // åbnet klartekst (som g_secRxBuf)
+  uint64_t      sealUs = 0, openUs = 0;
+  uint32_t      secDropped = 0;
+
+  bool lost() { return std::uniform_real_distribution<double>(0, 100)(rnd) < o->loss; }
+
+  void pace(size_t n) const {
+    if (o->linkBps) std::this_thread::sleep_for(std::chrono::microseconds(1000000ULL * n / o->linkBps));
+  }
+
+  // Én linje ud som notifikationer á MTU - 3, i linkets takt
+  void sendLine(const char* s, size_t n) {
+    if (o->latencyMs) std::this_thread::sleep_for(std::chrono::milliseconds(o->latencyMs));
+    size_t chunk = o->mtu - 3;
+    for (size_t i = 0; i < n; i += chunk) {
+      size_t k = n - i < chunk ? n - i : chunk;
+      sendPacket(fd, P_NOTIFY, s + i, k);
+      pace(k);
+    }
+    txMsgs++;
+    txBytes += (uint32_t)n;
+  }
+  void sendLine(const char* s) { sendLine(s, strlen(s)); }
+
+  // Som BleLink::_sendUnit/_sendSealed: krypteret, når sessionen er det
+  void sendUnit(const char* s, size_t n) {
+    if (!crypto.active()) {
+      sendLine(s, n);
+      return;
+    }
+    static uint8_t frame[4 + BleLinkCrypto::kOverhead + kSecMax];
+    for (size_t off = 0; off < n; off += kSecMax) {
+      size_t   k  = n - off < kSecMax ? n - off : kSecMax;
+      uint64_t t0 = nowUs();
+      size_t   m  = crypto.seal((const uint8_t*)s + off, k, frame + 4, sizeof(frame) - 4);
+      sealUs += nowUs() - t0;
+      if (m == 0) return;
+      frame[0] = 0x00;
+      frame[1] = kFrameSecure;
+      frame[2] = m & 0xFF;
+      frame[3] = m >> 8;
+      sendLine((const char*)frame, 4 + m);
+    }
+  }
+  void sendUnit(const char* s) { sendUnit(s, strlen(s)); }
+};
+
+static BleLinkTest g_test;
+static Conn        g_conn;
+
+static void sendResult(const BleLinkTest::Result& res) {
+  char r[192];
+  snprintf(r, sizeof(r),
+           "{\"_bl\":\"test_done\",\"mode\":\"%s\",\"lines\":%lu,\"bytes\":%lu,\"lost\":%lu,\"crc\":%lu,\"ms\":%lu}\n",
+           BleLinkTest::modeName(res.mode), (unsigned long)res.lines, (unsigned long)res.bytes,
+           (unsigned long)res.lost, (unsigned long)res.crc, (unsigned long)res.ms);
+  g_conn.sendUnit(r);
+}
+
+// Som BleLink::_startSecure/_finishSecure: svaret går i klartekst
+static void startSecure(const std::string& line) {
+  if (!g_conn.o->secure) {
+    g_conn.sendLine("{\"_bl\":\"sec_hello\",\"err\":\"off\"}\n");
+    return;
+  }
+  uint8_t hn[BleLinkCrypto::kNonceLen], dn[BleLinkCrypto::kNonceLen], auth[BleLinkCrypto::kAuthLen];
+  std::string r;
+  if (fromHex(jsonStr(line, "hn"), hn, sizeof(hn)) && g_conn.crypto.begin(hn, dn, auth)) {
+    r = "{\"_bl\":\"sec_hello\",\"dn\":\"" + toHex(dn, sizeof(dn)) + "\",\"auth\":\"" +
+        toHex(auth, sizeof(auth)) + "\"}\n";
+  } else {
+    r = "{\"_bl\":\"sec_hello\",\"err\":\"hn\"}\n";
+  }
+  g_conn.sendLine(r.data(), r.size());
+}
+
+static void onLine(const std::string& line, bool plain) {
+  // Med PSK kun sec_hello i klartekst, og kun før handshaket (som _plainOk)
+  if (plain && g_conn.o->secure &&
+      (g_conn.crypto.active() || jsonStr(line, "_bl") != "sec_hello")) {
+    g_conn.secDropped++;
+    return;
+  }
+  // testtrafik først (som _emitLine); tabt på vej ind = hul i seq hos sink
+  if (line.size() >= 2 && line[0] == '~' && line[1] == 'T' &&
+      g_test.mode() == BleLinkTest::Mode::Sink && g_conn.lost()) return;
+  if (g_test.onLine(line.c_str(), line.size())) return;
+
+  std::string op = jsonStr(line, "_bl");
+  char r[192];
+  if (op == "sec_hello") {
+    startSecure(line);
+  } else if (op == "hello") {            // ingen sessioner her: altid ny
+    snprintf(r, sizeof(r), "{\"_bl\":\"hello\",\"tok\":\"%08lx\",\"resumed\":false,\"rx\":0}\n",
+             (unsigned long)rand());
+    g_conn.sendUnit(r);
+  } else if (op == "time") {
+    snprintf(r, sizeof(r), "{\"_bl\":\"time\",\"ms\":%lu}\n", (unsigned long)millis());
+    g_conn.sendUnit(r);
+  } else if (op == "stats") {
+    snprintf(r, sizeof(r),
+             "{\"_bl\":\"stats\",\"up\":%lu,\"rx\":[%lu,%lu],\"tx\":[%lu,%lu,0],\"mtu\":%u}\n",
+             (unsigned long)millis(), (unsigned long)g_conn.rxMsgs, (unsigned long)g_conn.rxBytes,
+             (unsigned long)g_conn.txMsgs, (unsigned long)g_conn.txBytes, (unsigned)g_conn.o->mtu);
+    g_conn.sendUnit(r);
+  } else if (op == "test") {
+    BleLinkTest::Mode m = BleLinkTest::modeFromName(jsonStr(line, "mode").c_str());
+    if (m == BleLinkTest::Mode::Off) {
+      sendResult(g_test.stop(millis()));
+    } else {
+      g_test.start(m, jsonNum(line, "n"), (uint16_t)jsonNum(line, "size", 64), millis());
+      snprintf(r, sizeof(r), "{\"_bl\":\"test_ack\",\"mode\":\"%s\"}\n", BleLinkTest::modeName(m));
+      g_conn.sendUnit(r);
+    }
+  }
+}
+
+// Linjer som BleLink.cpp's parseUnits; krypterede frames åbnes ind i secBuf
+static void parseUnits(std::string& buf, bool plain) {
+  while (!buf.empty()) {
+    if (buf[0] == '\0') {
+      if (buf.size() < 4) break;
+      size_t n = (uint8_t)buf[2] | (uint8_t)buf[3] << 8;
+      if (buf.size() < 4 + n) break;
+      if (plain && (uint8_t)buf[1] == kFrameSecure && g_conn.o->secure) {
+        static uint8_t p[kSecMax];
+        uint64_t t0 = nowUs();
+        size_t   k  = g_conn.crypto.open((const uint8_t*)buf.data() + 4, n, p, sizeof(p));
+        g_conn.openUs += nowUs() - t0;
+        g_conn.secBuf.append((const char*)p, k);
+        buf.erase(0, 4 + n);
+        parseUnits(g_conn.secBuf, false);
+        continue;
+      }
+      buf.erase(0, 4 + n);               // andre frames bruges ikke her
+      continue;
+    }
+    size_t nl = buf.find('\n');
+    if (nl == std::string::npos) break;
+    g_conn.rxMsgs++;
+    onLine(buf.substr(0, nl), plain);
+    buf.erase(0, nl + 1);
+  }
+}
+
+// Én forbindelse
+static void serve() {
+  std::string buf, data;
+  for (;;) {
+    // Source: lidt pr. runde, så kontrolbeskeder stadig besvares undervejs
+    if (g_test.mode() == BleLinkTest::Mode::Source && g_test.poll(kPollLines)) {
+      sendResult(g_test.stop(millis()));
+    }
+
+    pollfd pf = { g_conn.fd, POLLIN, 0 };
+    if (::poll(&pf, 1, g_test.mode() == BleLinkTest::Mode::Source ? 0 : 2) <= 0) continue;
+    uint8_t kind;
+    if (!readPacket(g_conn.fd, &kind, data)) break;
+    if (kind != P_WRITE_REQ && kind != P_WRITE_CMD) continue;
+    g_conn.pace(data.size());            // writes tager også tid på linket
+    if (kind == P_WRITE_REQ) sendPacket(g_conn.fd, P_ACK, nullptr, 0);
+    g_conn.rxBytes += (uint32_t)data.size();
+    buf += data;
+    parseUnits(buf, true);
+  }
+  if (g_test.active()) g_test.stop(millis());
+}
+
+// --- --bench-crypto: som bench_crypto i main.cpp, plus open ---
+// Værtens frames (retning 2, som ble_link.py's _SecureSession.seal) laves på
+// forhånd med sessionsnøglen, så open() måles på gyldige frames.
+static bool hostSeal(const uint8_t key[16], uint32_t ctr, const uint8_t* in, size_t n, uint8_t* out) {
+  static mbedtls_ccm_context ccm;
+  static bool keyed = false;
+  if (!keyed) {
+    mbedtls_ccm_init(&ccm);
+    keyed = mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, key, 128) == 0;
+  }
+  uint8_t nonce[13] = {0};
+  nonce[0] = 2;
+  memcpy(nonce + 1, &ctr, 4);
+  memcpy(out, &ctr, 4);
+  return keyed && mbedtls_ccm_encrypt_and_tag(&ccm, n, nonce, sizeof(nonce), nullptr, 0, in, out + 4,
+                                              out + 4 + n, BleLinkCrypto::kTagLen) == 0;
+}
+
+static int benchCrypto(const Opts& o) {
+  size_t   size = o.benchSize > kSecMax ? kSecMax : o.benchSize;
+  uint32_t n    = o.benchN ? o.benchN : 1;
+  BleLinkCrypto c;
+  uint8_t hn[BleLinkCrypto::kNonceLen] = {0}, dn[BleLinkCrypto::kNonceLen], auth[BleLinkCrypto::kAuthLen];
+  c.setKey(o.psk);
+  if (!c.begin(hn, dn, auth)) return 1;
+
+  // Sessionsnøglen som værten udleder den: HMAC-SHA256(PSK, "BLk" | hn | dn)[0..15]
+  uint8_t msg[3 + 2 * BleLinkCrypto::kNonceLen], key[32];
+  memcpy(msg, "BLk", 3);
+  memcpy(msg + 3, hn, sizeof(hn));
+  memcpy(msg + 3 + sizeof(hn), dn, sizeof(dn));
+  mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), o.psk, sizeof(o.psk), msg, sizeof(msg), key);
+
+  const size_t fsz = size + BleLinkCrypto::kOverhead;
+  std::string  in(size, 'x'), frames(fsz * n, '\0'), out(fsz, '\0');
+  for (uint32_t i = 0; i < n; ++i) {
+    if (!hostSeal(key, i + 1, (const uint8_t*)in.data(), size, (uint8_t*)&frames[fsz * i])) return 1;
+  }
+
+  uint64_t t0 = nowUs();
+  for (uint32_t i = 0; i < n; ++i) c.seal((const uint8_t*)in.data(), size, (uint8_t*)&out[0], out.size());
+  uint64_t sealUs = nowUs() - t0;
+
+  t0 = nowUs();
+  uint32_t bad = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    if (c.open((const uint8_t*)&frames[fsz * i], fsz, (uint8_t*)&out[0], out.size()) != size) bad++;
+  }
+  uint64_t openUs = nowUs() - t0;
+
+  volatile uint8_t sink = 0;           // memcpy må ikke optimeres væk
+  t0 = nowUs();
+  for (uint32_t i = 0; i < n; ++i) {
+    memcpy(&out[0], in.data(), size);
+    sink = sink + (uint8_t)out[i % size];
+  }
+  uint64_t copyUs = nowUs() - t0;
+
+  auto mbps = [&](uint64_t us) { return us ? (double)size * n / us : 0.0; };   // bytes/µs = MB/s
+  printf("[bench] %zu B x %lu: seal %.2f µs (%.1f MB/s), open %.2f µs (%.1f MB/s), "
+         "memcpy %.3f µs (%.0f MB/s), +%zu B pr. frame (%.1f %%)%s\n",
+         size, (unsigned long)n, (double)sealUs / n, mbps(sealUs), (double)openUs / n, mbps(openUs),
+         (double)copyUs / n, mbps(copyUs), (size_t)(4 + BleLinkCrypto::kOverhead),
+         100.0 * (4 + BleLinkCrypto::kOverhead) / size, bad ? ", OPEN FEJLEDE" : "");
+  return bad ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  Opts o;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--port"))            o.port      = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--name"))       o.name      = argv[i + 1];
+    else if (!strcmp(argv[i], "--link-bps"))   o.linkBps   = (uint32_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--latency-ms")) o.latencyMs = (uint32_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--mtu"))        o.mtu       = (uint16_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--loss"))       o.loss      = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--bench-crypto")) o.benchSize = (uint32_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--bench-n"))    o.benchN    = (uint32_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--psk")) {
+      o.secure = fromHex(argv[i + 1], o.psk, sizeof(o.psk));
+      if (!o.secure) {
+        fprintf(stderr, "--psk: 16 bytes som hex\n");
+        return 2;
+      }
+    }
+  }
+  if (o.mtu < 23) o.mtu = 23;
+  if (o.benchSize) return benchCrypto(o);
+  if (o.secure) g_conn.crypto.setKey(o.psk);
+
+  g_conn.o = &o;
+  // Som BleLink::setup(): testlinjer ud via linket; tabte "når ikke frem"
+  g_test.begin([](const char* line, size_t len) {
+    if (!g_conn.lost()) g_conn.sendUnit(line, len);
+    return true;
+  });
+
+  int srv = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in a = {};
+  a.sin_family      = AF_INET;
+  a.sin_port        = htons((uint16_t)o.port);
+  a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(srv, (sockaddr*)&a, sizeof(a)) != 0 || listen(srv, 4) != 0) {
+    perror("bind");
+    return 1;
+  }
+  printf("[test] %s på 127.0.0.1:%d (MTU %u, %u B/s, %u ms, tab %.1f%%)\n", o.name.c_str(), o.port,
+         (unsigned)o.mtu, (unsigned)o.linkBps, (unsigned)o.latencyMs, o.loss);
+  fflush(stdout);
+
+  for (;;) {
+    int fd = accept(srv, nullptr, nullptr);
+    if (fd < 0) continue;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));   // echo-RTT uden Nagle
+    uint8_t kind;
+    std::string data;
+    if (readPacket(fd, &kind, data)) {
+      if (kind == P_LIST) {
+        std::string names = "[\"" + o.name + "\"]";
+        sendPacket(fd, P_NAMES, names.data(), names.size());
+      } else if (kind == P_OPEN && data == o.name) {
+        uint8_t mtu[2] = { (uint8_t)(o.mtu & 0xFF), (uint8_t)(o.mtu >> 8) };
+        sendPacket(fd, P_ACCEPT, mtu, 2);
+        g_conn.fd = fd;
+        g_conn.rxMsgs = g_conn.rxBytes = g_conn.txMsgs = g_conn.txBytes = 0;
+        g_conn.sealUs = g_conn.openUs = 0;
+        g_conn.secDropped = 0;
+        g_conn.secBuf.clear();
+        BleLinkCrypto::Stats c0 = g_conn.crypto.stats();
+        serve();
+        g_conn.crypto.end();               // ny forbindelse = nyt handshake
+        g_conn.fd = -1;
+        printf("[test] afbrudt: rx %lu linjer/%lu B, tx %lu linjer/%lu B\n",
+               (unsigned long)g_conn.rxMsgs, (unsigned long)g_conn.rxBytes,
+               (unsigned long)g_conn.txMsgs, (unsigned long)g_conn.txBytes);
+        if (o.secure) {
+          BleLinkCrypto::Stats c = g_conn.crypto.stats();
+          uint32_t sealed = c.sealed - c0.sealed, opened = c.opened - c0.opened;
+          printf("[test] krypto: %lu seal (%.1f µs hver), %lu open (%.1f µs hver), %lu afvist, "
+                 "%lu klartekst droppet\n",
+                 (unsigned long)sealed, sealed ? (double)g_conn.sealUs / sealed : 0.0,
+                 (unsigned long)opened, opened ? (double)g_conn.openUs / opened : 0.0,
+                 (unsigned long)(c.rejected - c0.rejected), (unsigned long)g_conn.secDropped);
+        }
+        fflush(stdout);
+      } else {
+        sendPacket(fd, P_REJECT, nullptr, 0);
+      }
+    }
+    close(fd);
+  }
+}
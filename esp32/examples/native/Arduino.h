@@ -0,0 +1,44 @@
+#ifndef BLE_LINK_NATIVE_ARDUINO_H
+#define BLE_LINK_NATIVE_ARDUINO_H
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+
+/**
+ * Arduino/FreeRTOS-erstatning til de native eksempler (soak_native, loopback_native, ...).
+ *
+ * Kun det, BleLinks Arduino-frie kerne bruger: pulje, TX- og RX-køer,
+ * session og log (BleLinkPool, BleLinkTxSched, BleLinkRxQueue,
+ * BleLinkSession, BleLinkLog). BleLink.cpp selv (NimBLE, ArduinoJson)
+ * bygges ikke native. Kritiske sektioner er en spinlock som på ESP32.
+ *
+ *   g++ -std=c++17 -I../native -I../../src ...
+ */
+struct portMUX_TYPE {
+  std::atomic_flag f = ATOMIC_FLAG_INIT;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+inline void portENTER_CRITICAL(portMUX_TYPE* m) {
+  while (m->f.test_and_set(std::memory_order_acquire)) {}
+}
+inline void portEXIT_CRITICAL(portMUX_TYPE* m) { m->f.clear(std::memory_order_release); }
+
+inline uint32_t millis() {
+  static const auto t0 = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now() - t0).count();
+}
+
+inline uint32_t micros() {
+  static const auto t0 = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now() - t0).count();
+}
+
+#endif // BLE_LINK_NATIVE_ARDUINO_H
@@ -0,0 +1,20 @@
+#ifndef BLE_LINK_NATIVE_ESP_SYSTEM_H
+#define BLE_LINK_NATIVE_ESP_SYSTEM_H
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <random>
+
+// esp_random() til de native eksempler (se Arduino.h ved siden af)
+inline uint32_t esp_random() {
+  static std::random_device rd;
+  return rd();
+}
+
+inline void esp_fill_random(void* buf, size_t len) {
+  uint8_t* p = static_cast<uint8_t*>(buf);
+  for (size_t i = 0; i < len; ++i) p[i] = (uint8_t)esp_random();
+}
+
+#endif // BLE_LINK_NATIVE_ESP_SYSTEM_H
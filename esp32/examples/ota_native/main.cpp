@@ -0,0 +1,236 @@
+// Firmwareopdatering uden ESP32: BleLinkOta + BleLinkOtaFile bag samme
+// TCP-protokol som python/fleet_sim.py, så python/ota.py kører hele
+// forløbet (vindue, kvitteringer, tilbagespoling, genoptagelse, hash) på Linux.
+// Skrive-konteksten er en tråd, så dobbeltbufferens overlap er det samme som
+// med skrive-tasken på ESP32; --flash-ms giver skrivningen ESP32-agtig varighed.
+//
+//   g++ -std=c++17 -O2 -I../../src -o ota_native main.cpp ../../src/BleLinkOta.cpp
+//       ../../src/BleLinkOtaFile.cpp -lmbedcrypto -pthread          (én kommando)
+//   ./ota_native --out /tmp/fw.bin --flash-ms 30 --loss 1 --drop-at 100000
+//   python ota.py OTA-NATIVE firmware.bin --sim 127.0.0.1:7600     (anden terminal)
+//
+// --loss PCT kasserer tilfældige billedframes (huller), --drop-at N lukker
+// forbindelsen én gang, når N bytes er modtaget (værten genoptager).
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include "BleLinkOta.h"
+#include "BleLinkOtaFile.h"
+
+// fleet_sim.py: [type u8][len u16 LE][payload]
+enum : uint8_t { P_LIST = 0x01, P_NAMES, P_OPEN, P_ACCEPT, P_REJECT,
+                 P_WRITE_REQ, P_WRITE_CMD, P_ACK, P_NOTIFY };
+
+static const char* kName = "OTA-NATIVE";
+static int         g_fd  = -1;           // forbundet vært (-1 = ingen)
+
+static uint32_t millis() {
+  static auto t0 = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now() - t0).count();
+}
+
+// --- TCP-pakker ---
+static bool readExact(int fd, void* p, size_t n) {
+  uint8_t* d = (uint8_t*)p;
+  while (n > 0) {
+    ssize_t r = recv(fd, d, n, 0);
+    if (r <= 0) return false;
+    d += r;
+    n -= (size_t)r;
+  }
+  return true;
+}
+
+static bool readPacket(int fd, uint8_t* kind, std::string& data) {
+  uint8_t h[3];
+  if (!readExact(fd, h, 3)) return false;
+  *kind = h[0];
+  data.resize((size_t)(h[1] | h[2] << 8));
+  return data.empty() || readExact(fd, &data[0], data.size());
+}
+
+static bool sendPacket(int fd, uint8_t kind, const void* p, size_t n) {
+  uint8_t h[3] = { kind, (uint8_t)(n & 0xFF), (uint8_t)(n >> 8) };
+  return send(fd, h, 3, MSG_NOSIGNAL) == 3 &&
+         (n == 0 || send(fd, p, n, MSG_NOSIGNAL) == (ssize_t)n);
+}
+
+// --- kontrolbeskeder (kun de få felter, der bruges her) ---
+static std::string jsonStr(const std::string& line, const char* key) {
+  std::string k = std::string("\"") + key + "\":\"";
+  size_t a = line.find(k);
+  if (a == std::string::npos) return "";
+  a += k.size();
+  size_t b = line.find('"', a);
+  return b == std::string::npos ? "" : line.substr(a, b - a);
+}
+
+static uint32_t jsonNum(const std::string& line, const char* key) {
+  std::string k = std::string("\"") + key + "\":";
+  size_t a = line.find(k);
+  return a == std::string::npos ? 0 : (uint32_t)strtoul(line.c_str() + a + k.size(), nullptr, 10);
+}
+
+static void sendLine(const char* s) { if (g_fd >= 0) sendPacket(g_fd, P_NOTIFY, s, strlen(s)); }
+
+static void onLine(BleLinkOta& ota, const std::string& line) {
+  std::string op = jsonStr(line, "_bl");
+  if (op == "hello") {                   // ingen sessioner her: altid ny
+    char r[96];
+    snprintf(r, sizeof(r), "{\"_bl\":\"hello\",\"tok\":\"%08lx\",\"resumed\":false,\"rx\":0}\n",
+             (unsigned long)rand());
+    sendLine(r);
+  } else if (op == "ota_begin") {
+    ota.start(jsonNum(line, "size"), jsonStr(line, "sha").c_str(), millis());
+  } else if (op == "ota_status") {
+    ota.status();
+  } else if (op == "ota_apply") {
+    if (ota.apply()) printf("[ota] anvendt: billedet er skrevet færdigt\n");
+  } else if (op == "ota_abort") {
+    ota.cancel();
+  }
+}
+
+struct Opts {
+  int         port    = 7600;
+  std::string out     = "ota_native.bin";
+  uint32_t    flashMs = 0;
+  double      loss    = 0;               // procent
+  uint32_t    dropAt  = 0;               // 0 = aldrig
+};
+
+// Én forbindelse: del RX i linjer/frames som BleLink.cpp's parseUnits
+static void serve(int fd, BleLinkOta& ota, const Opts& o, bool* dropped, std::mt19937& rnd) {
+  std::string buf, data;
+  g_fd = fd;
+  for (;;) {
+    ota.poll(millis());
+    pollfd pf = { fd, POLLIN, 0 };
+    if (::poll(&pf, 1, 2) <= 0) continue;     // som loop(): kredit ud kort efter skrivningen
+    uint8_t kind;
+    if (!readPacket(fd, &kind, data)) break;
+    if (kind == P_WRITE_REQ) sendPacket(fd, P_ACK, nullptr, 0);
+    if (kind != P_WRITE_REQ && kind != P_WRITE_CMD) continue;
+    buf += data;
+
+    while (!buf.empty()) {
+      if (buf[0] == '\0') {
+        if (buf.size() < 4) break;
+        size_t n = (uint8_t)buf[2] | (uint8_t)buf[3] << 8;
+        if (buf.size() < 4 + n) break;
+        if ((uint8_t)buf[1] == BleLinkOta::kFrameType &&
+            std::uniform_real_distribution<double>(0, 100)(rnd) >= o.loss) {
+          ota.onFrame((const uint8_t*)buf.data() + 4, n, millis());
+        }
+        buf.erase(0, 4 + n);
+        continue;
+      }
+      size_t nl = buf.find('\n');
+      if (nl == std::string::npos) break;
+      onLine(ota, buf.substr(0, nl));
+      buf.erase(0, nl + 1);
+    }
+
+    if (o.dropAt && !*dropped && ota.received() >= o.dropAt) {
+      *dropped = true;
+      printf("[ota] lukker forbindelsen ved %lu bytes\n", (unsigned long)ota.received());
+      break;
+    }
+  }
+  g_fd = -1;
+}
+
+int main(int argc, char** argv) {
+  Opts o;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--port"))          o.port    = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--out"))      o.out     = argv[i + 1];
+    else if (!strcmp(argv[i], "--flash-ms")) o.flashMs = (uint32_t)atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--loss"))     o.loss    = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--drop-at"))  o.dropAt  = (uint32_t)atoi(argv[i + 1]);
+  }
+
+  BleLinkOtaFile          flash(o.out.c_str(), o.flashMs * 1000);
+  BleLinkOta              ota;
+  std::mutex              mu;
+  std::condition_variable cv;
+  bool                    kicked = false;
+
+  // Skrive-tråden: samme rolle som skrive-tasken (otaWriter) i BleLink.cpp
+  std::thread writer([&] {
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> l(mu);
+        cv.wait(l, [&] { return kicked; });
+        kicked = false;
+      }
+      while (ota.service()) {}
+    }
+  });
+  writer.detach();
+
+  ota.setFlash(&flash);
+  ota.begin([](const char* line, size_t len) {
+              return g_fd >= 0 && sendPacket(g_fd, P_NOTIFY, line, len);
+            },
+            [&] {
+              std::lock_guard<std::mutex> l(mu);
+              kicked = true;
+              cv.notify_one();
+            });
+
+  int srv = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in a = {};
+  a.sin_family      = AF_INET;
+  a.sin_port        = htons((uint16_t)o.port);
+  a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(srv, (sockaddr*)&a, sizeof(a)) != 0 || listen(srv, 4) != 0) {
+    perror("bind");
+    return 1;
+  }
+  printf("[ota] %s på 127.0.0.1:%d -> %s\n", kName, o.port, o.out.c_str());
+  fflush(stdout);
+
+  std::mt19937 rnd(1);
+  bool dropped = false;
+  for (;;) {
+    int fd = accept(srv, nullptr, nullptr);
+    if (fd < 0) continue;
+    uint8_t kind;
+    std::string data;
+    if (readPacket(fd, &kind, data)) {
+      if (kind == P_LIST) {
+        std::string names = std::string("[\"") + kName + "\"]";
+        sendPacket(fd, P_NAMES, names.data(), names.size());
+      } else if (kind == P_OPEN && data == kName && g_fd < 0) {
+        uint8_t mtu[2] = { 247, 0 };
+        sendPacket(fd, P_ACCEPT, mtu, 2);
+        serve(fd, ota, o, &dropped, rnd);
+        BleLinkOta::Stats s = ota.stats();
+        printf("[ota] afbrudt: %s off=%lu frames=%lu gaps=%lu stalls=%lu dups=%lu blokke=%lu flash=%lu ms\n",
+               BleLinkOta::stateName(ota.state()), (unsigned long)ota.received(),
+               (unsigned long)s.frames, (unsigned long)s.gaps, (unsigned long)s.stalls,
+               (unsigned long)s.dups, (unsigned long)s.blocks, (unsigned long)(s.flashUs / 1000));
+        fflush(stdout);
+      } else {
+        sendPacket(fd, P_REJECT, nullptr, 0);
+      }
+    }
+    close(fd);
+  }
+}
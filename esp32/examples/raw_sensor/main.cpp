@@ -0,0 +1,51 @@
+#include <Arduino.h>
+#include "BleLink.h"
+
+// Rå sensorknude: ingen JSON-API, rå linjer eller log (se [env:esp32dev-raw]).
+// Linjer modtages som BleLinkMessage, målinger sendes som rå tekst.
+// Hvert 10. sekund skrives linkStats() til Serial: rxCycles er CPU-cykler
+// pr. modtaget enhed, til sammenligning mellem build-konfigurationer.
+
+BleLink bleLink("BLE-LINK-RAW");
+
+static uint32_t g_periodMs = 1000;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+  Serial.println("\n--- BleLink rå sensorknude ---");
+
+  // "RATE <ms>" ændrer måleperioden, "PING" besvares med "PONG"
+  bleLink.onReceiveMessage([](BleLinkMessage& m){
+    if (strncmp(m.raw(), "RATE ", 5) == 0) {
+      g_periodMs = strtoul(m.raw() + 5, nullptr, 10);
+    } else if (strcmp(m.raw(), "PING") == 0) {
+      bleLink.sendRaw("PONG");
+    }
+  });
+
+  bleLink.setup();
+}
+
+void loop() {
+  bleLink.loop();
+
+  static uint32_t last = 0;
+  if (g_periodMs && millis() - last >= g_periodMs && bleLink.isConnected()) {
+    last = millis();
+    char line[48];
+    snprintf(line, sizeof(line), "T %lu %.2f", (unsigned long)millis(), temperatureRead());
+    bleLink.sendRaw(line);
+  }
+
+  static uint32_t lastStats = 0;
+  if (millis() - lastStats >= 10000) {
+    lastStats = millis();
+    BleLink::LinkStats st = bleLink.linkStats();
+    Serial.printf("[stats] rx=%lu cyc/enhed=%lu tx=%lu fri heap=%lu\n",
+                  (unsigned long)st.rxMsgs, (unsigned long)st.rxCycles,
+                  (unsigned long)st.txMsgs, (unsigned long)ESP.getFreeHeap());
+  }
+
+  delay(5);
+}
@@ -0,0 +1,336 @@
+// Soak-test på Linux: BleLinks kerne gennem millioner af blandede enheder,
+// reconnects og overlange linjer, med en instrumenteret allokator. Samme
+// spørgsmål som python/soak.py mod [env:esp32dev-soak], men uden hardware:
+// vokser heapen, fragmenteres den, og hvor mange allokeringer koster en
+// besked?
+//
+// Vejen følger BleLink.cpp: writes á 20..244 B lægges i en std::string og
+// deles i linjer/frames (som parseUnits), køes pr. prioritet
+// (BleLinkRxQueue), dispatches og besvares med et ekko fra puljen
+// (BleLinkPool, også heap-udlån over 2 KB) gennem DRR-køerne
+// (BleLinkTxSched) og sessionens gensendelsesvindue (BleLinkSession).
+// NimBLE og ArduinoJson er ikke med; se examples/native/Arduino.h.
+//
+//   g++ -std=c++17 -O2 -I../native -I../../src -o soak_native main.cpp
+//       ../../src/BleLinkPool.cpp ../../src/BleLinkTxSched.cpp
+//       ../../src/BleLinkRxQueue.cpp ../../src/BleLinkSession.cpp  (én kommando)
+//   ./soak_native --messages 20000000 --reconnect-every 50000 --csv /tmp/soak.csv
+//
+// Allokatoren: malloc/free/calloc/realloc defineres her og kalder glibc's
+// __libc_*; alt i processen (også std::string og new) tælles. "arena" er
+// heap hentet fra systemet, "arena_free" den ledige del af den — vokser
+// arena, mens live bytes står stille, er det fragmentering.
+
+#include <malloc.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include "BleLinkPool.h"
+#include "BleLinkTxSched.h"
+#include "BleLinkRxQueue.h"
+#include "BleLinkSession.h"
+
+// --- instrumenteret allokator ---
+extern "C" {
+void* __libc_malloc(size_t n);
+void  __libc_free(void* p);
+void* __libc_calloc(size_t n, size_t sz);
+void* __libc_realloc(void* p, size_t n);
+}
+
+static size_t g_allocs = 0, g_frees = 0, g_live = 0, g_peakLive = 0;
+
+static void noteAlloc(void* p) {
+  if (!p) return;
+  g_allocs++;
+  g_live += malloc_usable_size(p);
+  if (g_live > g_peakLive) g_peakLive = g_live;
+}
+
+static void noteFree(void* p) {
+  if (!p) return;
+  size_t n = malloc_usable_size(p);
+  g_frees++;
+  g_live -= n <= g_live ? n : g_live;
+}
+
+extern "C" {
+void* malloc(size_t n) {
+  void* p = __libc_malloc(n);
+  noteAlloc(p);
+  return p;
+}
+
+void free(void* p) {
+  noteFree(p);
+  __libc_free(p);
+}
+
+void* calloc(size_t n, size_t sz) {
+  void* p = __libc_calloc(n, sz);
+  noteAlloc(p);
+  return p;
+}
+
+void* realloc(void* p, size_t n) {
+  // som BleLinkHeap.cpp: free + malloc; realloc(p, 0) er kun free
+  if (p && n == 0) {
+    noteFree(p);
+    return __libc_realloc(p, 0);
+  }
+  size_t before = p ? malloc_usable_size(p) : 0;
+  void*  q      = __libc_realloc(p, n);
+  if (!q) return q;
+  if (p) g_frees++;
+  g_allocs++;
+  g_live += malloc_usable_size(q);
+  g_live -= before <= g_live ? before : g_live;
+  if (g_live > g_peakLive) g_peakLive = g_live;
+  return q;
+}
+} // extern "C"
+
+// --- enheden (som BleLink.cpp) ---
+static const size_t  kFrameHdr   = 4;       // [0x00][type][len u16 LE]
+static const size_t  kFrameMaxRx = 2048;    // som BL_FRAME_MAX_RX
+static const uint8_t kTxChannels = BleLinkTxSched::kChannels;
+
+struct Counters {
+  uint64_t sent = 0, units = 0, echoed = 0, rxDrops = 0, txDrops = 0, resync = 0, reconnects = 0;
+};
+
+static BleLinkPool    g_pool;
+static BleLinkTxSched g_txq;
+static BleLinkRxQueue g_rxq;
+static BleLinkSession g_sess;
+static std::string    g_rxBuf;
+static Counters       g_n;
+
+static void releaseToPool(void* ctx, char* buf) { static_cast<BleLinkPool*>(ctx)->release(buf); }
+
+static void queueUnit(bool line, uint8_t kind, const uint8_t* p, size_t n) {
+  size_t skip = 0;
+  BleLinkRxQueue::Prio pr = BleLinkRxQueue::classify(line, p, n, &skip);
+  if (!g_rxq.push(pr, kind, p + skip, n - skip, micros())) {   // ingen NimBLE at vente på
+    g_rxq.noteDrop(pr);
+    g_n.rxDrops++;
+  }
+}
+
+// parseUnits() i BleLink.cpp
+static void parseUnits(std::string& buf) {
+  while (!buf.empty()) {
+    if ((uint8_t)buf[0] == 0x00) {
+      if (buf.size() < kFrameHdr) break;
+      size_t n = (uint8_t)buf[2] | ((size_t)(uint8_t)buf[3] << 8);
+      if (n > kFrameMaxRx) { buf.clear(); g_n.resync++; break; }
+      if (buf.size() < kFrameHdr + n) break;
+      queueUnit(false, (uint8_t)buf[1], (const uint8_t*)buf.data() + kFrameHdr, n);
+      buf.erase(0, kFrameHdr + n);
+      continue;
+    }
+    size_t pos = buf.find('\n');
+    if (pos == std::string::npos) break;
+    buf[pos] = '\0';
+    queueUnit(true, BleLinkRxQueue::kLine, (const uint8_t*)buf.data(), pos);
+    buf.erase(0, pos + 1);
+  }
+}
+
+// Ekko: lån fra puljen (gensendelsesvinduet viger, som i _acquireTx) og køer
+static void echo(const BleLinkRxQueue::Unit& u) {
+  bool   line = u.kind == BleLinkRxQueue::kLine;
+  size_t need = line ? u.len + 2 : kFrameHdr + u.len;
+  size_t cap  = 0;
+  char*  buf  = g_pool.acquire(need, &cap);
+  if (!buf && g_sess.retained()) {
+    g_sess.reclaim(releaseToPool, &g_pool);
+    buf = g_pool.acquire(need, &cap);
+  }
+  if (!buf) {
+    g_n.txDrops++;
+    return;
+  }
+  size_t len;
+  if (line) {
+    memcpy(buf, u.data, u.len);
+    buf[u.len] = '\n';
+    buf[u.len + 1] = '\0';
+    len = u.len + 1;
+  } else {
+    buf[0] = 0x00;
+    buf[1] = u.kind;
+    buf[2] = u.len & 0xFF;
+    buf[3] = u.len >> 8;
+    memcpy(buf + kFrameHdr, u.data, u.len);
+    len = kFrameHdr + u.len;
+  }
+  uint8_t ch = line ? 0 : kTxChannels - 1;
+  if (!g_txq.push(ch, buf, (uint16_t)len, millis())) {
+    g_pool.release(buf);
+    g_n.txDrops++;
+    return;
+  }
+  g_n.echoed++;
+}
+
+// loop(): RX-køerne tømmes, svarene "sendes" og bliver i sessionens vindue
+static void loopOnce() {
+  BleLinkRxQueue::Unit u;
+  while (g_rxq.front(u)) {
+    uint32_t now = micros();
+    echo(u);
+    g_rxq.pop(u, now);
+    g_n.units++;
+  }
+  BleLinkTxSched::Item it;
+  while (g_txq.pop(millis(), it)) {
+    if (char* old = g_sess.retain(it.buf, it.len)) g_pool.release(old);
+  }
+}
+
+static void reconnect() {
+  g_rxBuf.clear();                     // som onServerDisconnected()
+  g_txq.clear(releaseToPool, &g_pool);
+  g_sess.fresh(releaseToPool, &g_pool);
+  g_n.reconnects++;
+}
+
+// --- trafik (som soak.py: echo-JSON, PING, '!'-linjer, frames, overlange) ---
+// s genbruges, så testens egne strenge ikke tælles med i allokeringerne
+static void makeUnit(std::mt19937& rnd, uint64_t seq, std::string& s) {
+  char     num[24];
+  uint32_t r = rnd() % 100;
+  snprintf(num, sizeof(num), "%llu", (unsigned long long)seq);
+  s.clear();
+  if (r < 55) {
+    s += "{\"op\":\"echo\",\"seq\":";
+    s += num;
+    s += ",\"pad\":\"";
+    s.append(rnd() % 96, 'x');
+    s += "\"}\n";
+  } else if (r < 70) {
+    s += "PING\n";
+  } else if (r < 80) {
+    s += "!{\"op\":\"stop\",\"seq\":";
+    s += num;
+    s += "}\n";
+  } else if (r < 95) {
+    size_t n = 8 + rnd() % 600;
+    s.resize(kFrameHdr + n);
+    s[0] = 0x00;
+    s[1] = 0x01;
+    s[2] = (char)(n & 0xFF);
+    s[3] = (char)(n >> 8);
+    for (size_t i = 0; i < n; ++i) s[kFrameHdr + i] = (char)(1 + rnd() % 255);
+  } else {
+    s += "{\"op\":\"big\",\"pad\":\"";            // overlang linje
+    s.append(300 + rnd() % 6000, 'y');
+    s += "\"}\n";
+  }
+}
+
+struct Opts {
+  uint64_t messages       = 2000000;
+  uint64_t reconnectEvery = 50000;
+  uint64_t sampleEvery    = 100000;
+  uint32_t seed           = 1;
+  const char* csv         = nullptr;
+  bool     json           = false;
+};
+
+struct Sample {
+  uint64_t msgs;
+  size_t   live, arena, arenaFree;
+  double   allocsPerMsg;
+};
+
+int main(int argc, char** argv) {
+  Opts o;
+  for (int i = 1; i < argc; ++i) {
+    auto next = [&]{ return i + 1 < argc ? argv[++i] : "0"; };
+    if      (!strcmp(argv[i], "--messages"))        o.messages = strtoull(next(), nullptr, 10);
+    else if (!strcmp(argv[i], "--reconnect-every")) o.reconnectEvery = strtoull(next(), nullptr, 10);
+    else if (!strcmp(argv[i], "--sample-every"))    o.sampleEvery = strtoull(next(), nullptr, 10);
+    else if (!strcmp(argv[i], "--seed"))            o.seed = (uint32_t)strtoul(next(), nullptr, 10);
+    else if (!strcmp(argv[i], "--csv"))             o.csv = next();
+    else if (!strcmp(argv[i], "--json"))            o.json = true;
+    else {
+      fprintf(stderr, "brug: %s [--messages N] [--reconnect-every N] [--sample-every N]"
+                      " [--seed N] [--csv FIL] [--json]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (o.sampleEvery == 0) o.sampleEvery = 100000;
+
+  std::mt19937 rnd(o.seed);
+  g_sess.fresh(releaseToPool, &g_pool);
+  FILE* csv = o.csv ? fopen(o.csv, "w") : nullptr;
+  if (csv) fprintf(csv, "messages,live_bytes,peak_live,arena,arena_free,allocs_per_msg\n");
+
+  Sample first = {0, 0, 0, 0, 0}, last = first;
+  size_t peakArena = 0;
+  size_t allocs0 = g_allocs;
+  uint64_t msgs0 = 0;
+  std::string unit;
+  for (uint64_t m = 1; m <= o.messages; ++m) {
+    makeUnit(rnd, m, unit);
+    for (size_t off = 0; off < unit.size(); ) {        // writes som BLE-MTU'en giver dem
+      size_t k = 20 + rnd() % 225;
+      if (k > unit.size() - off) k = unit.size() - off;
+      g_rxBuf.append(unit, off, k);
+      parseUnits(g_rxBuf);
+      loopOnce();
+      off += k;
+    }
+    g_n.sent++;
+    if (o.reconnectEvery && m % o.reconnectEvery == 0) reconnect();
+
+    if (m % o.sampleEvery == 0 || m == o.messages) {
+      struct mallinfo2 mi = mallinfo2();
+      Sample s = { m, g_live, mi.arena, mi.fordblks,
+                   (double)(g_allocs - allocs0) / (double)(m - msgs0) };
+      allocs0 = g_allocs;
+      msgs0   = m;
+      if (first.msgs == 0) first = s;
+      last = s;
+      if (s.arena > peakArena) peakArena = s.arena;
+      if (csv) fprintf(csv, "%llu,%zu,%zu,%zu,%zu,%.4f\n", (unsigned long long)s.msgs,
+                       s.live, g_peakLive, s.arena, s.arenaFree, s.allocsPerMsg);
+      if (!o.json) {
+        printf("[soak] %10llu msgs  live %7zu B  arena %8zu B (fri %7zu)  %.3f allok/msg\n",
+               (unsigned long long)s.msgs, s.live, s.arena, s.arenaFree, s.allocsPerMsg);
+      }
+    }
+  }
+  if (csv) fclose(csv);
+
+  // Trend efter første sample (opvarmning: std::string og puljen finder deres niveau)
+  double mio   = (double)(last.msgs - first.msgs) / 1e6;
+  double trend = mio > 0 ? ((double)last.live - (double)first.live) / mio : 0.0;
+  BleLinkPool::Stats ps = g_pool.stats();
+  if (o.json) {
+    printf("{\"messages\":%llu,\"units\":%llu,\"echoed\":%llu,\"rx_drops\":%llu,\"tx_drops\":%llu,"
+           "\"resync\":%llu,\"reconnects\":%llu,\"allocs\":%zu,\"frees\":%zu,"
+           "\"allocs_per_msg\":%.4f,\"live_bytes\":%zu,\"peak_live\":%zu,\"peak_arena\":%zu,"
+           "\"arena_free\":%zu,\"live_trend_per_mio\":%.1f,\"pool_heap\":%u,\"pool_misses\":%u}\n",
+           (unsigned long long)g_n.sent, (unsigned long long)g_n.units,
+           (unsigned long long)g_n.echoed, (unsigned long long)g_n.rxDrops,
+           (unsigned long long)g_n.txDrops, (unsigned long long)g_n.resync,
+           (unsigned long long)g_n.reconnects, g_allocs, g_frees,
+           (double)g_allocs / (double)(g_n.sent ? g_n.sent : 1), last.live, g_peakLive, peakArena,
+           last.arenaFree, trend, ps.big, ps.misses);
+  } else {
+    printf("beskeder %llu, enheder %llu, ekko %llu, RX-drop %llu, TX-drop %llu, reconnects %llu\n",
+           (unsigned long long)g_n.sent, (unsigned long long)g_n.units,
+           (unsigned long long)g_n.echoed, (unsigned long long)g_n.rxDrops,
+           (unsigned long long)g_n.txDrops, (unsigned long long)g_n.reconnects);
+    printf("allokeringer %zu (%.3f pr. besked), peak live %zu B, peak arena %zu B\n",
+           g_allocs, (double)g_allocs / (double)(g_n.sent ? g_n.sent : 1), g_peakLive, peakArena);
+    printf("live-trend %+.1f B pr. mio. beskeder, puljens heap-udlån %u, misses %u\n",
+           trend, ps.big, ps.misses);
+  }
+  return 0;
+}
@@ -0,0 +1,156 @@
+// BleLinkTxSched på Linux med et virtuelt ur: DRR-køerne og det globale
+// rate-loft (token bucket) tømmes i 1 ms-skridt, som loop() gør, og hvert
+// spor tjekkes for fremdrift og snitrate. Især linjer over spanden
+// (max(rate/4, 2048) bytes, heap-lån op til kMaxLen) under et lavt loft:
+// de skal sendes og må ikke blokere kanalerne bag sig. exit 1 ved afvigelse.
+//
+//   g++ -std=c++17 -O2 -I../native -I../../src -o txsched_native main.cpp
+//       ../../src/BleLinkTxSched.cpp ../../src/BleLinkPool.cpp      (én kommando)
+//   ./txsched_native          # PASS/FAIL pr. spor
+//   ./txsched_native -v       # plus hver afsendt linje
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "BleLinkPool.h"
+#include "BleLinkTxSched.h"
+
+// Én linje, der lægges i kø til tiden t (ms fra start)
+struct Push {
+  uint32_t t;
+  uint8_t  ch;
+  uint16_t len;
+};
+
+struct Sent {
+  uint32_t t;
+  uint8_t  ch;
+  uint16_t len;
+};
+
+struct Run {
+  std::vector<Sent> sent;
+  size_t            left = 0;     // stadig i kø til sidst
+  size_t            full = 0;     // push afvist: kanalens kø fuld
+};
+
+// Linjerne peger ikke på rigtige buffere; schedulereren læser dem ikke
+static char g_dummy;
+
+static Run play(uint32_t rateBps, const std::vector<Push>& pushes, uint32_t ms, bool verbose) {
+  BleLinkTxSched q;
+  q.setRateLimit(rateBps);
+  uint32_t t0 = millis();          // setRateLimit() starter spanden ved millis()
+  Run      run;
+  size_t   next = 0;
+  for (uint32_t t = 0; t <= ms; ++t) {
+    while (next < pushes.size() && pushes[next].t <= t) {
+      const Push& p = pushes[next++];
+      if (!q.push(p.ch, &g_dummy, p.len, t0 + t)) run.full++;
+    }
+    BleLinkTxSched::Item it;
+    while (q.pop(t0 + t, it)) {
+      run.sent.push_back({ t, it.ch, it.len });
+      if (verbose) printf("%8lu ms  ch %u  %5u B\n", (unsigned long)t, it.ch, it.len);
+    }
+  }
+  run.left = q.depth();
+  return run;
+}
+
+static uint32_t bytesUntil(const Run& r, uint32_t t) {
+  uint32_t n = 0;
+  for (const Sent& s : r.sent) {
+    if (s.t <= t) n += s.len;
+  }
+  return n;
+}
+
+static uint32_t firstOf(const Run& r, uint8_t ch, uint16_t len) {
+  for (const Sent& s : r.sent) {
+    if (s.ch == ch && s.len == len) return s.t;
+  }
+  return UINT32_MAX;
+}
+
+// Snitraten må højst overskrides med én spand plus den sidste linje
+static bool rateOk(const Run& r, uint32_t rateBps, uint32_t ms) {
+  uint32_t burst = rateBps / 4 > BleLinkPool::maxSize() ? rateBps / 4 : (uint32_t)BleLinkPool::maxSize();
+  for (uint32_t t = 1000; t <= ms; t += 1000) {
+    uint64_t allowed = (uint64_t)rateBps * t / 1000 + burst + BleLinkPool::kMaxLen;
+    if (bytesUntil(r, t) > allowed) return false;
+  }
+  return true;
+}
+
+struct Case {
+  const char*       name;
+  uint32_t          rateBps;
+  uint32_t          ms;
+  std::vector<Push> pushes;
+  std::function<const char*(const Run&)> check;   // nullptr = ok
+};
+
+static std::vector<Push> every(uint8_t ch, uint16_t len, uint32_t fromMs, uint32_t stepMs, uint32_t n) {
+  std::vector<Push> v;
+  for (uint32_t i = 0; i < n; ++i) v.push_back({ fromMs + i * stepMs, ch, len });
+  return v;
+}
+
+static std::vector<Push> merged(std::vector<Push> a, const std::vector<Push>& b) {
+  a.insert(a.end(), b.begin(), b.end());
+  std::stable_sort(a.begin(), a.end(), [](const Push& x, const Push& y) { return x.t < y.t; });
+  return a;
+}
+
+static std::vector<Case> cases() {
+  return {
+    { "uden loft", 0, 100, every(0, 4000, 0, 1, 8),
+      [](const Run& r) -> const char* {
+        return r.sent.size() == 8 && r.sent.back().t == 7 ? nullptr : "linjerne ventede";
+      } },
+    { "loft holdes", 8000, 10000, every(0, 200, 0, 20, 500),
+      [](const Run& r) -> const char* {
+        return bytesUntil(r, 10000) >= 8000 * 9 ? nullptr : "for lidt sendt";
+      } },
+    { "2049 B under lavt loft", 1000, 8000, merged({ { 0, 0, 2049 } }, every(1, 64, 0, 100, 60)),
+      [](const Run& r) -> const char* {
+        uint32_t b = firstOf(r, 0, 2049);
+        if (b == UINT32_MAX) return "linjen over spanden blev aldrig sendt";
+        if (b > 2048 + 64 + 50) return "linjen ventede ud over en fuld spand";   // én spand efter første 64 B-linje
+        return r.left == 0 ? nullptr : "kanal 1 gik i stå bag den store linje";
+      } },
+    { "64 KB under lavt loft", 4000, 40000,
+      merged({ { 0, 2, (uint16_t)BleLinkPool::kMaxLen } }, every(0, 100, 0, 200, 150)),
+      [](const Run& r) -> const char* {
+        uint32_t b = firstOf(r, 2, (uint16_t)BleLinkPool::kMaxLen);
+        if (b == UINT32_MAX) return "64 KB-linjen blev aldrig sendt";
+        // Gælden (64 KB - spand) betales af, før kanal 0 sender igen
+        uint32_t after = UINT32_MAX;
+        for (const Sent& s : r.sent) {
+          if (s.t > b && s.ch == 0) { after = s.t; break; }
+        }
+        if (after == UINT32_MAX) return "kanal 0 gik i stå";
+        if (after - b < (BleLinkPool::kMaxLen - 2048) * 1000 / 4000 - 10) return "gælden blev ikke betalt";
+        return r.left == 0 ? nullptr : "linjer stadig i kø";
+      } },
+  };
+}
+
+int main(int argc, char** argv) {
+  bool verbose = argc > 1 && !strcmp(argv[1], "-v");
+  int  fails   = 0;
+  for (const Case& k : cases()) {
+    if (verbose) printf("-- %s\n", k.name);
+    Run         r   = play(k.rateBps, k.pushes, k.ms, verbose);
+    const char* err = k.check(r);
+    if (!err && k.rateBps && !rateOk(r, k.rateBps, k.ms)) err = "snitraten over loftet";
+    printf("%-4s %-24s loft %5lu B/s, sendt %4zu linjer / %6lu B, kø fuld %3zu, i kø %zu%s%s\n",
+           err ? "FAIL" : "PASS", k.name, (unsigned long)k.rateBps, r.sent.size(),
+           (unsigned long)bytesUntil(r, k.ms), r.full, r.left, err ? ": " : "", err ? err : "");
+    if (err) fails++;
+  }
+  return fails ? 1 : 0;
+}
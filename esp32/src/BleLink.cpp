@@ -1,28 +1,100 @@
 #include "BleLink.h"
+#include "BleLinkHeap.h"
 #include <NimBLEDevice.h>
 #include <string>
 #include <cstring>
+#include <cstdarg>
 
 // --- NUS UUIDs ---
 #define NUS_SERVICE_UUID "6E400001-B5A3-F393-E0A9-E50E24DCCA9E"
 #define NUS_CHAR_RX_UUID "6E400002-B5A3-F393-E0A9-E50E24DCCA9E"  // Write host->ESP32
 #define NUS_CHAR_TX_UUID "6E400003-B5A3-F393-E0A9-E50E24DCCA9E"  // Notify ESP32->host
 
+// --- log-kanal ---
+#define BL_LOG_BATCH    12     // linjer pr. frame
+#define BL_LOG_FLUSH_MS 250    // send senest når ældste linje er så gammel
+
+// --- binære frames: [0x00][type][len u16 LE][payload] ---
+#define BL_FRAME_START  0x00
+#define BL_FRAME_MAX_RX 2048   // større længde = ude af synk -> kassér RX-bufferen
+#define BL_SEC_MAX      2048   // største klartekst i én krypteret frame
+
+// --- notifikationer (_sendLine) ---
+#define BL_NOTIFY_MIN     20   // nyttelast pr. notifikation før MTU-udvekslingen (23 - 3)
+#define BL_NOTIFY_BACKOFF 8    // længste pause (ms) mellem genforsøg, når stakken er fuld
+#define BL_NOTIFY_GIVEUP  1000 // opgiv resten af enheden, når stakken har afvist ét stykke så længe (ms)
+
+// --- RX-køer (BleLinkRxQueue) ---
+#define BL_RX_BUDGET_US   4000 // normal-dispatch pr. loop(); høj prioritet tømmes altid
+#define BL_RX_WAIT_MS     100  // NimBLE-tasken venter så længe på plads i en fuld RX-kø
+#define BL_HANDSHAKE_MAX  192  // hello/sec_hello er korte: længere linjer parses ikke i NimBLE-tasken
+
+// --- forbindelsesparametre (BleLinkConnPolicy) ---
+#define BL_CP_SAMPLE_MS  250   // politikken får et sample så ofte
+#define BL_NO_CONN       0xFFFF
+
+// --- firmwareopdatering (BleLinkOta) ---
+#define BL_OTA_RESTART_MS 1000 // genstart så længe efter ota_apply (svaret skal ud)
+#define BL_OTA_STACK      4096 // skrive-taskens stak
+#define BL_OTA_PRIO       2    // over loop() (1): flash-skrivning overlapper modtagelsen
+
+// --- historik (BleLinkHistory) ---
+#define BL_HIST_FRAME     508  // payload pr. frame: med header netop en 512-blok i puljen
+#define BL_HIST_INFLIGHT  2    // frames i bulk-kanalens kø ad gangen
+
+// --- sessioner (BleLinkSession) ---
+#define BL_RESUME_MS     30000 // bevar køerne så længe efter disconnect
+#define BL_HELLO_WAIT_MS 3000  // hold TX højst så længe efter connect, mens vi venter på hello
+
+// --- konfiguration (BleLinkConfig) ---
+#define BL_CFG_PART      768   // dokument-bytes pr. cfg_part: escapet højst en 2048-blok
+#define BL_CFG_INFLIGHT  2     // dele i kommandokanalens kø ad gangen
+
+// --- registerkort ---
+#define BL_REG_NOTIFY_MS 50    // saml appens ændringer i højst så lang tid
+
+// --- broadcast (manufacturer data) ---
+#define BL_BC_COMPANY_ID 0xFFFF  // reserveret til test/intern brug
+#define BL_BC_MAGIC      0xB1
+#define BL_ADV_FLAGS     0x06    // LE General Discoverable | BR/EDR not supported
+
 // --- NimBLE globals ---
 static NimBLEServer*         g_server     = nullptr;
 static NimBLECharacteristic* g_tx         = nullptr;
 static bool                  g_connected  = false;
 static volatile bool         g_needReinit = false;
 static std::string           g_rxBuf;
+static std::string           g_secRxBuf;        // dekrypteret RX (linjer/frames)
+
+// --- tællere (læses af linkStats / {"_bl":"stats"}) ---
+static volatile uint32_t     g_rxMsgs     = 0;
+static volatile uint32_t     g_rxBytes    = 0;
+static volatile uint32_t     g_connects   = 0;
+static volatile uint16_t     g_mtu        = 0;
+static volatile int          g_notifyRc   = 0;   // seneste notify-fejl (onStatus), 0 = sendt
+static volatile uint16_t     g_connHandle = BL_NO_CONN;
+
+// --- session: TX holdes fra connect til værtens hello ---
+static volatile bool         g_awaitHello = false;
+static volatile uint32_t     g_connAt     = 0;
+
+#if BLELINK_ENABLE_OTA
+// --- firmwareopdatering: skrive-task (write-behind) ---
+static TaskHandle_t          g_otaTask    = nullptr;
+#endif
 
 // --- helpers ---
-static void onServerConnected(NimBLEServer* s) {
+static void onServerConnected(NimBLEServer* s, uint16_t handle = BL_NO_CONN) {
+  if (handle != BL_NO_CONN) g_connHandle = handle;   // også når debounce slår til
   static uint32_t lastConn = 0;
   if (millis() - lastConn < 300) return;  // debounce
   lastConn = millis();
 
   g_connected  = true;
   g_needReinit = false;
+  g_connects++;
+  g_awaitHello = true;
+  g_connAt     = millis();
   if (s) s->getAdvertising()->stop();
   Serial.println("[BleLink] Connected");
 }
@@ -32,58 +104,110 @@ static void onServerDisconnected() {
   if (millis() - lastDisc < 300) return;  // debounce
   lastDisc = millis();
 
-  g_connected = false;
+  g_connected  = false;
+  g_mtu        = 0;
+  g_connHandle = BL_NO_CONN;
   g_rxBuf.clear();
+  g_secRxBuf.clear();
   Serial.println("[BleLink] Disconnected -> restart advertising");
   NimBLEDevice::getAdvertising()->start();
   g_needReinit = true; // “ren” reinit i loop()
 }
 
-static void handleWrite(NimBLECharacteristic* ch,
-                        std::function<void(const JsonDocument&)> emitJson,
-                        std::function<void(const String&)> emitRaw) {
+static void releaseToPool(void* ctx, char* buf) { static_cast<BleLinkPool*>(ctx)->release(buf); }
+
+#if BLELINK_ENABLE_OTA
+// Skriver klare blokke til flash, mens loop() fylder den anden buffer
+static void otaWriter(void* arg) {
+  BleLinkOta* ota = static_cast<BleLinkOta*>(arg);
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (ota->service()) {}
+  }
+}
+#endif
+
+// hello/sec_hello styrer TX og kryptering og håndteres straks i NimBLE-tasken
+static bool isHandshake(BleLinkMessage& m) {
+  if (m.length() > BL_HANDSHAKE_MAX) return false;
+  const char* op = m.controlOp();
+  return op && (strcmp(op, "hello") == 0 || strcmp(op, "sec_hello") == 0);
+}
+
+using LineFn  = std::function<void(BleLinkMessage& m)>;
+using FrameFn = std::function<void(uint8_t type, const uint8_t* p, size_t n)>;
+
+// Del buf i hele linjer/frames og dispatch dem (bruges også til dekrypteret RX).
+// Linjer parses ikke her: BleLinkMessage parser først, når nogen spørger.
+static void parseUnits(std::string& buf, const LineFn& emitLine, const FrameFn& emitFrame) {
+  while (!buf.empty()) {
+    // Binær frame (tekstlinjer indeholder aldrig 0x00)
+    if ((uint8_t)buf[0] == BL_FRAME_START) {
+      if (buf.size() < BleLink::kFrameHeader) break;
+      size_t n = (uint8_t)buf[2] | ((size_t)(uint8_t)buf[3] << 8);
+      if (n > BL_FRAME_MAX_RX) { buf.clear(); break; }
+      if (buf.size() < BleLink::kFrameHeader + n) break;
+      uint8_t type = (uint8_t)buf[1];
+      if (type != BleLink::kFrameSecure) g_rxMsgs++;   // indholdet tælles
+      emitFrame(type, (const uint8_t*)buf.data() + BleLink::kFrameHeader, n);
+      buf.erase(0, BleLink::kFrameHeader + n);
+      continue;
+    }
+
+    size_t pos = buf.find('\n');
+    if (pos == std::string::npos) break;
+    buf[pos] = '\0';                    // linjen læses på plads (ingen kopi)
+    g_rxMsgs++;
+    BleLinkMessage m(buf.data(), pos);
+    emitLine(m);
+    buf.erase(0, pos + 1);
+  }
+}
+
+static void handleWrite(NimBLECharacteristic* ch, const LineFn& emitLine, const FrameFn& emitFrame) {
   if (!ch) return;
   std::string chunk = ch->getValue();
   if (chunk.empty()) return;
 
+  g_rxBytes += chunk.size();
   g_rxBuf.append(chunk);
-  size_t pos;
-  while ((pos = g_rxBuf.find('\n')) != std::string::npos) {
-    std::string line = g_rxBuf.substr(0, pos);
-    g_rxBuf.erase(0, pos + 1);
-
-    // Prøv JSON
-    JsonDocument doc;
-    DeserializationError err = deserializeJson(doc, line);
-    if (!err) {
-      emitJson(doc);
-    } else {
-      emitRaw(String(line.c_str()));
-    }
-  }
+  parseUnits(g_rxBuf, emitLine, emitFrame);
 }
 
 // --- callbacks (uden override for kompatibilitet) ---
 class ServerCallbacks : public NimBLEServerCallbacks {
 public:
   void onConnect(NimBLEServer* s) { onServerConnected(s); }
-  void onConnect(NimBLEServer* s, ble_gap_conn_desc* /*d*/) { onServerConnected(s); }
+  void onConnect(NimBLEServer* s, ble_gap_conn_desc* d) { onServerConnected(s, d ? d->conn_handle : BL_NO_CONN); }
+  void onConnect(NimBLEServer* s, NimBLEConnInfo& i) { onServerConnected(s, i.getConnHandle()); }
   void onDisconnect(NimBLEServer* /*s*/) { onServerDisconnected(); }
   void onDisconnect(NimBLEServer* /*s*/, ble_gap_conn_desc* /*d*/) { onServerDisconnected(); }
+  void onMTUChange(uint16_t mtu, ble_gap_conn_desc* /*d*/) { g_mtu = mtu; }
+  void onMTUChange(uint16_t mtu, NimBLEConnInfo& /*i*/) { g_mtu = mtu; }
+};
+
+// TX: NimBLE 1.4 melder notify()'s resultat synkront i onStatus; ERROR_GATT
+// med BLE_HS_ENOMEM betyder, at stakkens mbufs er brugt op (linket er fuldt)
+class TxCallbacks : public NimBLECharacteristicCallbacks {
+public:
+  void onStatus(NimBLECharacteristic* /*c*/, Status s, int code) {
+    if (s == Status::ERROR_GATT) g_notifyRc = code ? code : -1;
+  }
+  void onStatus(NimBLECharacteristic* /*c*/, int code) {   // NimBLE 2.x
+    if (code) g_notifyRc = code;
+  }
 };
 
 class CharCallbacks : public NimBLECharacteristicCallbacks {
 public:
-  CharCallbacks(std::function<void(const JsonDocument&)> j,
-                std::function<void(const String&)> r)
-  : _emitJson(std::move(j)), _emitRaw(std::move(r)) {}
+  CharCallbacks(LineFn l, FrameFn f) : _emitLine(std::move(l)), _emitFrame(std::move(f)) {}
 
-  void onWrite(NimBLECharacteristic* c) { handleWrite(c, _emitJson, _emitRaw); }
-  void onWrite(NimBLECharacteristic* c, NimBLEConnInfo& /*i*/) { handleWrite(c, _emitJson, _emitRaw); }
+  void onWrite(NimBLECharacteristic* c) { handleWrite(c, _emitLine, _emitFrame); }
+  void onWrite(NimBLECharacteristic* c, NimBLEConnInfo& /*i*/) { handleWrite(c, _emitLine, _emitFrame); }
 
 private:
-  std::function<void(const JsonDocument&)> _emitJson;
-  std::function<void(const String&)>       _emitRaw;
+  LineFn  _emitLine;
+  FrameFn _emitFrame;
 };
 
 // --- BleLink impl ---
@@ -92,9 +216,24 @@ BleLink::BleLink(const char* deviceName) {
   _name[sizeof(_name)-1] = '\0';
 }
 
-void BleLink::setup() { _initializeBLE(); }
+void BleLink::setup() {
+  if (!_txLock) _txLock = xSemaphoreCreateMutex();
+#if BLELINK_ENABLE_JSON
+  _sched.begin();
+#endif
+  _test.begin([this](const char* line, size_t len){ return _sendBytes(line, len); });
+#if BLELINK_ENABLE_OTA
+  _ota.begin([this](const char* line, size_t len){ return _sendBytes(line, len); },
+             []{ if (g_otaTask) xTaskNotifyGive(g_otaTask); });
+  _ota.setRxRoom([this]{ return _otaRxRoom(); });
+#endif
+  _initializeBLE();
+}
 
 void BleLink::loop() {
+#if BLELINK_ENABLE_STATS
+  uint32_t t0 = micros();
+#endif
   if (g_connected && g_server && g_server->getConnectedCount() == 0) {
     Serial.println("[BleLink] Link lost w/o callback -> reinit");
     g_connected  = false;
@@ -102,11 +241,74 @@ void BleLink::loop() {
   }
   if (g_needReinit) {
     g_needReinit = false;
+    if (_sess.token()[0]) {            // køerne bevares til genoptagelse
+      _resumable = true;
+      _lostAt    = millis();
+    } else {
+      _clearTx();                      // vært uden sessioner: intet at sende til
+#if BLELINK_ENABLE_JSON
+      _cfgOut = false;
+#endif
+#if BLELINK_ENABLE_HISTORY
+      if (_hist.active()) _hist.finish();
+      _histEndDue = false;
+#endif
+    }
+    _crypto.end();                     // ny forbindelse = nyt handshake
+    _secPending = false;
     delay(150);
     NimBLEDevice::deinit();
     delay(250);
     _initializeBLE();
   }
+
+  // Session: værten sagde ikke hello i tide, eller den afbrudte udløb
+  if (g_awaitHello && g_connected && millis() - g_connAt >= BL_HELLO_WAIT_MS) _noHello();
+  if (_resumable && !g_connected && millis() - _lostAt >= BL_RESUME_MS) _endSession();
+
+  // Broadcast: opdatér status-payload efter skema (kun mens vi annoncerer)
+  if (_bcCb && !g_connected && millis() - _bcLast >= _bcIntervalMs) {
+    _bcLast = millis();
+    _bcSeq++;
+    _applyAdvertising();
+  }
+
+  if (_secPending && g_connected) _finishSecure(0);
+  _pumpRx();
+  _reportRxDrops();
+#if BLELINK_ENABLE_OTA
+  _ota.poll(millis());
+  if (_otaRestartAt && (int32_t)(millis() - _otaRestartAt) >= 0) {
+    Serial.println("[BleLink] OTA applied -> restart");
+    ESP.restart();
+  }
+#endif
+  _pollConnPolicy();
+#if BLELINK_ENABLE_JSON
+  _pollSchedule();
+  _pumpConfig();
+#endif
+
+  _pumpRegs();
+#if BLELINK_ENABLE_HISTORY
+  _pumpHistory();
+#endif
+  _pumpTx(true);
+#if BLELINK_ENABLE_LOG
+  _pumpLog();
+#endif
+
+  // Throughput-test (source): send lidt pr. loop(), så loop() ikke blokeres
+  if (_test.mode() == BleLinkTest::Mode::Source && g_connected && _test.poll(8)) {
+    _sendTestResult(_test.stop(millis()));
+  }
+
+#if BLELINK_ENABLE_STATS
+  uint32_t us = micros() - t0;
+  _loopCount++;
+  _loopAvgUs = _loopAvgUs ? (_loopAvgUs * 7 + us) / 8 : us;  // EWMA, alfa = 1/8
+  if (us > _loopMaxUs) _loopMaxUs = us;
+#endif
 }
 
 void BleLink::disconnect() {
@@ -115,29 +317,162 @@ void BleLink::disconnect() {
 
 bool BleLink::isConnected() const { return g_connected; }
 
-void BleLink::sendJson(const JsonDocument& doc) {
-  String s; serializeJson(doc, s);
-  if (!s.endsWith("\n")) s += "\n";
-  _sendLine(s.c_str());
+bool BleLink::sendJson(const JsonDocument& doc, uint8_t channel) {
+  if (!g_connected) return false;
+  size_t cap = 0;
+  size_t len = measureJson(doc);
+  char*  buf = _acquireTx(len + 2, &cap);  // + '\n' + '\0'
+  if (!buf) return false;
+  len = serializeJson(doc, buf, cap - 1);
+  buf[len++] = '\n';
+  buf[len]   = '\0';
+  return _enqueueTx(channel, buf, len, true);
+}
+
+bool BleLink::sendRaw(const char* cstr, uint8_t channel) {
+  if (!cstr || !g_connected) return false;
+  size_t len = strlen(cstr);
+  bool   nl  = len > 0 && cstr[len - 1] == '\n';
+  size_t cap = 0;
+  char*  buf = _acquireTx(len + (nl ? 1 : 2), &cap);
+  if (!buf) return false;
+  memcpy(buf, cstr, len);
+  if (!nl) buf[len++] = '\n';
+  buf[len] = '\0';
+  return _enqueueTx(channel, buf, len, true);
+}
+
+bool BleLink::sendFrame(uint8_t type, const void* payload, size_t len, uint8_t channel) {
+  size_t room = 0;
+  uint8_t* p = _beginFrame(len, &room);
+  if (!p) return false;
+  memcpy(p, payload, len);
+  return _endFrame(channel, type, p, len);
+}
+
+#if BLELINK_ENABLE_PROTO
+bool BleLink::sendProto(uint16_t type, const pb_msgdesc_t* fields, const void* msg, uint8_t channel) {
+  size_t need = 0;
+  if (!BleLinkProto::encodedSize(fields, msg, &need)) return false;
+  size_t room = 0;
+  uint8_t* p = _beginFrame(need, &room);
+  if (!p) return false;
+  size_t n = _proto.encode(p, room, type, fields, msg);
+  if (n == 0) {
+    _pool.release((char*)(p - kFrameHeader));
+    return false;
+  }
+  return _endFrame(channel, kFrameProto, p, n);
 }
+#endif
 
-void BleLink::sendRaw(const char* cstr) {
-  if (!cstr) return;
-  String s(cstr);
-  if (!s.endsWith("\n")) s += "\n";
-  _sendLine(s.c_str());
+BleLink::LinkStats BleLink::linkStats() const {
+  LinkStats st;
+  st.rxMsgs    = g_rxMsgs;
+  st.rxBytes   = g_rxBytes;
+  st.rxParsed  = BleLinkMessage::parses();
+  st.txMsgs    = _txMsgs;
+  st.txBytes   = _txBytes;
+  st.txDropped = _txDropped;
+  st.txBusy    = _txBusy;
+  st.connects  = g_connects;
+  st.mtu       = g_mtu;
+  st.loopCount = _loopCount;
+  st.loopAvgUs = _loopAvgUs;
+  st.loopMaxUs = _loopMaxUs;
+  st.rxCycles  = _rxCycles;
+  return st;
 }
 
+void BleLink::setSendPolicy(SendPolicy policy, uint32_t blockTimeoutMs) {
+  _policy         = policy;
+  _blockTimeoutMs = blockTimeoutMs;
+}
+
+void BleLink::setChannelWeight(uint8_t channel, uint16_t quantumBytes) {
+  _txq.setWeight(channel, quantumBytes);
+}
+
+void BleLink::setTxRateLimit(uint32_t bytesPerSec) { _txq.setRateLimit(bytesPerSec); }
+
+#if BLELINK_ENABLE_JSON
 void BleLink::onReceiveJson(JsonCb cb) { _jsonCb = std::move(cb); }
+#endif
+#if BLELINK_ENABLE_RAW
 void BleLink::onReceiveRaw (RawCb  cb) { _rawCb  = std::move(cb); }
+#endif
+void BleLink::onReceiveMsg (MsgCb  cb) { _msgCb  = std::move(cb); }
+void BleLink::onReceiveMessage(LineCb cb) { _lineCb = std::move(cb); }
+
+void BleLink::setBroadcast(uint8_t version, BroadcastCb cb, uint32_t intervalMs) {
+  _bcVersion    = version;
+  _bcCb         = std::move(cb);
+  _bcIntervalMs = intervalMs;
+  _bcLast       = millis();
+  if (g_server) _applyAdvertising();
+}
 
-void BleLink::_emitJson(const JsonDocument& doc) { if (_jsonCb) _jsonCb(doc); }
-void BleLink::_emitRaw (const String& line)      { if (_rawCb)  _rawCb(line); }
+// Modtaget linje: kontrolbesked, testtrafik, onReceiveMessage eller
+// (klassisk) onReceiveJson/onReceiveRaw. Parses kun, hvis nogen skal bruge JSON.
+// Batch-elementer og planlagte kommandoer går samme vej (BleLinkMessage(doc)).
+void BleLink::_emitLine(BleLinkMessage& m) {
+  if (m.controlOp()) {
+    _handleControl(m.json());
+    return;
+  }
+  // testlinjer ("~T...") er aldrig JSON: et parset dokument serialiseres ikke for at se efter
+  if (!m.parsed() && _test.onLine(m.raw(), m.length())) return;
+  if (_lineCb) {
+    _lineCb(m);
+    return;
+  }
+#if BLELINK_ENABLE_JSON && BLELINK_ENABLE_RAW
+  if (!_jsonCb && !_rawCb) return;
+  if (m.isJson()) {
+    if (_jsonCb) _jsonCb(m.json());
+  } else if (_rawCb) {
+    _rawCb(String(m.raw()));
+  }
+#elif BLELINK_ENABLE_JSON
+  if (_jsonCb && m.isJson()) _jsonCb(m.json());
+#elif BLELINK_ENABLE_RAW
+  if (_rawCb) _rawCb(String(m.raw()));   // uden JSON-API: alle linjer er rå
+#endif
+}
+
+void BleLink::_emitFrame(uint8_t type, const uint8_t* p, size_t n) {
+  switch (type) {
+    case kFrameMsg:
+      if (n > 0 && _msgCb) _msgCb(p[0], p + 1, n - 1);
+      break;
+#if BLELINK_ENABLE_PROTO
+    case kFrameProto:
+      _proto.dispatch(p, n);
+      break;
+#endif
+    case kFrameSecure:
+      _openSecure(p, n);
+      break;
+#if BLELINK_ENABLE_OTA
+    case kFrameOta:
+      _ota.onFrame(p, n, millis());
+      break;
+#endif
+    default:
+      break;                           // ukendt frame-type: ignoreres
+  }
+}
 
 void BleLink::_initializeBLE() {
   static ServerCallbacks srvCb;
-  static CharCallbacks   chCb([this](const JsonDocument& d){ _emitJson(d); },
-                              [this](const String& s){ _emitRaw(s); });
+  // Med PSK slås klartekst fra (undtagen handshake); se _plainOk()
+  static CharCallbacks   chCb([this](BleLinkMessage& m){
+                                if (_plainOk(&m)) { _rxUnit(&m); _queueLine(m); }
+                              },
+                              [this](uint8_t t, const uint8_t* p, size_t n){
+                                if (t == kFrameSecure) _emitFrame(t, p, n);   // indholdet tælles
+                                else if (_plainOk(nullptr)) { _rxUnit(nullptr); _queueFrame(t, p, n); }
+                              });
 
   NimBLEDevice::init(_name);
   NimBLEDevice::setPower(ESP_PWR_LVL_P9);
@@ -148,6 +483,8 @@ void BleLink::_initializeBLE() {
 
   NimBLEService* svc = g_server->createService(NUS_SERVICE_UUID);
   g_tx = svc->createCharacteristic(NUS_CHAR_TX_UUID, NIMBLE_PROPERTY::NOTIFY);
+  static TxCallbacks txCb;
+  g_tx->setCallbacks(&txCb);
   NimBLECharacteristic* rx = svc->createCharacteristic(
     NUS_CHAR_RX_UUID, NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::WRITE_NR);
   rx->setCallbacks(&chCb);
@@ -157,20 +494,944 @@ void BleLink::_initializeBLE() {
   NimBLEAdvertising* adv = NimBLEDevice::getAdvertising();
   adv->setName(_name);
   adv->addServiceUUID(svc->getUUID());
+  _applyAdvertising();
   adv->start();
 
   Serial.println("[BleLink] Advertising started");
 }
 
-void BleLink::_sendLine(const char* cstr) {
-  if (!g_connected || !g_tx || !cstr) return;
-  const char* s = cstr;
-  const size_t CHUNK = 20; // MTU-safe
-  size_t len = strlen(s);
-  for (size_t i = 0; i < len; i += CHUNK) {
-    size_t n = (len - i < CHUNK) ? (len - i) : CHUNK;
+// Lån en TX-buffer uden at vente og uden at tælle et drop: til baggrundstrafik
+// (historik), der selv prøver igen fra næste loop()
+char* BleLink::_tryAcquireTx(size_t need, size_t* cap) {
+  char* buf = _pool.acquire(need, cap);
+  if (!buf && _sess.retained() && _txLock && xSemaphoreTake(_txLock, 0) == pdTRUE) {
+    _sess.reclaim(releaseToPool, &_pool);   // gensendelsesvinduet viger for ny trafik
+    xSemaphoreGive(_txLock);
+    buf = _pool.acquire(need, cap);
+  }
+  return buf;
+}
+
+// Lån en TX-buffer; ved udtømt pulje afgør _policy om vi venter eller dropper
+char* BleLink::_acquireTx(size_t need, size_t* cap) {
+  char* buf = _tryAcquireTx(need, cap);
+  if (!buf && _policy == SendPolicy::Block && need <= BleLinkPool::kMaxLen) {
+    uint32_t t0 = millis();
+    while (!buf && millis() - t0 < _blockTimeoutMs) {
+      _pumpTx(false);                  // bufferne ligger i TX-køerne
+      delay(1);
+      buf = _pool.acquire(need, cap);
+    }
+  }
+  if (!buf) _txDropped++;
+  return buf;
+}
+
+// Lån en TX-buffer til en frame med plads til maxPayload; returnerer
+// payload-området (efter headeren), så kaldet kan kode direkte i bufferen
+uint8_t* BleLink::_beginFrame(size_t maxPayload, size_t* room) {
+  if (!g_connected || maxPayload > 0xFFFF) return nullptr;
+  size_t cap = 0;
+  char*  buf = _acquireTx(kFrameHeader + maxPayload, &cap);
+  if (!buf) return nullptr;
+  *room = cap - kFrameHeader;
+  return (uint8_t*)buf + kFrameHeader;
+}
+
+bool BleLink::_endFrame(uint8_t ch, uint8_t type, uint8_t* payload, size_t len) {
+  uint8_t* h = payload - kFrameHeader;
+  h[0] = BL_FRAME_START;
+  h[1] = type;
+  h[2] = len & 0xFF;
+  h[3] = len >> 8;
+  return _enqueueTx(ch, (char*)h, kFrameHeader + len, true);
+}
+
+// Reserverede kontrolbeskeder ({"_bl":...}); true = håndteret her
+bool BleLink::_handleControl(const JsonDocument& doc) {
+  const char* op = doc["_bl"] | (const char*)nullptr;
+  if (!op) return false;
+
+  if (strcmp(op, "time") == 0) {
+    JsonDocument r;
+    r["_bl"] = "time";
+    r["ms"]  = (uint32_t)millis();
+    sendJson(r);
+#if BLELINK_ENABLE_JSON
+  } else if (strcmp(op, "sched") == 0) {
+    JsonDocument r;
+    r["_bl"] = "sched_ack";
+    JsonArray rej = r["rej"].to<JsonArray>();
+    uint16_t n = 0;
+    for (JsonVariantConst c : doc["cmds"].as<JsonArrayConst>()) {
+      uint16_t id = c["id"] | 0;
+      if (_sched.add(id, c["at"] | (uint32_t)0, c["cmd"])) n++;
+      else rej.add(id);
+    }
+    r["n"] = n;
+    sendJson(r);
+  } else if (strcmp(op, "sched_clear") == 0) {
+    _sched.clear();
+#endif
+  } else if (strcmp(op, "sec_hello") == 0) {
+    _startSecure(doc);
+  } else if (strcmp(op, "hello") == 0) {
+    _handleHello(doc);
+#if BLELINK_ENABLE_STATS
+  } else if (strcmp(op, "stats") == 0) {
+    _sendStats();
+#endif
+  } else if (strcmp(op, "test") == 0) {
+    BleLinkTest::Mode m = BleLinkTest::modeFromName(doc["mode"] | "");
+    if (m == BleLinkTest::Mode::Off) {
+      _sendTestResult(_test.stop(millis()));            // "stop"
+    } else {
+      _test.start(m, doc["n"] | (uint32_t)0, doc["size"] | (uint16_t)64, millis());
+      JsonDocument r;
+      r["_bl"]  = "test_ack";
+      r["mode"] = BleLinkTest::modeName(m);
+      sendJson(r);
+    }
+  } else if (strncmp(op, "reg_", 4) == 0) {
+    _handleRegs(op, doc);
+#if BLELINK_ENABLE_OTA
+  } else if (strncmp(op, "ota_", 4) == 0) {
+    _handleOta(op, doc);
+#endif
+#if BLELINK_ENABLE_HISTORY
+  } else if (strcmp(op, "hist") == 0 || strcmp(op, "hist_cancel") == 0 ||
+             strcmp(op, "hist_info") == 0) {
+    _handleHistory(op, doc);
+#endif
+#if BLELINK_ENABLE_JSON
+  } else if (strncmp(op, "cfg_", 4) == 0) {
+    _handleConfig(op, doc);
+  } else if (strcmp(op, "batch") == 0) {
+    // Envelope med flere beskeder fra send_many(): pak ud i rækkefølge, hver
+    // som var den modtaget alene (strenge som linjer, objekter som parset JSON)
+    for (JsonVariantConst e : doc["m"].as<JsonArrayConst>()) {
+      if (e.is<const char*>()) {
+        const char* line = e.as<const char*>();
+        BleLinkMessage m(line, strlen(line));
+        _emitLine(m);
+      } else {
+        BleLinkMessage m(e);
+        _emitLine(m);
+      }
+    }
+#endif
+  }
+  return true;                         // ukendte "_bl" sluges også
+}
+
+#if BLELINK_ENABLE_STATS
+// Kompakt snapshot til fjern-diagnose (python: get_device_stats)
+void BleLink::_sendStats() {
+  LinkStats st = linkStats();
+  BleLinkPool::Stats ps = _pool.stats();
+  BleLinkHeapSnapshot h = BleLinkHeap::snapshot();
+
+  JsonDocument r;
+  r["_bl"] = "stats";
+  r["up"]  = (uint32_t)millis();
+  JsonArray rx = r["rx"].to<JsonArray>();       // [msgs, bytes, JSON-parsinger, cykler/enhed]
+  rx.add(st.rxMsgs); rx.add(st.rxBytes); rx.add(st.rxParsed); rx.add(st.rxCycles);
+  JsonArray tx = r["tx"].to<JsonArray>();       // [msgs, bytes, dropped, notify-genforsøg]
+  tx.add(st.txMsgs); tx.add(st.txBytes); tx.add(st.txDropped); tx.add(st.txBusy);
+  r["con"] = st.connects;
+  r["mtu"] = st.mtu;
+  JsonObject q = r["q"].to<JsonObject>();       // kødybder
+#if BLELINK_ENABLE_JSON
+  q["sched"] = (uint32_t)_sched.size();
+#endif
+  q["rxbuf"] = (uint32_t)g_rxBuf.size();
+  q["tx"]    = (uint32_t)_txq.depth();
+  JsonArray pool = q["pool"].to<JsonArray>();   // i brug pr. klasse
+  for (size_t c = 0; c < BleLinkPool::kClasses; ++c) pool.add(ps.inUse[c]);
+  r["pmiss"] = ps.misses;
+  JsonArray big = r["pbig"].to<JsonArray>();   // [heap-udlån over maxSize(), afvist over kMaxLen]
+  big.add(ps.big); big.add(ps.tooLarge);
+  JsonArray chs = r["ch"].to<JsonArray>();      // pr. TX-kanal
+  for (uint8_t c = 0; c < kTxChannels; ++c) {
+    BleLinkTxSched::ChannelStats cs = _txq.stats(c);
+    JsonArray e = chs.add<JsonArray>();         // [msgs, bytes, drops, depth, maxWaitMs, B/s]
+    e.add(cs.msgs); e.add(cs.bytes); e.add(cs.drops);
+    e.add(cs.depth); e.add(cs.maxWaitMs); e.add(cs.rateBps);
+  }
+  JsonArray heap = r["heap"].to<JsonArray>();   // [free, minFree, largest]
+  heap.add(h.freeHeap); heap.add(h.minFreeHeap); heap.add(h.largestBlock);
+  JsonArray lp = r["loop"].to<JsonArray>();     // [count, avgUs, maxUs]
+  lp.add(st.loopCount); lp.add(st.loopAvgUs); lp.add(st.loopMaxUs);
+  if (_crypto.enabled()) {
+    BleLinkCrypto::Stats cs = _crypto.stats();
+    JsonArray sec = r["sec"].to<JsonArray>();   // [sessions, sealed, opened, rejected, plainDropped]
+    sec.add(cs.sessions); sec.add(cs.sealed); sec.add(cs.opened);
+    sec.add(cs.rejected); sec.add(_secDropped);
+  }
+#if BLELINK_ENABLE_PROTO
+  BleLinkProto::Stats pb = _proto.stats();
+  if (pb.rx || pb.tx || pb.unknown || pb.decodeErr || pb.encodeErr) {
+    JsonArray pa = r["pb"].to<JsonArray>();     // [rx, tx, ukendt type, dekodefejl, kodefejl]
+    pa.add(pb.rx); pa.add(pb.tx); pa.add(pb.unknown); pa.add(pb.decodeErr); pa.add(pb.encodeErr);
+    if (pb.lastError) {
+      JsonArray pe = r["pberr"].to<JsonArray>();  // [beskedtype, nanopb-fejltekst]
+      pe.add(pb.lastType); pe.add(pb.lastError);
+    }
+  }
+#endif
+  BleLinkSession::Stats ss = _sess.stats();
+  JsonArray ses = r["ses"].to<JsonArray>();     // [fresh, resumed, resent, gaps]
+  ses.add(ss.fresh); ses.add(ss.resumed); ses.add(ss.resent); ses.add(ss.gaps);
+  JsonArray rxq = r["rxq"].to<JsonArray>();     // pr. RX-prioritet (høj, normal)
+  for (uint8_t p = 0; p < BleLinkRxQueue::kPrios; ++p) {
+    BleLinkRxQueue::Stats qs = _rxq.stats(p);
+    JsonArray e = rxq.add<JsonArray>();         // [dispatched, drops, depth, avgUs, maxUs, heap]
+    e.add(qs.dispatched); e.add(qs.drops); e.add(qs.depth); e.add(qs.avgUs); e.add(qs.maxUs);
+    e.add(qs.ext);
+  }
+  _rxq.resetMax();
+#if BLELINK_ENABLE_OTA
+  if (_ota.state() != BleLinkOta::State::Idle) {
+    BleLinkOta::Stats os = _ota.stats();
+    JsonArray ota = r["ota"].to<JsonArray>();   // [tilstand, off, size, gaps, stalls, blokke, flashMs]
+    ota.add(BleLinkOta::stateName(_ota.state()));
+    ota.add(_ota.received()); ota.add(_ota.size());
+    ota.add(os.gaps); ota.add(os.stalls); ota.add(os.blocks); ota.add(os.flashUs / 1000);
+  }
+#endif
+#if BLELINK_ENABLE_HISTORY
+  if (_hist.capacity() > 0) {
+    BleLinkHistory::Stats hs = _hist.stats();
+    JsonArray hist = r["hist"].to<JsonArray>(); // [poster, kapacitet, forespørgsler, frames, sendt, annulleret, tabt]
+    hist.add((uint32_t)_hist.size()); hist.add((uint32_t)_hist.capacity());
+    hist.add(hs.queries); hist.add(hs.frames); hist.add(hs.records); hist.add(hs.cancelled); hist.add(hs.lost);
+  }
+#endif
+  if (_cpOn) {
+    BleLinkConnPolicy::Stats cps = _cp.stats();
+    JsonArray cp = r["cp"].to<JsonArray>();     // [tilstand, anmodninger, udskudt, maxInterval]
+    cp.add(BleLinkConnPolicy::modeName(_cp.mode()));
+    cp.add(cps.requests); cp.add(cps.deferred); cp.add(_cp.params().maxInterval);
+  }
+  _loopMaxUs = 0;                               // max gælder pr. forespørgsel
+  sendJson(r);
+}
+#endif
+
+#if BLELINK_ENABLE_JSON
+void BleLink::onConfigChanged(ConfigCb cb) { _cfgCb = std::move(cb); }
+
+// Merge-patch-konfiguration; værten laver fuld synk (cfg_set) ved cfg_nak
+bool BleLink::_handleConfig(const char* op, const JsonDocument& doc) {
+  JsonDocument r;
+  bool changed = false;
+  if (strcmp(op, "cfg_get") == 0) {
+    if (measureJson(_cfg.doc()) > BL_CFG_PART) {
+      _cfgOut     = true;              // for stort til én besked: _pumpConfig()
+      _cfgOutVer  = _cfg.version();
+      _cfgOutOff  = 0;
+      _cfgOutPart = 0;
+      return true;
+    }
+    r["_bl"] = "cfg";
+    r["v"]   = _cfg.version();
+    r["doc"] = _cfg.doc();
+  } else if (strcmp(op, "cfg_patch") == 0) {
+    changed  = _cfg.patch(doc["base"] | (uint32_t)0, doc["p"]);
+    r["_bl"] = changed ? "cfg_ack" : "cfg_nak";
+    r["v"]   = _cfg.version();
+  } else if (strcmp(op, "cfg_set") == 0) {
+    _cfg.set(doc["doc"]);
+    changed  = true;
+    r["_bl"] = "cfg_ack";
+    r["v"]   = _cfg.version();
+  } else {
+    return false;
+  }
+  sendJson(r);
+  if (changed && _cfgCb) _cfgCb(_cfg.doc(), _cfg.version());
+  return true;
+}
+
+// Stort cfg_get-svar: dokumentet i dele á BL_CFG_PART, så hverken puljen
+// eller en enkelt linje skal rumme det hele. Ændres dokumentet undervejs,
+// startes forfra med den nye version (værten starter forfra ved i = 0).
+void BleLink::_pumpConfig() {
+  while (_cfgOut && g_connected && _txq.stats(0).depth < BL_CFG_INFLIGHT) {
+    if (_cfg.version() != _cfgOutVer) {
+      _cfgOutVer  = _cfg.version();
+      _cfgOutOff  = 0;
+      _cfgOutPart = 0;
+    }
+    char   part[BL_CFG_PART + 1];
+    size_t n = _cfg.slice(_cfgOutOff, part, sizeof(part));
+    JsonDocument r;
+    r["v"] = _cfgOutVer;
+    if (n == 0) {
+      r["_bl"]   = "cfg";
+      r["parts"] = _cfgOutPart;
+    } else {
+      r["_bl"] = "cfg_part";
+      r["i"]   = _cfgOutPart;
+      r["d"]   = (const char*)part;
+    }
+    if (!_trySendJson(r, 0)) return;   // næste loop(): sendte dele frigiver blokke
+    if (n == 0) {
+      _cfgOut = false;
+    } else {
+      _cfgOutOff += n;
+      _cfgOutPart++;
+    }
+  }
+}
+#endif
+
+void BleLink::onRegisterWrite(RegCb cb) { _regCb = std::move(cb); }
+
+bool BleLink::_handleRegs(const char* op, const JsonDocument& doc) {
+  JsonDocument r;
+  uint64_t changed = 0;
+  if (strcmp(op, "reg_r") == 0) {
+    r["_bl"] = "reg";
+    _regs.read(doc["ids"].as<JsonArrayConst>(), r["v"].to<JsonObject>());
+  } else if (strcmp(op, "reg_w") == 0) {
+    r["_bl"] = "reg_wack";
+    changed = _regs.write(doc["v"].as<JsonObjectConst>(), r["ok"].to<JsonArray>(),
+                          r["err"].to<JsonArray>(), r["v"].to<JsonObject>());
+  } else {
+    return false;
+  }
+  sendJson(r);
+  for (uint8_t id = 0; changed && id < BleLinkRegs::kMax; ++id) {
+    if ((changed >> id) & 1ULL && _regCb) _regCb(id);
+  }
+  return true;
+}
+
+// Push appens registerændringer samlet; ved fuld kø prøves igen senere
+void BleLink::_pumpRegs() {
+  if (!g_connected || millis() - _regLast < BL_REG_NOTIFY_MS) return;
+  uint64_t dirty = _regs.takeDirty();
+  if (!dirty) return;
+  _regLast = millis();
+
+  JsonDocument r;
+  r["_bl"] = "reg_n";
+  JsonObject v = r["v"].to<JsonObject>();
+  for (uint8_t id = 0; id < BleLinkRegs::kMax; ++id) {
+    if ((dirty >> id) & 1ULL) _regs.put(id, v);
+  }
+  if (!_trySendJson(r, 0)) _regs.markDirty(dirty);
+}
+
+#if BLELINK_ENABLE_OTA
+void BleLink::setOtaFlash(BleLinkOtaFlash* flash, bool allowPlain) {
+  _ota.setFlash(flash);
+  _otaPlain = allowPlain;
+  if (flash && !g_otaTask) {
+    xTaskCreate(otaWriter, "bl_ota", BL_OTA_STACK, &_ota, BL_OTA_PRIO, &g_otaTask);
+  }
+}
+
+// Billedbytes, RX-køen kan rumme i frames á én write (MTU - 3), så
+// kreditten til værten ikke overstiger køen (frames ligger der til loop())
+uint32_t BleLink::_otaRxRoom() const {
+  size_t mtu  = g_mtu ? g_mtu : 23;
+  size_t over = kFrameHeader + (_crypto.active() ? kFrameHeader + BleLinkCrypto::kOverhead : 0);
+  if (mtu - 3 <= over + 4) return 0;
+  size_t unit = mtu - 3 - over;        // indre frame: [offset u32][data]
+  return (uint32_t)(_rxq.room(BleLinkRxQueue::kNormal, unit) / unit * (unit - 4));
+}
+
+// Kontrol af firmwareopdateringen; data kommer som frames (kFrameOta)
+void BleLink::_handleOta(const char* op, const JsonDocument& doc) {
+  if (strcmp(op, "ota_begin") == 0) {
+    // Et billede bestemmer, hvad enheden kører: kun over en krypteret session,
+    // medmindre appen udtrykkeligt har tilladt klartekst
+    if (!_crypto.active() && !_otaPlain) return _ota.refuse("insecure");
+    _ota.start(doc["size"] | (uint32_t)0, doc["sha"] | "", millis());
+  } else if (strcmp(op, "ota_status") == 0) {
+    _ota.status();
+  } else if (strcmp(op, "ota_apply") == 0) {
+    if (_ota.apply()) _otaRestartAt = millis() + BL_OTA_RESTART_MS;
+  } else if (strcmp(op, "ota_abort") == 0) {
+    _ota.cancel();
+  }
+}
+#endif
+
+#if BLELINK_ENABLE_HISTORY
+// Range-forespørgsler på historikken; svaret streames fra _pumpHistory()
+void BleLink::_handleHistory(const char* op, const JsonDocument& doc) {
+  if (strcmp(op, "hist") == 0) {
+    _hist.query(doc["id"] | (uint16_t)0, doc["from"] | (uint32_t)0,
+                doc["to"] | BleLinkHistory::kNoLimit, doc["max"] | (uint32_t)0,
+                doc["cur"] | BleLinkHistory::kNoLimit);
+    if (!_hist.active()) {             // ingen ring (begin() ikke kaldt): tomt svar
+      _histEnd    = _hist.finish();
+      _histEndDue = true;
+    }
+  } else if (strcmp(op, "hist_cancel") == 0) {
+    _hist.cancel(doc["id"] | (uint16_t)0);
+  } else if (strcmp(op, "hist_info") == 0) {
+    JsonDocument r;
+    r["_bl"] = "hist_info";
+    r["n"]   = (uint32_t)_hist.size();
+    r["cap"] = (uint32_t)_hist.capacity();
+    r["rec"] = _hist.recSize();
+    r["seq"] = _hist.firstSeq();
+    r["end"] = _hist.endSeq();
+    if (_hist.size() > 0) {
+      r["t0"] = _hist.timeAt(_hist.firstSeq());
+      r["t1"] = _hist.timeAt(_hist.endSeq() - 1);
+    }
+    sendJson(r);
+  }
+}
+
+// Historik-svar på bulk-kanalen (sidste kanal): højst BL_HIST_INFLIGHT frames
+// i kø ad gangen, så linket holdes fuldt, uden at en hel side fylder puljen
+// og køen foran appens egen trafik. hist_end følger efter sidste frame.
+void BleLink::_pumpHistory() {
+  const uint8_t ch = kTxChannels - 1;
+  while (_hist.active() && g_connected && _txq.stats(ch).depth < BL_HIST_INFLIGHT) {
+    size_t   cap = 0;
+    char*    buf = _tryAcquireTx(kFrameHeader + BL_HIST_FRAME, &cap);
+    if (!buf) return;                  // næste loop(): sendte frames frigiver blokke
+    if (cap > kFrameHeader + BL_HIST_FRAME) cap = kFrameHeader + BL_HIST_FRAME;   // større blok: samme frame
+    uint8_t* p = (uint8_t*)buf + kFrameHeader;
+    size_t   n = _hist.fill(p, cap - kFrameHeader);
+    if (n == 0) {
+      _pool.release(buf);
+      _histEnd    = _hist.finish();
+      _histEndDue = true;
+      break;
+    }
+    _endFrame(ch, kFrameHist, p, n);   // tabt frame: værten ser hullet i seq
+  }
+  if (!_histEndDue || !g_connected) return;
+
+  JsonDocument r;
+  r["_bl"]  = "hist_end";
+  r["id"]   = _histEnd.id;
+  r["n"]    = _histEnd.n;
+  r["next"] = _histEnd.next;
+  r["more"] = _histEnd.more;
+  r["lost"] = _histEnd.lost;
+  if (_histEnd.cancelled) r["cancelled"] = true;
+  if (_trySendJson(r, ch)) _histEndDue = false;
+}
+#endif
+
+void BleLink::_sendTestResult(const BleLinkTest::Result& res) {
+  JsonDocument r;
+  r["_bl"]   = "test_done";
+  r["mode"]  = BleLinkTest::modeName(res.mode);
+  r["lines"] = res.lines;
+  r["bytes"] = res.bytes;
+  r["lost"]  = res.lost;
+  r["crc"]   = res.crc;
+  r["ms"]    = res.ms;
+  sendJson(r);
+}
+
+// Send færdig linje (inkl. '\n') via puljen; false = ingen buffer lige nu
+bool BleLink::_sendBytes(const char* s, size_t len) {
+  if (!g_connected) return false;
+  char* buf = _pool.acquire(len + 1);
+  if (!buf) return false;
+  memcpy(buf, s, len);
+  buf[len] = '\0';
+  return _enqueueTx(0, buf, len, false);  // fuld kø -> prøv igen senere
+}
+
+#if BLELINK_ENABLE_JSON
+// Udfør forfaldne planlagte kommandoer og send rapporterne i én besked
+void BleLink::_pollSchedule() {
+  if (_sched.size() == 0) return;
+  BleLinkSchedule::Report rep[16];
+  size_t n = _sched.poll(millis(), [this](const JsonDocument& cmd){
+                           BleLinkMessage m(cmd);
+                           _emitLine(m);
+                         },
+                         rep, sizeof(rep) / sizeof(rep[0]));
+  if (n == 0) return;
+
+  JsonDocument r;
+  r["_bl"] = "sched_done";
+  JsonArray arr = r["r"].to<JsonArray>();
+  for (size_t i = 0; i < n; ++i) {
+    JsonArray e = arr.add<JsonArray>();
+    e.add(rep[i].id);
+    e.add(rep[i].lateMs);
+  }
+  sendJson(r);
+}
+#endif
+
+// Med broadcast: adv = flags + manufacturer data, scan response = navn.
+// (Service-UUID'en er ikke plads til; Python finder enheden på navnet.)
+void BleLink::_applyAdvertising() {
+  if (!_bcCb) return;
+  uint8_t pkt[5 + kBroadcastMax];
+  pkt[0] = BL_BC_COMPANY_ID & 0xFF;
+  pkt[1] = BL_BC_COMPANY_ID >> 8;
+  pkt[2] = BL_BC_MAGIC;
+  pkt[3] = _bcVersion;
+  pkt[4] = _bcSeq;
+  size_t n = _bcCb(pkt + 5, kBroadcastMax);
+  if (n > kBroadcastMax) n = kBroadcastMax;
+
+  NimBLEAdvertisementData advData;
+  advData.setFlags(BL_ADV_FLAGS);
+  advData.setManufacturerData(std::string((const char*)pkt, 5 + n));
+
+  NimBLEAdvertisementData scanData;
+  scanData.setName(_name);
+
+  NimBLEAdvertising* adv = NimBLEDevice::getAdvertising();
+  adv->setAdvertisementData(advData);
+  adv->setScanResponseData(scanData);
+}
+
+// Læg færdig linje i kanalens kø. Ved fuld kø afgør _policy (hvis mayBlock)
+// om vi selv tømmer køerne og prøver igen, eller dropper. Ejer buf bagefter.
+bool BleLink::_enqueueTx(uint8_t ch, char* buf, size_t len, bool mayBlock) {
+  if (ch >= kTxChannels) ch = kTxChannels - 1;
+  bool ok = _txq.push(ch, buf, (uint16_t)len, millis());
+  if (!ok && mayBlock && _policy == SendPolicy::Block) {
+    uint32_t t0 = millis();
+    while (!ok && g_connected && millis() - t0 < _blockTimeoutMs) {
+      _pumpTx(false);
+      if (!(ok = _txq.push(ch, buf, (uint16_t)len, millis()))) delay(1);
+    }
+  }
+  if (!ok) {
+    _pool.release(buf);
+    if (mayBlock) {
+      _txq.noteDrop(ch);
+      _txDropped++;
+    }
+    return false;
+  }
+  _pumpTx(false);
+  return true;
+}
+
+// Send fra køerne i DRR-orden. Kun én task ad gangen (try-lock: er en anden
+// i gang, sender den også vores). drain=false: højst én linje pr. kanal.
+void BleLink::_pumpTx(bool drain) {
+  if (!g_connected || !_txLock) return;
+  if (_crypto.enabled() && !_crypto.active()) return;   // intet i klartekst før handshake
+  if (g_awaitHello) return;                             // genoptag/ny session afgøres først
+  if (xSemaphoreTake(_txLock, 0) != pdTRUE) return;
+  BleLinkTxSched::Item it;
+  size_t n = 0;
+  while ((drain || n < kTxChannels) && g_connected && _txq.pop(millis(), it)) {
+    _sendUnit(it.buf, it.len);
+    // Bufferen bliver i sessionens vindue; den ældste frigives
+    if (char* old = _sess.retain(it.buf, it.len)) _pool.release(old);
+    n++;
+  }
+  xSemaphoreGive(_txLock);
+}
+
+// Ikke-blokerende sendJson (til baggrundstrafik som log): false = prøv senere
+bool BleLink::_trySendJson(const JsonDocument& doc, uint8_t ch) {
+  if (!g_connected) return false;
+  size_t cap = 0;
+  size_t len = measureJson(doc);
+  char*  buf = _pool.acquire(len + 2, &cap);
+  if (!buf) return false;
+  len = serializeJson(doc, buf, cap - 1);
+  buf[len++] = '\n';
+  buf[len]   = '\0';
+  return _enqueueTx(ch, buf, len, false);
+}
+
+#if BLELINK_ENABLE_LOG
+static const char* logLevelName(char level) {
+  switch (level) {
+    case 'E': return "E";
+    case 'W': return "W";
+    case 'I': return "I";
+    case 'D': return "D";
+    default:  return "?";
+  }
+}
+
+static void buildLogFrame(JsonDocument& r, const BleLinkLog::Entry* e, size_t n, uint32_t dropped) {
+  r.clear();
+  r["_bl"] = "log";
+  r["d"]   = dropped;
+  JsonArray arr = r["e"].to<JsonArray>();
+  for (size_t i = 0; i < n; ++i) {
+    JsonArray x = arr.add<JsonArray>();
+    x.add(e[i].ms);
+    x.add(logLevelName(e[i].level));
+    x.add((const char*)e[i].text);     // e lever til efter serialiseringen
+  }
+}
+
+// Log-frames sendes kun på et ellers tomt link (laveste prioritet).
+// Fylder en batch mere end en slab (escapede tegn), halveres den, til den
+// passer; en enkelt linje, der stadig ikke passer, afkortes. Ellers ville
+// samme batch fejle ved hvert loop(), og loggen gå i stå.
+void BleLink::_pumpLog() {
+  if (!g_connected || _txq.depth() > 0) return;
+  size_t pending = _log.size();
+  if (pending == 0) return;
+  if (pending < BL_LOG_BATCH && millis() - _log.oldestMs() < BL_LOG_FLUSH_MS) return;
+
+  BleLinkLog::Entry e[BL_LOG_BATCH];
+  uint32_t dropped = 0;
+  size_t   n = _log.peek(e, BL_LOG_BATCH, &dropped);
+
+  JsonDocument r;
+  buildLogFrame(r, e, n, dropped);
+  while (measureJson(r) + 2 > BleLinkPool::maxSize()) {
+    if (n > 1) {
+      n /= 2;
+    } else {
+      size_t len = strlen(e[0].text);
+      if (len == 0) return;            // kan ikke ske med kText < maxSize()
+      e[0].text[len / 2] = '\0';
+    }
+    buildLogFrame(r, e, n, dropped);
+  }
+  if (_trySendJson(r, kTxChannels - 1)) _log.consume(n, dropped);
+}
+
+void BleLink::log(char level, const char* fmt, ...) {
+  char text[BleLinkLog::kText];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(text, sizeof(text), fmt, ap);
+  va_end(ap);
+  _log.push(level, text, millis());
+}
+#endif
+
+void BleLink::_clearTx() {
+  _txq.clear(releaseToPool, &_pool);
+  _sess.reclaim(releaseToPool, &_pool);
+}
+
+// --- RX-køer (BleLinkRxQueue) ---
+
+// Fra NimBLE-tasken: handshakes straks, resten i køen for sin prioritet.
+// Kun enheder, der kom i køen, tælles til sessionen (værten gensender fra rx).
+void BleLink::_queueLine(BleLinkMessage& m) {
+  if (isHandshake(m)) {
+    _emitLine(m);
+    return;
+  }
+  const uint8_t* p = (const uint8_t*)m.raw();
+  size_t skip = 0;
+  BleLinkRxQueue::Prio pr = BleLinkRxQueue::classify(true, p, m.length(), &skip);
+  if (_pushRx(pr, BleLinkRxQueue::kLine, p + skip, m.length() - skip)) _sess.noteRx();
+}
+
+void BleLink::_queueFrame(uint8_t type, const uint8_t* p, size_t n) {
+  size_t skip = 0;
+  if (_pushRx(BleLinkRxQueue::classify(false, p, n, &skip), type, p, n)) _sess.noteRx();
+}
+
+// Fuld kø: NimBLE-tasken venter på loop() (imens venter værtens write-svar,
+// så værten sænker farten). Først efter BL_RX_WAIT_MS droppes enheden; det
+// tælles og meldes til værten fra loop() (_reportRxDrops).
+bool BleLink::_pushRx(BleLinkRxQueue::Prio pr, uint8_t kind, const uint8_t* p, size_t n) {
+  uint32_t t0 = millis();
+  while (!_rxq.push(pr, kind, p, n, micros())) {
+    if (!g_connected || millis() - t0 >= BL_RX_WAIT_MS) {
+      _rxq.noteDrop(pr);
+      _rxLost++;
+      return false;
+    }
+    delay(1);
+  }
+  return true;
+}
+
+// {"_bl":"rx_drop","n":<tabt i alt>,"rx":<enheder modtaget>}
+void BleLink::_reportRxDrops() {
+  uint32_t lost = _rxLost;
+  if (lost == _rxLostSent || !g_connected || g_awaitHello) return;
+  JsonDocument r;
+  r["_bl"] = "rx_drop";
+  r["n"]   = lost;
+  r["rx"]  = _sess.rxSeq();
+  if (_trySendJson(r, 0)) _rxLostSent = lost;
+}
+
+// Dispatch fra loop(), højeste prioritet først (front() ser efter høj
+// prioritet før hver enhed). Høj prioritet tømmes altid; normal højst
+// BL_RX_BUDGET_US pr. loop(), resten venter til næste.
+void BleLink::_pumpRx() {
+  uint32_t t0 = micros();
+  BleLinkRxQueue::Unit u;
+  while (_rxq.front(u)) {
+    uint32_t now = micros();
+    if (u.prio != BleLinkRxQueue::kHigh && now - t0 >= BL_RX_BUDGET_US) break;
+    uint32_t c0 = ESP.getCycleCount();
+    if (u.kind == BleLinkRxQueue::kLine) {
+      BleLinkMessage m((const char*)u.data, u.len);
+      _emitLine(m);
+    } else {
+      _emitFrame(u.kind, u.data, u.len);
+    }
+    uint32_t cyc = ESP.getCycleCount() - c0;   // inkl. appens handler
+    _rxCycles = _rxCycles ? (_rxCycles * 7 + cyc) / 8 : cyc;
+    _rxq.pop(u, now);
+  }
+}
+
+// --- forbindelsesparametre (BleLinkConnPolicy) ---
+
+void BleLink::enableConnPolicy(bool on, const BleLinkConnPolicy::Config& cfg) {
+  _cp.setConfig(cfg);
+  _cp.reset(millis());
+  _cpOn       = on;
+  _cpConnects = g_connects;
+}
+
+// Sample kødybder og rater; beder centralen om nye parametre, når politikken
+// skifter tilstand. Anmodningen kan afvises — så bliver centralens valg stående.
+void BleLink::_pollConnPolicy() {
+  if (!_cpOn || !g_connected || millis() - _cpLast < BL_CP_SAMPLE_MS) return;
+  uint32_t now = millis();
+  uint32_t dt  = now - _cpLast;
+  uint32_t tx = _txBytes, rx = g_rxBytes;
+  _cpLast = now;
+  if (_cpConnects != g_connects) {     // ny forbindelse: start forfra
+    _cpConnects = g_connects;
+    _cp.reset(now);
+    _cpTxBytes = tx;
+    _cpRxBytes = rx;
+    return;
+  }
+  BleLinkConnPolicy::Sample s;
+  s.nowMs   = now;
+  s.txDepth = (uint16_t)_txq.depth();
+  s.rxDepth = (uint16_t)_rxq.depth();
+  s.txBps   = (tx - _cpTxBytes) * 1000 / dt;
+  s.rxBps   = (rx - _cpRxBytes) * 1000 / dt;
+  _cpTxBytes = tx;
+  _cpRxBytes = rx;
+  if (!_cp.update(s) || !g_server || g_connHandle == BL_NO_CONN) return;
+  const BleLinkConnPolicy::Params& p = _cp.params();
+  g_server->updateConnParams(g_connHandle, p.minInterval, p.maxInterval, p.latency, p.timeout);
+}
+
+// --- sessioner (BleLinkSession) ---
+
+// Enhed fra værten (handshakes tæller ikke). Sender værten andet før
+// hello, kender den ikke sessioner: TX slippes fri med det samme.
+void BleLink::_rxUnit(BleLinkMessage* m) {
+  if (m && isHandshake(*m)) return;
+  if (g_awaitHello) _noHello();
+}
+
+// Genoptag, hvis værten har sessionens token og vinduet rækker tilbage til
+// det, værten mangler; ellers ny session. Svar og gensendelse går ud under
+// TX-låsen, før køerne slippes fri.
+void BleLink::_handleHello(const JsonDocument& doc) {
+  if (!_txLock || xSemaphoreTake(_txLock, pdMS_TO_TICKS(200)) != pdTRUE) return;
+  uint32_t hostRx  = doc["rx"] | (uint32_t)0;
+  bool     resumed = _resumable && _sess.matches(doc["tok"] | "") && _sess.canResume(hostRx);
+  if (resumed) {
+    _sess.noteResumed();
+  } else {
+    if (_resumable) _clearTx();        // den gamle sessions rester
+    _sess.fresh(releaseToPool, &_pool);
+  }
+  _resumable = false;
+
+  JsonDocument r;
+  r["_bl"]     = "hello";
+  r["tok"]     = _sess.token();
+  r["resumed"] = resumed;
+  r["rx"]      = _sess.rxSeq();
+  char   line[96];
+  size_t len = serializeJson(r, line, sizeof(line) - 1);
+  line[len++] = '\n';
+  _sendUnit(line, len);
+  if (resumed) _sess.resend(hostRx, [this](const char* s, size_t n){ _sendUnit(s, n); });
+  g_awaitHello = false;
+  xSemaphoreGive(_txLock);
+  _pumpTx(false);
+}
+
+// Værten sagde ikke hello (i tide): den kender ikke sessioner. Intet
+// genoptages, og vinduets pool-blokke frigives i stedet for at vente på
+// en genoptagelse, der aldrig kommer.
+void BleLink::_noHello() {
+  g_awaitHello = false;
+  if (_resumable) {
+    _endSession();
+    return;
+  }
+  if (!_txLock || xSemaphoreTake(_txLock, pdMS_TO_TICKS(200)) != pdTRUE) return;
+  _sess.reclaim(releaseToPool, &_pool);
+  xSemaphoreGive(_txLock);
+}
+
+// Afbrudt session opgives: køer og vindue ryddes, næste hello giver nyt token
+void BleLink::_endSession() {
+  if (!_txLock || xSemaphoreTake(_txLock, pdMS_TO_TICKS(200)) != pdTRUE) return;
+  _clearTx();
+  _resumable = false;
+  xSemaphoreGive(_txLock);
+#if BLELINK_ENABLE_JSON
+  _cfgOut = false;
+#endif
+#if BLELINK_ENABLE_HISTORY
+  if (_hist.active()) _hist.finish();  // ny vært: spørger igen med sin cursor
+  _histEndDue = false;
+#endif
+}
+
+// Én linje/frame ud på linket, krypteret hvis sessionen er det (under _txLock)
+void BleLink::_sendUnit(const char* s, size_t len) {
+  if (_crypto.active()) _sendSealed(s, len);
+  else                  _sendLine(s, len);
+}
+
+// --- kryptering (BleLinkCrypto) ---
+void BleLink::setPsk(const uint8_t* psk) { _crypto.setKey(psk); }
+
+static void toHex(const uint8_t* p, size_t n, char* out) {
+  static const char* d = "0123456789abcdef";
+  for (size_t i = 0; i < n; ++i) {
+    out[2 * i]     = d[p[i] >> 4];
+    out[2 * i + 1] = d[p[i] & 15];
+  }
+  out[2 * n] = '\0';
+}
+
+static bool fromHex(const char* s, uint8_t* out, size_t n) {
+  if (!s || strlen(s) != 2 * n) return false;
+  for (size_t i = 0; i < 2 * n; ++i) {
+    char c = s[i];
+    int  v = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+           : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    if (v < 0) return false;
+    out[i / 2] = (i & 1) ? (out[i / 2] | v) : (v << 4);
+  }
+  return true;
+}
+
+// Med PSK accepteres kun handshake og krypterede frames i klartekst
+bool BleLink::_plainOk(BleLinkMessage* m) {
+  if (!_crypto.enabled()) return true;
+  const char* op = m && isHandshake(*m) ? m->controlOp() : nullptr;
+  // Klartekst-sec_hello kun før handshaket: midt i en krypteret session
+  // kunne en fremmed ellers skifte nøglen ud under værten
+  if (op && strcmp(op, "sec_hello") == 0 && !_crypto.active()) return true;
+  _secDropped++;
+  return false;
+}
+
+// Handshake: svaret sendes i klartekst under TX-låsen, så intet krypteres
+// med den nye nøgle, før værten har fået svaret. Er låsen optaget (en lang
+// enhed er ved at blive sendt), prøver loop() igen; værten venter på svaret.
+void BleLink::_startSecure(const JsonDocument& doc) {
+  if (!_crypto.enabled()) {
+    JsonDocument r;
+    r["_bl"] = "sec_hello";
+    r["err"] = "off";
+    sendJson(r);
+    return;
+  }
+  _secHnOk    = fromHex(doc["hn"] | "", _secHn, sizeof(_secHn));
+  _secPending = true;
+  _finishSecure(200);
+}
+
+void BleLink::_finishSecure(uint32_t waitMs) {
+  if (!_txLock || xSemaphoreTake(_txLock, pdMS_TO_TICKS(waitMs)) != pdTRUE) return;
+  if (!_secPending) {                  // den anden task nåede det først
+    xSemaphoreGive(_txLock);
+    return;
+  }
+  JsonDocument r;
+  r["_bl"] = "sec_hello";
+  uint8_t dn[BleLinkCrypto::kNonceLen], auth[BleLinkCrypto::kAuthLen];
+  char    dnHex[2 * sizeof(dn) + 1], authHex[2 * sizeof(auth) + 1];
+  if (_secHnOk && _crypto.begin(_secHn, dn, auth)) {
+    toHex(dn, sizeof(dn), dnHex);
+    toHex(auth, sizeof(auth), authHex);
+    r["dn"]   = dnHex;
+    r["auth"] = authHex;
+  } else {
+    r["err"] = "hn";
+  }
+  char   line[128];
+  size_t len = serializeJson(r, line, sizeof(line) - 1);
+  line[len++] = '\n';
+  _sendLine(line, len);
+  _secPending = false;
+  xSemaphoreGive(_txLock);
+}
+
+void BleLink::_openSecure(const uint8_t* p, size_t n) {
+  static uint8_t plain[BL_SEC_MAX];    // kun NimBLE-tasken modtager
+  size_t len = _crypto.open(p, n, plain, sizeof(plain));
+  if (len == 0) return;
+  g_secRxBuf.append((const char*)plain, len);
+  parseUnits(g_secRxBuf,
+             [this](BleLinkMessage& m){ _rxUnit(&m); _queueLine(m); },
+             [this](uint8_t t, const uint8_t* q, size_t k){
+               if (t != kFrameSecure) { _rxUnit(nullptr); _queueFrame(t, q, k); }
+             });
+}
+
+// Kaldes under _txLock (_sendUnit). Enheder over BL_SEC_MAX forsegles i
+// flere frames: modtageren samler klarteksten i én strøm (som g_secRxBuf)
+void BleLink::_sendSealed(const char* s, size_t len) {
+  static uint8_t frame[kFrameHeader + BleLinkCrypto::kOverhead + BL_SEC_MAX];
+  for (size_t off = 0; off < len; off += BL_SEC_MAX) {
+    size_t k = len - off < BL_SEC_MAX ? len - off : BL_SEC_MAX;
+    size_t n = _crypto.seal((const uint8_t*)s + off, k, frame + kFrameHeader, sizeof(frame) - kFrameHeader);
+    if (n == 0) {
+      _txDropped++;
+      return;
+    }
+    frame[0] = BL_FRAME_START;
+    frame[1] = kFrameSecure;
+    frame[2] = n & 0xFF;
+    frame[3] = n >> 8;
+    _sendLine((const char*)frame, kFrameHeader + n);
+  }
+}
+
+// Notifikationer á MTU - 3 (20 før MTU-udvekslingen), uden pause, så længe
+// stakken tager imod. Afviser den (mbufs brugt op), sendes samme stykke igen
+// efter 1, 2, 4 .. BL_NOTIFY_BACKOFF ms; efter BL_NOTIFY_GIVEUP ms opgives resten.
+void BleLink::_sendLine(const char* s, size_t len) {
+  if (!g_connected || !g_tx || !s) return;
+  size_t chunk = g_mtu > BL_NOTIFY_MIN + 3 ? g_mtu - 3 : BL_NOTIFY_MIN;
+  _txMsgs++;
+  _txBytes += len;
+  uint32_t wait = 0, waited = 0;
+  for (size_t i = 0; i < len && g_connected; ) {
+    size_t n = (len - i < chunk) ? (len - i) : chunk;
+    g_notifyRc = 0;
     g_tx->setValue((const uint8_t*)(s + i), n);
     g_tx->notify();
-    delay(2);
+    if (g_notifyRc == 0) {
+      i     += n;
+      wait   = 0;
+      waited = 0;
+      continue;
+    }
+    if (waited >= BL_NOTIFY_GIVEUP) {
+      _txDropped++;                    // værten ser en afkortet enhed og synker igen
+      return;
+    }
+    wait = wait ? (wait * 2 > BL_NOTIFY_BACKOFF ? BL_NOTIFY_BACKOFF : wait * 2) : 1;
+    _txBusy++;
+    delay(wait);
+    waited += wait;
   }
 }
@@ -5,6 +5,32 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <functional>
+#include "BleLinkFeatures.h"
+#include "BleLinkPool.h"
+#include "BleLinkTest.h"
+#include "BleLinkTxSched.h"
+#include "BleLinkRegs.h"
+#if BLELINK_ENABLE_JSON
+#include "BleLinkSchedule.h"
+#include "BleLinkConfig.h"
+#endif
+#if BLELINK_ENABLE_LOG
+#include "BleLinkLog.h"
+#endif
+#if BLELINK_ENABLE_PROTO
+#include "BleLinkProto.h"
+#endif
+#if BLELINK_ENABLE_OTA
+#include "BleLinkOta.h"
+#endif
+#if BLELINK_ENABLE_HISTORY
+#include "BleLinkHistory.h"
+#endif
+#include "BleLinkCrypto.h"
+#include "BleLinkSession.h"
+#include "BleLinkMessage.h"
+#include "BleLinkRxQueue.h"
+#include "BleLinkConnPolicy.h"
 
 /**
  * BleLink — generisk BLE transport over Nordic UART Service (NUS).
@@ -13,15 +39,136 @@
  * Ved modtagelse:
  *   - Er linjen gyldig JSON -> onReceiveJson(doc) kaldes
  *   - Ellers -> onReceiveRaw(line) kaldes
+ *   - Med onReceiveMessage(cb) går alle linjer dertil i stedet, uparsede:
+ *     BleLinkMessage parser først, når cb læser json() (raw() er gratis)
+ *   - Handlerne kaldes fra loop(), ikke fra NimBLE-tasken: modtagne enheder
+ *     lægges i køer pr. prioritet (BleLinkRxQueue) og dispatches højeste
+ *     først. Linjer med '!' foran er høj prioritet ('!' fjernes kun foran
+ *     JSON); alt andet dispatches i modtagerækkefølge. Kun handshakes
+ *     (hello/sec_hello) håndteres straks.
  *
  * Afsendelse:
  *   - sendJson(doc): sender JSON som én linje
  *   - sendRaw(cstr): sender rå tekstlinje som den er (tilføjer '\n' hvis mangler)
+ *
+ * TX-buffere lånes fra en fast slab-pulje (BleLinkPool) — ingen malloc pr. besked.
+ * Beskeder over puljens største blok (2 KB) lånes fra heapen (få ad gangen);
+ * over BleLinkPool::kMaxLen (64 KB) afvises de og tælles i poolStats().tooLarge.
+ * Er puljen udtømt, afgør SendPolicy om beskeden droppes med det samme
+ * eller om der ventes (højst blockTimeoutMs) på en ledig buffer.
+ *
+ * Afsendelse er kø-baseret: hver besked lægges i sin kanals kø
+ * (kTxChannels, default kanal 0), og køerne tømmes efter deficit round
+ * robin (BleLinkTxSched) med vægt pr. kanal og valgfrit bytes/s-loft.
+ * Køerne tømmes fra loop() og opportunistisk fra send-kaldet selv.
+ *
+ * Broadcast (forbindelsesløs): setBroadcast() lægger en lille, versioneret
+ * status-payload i manufacturer-specific advertising data og opdaterer den
+ * periodisk fra loop(). Format (efter company id 0xFFFF):
+ *   [0xB1 magic][version][seq][payload ... højst kBroadcastMax bytes]
+ *
+ * Kontrolbeskeder: JSON-objekter med nøglen "_bl" er reserveret til
+ * biblioteket og når aldrig onReceiveJson. Pt.:
+ *   {"_bl":"time"}                 -> {"_bl":"time","ms":<millis>}  (ur-synk)
+ *   {"_bl":"sched","cmds":[..]}    -> {"_bl":"sched_ack","n":..,"rej":[..]}
+ *   {"_bl":"sched_clear"}
+ *   {"_bl":"batch","m":[..]}       -> hvert element dispatches i rækkefølge, som
+ *                                     var det modtaget alene (streng = linje)
+ *   {"_bl":"stats"}                -> {"_bl":"stats",...} kompakt snapshot af
+ *                                     tællere, kødybder, MTU, heap og loop()-tid
+ *   {"_bl":"test","mode":"source|sink|echo|stop",...}
+ *                                  -> throughput-test (BleLinkTest); resultat i
+ *                                     {"_bl":"test_done",...}
+ *   {"_bl":"hello","tok":..,"rx":N} -> {"_bl":"hello","tok":..,"resumed":..,"rx":M}
+ *                                     sessionsgenoptagelse (BleLinkSession)
+ *
+ * Binære frames: mellem tekstlinjerne kan stå [0x00][type][len u16 LE][payload]
+ * (tekst indeholder aldrig 0x00). Type 0x01 er skema-beskeder ([id][felter],
+ * genereret af python/blgen.py til BleLinkMsgs.h): sendMsg(m) koder direkte
+ * i TX-bufferen, onReceiveMsg(cb) modtager id + felter til decode().
+ * Type 0x02 er protobuf (nanopb, BleLinkProto): sendProto() koder direkte
+ * i TX-bufferen, onProto<T>(type, fields, cb) giver typede handlere.
+ * Type 0x03 er krypteret indhold (AES-CCM, BleLinkCrypto): med setPsk()
+ * sendes og modtages alt — linjer og frames — kun krypteret efter et
+ * handshake ({"_bl":"sec_hello"}), og klartekst fra værten ignoreres.
+ * Type 0x04 er firmwarebilledet under en opdatering ([offset u32][data],
+ * BleLinkOta): med setOtaFlash() kan værten (python/ota.py) sende et nyt
+ * billede ({"_bl":"ota_*"}), som skrives til flash i en task og verificeres
+ * med SHA-256; ota_apply sætter boot-partitionen og genstarter. ota_begin
+ * kræver en krypteret session (setPsk), medmindre setOtaFlash(f, true).
+ * Type 0x05 er svar på en historik-forespørgsel (BleLinkHistory): appen
+ * lægger samples i history(), og værten henter et tidsinterval med
+ * {"_bl":"hist",...}; posterne streames i store frames på en bulk-kanal.
+ *
+ * Konfiguration: et versioneret JSON-dokument (BleLinkConfig), som værten
+ * opdaterer med RFC 7386 merge patches ({"_bl":"cfg_patch",...}); se
+ * BleLinkConfig.h. onConfigChanged() kaldes efter hver ændring.
+ *
+ * Sessioner: efter connect holdes TX tilbage, til værten har sendt
+ * {"_bl":"hello"} (højst BL_HELLO_WAIT_MS). Ved disconnect bevares TX-køerne
+ * og de seneste sendte enheder i BL_RESUME_MS; kommer værten tilbage med
+ * sessionens token, sendes det mistede igen, og køerne fortsætter, hvor de
+ * slap. Ellers (eller efter fristen) startes en ny session med tomme køer.
+ *
+ * Forbindelsesparametre: med enableConnPolicy() følger BleLinkConnPolicy
+ * kødybder og bytes/s og beder centralen om kort interval under bursts og
+ * langt interval + slave latency i tomgang (med hysterese).
+ *
+ * Dele kan fravælges ved compile-time (JSON-API, rå linjer, log, stats,
+ * protobuf); se BleLinkFeatures.h.
+ *
+ * Registerkort: regs() er et typet registerkort (BleLinkRegs) med bulk
+ * læs/skriv fra værten; appens ændringer pushes samlet fra loop().
+ *
+ * Log-kanal: log() lægger linjer i en fast ring (BleLinkLog). De sendes
+ * samlet som {"_bl":"log","d":<tabt>,"e":[[ms,"L","tekst"],..]} på laveste
+ * prioritet — kun når alle TX-køer er tomme. Kan linket ikke følge med,
+ * overskrives ældste linjer, og værten får antallet i "d".
+ * Planlagte kommandoer udføres fra loop() via onReceiveJson, og
+ * udførselsrapporter sendes samlet: {"_bl":"sched_done","r":[[id,lateMs],..]}
  */
 class BleLink {
 public:
+#if BLELINK_ENABLE_JSON
   using JsonCb = std::function<void(const JsonDocument& doc)>;
+  using ConfigCb = std::function<void(const JsonDocument& cfg, uint32_t version)>;
+#endif
+#if BLELINK_ENABLE_RAW
   using RawCb  = std::function<void(const String& line)>;
+#endif
+  using RegCb    = std::function<void(uint8_t id)>;
+  using MsgCb    = std::function<void(uint8_t msgId, const uint8_t* body, size_t len)>;
+  using LineCb   = std::function<void(BleLinkMessage& msg)>;
+  // Fyld buf med status-payload (højst cap bytes); returnér antal bytes
+  using BroadcastCb = std::function<size_t(uint8_t* buf, size_t cap)>;
+
+  struct LinkStats {
+    uint32_t rxMsgs = 0, rxBytes = 0;   // modtagne linjer / bytes
+    uint32_t rxParsed  = 0;             // JSON-parsinger (lazy: <= linjer)
+    uint32_t txMsgs = 0, txBytes = 0;   // sendte linjer / bytes
+    uint32_t txDropped = 0;             // droppet pga. ingen TX-buffer
+    uint32_t txBusy    = 0;             // notify afvist af stakken (fuldt link), sendt igen
+    uint32_t connects  = 0;
+    uint16_t mtu       = 0;             // forhandlet ATT MTU (0 = ukendt)
+    uint32_t loopCount = 0;
+    uint32_t loopAvgUs = 0;             // glidende gennemsnit af loop()-tid
+    uint32_t loopMaxUs = 0;             // max siden sidste {"_bl":"stats"}
+    uint32_t rxCycles  = 0;             // CPU-cykler pr. dispatchet enhed (glidende gennemsnit)
+  };
+
+  static constexpr size_t kBroadcastMax = 21;  // 31 - flags(3) - AD-header(4) - BleLink-header(3)
+
+  static constexpr size_t  kFrameHeader = 4;     // [0x00][type][len u16 LE]
+  static constexpr uint8_t kFrameMsg    = 0x01;  // skema-besked: [id][felter]
+  static constexpr uint8_t kFrameProto  = 0x02;  // protobuf: [type u16 LE][pb]
+  static constexpr uint8_t kFrameSecure = 0x03;  // krypteret: [tæller][ct][tag]
+  static constexpr uint8_t kFrameOta    = 0x04;  // firmwarebillede: [offset u32 LE][data]
+  static constexpr uint8_t kFrameHist   = 0x05;  // historik: [id u16][seq u32][n u16][rec u8][poster]
+
+  enum class SendPolicy : uint8_t {
+    Drop,   // ingen ledig buffer -> beskeden droppes (send returnerer false)
+    Block,  // vent på en ledig buffer, højst blockTimeoutMs
+  };
 
   explicit BleLink(const char* deviceName = "BleLink-Device");
 
@@ -31,23 +178,235 @@ public:
 
   bool isConnected() const;
 
-  // Afsendelse
-  void sendJson(const JsonDocument& doc);
-  void sendRaw(const char* cstr);
+  static constexpr uint8_t kTxChannels = BleLinkTxSched::kChannels;
+
+  // Afsendelse (false = droppet pga. ingen forbindelse, buffer eller køplads)
+  bool sendJson(const JsonDocument& doc, uint8_t channel = 0);
+  bool sendRaw(const char* cstr, uint8_t channel = 0);
+  bool sendFrame(uint8_t type, const void* payload, size_t len, uint8_t channel = 0);
+
+  // Skema-besked (BleLinkMsgs.h): kodes direkte i TX-bufferen, ingen JSON
+  template <class M>
+  bool sendMsg(const M& m, uint8_t channel = 0) {
+    size_t room = 0;
+    uint8_t* p = _beginFrame(1 + M::kMaxSize, &room);
+    if (!p) return false;
+    p[0] = M::kId;
+    return _endFrame(channel, kFrameMsg, p, 1 + encode(m, p + 1, room - 1));
+  }
+
+#if BLELINK_ENABLE_PROTO
+  // Protobuf (nanopb): fields = Msg_fields, msg = peger på Msg-structen
+  bool sendProto(uint16_t type, const pb_msgdesc_t* fields, const void* msg, uint8_t channel = 0);
+#endif
+
+  void setSendPolicy(SendPolicy policy, uint32_t blockTimeoutMs = 50);
+  void setChannelWeight(uint8_t channel, uint16_t quantumBytes);  // DRR-vægt
+  void setTxRateLimit(uint32_t bytesPerSec);                      // 0 = intet loft
+  BleLinkTxSched::ChannelStats txChannelStats(uint8_t channel) const { return _txq.stats(channel); }
+  BleLinkPool::Stats poolStats() const { return _pool.stats(); }
+  uint32_t txDropped() const { return _txDropped; }
+  LinkStats linkStats() const;
 
   // Modtagelse
+#if BLELINK_ENABLE_JSON
   void onReceiveJson(JsonCb cb);
+#endif
+#if BLELINK_ENABLE_RAW
   void onReceiveRaw(RawCb cb);
+#endif
+  void onReceiveMessage(LineCb cb);  // alle linjer, JSON parses ved behov (erstatter de to ovenfor)
+  void onReceiveMsg(MsgCb cb);      // skema-beskeder (binær frame 0x01)
+
+#if BLELINK_ENABLE_PROTO
+  // Typet protobuf-handler pr. beskedtype (højst BleLinkProto::kHandlers), fx
+  //   onProto<Reading>(1, Reading_fields, [](const Reading& r){ ... });
+  template <class T>
+  bool onProto(uint16_t type, const pb_msgdesc_t* fields, std::function<void(const T&)> cb) {
+    return _proto.on<T>(type, fields, std::move(cb));
+  }
+  BleLinkProto::Stats protoStats() const { return _proto.stats(); }
+#endif
+
+#if BLELINK_ENABLE_JSON
+  // Versioneret konfiguration (opdateres af værten via merge patches)
+  const JsonDocument& config() const { return _cfg.doc(); }
+  uint32_t configVersion() const { return _cfg.version(); }
+  void onConfigChanged(ConfigCb cb);
+#endif
+
+  // Registerkort (id 0..63); onRegisterWrite kaldes for hvert register værten ændrer
+  BleLinkRegs& regs() { return _regs; }
+  void onRegisterWrite(RegCb cb);
+
+  // Log til værten (tabsvillig, laveste prioritet). level: 'E','W','I','D'
+#if BLELINK_ENABLE_LOG
+  void log(char level, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+#else
+  void log(char, const char*, ...) __attribute__((format(printf, 3, 4))) {}
+#endif
+
+  // Kryptering med forhåndsdelt 16-byte nøgle (nullptr = fra); kald før setup()
+  void setPsk(const uint8_t* psk);
+  BleLinkCrypto::Stats cryptoStats() const { return _crypto.stats(); }
+  BleLinkSession::Stats sessionStats() const { return _sess.stats(); }
+  BleLinkRxQueue::Stats rxQueueStats(uint8_t prio) const { return _rxq.stats(prio); }
+
+  // Adaptive forbindelsesparametre (fra = centralens valg bevares)
+  void enableConnPolicy(bool on, const BleLinkConnPolicy::Config& cfg = BleLinkConnPolicy::Config());
+  BleLinkConnPolicy::Mode  connMode() const { return _cp.mode(); }
+  BleLinkConnPolicy::Stats connPolicyStats() const { return _cp.stats(); }
+
+#if BLELINK_ENABLE_OTA
+  // Firmwareopdatering: backend (fx BleLinkOtaEsp); nullptr = afvis ota_begin.
+  // ota_begin afvises uden krypteret session (setPsk), medmindre allowPlain
+  void setOtaFlash(BleLinkOtaFlash* flash, bool allowPlain = false);
+  BleLinkOta::State otaState() const { return _ota.state(); }
+  BleLinkOta::Stats otaStats() const { return _ota.stats(); }
+#endif
+
+#if BLELINK_ENABLE_HISTORY
+  // Historik: history().begin(sizeof(Sample)) i setup(), add(t, &s) pr. sample
+  BleLinkHistory& history() { return _hist; }
+#endif
+
+  // Broadcast: cb kaldes hvert intervalMs; nullptr slår broadcast fra
+  void setBroadcast(uint8_t version, BroadcastCb cb, uint32_t intervalMs = 1000);
 
 private:
   void _initializeBLE();
-  void _sendLine(const char* cstr);
-  void _emitJson(const JsonDocument& doc);
-  void _emitRaw(const String& line);
+  char* _acquireTx(size_t need, size_t* cap);
+  char* _tryAcquireTx(size_t need, size_t* cap);   // blokerer og tæller ikke
+  bool  _enqueueTx(uint8_t ch, char* buf, size_t len, bool mayBlock);
+  void  _pumpTx(bool drain);
+  void  _clearTx();
+  bool  _trySendJson(const JsonDocument& doc, uint8_t ch);
+  uint8_t* _beginFrame(size_t maxPayload, size_t* room);
+  bool     _endFrame(uint8_t ch, uint8_t type, uint8_t* payload, size_t len);
+#if BLELINK_ENABLE_LOG
+  void  _pumpLog();
+#endif
+  void _sendLine(const char* s, size_t len);
+  void _emitLine(BleLinkMessage& m);
+#if BLELINK_ENABLE_JSON
+  void _pollSchedule();
+  bool _handleConfig(const char* op, const JsonDocument& doc);
+  void _pumpConfig();
+#endif
+  void _emitFrame(uint8_t type, const uint8_t* p, size_t n);
+  bool _plainOk(BleLinkMessage* m);
+  void _startSecure(const JsonDocument& doc);
+  void _finishSecure(uint32_t waitMs);
+  void _openSecure(const uint8_t* p, size_t n);
+  void _sendSealed(const char* s, size_t len);
+  void _sendUnit(const char* s, size_t len);
+  void _rxUnit(BleLinkMessage* m);
+  void _queueLine(BleLinkMessage& m);
+  void _queueFrame(uint8_t type, const uint8_t* p, size_t n);
+  bool _pushRx(BleLinkRxQueue::Prio pr, uint8_t kind, const uint8_t* p, size_t n);
+  void _reportRxDrops();
+  void _pumpRx();
+  void _pollConnPolicy();
+  void _handleHello(const JsonDocument& doc);
+  void _endSession();
+  void _noHello();
+  void _applyAdvertising();
+  bool _handleControl(const JsonDocument& doc);
+#if BLELINK_ENABLE_STATS
+  void _sendStats();
+#endif
+  bool _handleRegs(const char* op, const JsonDocument& doc);
+#if BLELINK_ENABLE_OTA
+  void _handleOta(const char* op, const JsonDocument& doc);
+  uint32_t _otaRxRoom() const;
+#endif
+#if BLELINK_ENABLE_HISTORY
+  void _handleHistory(const char* op, const JsonDocument& doc);
+  void _pumpHistory();
+#endif
+  void _pumpRegs();
+  bool _sendBytes(const char* s, size_t len);
+  void _sendTestResult(const BleLinkTest::Result& r);
 
   char   _name[32] = {0};
+#if BLELINK_ENABLE_JSON
   JsonCb _jsonCb   = nullptr;
+#endif
+#if BLELINK_ENABLE_RAW
   RawCb  _rawCb    = nullptr;
+#endif
+  LineCb _lineCb   = nullptr;
+  MsgCb  _msgCb    = nullptr;
+#if BLELINK_ENABLE_PROTO
+  BleLinkProto _proto;
+#endif
+  BleLinkCrypto _crypto;
+  uint32_t      _secDropped = 0;   // klartekst afvist pga. PSK
+  uint8_t       _secHn[BleLinkCrypto::kNonceLen];
+  bool          _secHnOk = false;
+  volatile bool _secPending = false;   // sec_hello-svaret venter på _txLock
+  BleLinkSession _sess;
+  bool          _resumable  = false;   // afbrudt session venter på genoptagelse
+  uint32_t      _lostAt     = 0;
+
+  BleLinkRxQueue _rxq;
+  volatile uint32_t _rxLost     = 0;   // enheder droppet efter BL_RX_WAIT_MS (NimBLE-tasken)
+  uint32_t          _rxLostSent = 0;   // meldt til værten (rx_drop)
+
+  BleLinkConnPolicy _cp;
+  bool          _cpOn       = false;
+  uint32_t      _cpLast     = 0;
+  uint32_t      _cpTxBytes  = 0;
+  uint32_t      _cpRxBytes  = 0;
+  uint32_t      _cpConnects = 0;
+
+  BleLinkPool    _pool;
+  BleLinkTxSched _txq;
+  SemaphoreHandle_t _txLock = nullptr;   // kun én task sender ad gangen
+  SendPolicy  _policy         = SendPolicy::Drop;
+  uint32_t    _blockTimeoutMs = 50;
+  uint32_t    _txDropped      = 0;
+  uint32_t    _txBusy         = 0;
+  uint32_t    _txMsgs         = 0;
+  uint32_t    _txBytes        = 0;
+
+  uint32_t    _loopCount      = 0;
+  uint32_t    _loopAvgUs      = 0;
+  uint32_t    _loopMaxUs      = 0;
+  uint32_t    _rxCycles       = 0;
+
+  BroadcastCb _bcCb         = nullptr;
+  uint8_t     _bcVersion    = 0;
+  uint8_t     _bcSeq        = 0;
+  uint32_t    _bcIntervalMs = 1000;
+  uint32_t    _bcLast       = 0;
+
+  BleLinkTest     _test;
+#if BLELINK_ENABLE_JSON
+  BleLinkSchedule _sched;
+  BleLinkConfig   _cfg;
+  ConfigCb        _cfgCb = nullptr;
+  bool            _cfgOut = false;       // cfg_get streames i dele fra loop()
+  uint32_t        _cfgOutVer  = 0;
+  size_t          _cfgOutOff  = 0;
+  uint16_t        _cfgOutPart = 0;
+#endif
+#if BLELINK_ENABLE_LOG
+  BleLinkLog      _log;
+#endif
+  BleLinkRegs     _regs;
+  RegCb           _regCb = nullptr;
+  uint32_t        _regLast = 0;
+#if BLELINK_ENABLE_OTA
+  BleLinkOta      _ota;
+  uint32_t        _otaRestartAt = 0;   // 0 = ingen genstart planlagt
+  bool            _otaPlain     = false;   // ota_begin også uden krypteret session
+#endif
+#if BLELINK_ENABLE_HISTORY
+  BleLinkHistory  _hist;
+  BleLinkHistory::End _histEnd;
+  bool            _histEndDue = false;   // hist_end venter på en TX-buffer
+#endif
 };
 
 #endif // BLE_LINK_H
@@ -0,0 +1,84 @@
+#include "BleLinkConfig.h"
+
+// Fjernede værdier frigives ikke altid i JsonDocument; kopiér jævnligt
+#define BL_CFG_COMPACT_EVERY 32
+
+bool BleLinkConfig::patch(uint32_t baseVersion, JsonVariantConst p) {
+  if (baseVersion != _version) return false;
+  mergePatch(_doc, p);
+  _version++;
+  if (++_patches >= BL_CFG_COMPACT_EVERY) _compact();
+  return true;
+}
+
+void BleLinkConfig::set(JsonVariantConst doc) {
+  _doc.clear();
+  _doc.set(doc);
+  _version++;
+  _patches = 0;
+}
+
+void BleLinkConfig::mergePatch(JsonDocument& target, JsonVariantConst patch) {
+  if (!patch.is<JsonObjectConst>()) {  // ikke-objekt erstatter hele dokumentet
+    target.set(patch);
+    return;
+  }
+  if (!target.is<JsonObject>()) target.to<JsonObject>();
+  _mergeObject(target.as<JsonObject>(), patch.as<JsonObjectConst>());
+}
+
+void BleLinkConfig::_mergeObject(JsonObject target, JsonObjectConst patch) {
+  for (JsonPairConst kv : patch) {
+    const char*      k = kv.key().c_str();
+    JsonVariantConst v = kv.value();
+    if (v.isNull()) {
+      target.remove(k);                // null = slet nøglen
+    } else if (v.is<JsonObjectConst>()) {
+      JsonObject child = target[k].is<JsonObject>() ? target[k].as<JsonObject>()
+                                                    : target[k].to<JsonObject>();
+      _mergeObject(child, v.as<JsonObjectConst>());
+    } else {
+      target[k] = v;
+    }
+  }
+}
+
+// Writer til serializeJson(): gemmer kun bytes [skip, skip + cap)
+struct SliceWriter {
+  size_t skip;
+  char*  out;
+  size_t cap;
+  size_t n = 0;
+
+  size_t write(uint8_t c) {
+    if (skip > 0)     skip--;
+    else if (n < cap) out[n++] = (char)c;
+    return 1;
+  }
+  size_t write(const uint8_t* p, size_t k) {
+    for (size_t i = 0; i < k; ++i) write(p[i]);
+    return k;
+  }
+};
+
+// Serialiserer hele dokumentet pr. del (ingen buffer til det hele); en byte
+// ekstra viser, om delen klipper et tegn over
+size_t BleLinkConfig::slice(size_t off, char* out, size_t cap) const {
+  if (cap < 8) return 0;
+  SliceWriter w{off, out, cap};
+  serializeJson(_doc, w);
+  size_t n = w.n;
+  if (n == cap) {
+    n = cap - 1;
+    while (n > 0 && ((uint8_t)out[n] & 0xC0) == 0x80) n--;
+  }
+  out[n] = '\0';
+  return n;
+}
+
+void BleLinkConfig::_compact() {
+  JsonDocument fresh;
+  fresh.set(_doc);
+  _doc     = fresh;
+  _patches = 0;
+}
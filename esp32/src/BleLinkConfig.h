@@ -0,0 +1,51 @@
+#ifndef BLE_LINK_CONFIG_H
+#define BLE_LINK_CONFIG_H
+
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+/**
+ * BleLinkConfig — versioneret konfigurationsdokument på enheden.
+ *
+ * Værten sender kun ændringerne som RFC 7386 JSON Merge Patch mod en
+ * kendt version; patchen anvendes in place, og versionen tælles op.
+ * Passer versionen ikke, afvises patchen, og værten laver fuld synk.
+ *
+ *   {"_bl":"cfg_get"}                    -> {"_bl":"cfg","v":..,"doc":{..}}
+ *   {"_bl":"cfg_patch","base":v,"p":{..}} -> {"_bl":"cfg_ack","v":v+1}
+ *                                          | {"_bl":"cfg_nak","v":<aktuel>}
+ *   {"_bl":"cfg_set","doc":{..}}          -> {"_bl":"cfg_ack","v":..}
+ *
+ * Er dokumentet for stort til én besked, sendes det serialiserede dokument
+ * i dele fra loop(), og svaret kommer til sidst uden "doc":
+ *
+ *   {"_bl":"cfg_part","v":v,"i":0,"d":"{\"rate\":.."} ...
+ *   {"_bl":"cfg","v":v,"parts":n}
+ */
+class BleLinkConfig {
+public:
+  // false = base-version passer ikke (intet ændret)
+  bool patch(uint32_t baseVersion, JsonVariantConst p);
+  void set(JsonVariantConst doc);
+
+  const JsonDocument& doc() const { return _doc; }
+
+  // Det serialiserede dokument fra byte off, højst cap - 1 bytes, klippet
+  // på en UTF-8-grænse og NUL-termineret. 0 = intet efter off.
+  size_t slice(size_t off, char* out, size_t cap) const;
+  uint32_t version() const { return _version; }
+
+  // RFC 7386 merge patch af target (bruges også direkte af appen)
+  static void mergePatch(JsonDocument& target, JsonVariantConst patch);
+
+private:
+  static void _mergeObject(JsonObject target, JsonObjectConst patch);
+  void _compact();
+
+  JsonDocument _doc;
+  uint32_t     _version = 0;
+  uint16_t     _patches = 0;    // siden sidste kompaktering
+};
+
+#endif // BLE_LINK_CONFIG_H
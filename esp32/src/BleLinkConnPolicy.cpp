@@ -0,0 +1,45 @@
+#include "BleLinkConnPolicy.h"
+
+void BleLinkConnPolicy::reset(uint32_t nowMs) {
+  _mode       = Mode::Normal;
+  _lastReq    = nowMs;
+  _lastActive = nowMs;
+  _calm       = false;
+}
+
+BleLinkConnPolicy::Mode BleLinkConnPolicy::_target(const Sample& s) {
+  uint32_t depth = (uint32_t)s.txDepth + s.rxDepth;
+  uint32_t bps   = s.txBps + s.rxBps;
+
+  if (depth > 0 || bps >= _cfg.idleBps) _lastActive = s.nowMs;
+  bool calm = depth <= _cfg.calmDepth && bps <= _cfg.calmBps;
+  if (calm && !_calm) _calmSince = s.nowMs;
+  _calm = calm;
+
+  if (depth >= _cfg.burstDepth || bps >= _cfg.burstBps) return Mode::Burst;
+  if (_mode == Mode::Burst && !(calm && s.nowMs - _calmSince >= _cfg.holdMs)) return Mode::Burst;
+  if (s.nowMs - _lastActive >= _cfg.idleMs) return Mode::Idle;   // al trafik vækker
+  return Mode::Normal;
+}
+
+bool BleLinkConnPolicy::update(const Sample& s) {
+  Mode t = _target(s);
+  if (t == _mode) return false;
+  if (s.nowMs - _lastReq < _cfg.minGapMs) {
+    _stats.deferred++;
+    return false;
+  }
+  _mode    = t;
+  _lastReq = s.nowMs;
+  _stats.requests++;
+  _stats.entered[(uint8_t)t]++;
+  return true;
+}
+
+const char* BleLinkConnPolicy::modeName(Mode m) {
+  switch (m) {
+    case Mode::Burst: return "burst";
+    case Mode::Idle:  return "idle";
+    default:          return "normal";
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef BLE_LINK_CONN_POLICY_H
+#define BLE_LINK_CONN_POLICY_H
+
+#pragma once
+#include <stdint.h>
+
+/**
+ * BleLinkConnPolicy — vælger forbindelsesparametre ud fra trafikken.
+ *
+ * Centralen vælger intervallet ved connect; det er enten for langsomt til
+ * bursts eller spilder strøm i tomgang. BleLink giver politikken et sample
+ * (kødybder og bytes/s) med fast mellemrum og beder om nye parametre, når
+ * update() siger til:
+ *
+ *   Burst  — kø eller rate over burst-tærsklen: kort interval, ingen latency
+ *   Normal — mellemting (også straks efter connect)
+ *   Idle   — rate under idleBps i idleMs: langt interval + slave latency
+ *
+ * Hysterese: Burst forlades først, når trafikken har været under de lavere
+ * calm-tærskler i holdMs; Idle kræver idleMs uden trafik. Nye parametre
+ * anmodes højst hver minGapMs (centralen kan afvise for hyppige ønsker).
+ *
+ * Ren beslutningslogik uden Arduino/NimBLE, så den kan oversættes på
+ * værten og fodres med spor (fx fra python/fleet_sim.py).
+ */
+class BleLinkConnPolicy {
+public:
+  enum class Mode : uint8_t { Normal = 0, Burst = 1, Idle = 2 };
+  static constexpr uint8_t kModes = 3;
+
+  // Enheder som i BLE-specifikationen: interval 1,25 ms, timeout 10 ms
+  struct Params {
+    uint16_t minInterval;
+    uint16_t maxInterval;
+    uint16_t latency;      // antal events slaven må springe over
+    uint16_t timeout;      // supervision timeout
+  };
+
+  struct Config {
+    uint16_t burstDepth = 4;       // enheder i TX+RX-kø
+    uint32_t burstBps   = 2000;    // TX+RX bytes/s
+    uint16_t calmDepth  = 1;
+    uint32_t calmBps    = 500;
+    uint32_t idleBps    = 64;      // under dette tæller som tomgang (keepalives o.l.)
+    uint32_t holdMs     = 2000;    // rolig så længe før Burst forlades
+    uint32_t idleMs     = 5000;    // tomgang så længe før Idle
+    uint32_t minGapMs   = 1000;    // mindst mellem to anmodninger
+    Params   params[kModes] = {
+      {  24,  40, 0, 400 },        // Normal: 30-50 ms
+      {   6,  12, 0, 400 },        // Burst: 7,5-15 ms
+      {  80, 160, 4, 600 },        // Idle: 100-200 ms, latency 4, 6 s timeout
+    };
+  };
+
+  struct Sample {
+    uint32_t nowMs   = 0;
+    uint16_t txDepth = 0;
+    uint16_t rxDepth = 0;
+    uint32_t txBps   = 0;
+    uint32_t rxBps   = 0;
+  };
+
+  struct Stats {
+    uint32_t requests = 0;                 // parameteranmodninger i alt
+    uint32_t entered[kModes] = {0};        // skift til hver tilstand
+    uint32_t deferred = 0;                 // skift udskudt af minGapMs
+  };
+
+  void setConfig(const Config& cfg) { _cfg = cfg; }
+  const Config& config() const { return _cfg; }
+
+  // Ny forbindelse: Normal (centralens valg kendes ikke), ingen anmodning
+  void reset(uint32_t nowMs);
+
+  // true = bed om params() nu
+  bool update(const Sample& s);
+
+  Mode          mode() const { return _mode; }
+  const Params& params() const { return _cfg.params[(uint8_t)_mode]; }
+  Stats         stats() const { return _stats; }
+
+  static const char* modeName(Mode m);
+
+private:
+  Mode _target(const Sample& s);
+
+  Config   _cfg;
+  Mode     _mode       = Mode::Normal;
+  uint32_t _lastReq    = 0;
+  uint32_t _lastActive = 0;
+  uint32_t _calmSince  = 0;
+  bool     _calm       = false;
+  Stats    _stats;
+};
+
+#endif // BLE_LINK_CONN_POLICY_H
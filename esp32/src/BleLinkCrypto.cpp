@@ -0,0 +1,100 @@
+#include "BleLinkCrypto.h"
+#include <mbedtls/md.h>
+#include <esp_system.h>
+
+#define BL_DIR_TX 1   // enhed -> vært
+#define BL_DIR_RX 2   // vært -> enhed
+
+static bool hmac(const uint8_t* key, const char* label, const uint8_t* hn,
+                 const uint8_t* dn, uint8_t out[32]) {
+  uint8_t msg[3 + 2 * BleLinkCrypto::kNonceLen];
+  memcpy(msg, label, 3);
+  memcpy(msg + 3, hn, BleLinkCrypto::kNonceLen);
+  memcpy(msg + 3 + BleLinkCrypto::kNonceLen, dn, BleLinkCrypto::kNonceLen);
+  return mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                         key, BleLinkCrypto::kKeyLen, msg, sizeof(msg), out) == 0;
+}
+
+BleLinkCrypto::BleLinkCrypto() {
+  mbedtls_ccm_init(&_tx);
+  mbedtls_ccm_init(&_rx);
+}
+
+BleLinkCrypto::~BleLinkCrypto() {
+  mbedtls_ccm_free(&_tx);
+  mbedtls_ccm_free(&_rx);
+}
+
+void BleLinkCrypto::setKey(const uint8_t psk[kKeyLen]) {
+  end();
+  _hasKey = psk != nullptr;
+  if (psk) memcpy(_psk, psk, kKeyLen);
+  else     memset(_psk, 0, kKeyLen);
+}
+
+bool BleLinkCrypto::begin(const uint8_t hostNonce[kNonceLen], uint8_t devNonce[kNonceLen],
+                          uint8_t auth[kAuthLen]) {
+  end();
+  if (!_hasKey) return false;
+  esp_fill_random(devNonce, kNonceLen);
+
+  uint8_t key[32], mac[32];
+  if (!hmac(_psk, "BLk", hostNonce, devNonce, key) ||
+      !hmac(_psk, "BLa", hostNonce, devNonce, mac)) return false;
+  memcpy(auth, mac, kAuthLen);
+
+  bool ok = mbedtls_ccm_setkey(&_tx, MBEDTLS_CIPHER_ID_AES, key, kKeyLen * 8) == 0 &&
+            mbedtls_ccm_setkey(&_rx, MBEDTLS_CIPHER_ID_AES, key, kKeyLen * 8) == 0;
+  memset(key, 0, sizeof(key));
+  if (!ok) return false;
+  _txCtr  = 0;
+  _rxCtr  = 0;
+  _active = true;
+  _stats.sessions++;
+  return true;
+}
+
+void BleLinkCrypto::end() {
+  _active = false;
+  _txCtr  = 0;
+  _rxCtr  = 0;
+}
+
+size_t BleLinkCrypto::seal(const uint8_t* in, size_t n, uint8_t* out, size_t cap) {
+  if (!_active || cap < n + kOverhead) return 0;
+  uint32_t ctr = ++_txCtr;
+  uint8_t  nonce[13];
+  _nonce(BL_DIR_TX, ctr, nonce);
+  memcpy(out, &ctr, kCtrLen);
+  if (mbedtls_ccm_encrypt_and_tag(&_tx, n, nonce, sizeof(nonce), nullptr, 0,
+                                  in, out + kCtrLen, out + kCtrLen + n, kTagLen) != 0) return 0;
+  _stats.sealed++;
+  return n + kOverhead;
+}
+
+size_t BleLinkCrypto::open(const uint8_t* in, size_t n, uint8_t* out, size_t cap) {
+  if (!_active || n < kOverhead || cap < n - kOverhead) {
+    _stats.rejected++;
+    return 0;
+  }
+  uint32_t ctr;
+  memcpy(&ctr, in, kCtrLen);
+  size_t len = n - kOverhead;
+  uint8_t nonce[13];
+  _nonce(BL_DIR_RX, ctr, nonce);
+  if (ctr <= _rxCtr ||
+      mbedtls_ccm_auth_decrypt(&_rx, len, nonce, sizeof(nonce), nullptr, 0,
+                               in + kCtrLen, out, in + kCtrLen + len, kTagLen) != 0) {
+    _stats.rejected++;
+    return 0;
+  }
+  _rxCtr = ctr;
+  _stats.opened++;
+  return len;
+}
+
+void BleLinkCrypto::_nonce(uint8_t dir, uint32_t ctr, uint8_t out[13]) {
+  memset(out, 0, 13);
+  out[0] = dir;
+  memcpy(out + 1, &ctr, 4);           // little endian
+}
@@ -0,0 +1,74 @@
+#ifndef BLE_LINK_CRYPTO_H
+#define BLE_LINK_CRYPTO_H
+
+#pragma once
+#include <Arduino.h>
+#include <mbedtls/ccm.h>
+
+/**
+ * BleLinkCrypto — valgfri autentificeret kryptering (AES-128-CCM) af
+ * BleLinks trafik med en forhåndsdelt nøgle (PSK), uden BLE-pairing.
+ *
+ * Handshake (klartekst, første besked efter connect):
+ *   {"_bl":"sec_hello","hn":"<8 B hex>"}
+ *     -> {"_bl":"sec_hello","dn":"<8 B hex>","auth":"<8 B hex>"}
+ *   sessionsnøgle = HMAC-SHA256(PSK, "BLk" | hn | dn)[0..15]
+ *   auth          = HMAC-SHA256(PSK, "BLa" | hn | dn)[0..7]   (enheden kender PSK)
+ *
+ * Derefter sendes hver linje/frame krypteret som frame-type 0x03:
+ *   [tæller u32 LE][ciphertext][tag 8 B]
+ *   nonce (13 B) = [retning][tæller u32 LE][0 x 8]; retning 1 = enhed->vært,
+ *   2 = vært->enhed. Tælleren skal stige (afviser replay); nøglen er ny
+ *   for hver session, så nonces genbruges aldrig.
+ *
+ * AES køres via mbedtls, som på ESP32 bruger hardware-acceleratoren.
+ */
+class BleLinkCrypto {
+public:
+  static constexpr size_t kKeyLen   = 16;
+  static constexpr size_t kNonceLen = 8;   // hn / dn
+  static constexpr size_t kAuthLen  = 8;
+  static constexpr size_t kCtrLen   = 4;
+  static constexpr size_t kTagLen   = 8;
+  static constexpr size_t kOverhead = kCtrLen + kTagLen;
+
+  struct Stats {
+    uint32_t sessions = 0;
+    uint32_t sealed   = 0;
+    uint32_t opened   = 0;
+    uint32_t rejected = 0;   // forkert tag, gammel tæller eller for kort
+  };
+
+  BleLinkCrypto();
+  ~BleLinkCrypto();
+
+  void setKey(const uint8_t psk[kKeyLen]);   // nullptr slår kryptering fra
+  bool enabled() const { return _hasKey; }
+  bool active()  const { return _active; }
+
+  // Ny session ud fra værtens nonce; udfylder enhedens nonce og auth
+  bool begin(const uint8_t hostNonce[kNonceLen], uint8_t devNonce[kNonceLen],
+             uint8_t auth[kAuthLen]);
+  void end();
+
+  // in -> [tæller][ct][tag] i out; returnerer længden (0 = fejl/ingen session)
+  size_t seal(const uint8_t* in, size_t n, uint8_t* out, size_t cap);
+  // [tæller][ct][tag] -> klartekst i out; returnerer længden (0 = afvist)
+  size_t open(const uint8_t* in, size_t n, uint8_t* out, size_t cap);
+
+  Stats stats() const { return _stats; }
+
+private:
+  static void _nonce(uint8_t dir, uint32_t ctr, uint8_t out[13]);
+
+  mbedtls_ccm_context _tx;   // seal (TX-task) og open (NimBLE-task) kører
+  mbedtls_ccm_context _rx;   // samtidigt; CCM-konteksten har tilstand
+  uint8_t  _psk[kKeyLen] = {0};
+  bool     _hasKey = false;
+  bool     _active = false;
+  uint32_t _txCtr  = 0;   // seneste sendte (første er 1)
+  uint32_t _rxCtr  = 0;   // seneste accepterede (0 = ingen endnu)
+  Stats    _stats;
+};
+
+#endif // BLE_LINK_CRYPTO_H
@@ -0,0 +1,63 @@
+#ifndef BLE_LINK_FEATURES_H
+#define BLE_LINK_FEATURES_H
+
+#pragma once
+
+/**
+ * BleLinkFeatures — hvad der bygges med (compile-time).
+ *
+ * Alt er slået til som default. En sensorknude, der kun sender rå linjer
+ * eller frames, kan slå dele fra med build_flags (se [env:esp32dev-raw] i
+ * platformio.ini), fx -DBLELINK_ENABLE_JSON=0. Det fjernede findes så ikke
+ * i API'et — brug af det giver en compile-fejl, ikke en tavs no-op.
+ *
+ *   BLELINK_ENABLE_JSON   onReceiveJson, batch-envelopes, planlagte kommandoer
+ *                         og konfiguration (BleLinkConfig). Kontrolprotokollen
+ *                         (hello, sec_hello, time, reg_*) er stadig JSON, så
+ *                         ArduinoJson linkes fortsat, men kun deserialisering
+ *                         af korte kontrolbeskeder.
+ *   BLELINK_ENABLE_RAW    onReceiveRaw (String pr. linje)
+ *   BLELINK_ENABLE_LOG    log() og log-kanalen (log() bliver en tom inline)
+ *   BLELINK_ENABLE_STATS  {"_bl":"stats"}-snapshottet og loop()-tidsmåling
+ *   BLELINK_ENABLE_PROTO  protobuf-frames (nanopb skal så ikke være i lib_deps)
+ *   BLELINK_ENABLE_OTA    firmwareopdatering over linket (BleLinkOta, 2 x 4 KB buffere)
+ *   BLELINK_ENABLE_HISTORY  tidsindekseret historik med range-forespørgsler
+ *                         (BleLinkHistory); ringen på BLELINK_HISTORY_BYTES
+ *                         (default 16 KB) allokeres først i history().begin()
+ *
+ * onReceiveMessage (BleLinkMessage) og binære frames er altid med.
+ */
+
+#ifndef BLELINK_ENABLE_JSON
+#define BLELINK_ENABLE_JSON 1
+#endif
+
+#ifndef BLELINK_ENABLE_RAW
+#define BLELINK_ENABLE_RAW 1
+#endif
+
+#ifndef BLELINK_ENABLE_LOG
+#define BLELINK_ENABLE_LOG 1
+#endif
+
+#ifndef BLELINK_ENABLE_STATS
+#define BLELINK_ENABLE_STATS 1
+#endif
+
+#ifndef BLELINK_ENABLE_PROTO
+#define BLELINK_ENABLE_PROTO 1
+#endif
+
+#ifndef BLELINK_ENABLE_OTA
+#define BLELINK_ENABLE_OTA 1
+#endif
+
+#ifndef BLELINK_ENABLE_HISTORY
+#define BLELINK_ENABLE_HISTORY 1
+#endif
+
+#ifndef BLELINK_HISTORY_BYTES
+#define BLELINK_HISTORY_BYTES 16384
+#endif
+
+#endif // BLE_LINK_FEATURES_H
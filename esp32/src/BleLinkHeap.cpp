@@ -0,0 +1,103 @@
+#include "BleLinkHeap.h"
+
+#ifdef BLELINK_HEAP_TRACE
+#include <esp_heap_caps.h>
+
+// --- instrumenteret allokator (linker --wrap) ---
+static portMUX_TYPE      g_heapMux   = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t g_allocs    = 0;
+static volatile uint32_t g_frees     = 0;
+static volatile uint32_t g_liveBytes = 0;
+static volatile uint32_t g_peakLive  = 0;
+
+extern "C" {
+void* __real_malloc(size_t n);
+void  __real_free(void* p);
+void* __real_calloc(size_t n, size_t sz);
+void* __real_realloc(void* p, size_t n);
+
+static void noteAlloc(void* p) {
+  if (!p) return;
+  size_t n = heap_caps_get_allocated_size(p);
+  portENTER_CRITICAL(&g_heapMux);
+  g_allocs++;
+  g_liveBytes += n;
+  if (g_liveBytes > g_peakLive) g_peakLive = g_liveBytes;
+  portEXIT_CRITICAL(&g_heapMux);
+}
+
+static void noteFree(void* p) {
+  if (!p) return;
+  size_t n = heap_caps_get_allocated_size(p);
+  portENTER_CRITICAL(&g_heapMux);
+  g_frees++;
+  g_liveBytes -= (n <= g_liveBytes) ? n : g_liveBytes;
+  portEXIT_CRITICAL(&g_heapMux);
+}
+
+void* __wrap_malloc(size_t n) {
+  void* p = __real_malloc(n);
+  noteAlloc(p);
+  return p;
+}
+
+void __wrap_free(void* p) {
+  noteFree(p);
+  __real_free(p);
+}
+
+void* __wrap_calloc(size_t n, size_t sz) {
+  void* p = __real_calloc(n, sz);
+  noteAlloc(p);
+  return p;
+}
+
+void* __wrap_realloc(void* p, size_t n) {
+  // realloc = free + malloc i tællingen; realloc(p, 0) er kun free
+  if (p && n == 0) {
+    noteFree(p);
+    return __real_realloc(p, 0);
+  }
+  size_t before = p ? heap_caps_get_allocated_size(p) : 0;
+  void*  q      = __real_realloc(p, n);
+  if (!q) return q;                    // fejlet: p er uændret
+  size_t after  = heap_caps_get_allocated_size(q);
+  portENTER_CRITICAL(&g_heapMux);
+  if (p) g_frees++;
+  g_allocs++;
+  g_liveBytes += after;
+  g_liveBytes -= (before <= g_liveBytes) ? before : g_liveBytes;
+  if (g_liveBytes > g_peakLive) g_peakLive = g_liveBytes;
+  portEXIT_CRITICAL(&g_heapMux);
+  return q;
+}
+} // extern "C"
+#endif // BLELINK_HEAP_TRACE
+
+namespace BleLinkHeap {
+
+BleLinkHeapSnapshot snapshot() {
+  BleLinkHeapSnapshot s;
+  s.freeHeap     = ESP.getFreeHeap();
+  s.minFreeHeap  = ESP.getMinFreeHeap();
+  s.largestBlock = ESP.getMaxAllocHeap();
+#ifdef BLELINK_HEAP_TRACE
+  portENTER_CRITICAL(&g_heapMux);
+  s.allocs    = g_allocs;
+  s.frees     = g_frees;
+  s.liveBytes = g_liveBytes;
+  s.peakLive  = g_peakLive;
+  portEXIT_CRITICAL(&g_heapMux);
+#endif
+  return s;
+}
+
+bool tracing() {
+#ifdef BLELINK_HEAP_TRACE
+  return true;
+#else
+  return false;
+#endif
+}
+
+} // namespace BleLinkHeap
@@ -0,0 +1,32 @@
+#ifndef BLE_LINK_HEAP_H
+#define BLE_LINK_HEAP_H
+
+#pragma once
+#include <Arduino.h>
+
+/**
+ * BleLinkHeap — heap-telemetri til soak-tests.
+ *
+ * Altid tilgængeligt: fri heap, laveste fri heap og største frie blok.
+ * Bygges der med -DBLELINK_HEAP_TRACE og linker-flagene
+ *   -Wl,--wrap=malloc -Wl,--wrap=free -Wl,--wrap=calloc -Wl,--wrap=realloc
+ * (se [env:esp32dev-soak] i platformio.ini), tælles desuden alle
+ * allokeringer, frigivelser samt levende og maksimalt levende bytes.
+ */
+struct BleLinkHeapSnapshot {
+  uint32_t freeHeap     = 0;
+  uint32_t minFreeHeap  = 0;
+  uint32_t largestBlock = 0;
+  // kun med BLELINK_HEAP_TRACE (ellers 0)
+  uint32_t allocs       = 0;
+  uint32_t frees        = 0;
+  uint32_t liveBytes    = 0;
+  uint32_t peakLive     = 0;
+};
+
+namespace BleLinkHeap {
+  BleLinkHeapSnapshot snapshot();
+  bool tracing();   // true hvis bygget med BLELINK_HEAP_TRACE
+}
+
+#endif // BLE_LINK_HEAP_H
@@ -0,0 +1,218 @@
+#include "BleLinkHistory.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Filformat: header, derefter ringens slots som i RAM (slot = seq % cap).
+// crc dækker headeren (med crc = 0) og alle slots.
+static constexpr uint32_t kFileMagic = 0x32484C42;   // "BLH2"
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t rec;
+  uint32_t cap;
+  uint32_t end;
+  uint32_t count;
+  uint32_t last;
+  uint32_t crc;
+};
+
+// CRC-32 (IEEE, bitvis: kun ved sync/load)
+static uint32_t crc32(uint32_t crc, const uint8_t* p, size_t n) {
+  crc = ~crc;
+  while (n--) {
+    crc ^= *p++;
+    for (int k = 0; k < 8; ++k) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static void put16(uint8_t* p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+static void put32(uint8_t* p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(v >> (8 * i)); }
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+BleLinkHistory::~BleLinkHistory() { free(_mem); }
+
+bool BleLinkHistory::begin(uint8_t recSize) {
+  if (recSize == 0 || recSize > kMaxRec) return false;
+  if (!_mem && !(_mem = (uint8_t*)malloc(kBytes))) return false;
+  _rec    = recSize;
+  _cap    = kBytes / _stride();
+  _count  = 0;
+  _end    = 0;
+  _last   = 0;
+  _synced = kNoLimit;
+  _q      = Query();
+  return true;
+}
+
+bool BleLinkHistory::add(uint32_t t, const void* data) {
+  if (_cap == 0) return false;
+  if (_count > 0 && t < _last) {       // binær søgning kræver monoton tid
+    t = _last;
+    _stats.clamped++;
+  }
+  uint8_t* s = _slot(_end);
+  put32(s, t);
+  memcpy(s + 4, data, _rec);
+  _end++;
+  if (_count < _cap) _count++;
+  _last = t;
+  _stats.added++;
+  return true;
+}
+
+uint32_t BleLinkHistory::timeAt(uint32_t seq) const { return get32(_slot(seq)); }
+
+uint32_t BleLinkHistory::lowerBound(uint32_t t) const {
+  uint32_t lo = firstSeq(), hi = _end;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (timeAt(mid) < t) lo = mid + 1;
+    else                 hi = mid;
+  }
+  return lo;
+}
+
+// cursor (fra forrige sides "next") vinder over from: siden fortsætter
+// præcis dér, også når flere poster har samme tid
+void BleLinkHistory::query(uint16_t id, uint32_t from, uint32_t to, uint32_t max, uint32_t cursor) {
+  _q        = Query();
+  _q.active = _cap > 0;
+  _q.id     = id;
+  _q.next   = cursor != kNoLimit ? cursor : lowerBound(from);
+  _q.stop   = _end;                    // et øjebliksbillede: nye poster hører til næste side
+  _q.to     = to;
+  _q.left   = max ? max : kNoLimit;
+  _stats.queries++;
+}
+
+size_t BleLinkHistory::fill(uint8_t* p, size_t cap) {
+  if (!_q.active || cap < kFrameHdr + _stride()) return 0;
+  if (_q.next < firstSeq()) {          // overskrevet, før turen kom til dem
+    _q.lost      += firstSeq() - _q.next;
+    _stats.lost  += firstSeq() - _q.next;
+    _q.next       = firstSeq();
+  }
+
+  uint32_t seq = _q.next;
+  uint16_t n   = 0;
+  uint8_t* d   = p + kFrameHdr;
+  size_t   per = (cap - kFrameHdr) / _stride();
+  while (n < per && seq < _q.stop && _q.left > 0 && timeAt(seq) <= _q.to) {
+    memcpy(d, _slot(seq), _stride());
+    d += _stride();
+    seq++;
+    n++;
+    _q.left--;
+  }
+  if (n == 0) return 0;
+
+  put16(p, _q.id);
+  put32(p + 2, _q.next);
+  put16(p + 6, n);
+  p[8] = _rec;
+  _q.next  = seq;
+  _q.sent += n;
+  _stats.frames++;
+  _stats.records += n;
+  return kFrameHdr + (size_t)n * _stride();
+}
+
+BleLinkHistory::End BleLinkHistory::finish() {
+  End e;
+  e.id        = _q.id;
+  e.n         = _q.sent;
+  e.next      = _q.next < firstSeq() ? firstSeq() : _q.next;
+  e.lost      = _q.lost;
+  e.cancelled = _q.cancelled;
+  // Mere i intervallet: siden var fuld, eller der kom poster til undervejs
+  e.more      = !_q.cancelled && e.next < _end && timeAt(e.next) <= _q.to;
+  _q.active   = false;
+  return e;
+}
+
+bool BleLinkHistory::cancel(uint16_t id) {
+  if (!_q.active || _q.id != id) return false;
+  _q.cancelled = true;
+  _q.left      = 0;                    // fill() giver 0 -> finish()
+  _stats.cancelled++;
+  return true;
+}
+
+// --- persistens ---
+
+bool BleLinkHistory::sync(const char* path) {
+  if (_cap == 0) return false;
+  if (_synced == _end) return true;    // intet nyt
+
+  FileHeader h = { kFileMagic, _rec, (uint32_t)_cap, _end, (uint32_t)_count, _last, 0 };
+  size_t bytes = _cap * _stride();
+  h.crc = crc32(crc32(0, (const uint8_t*)&h, sizeof(h)), _mem, bytes);
+
+  char tmp[96];
+  if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp)) return false;
+  FILE* f = fopen(tmp, "wb");
+  if (!f) return false;
+  bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(_mem, 1, bytes, f) == bytes;
+  ok = fclose(f) == 0 && ok;
+  // rename() erstatter atomart (POSIX, LittleFS); kan filsystemet ikke
+  // erstatte, fjernes den gamle først — load() falder så tilbage på .tmp
+  if (ok && rename(tmp, path) != 0) ok = remove(path) == 0 && rename(tmp, path) == 0;
+  if (!ok) {
+    remove(tmp);
+    return false;
+  }
+  _synced = _end;
+  return true;
+}
+
+bool BleLinkHistory::load(const char* path) {
+  if (_cap == 0) return false;
+  char tmp[96];
+  bool clobbered = false;
+  if (_loadFile(path, &clobbered)) return true;
+  if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) < sizeof(tmp) &&
+      _loadFile(tmp, &clobbered)) return true;
+  if (clobbered) begin(_rec);          // halvt indlæst ring er værre end en tom
+  return false;                        // ellers er ringen urørt
+}
+
+// Filen tjekkes (header, størrelse, CRC) i bidder, før ringen røres: en
+// manglende eller afvist fil efterlader poster, der er lagt til før load().
+// *clobbered = ringen nåede at blive overskrevet (læsefejl i anden runde).
+bool BleLinkHistory::_loadFile(const char* path, bool* clobbered) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  FileHeader h;
+  size_t bytes = _cap * _stride();
+  bool ok = fread(&h, sizeof(h), 1, f) == 1 && h.magic == kFileMagic &&
+            h.rec == _rec && h.cap == _cap && h.count <= _cap;
+  if (ok) {
+    uint32_t crc  = h.crc;
+    h.crc         = 0;
+    uint32_t calc = crc32(0, (const uint8_t*)&h, sizeof(h));
+    uint8_t  chunk[128];
+    for (size_t left = bytes; ok && left > 0; ) {
+      size_t n = left < sizeof(chunk) ? left : sizeof(chunk);
+      ok    = fread(chunk, 1, n, f) == n;
+      calc  = crc32(calc, chunk, n);
+      left -= n;
+    }
+    ok = ok && calc == crc && fseek(f, (long)sizeof(h), SEEK_SET) == 0;
+  }
+  if (ok) {
+    *clobbered = true;
+    ok = fread(_mem, 1, bytes, f) == bytes;
+  }
+  fclose(f);
+  if (!ok) return false;
+  _end    = h.end;
+  _count  = h.count;
+  _last   = h.last;
+  _synced = _end;
+  _q      = Query();
+  return true;
+}
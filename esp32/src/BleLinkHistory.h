@@ -0,0 +1,133 @@
+#ifndef BLE_LINK_HISTORY_H
+#define BLE_LINK_HISTORY_H
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "BleLinkFeatures.h"
+
+/**
+ * BleLinkHistory — tidsindekseret ring af samples med range-forespørgsler.
+ *
+ * Faste poster [t u32][data recSize] i ét array på BLELINK_HISTORY_BYTES, som
+ * allokeres én gang i første begin() — en app uden historik betaler ikke for
+ * ringen, selv om BLELINK_ENABLE_HISTORY er slået til. Den ældste overskrives. Hver post har et løbenummer (seq),
+ * som aldrig genbruges, og tiden må ikke gå baglæns (add() holder den
+ * monoton), så et tidsinterval findes med binær søgning. Tiden er appens
+ * valg: millis() passer til "seneste time" efter et udfald; med persistens
+ * over genstart bør den være absolut (fx unix-sekunder).
+ *
+ * Værten spørger med {"_bl":"hist","id":Q,"from":t0,"to":t1,"max":N[,"cur":seq]};
+ * BleLink streamer svaret som frames af typen kFrameType, så store som
+ * TX-puljen tillader ([id u16][seq u32][n u16][recSize u8] + n poster), og
+ * afslutter med {"_bl":"hist_end","id":Q,"n":..,"next":seq,"more":..,"lost":..}.
+ * "max" er sidestørrelsen: more = true betyder, at værten kan fortsætte med
+ * "cur":next. {"_bl":"hist_cancel","id":Q} stopper en igangværende side.
+ *
+ * Persistens: sync(path) skriver hele ringen med en CRC-32 til "<path>.tmp"
+ * og omdøber den til path, så et strømsvigt midt i en sync efterlader den
+ * forrige fil (eller den nye) hel — aldrig en blanding. load(path) afviser
+ * en fil med forkert CRC og prøver så "<path>.tmp" (omdøbningen nåede ikke
+ * at ske). Findes ingen brugbar fil, er ringen urørt (poster lagt til før
+ * load() bevares). sync() uden nye poster skriver intet.
+ *
+ * Slid på flash: en sync med nye poster skriver hele ringen (kBytes + 28 B)
+ * uanset hvor få der er nye — med 16 KB hvert 10. sekund ca. 140 MB i døgnet.
+ * Kald derfor sync() sjældent, fx hvert 5.-15. minut og før en planlagt
+ * genstart eller deep sleep, ikke efter hver add(). Det, der kom til siden
+ * sidste sync, mistes ved strømsvigt.
+ * Stierne er stdio — på ESP32 fx "/littlefs/hist.bin" efter LittleFS.begin().
+ *
+ * Kun stdint/stdio (ingen Arduino/NimBLE). add() og forespørgslerne skal
+ * kaldes fra samme task som BleLink::loop().
+ */
+class BleLinkHistory {
+public:
+  static constexpr uint8_t  kFrameType = 0x05;
+  static constexpr size_t   kBytes     = BLELINK_HISTORY_BYTES;
+  static constexpr size_t   kMaxRec    = 64;        // største data pr. post
+  static constexpr size_t   kFrameHdr  = 9;         // [id u16][seq u32][n u16][recSize u8]
+  static constexpr uint32_t kNoLimit   = 0xFFFFFFFF;
+
+  struct Stats {
+    uint32_t added     = 0;
+    uint32_t clamped   = 0;     // tid baglæns -> sat til seneste
+    uint32_t queries   = 0;
+    uint32_t frames    = 0;
+    uint32_t records   = 0;     // sendt i alt
+    uint32_t cancelled = 0;
+    uint32_t lost      = 0;     // overskrevet, mens de stod for tur
+  };
+
+  // Resultatet af en afsluttet (eller annulleret) side
+  struct End {
+    uint16_t id        = 0;
+    uint32_t n         = 0;     // poster sendt i siden
+    uint32_t next      = 0;     // cursor til næste side
+    uint32_t lost      = 0;
+    bool     more      = false;
+    bool     cancelled = false;
+  };
+
+  BleLinkHistory() = default;
+  ~BleLinkHistory();
+  BleLinkHistory(const BleLinkHistory&) = delete;
+  BleLinkHistory& operator=(const BleLinkHistory&) = delete;
+
+  // Ny ring med recSize bytes data pr. post (1..kMaxRec); tømmer ringen.
+  // false = ugyldig recSize, eller ringen kunne ikke allokeres
+  bool begin(uint8_t recSize);
+  bool add(uint32_t t, const void* data);
+
+  size_t   size() const      { return _count; }
+  size_t   capacity() const  { return _cap; }
+  uint8_t  recSize() const   { return _rec; }
+  uint32_t firstSeq() const  { return _end - _count; }
+  uint32_t endSeq() const    { return _end; }
+  uint32_t timeAt(uint32_t seq) const;
+  uint32_t lowerBound(uint32_t t) const;   // første seq med tid >= t (endSeq() hvis ingen)
+
+  // Én forespørgsel ad gangen; en ny afløser den gamle
+  void query(uint16_t id, uint32_t from, uint32_t to, uint32_t max, uint32_t cursor = kNoLimit);
+  bool active() const { return _q.active; }
+  uint16_t queryId() const { return _q.id; }
+  // Fyld én frame-payload (højst cap bytes); 0 = siden er færdig -> finish()
+  size_t fill(uint8_t* p, size_t cap);
+  End    finish();
+  bool   cancel(uint16_t id);            // false = ikke den aktive
+
+  bool sync(const char* path);
+  bool load(const char* path);
+
+  Stats stats() const { return _stats; }
+
+private:
+  struct Query {
+    bool     active = false;
+    uint16_t id     = 0;
+    uint32_t next   = 0;        // næste seq
+    uint32_t stop   = 0;        // seq-grænse (ringens ende ved forespørgslen)
+    uint32_t to     = 0;
+    uint32_t left   = 0;        // tilbage i siden
+    uint32_t sent   = 0;
+    uint32_t lost   = 0;
+    bool     cancelled = false;
+  };
+
+  size_t   _stride() const { return 4 + _rec; }
+  uint8_t* _slot(uint32_t seq) { return _mem + (size_t)(seq % _cap) * _stride(); }
+  const uint8_t* _slot(uint32_t seq) const { return _mem + (size_t)(seq % _cap) * _stride(); }
+  bool _loadFile(const char* path, bool* clobbered);
+
+  uint8_t* _mem    = nullptr;     // kBytes, fra første begin()
+  uint8_t  _rec    = 0;
+  size_t   _cap    = 0;
+  size_t   _count  = 0;
+  uint32_t _end    = 0;         // næste seq
+  uint32_t _last   = 0;         // seneste tid
+  uint32_t _synced = kNoLimit;  // _end ved seneste sync() (kNoLimit = aldrig)
+  Query    _q;
+  Stats    _stats;
+};
+
+#endif // BLE_LINK_HISTORY_H
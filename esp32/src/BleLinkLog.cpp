@@ -0,0 +1,53 @@
+#include "BleLinkLog.h"
+
+void BleLinkLog::push(char level, const char* text, uint32_t nowMs) {
+  portENTER_CRITICAL(&_mux);
+  if (_count == kEntries) {            // fuld: overskriv ældste
+    _head = (_head + 1) % kEntries;
+    _count--;
+    _dropped++;
+  }
+  Entry& e = _ring[(_head + _count) % kEntries];
+  e.ms    = nowMs;
+  e.level = level;
+  strncpy(e.text, text ? text : "", kText - 1);
+  e.text[kText - 1] = '\0';
+  _count++;
+  portEXIT_CRITICAL(&_mux);
+}
+
+size_t BleLinkLog::peek(Entry* out, size_t max, uint32_t* dropped) const {
+  portENTER_CRITICAL(&_mux);
+  size_t n = _count < max ? _count : max;
+  for (size_t i = 0; i < n; ++i) out[i] = _ring[(_head + i) % kEntries];
+  if (dropped) *dropped = _dropped;
+  portEXIT_CRITICAL(&_mux);
+  return n;
+}
+
+void BleLinkLog::consume(size_t n, uint32_t droppedSeen) {
+  portENTER_CRITICAL(&_mux);
+  // Overskrevet siden peek() rammer de ældste først, dvs. vores sendte linjer
+  uint32_t lostSince = _dropped - droppedSeen;
+  size_t   ours      = lostSince < n ? lostSince : n;
+  n -= ours;
+  if (n > _count) n = _count;
+  _head    = (_head + n) % kEntries;
+  _count  -= n;
+  _dropped = lostSince - ours;         // kun reelt usendte tab er tilbage
+  portEXIT_CRITICAL(&_mux);
+}
+
+size_t BleLinkLog::size() const {
+  portENTER_CRITICAL(&_mux);
+  size_t n = _count;
+  portEXIT_CRITICAL(&_mux);
+  return n;
+}
+
+uint32_t BleLinkLog::oldestMs() const {
+  portENTER_CRITICAL(&_mux);
+  uint32_t ms = _count ? _ring[_head].ms : 0;
+  portEXIT_CRITICAL(&_mux);
+  return ms;
+}
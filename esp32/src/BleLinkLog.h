@@ -0,0 +1,43 @@
+#ifndef BLE_LINK_LOG_H
+#define BLE_LINK_LOG_H
+
+#pragma once
+#include <Arduino.h>
+
+/**
+ * BleLinkLog — fast ring af log-linjer, der streames til værten.
+ *
+ * Tabsvillig: er ringen fuld, overskrives ældste linje, og antallet af
+ * tabte linjer tælles, så værten får et "N dropped"-resumé i næste frame.
+ * push() kan kaldes fra alle tasks (spinlock), og der bruges ingen heap.
+ */
+class BleLinkLog {
+public:
+  static constexpr size_t kEntries = 32;
+  static constexpr size_t kText    = 96;   // inkl. '\0'
+
+  struct Entry {
+    uint32_t ms;
+    char     level;                        // 'E','W','I','D'
+    char     text[kText];
+  };
+
+  void push(char level, const char* text, uint32_t nowMs);
+
+  // Kopiér op til max ældste linjer (uden at fjerne dem) + drop-tæller
+  size_t peek(Entry* out, size_t max, uint32_t* dropped) const;
+  // Efter vellykket afsendelse: fjern de n linjer og de rapporterede drops
+  void   consume(size_t n, uint32_t droppedSeen);
+
+  size_t   size() const;
+  uint32_t oldestMs() const;
+
+private:
+  Entry    _ring[kEntries];
+  size_t   _head    = 0;
+  size_t   _count   = 0;
+  uint32_t _dropped = 0;
+  mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif // BLE_LINK_LOG_H
@@ -0,0 +1,67 @@
+#include "BleLinkMessage.h"
+
+static volatile uint32_t s_parses = 0;
+
+BleLinkMessage::BleLinkMessage(JsonVariantConst doc) : _state(State::Json) {
+  _doc.set(doc);
+}
+
+const char* BleLinkMessage::raw() {
+  if (!_s) {                            // fra dokument: serialiseres ved behov
+    serializeJson(_doc, _rawBuf);
+    _s = _rawBuf.c_str();
+    _n = _rawBuf.length();
+  }
+  return _s;
+}
+
+size_t BleLinkMessage::length() {
+  raw();
+  return _n;
+}
+
+// Kan linjen overhovedet være JSON? (første tegn efter whitespace)
+static bool mayBeJson(const char* s, size_t n) {
+  size_t i = 0;
+  while (i < n && (s[i] == ' ' || s[i] == '\t' || s[i] == '\r')) i++;
+  if (i == n) return false;
+  char c = s[i];
+  return c == '{' || c == '[' || c == '"' || c == '-' || (c >= '0' && c <= '9') ||
+         c == 't' || c == 'f' || c == 'n';
+}
+
+void BleLinkMessage::_parse() {
+  if (_state != State::Unparsed) return;
+  if (!mayBeJson(_s, _n)) {             // fx "PING": ingen parser
+    _err   = DeserializationError::InvalidInput;
+    _state = State::NotJson;
+    return;
+  }
+  s_parses++;
+  _err   = deserializeJson(_doc, _s, _n);
+  _state = _err ? State::NotJson : State::Json;
+  if (_err) _doc.clear();
+}
+
+bool BleLinkMessage::isJson() {
+  _parse();
+  return _state == State::Json;
+}
+
+JsonDocument& BleLinkMessage::json() {
+  _parse();
+  return _doc;
+}
+
+DeserializationError BleLinkMessage::error() {
+  _parse();
+  return _err;
+}
+
+const char* BleLinkMessage::controlOp() {
+  if (_state == State::Unparsed && !strstr(_s, "\"_bl\"")) return nullptr;
+  if (!isJson()) return nullptr;
+  return _doc["_bl"] | (const char*)nullptr;
+}
+
+uint32_t BleLinkMessage::parses() { return s_parses; }
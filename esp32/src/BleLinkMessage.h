@@ -0,0 +1,52 @@
+#ifndef BLE_LINK_MESSAGE_H
+#define BLE_LINK_MESSAGE_H
+
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+/**
+ * BleLinkMessage — én modtaget linje, der først parses som JSON, når en
+ * handler spørger (isJson()/json()). Den rå linje er altid tilgængelig.
+ *
+ * Linjen ligger i BleLinks RX-kø (ingen kopi) og er kun gyldig under
+ * callbacket; gem raw()/json() selv, hvis de skal bruges bagefter.
+ * Kontrolbeskeder genkendes uden parsing af alt andet: kun linjer, hvor
+ * "_bl" optræder, parses for at se efter nøglen (controlOp()).
+ */
+class BleLinkMessage {
+public:
+  // Linje uden '\n'; line[len] skal være '\0'
+  BleLinkMessage(const char* line, size_t len) : _s(line), _n(len) {}
+  // Allerede parset (batch-elementer, planlagte kommandoer)
+  explicit BleLinkMessage(JsonVariantConst doc);
+
+  BleLinkMessage(const BleLinkMessage&) = delete;
+  BleLinkMessage& operator=(const BleLinkMessage&) = delete;
+
+  const char* raw();                    // NUL-termineret, uden '\n'
+  size_t      length();
+  bool        isJson();                 // parser ved første kald
+  JsonDocument& json();                 // tomt dokument, hvis linjen ikke er JSON
+  DeserializationError error();
+  bool        parsed() const { return _state != State::Unparsed; }
+
+  // Værdien af "_bl" (kontrolbesked) eller nullptr
+  const char* controlOp();
+
+  // Antal JSON-parsinger i alt (til stats: sammenlign med modtagne linjer)
+  static uint32_t parses();
+
+private:
+  enum class State : uint8_t { Unparsed, Json, NotJson };
+  void _parse();
+
+  const char*          _s = nullptr;
+  size_t               _n = 0;
+  State                _state = State::Unparsed;
+  JsonDocument         _doc;
+  DeserializationError _err;
+  String               _rawBuf;         // raw() for et allerede parset dokument
+};
+
+#endif // BLE_LINK_MESSAGE_H
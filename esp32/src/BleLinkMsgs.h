@@ -0,0 +1,227 @@
+// GENERERET af python/blgen.py fra schema/blelink.bls — ret ikke i hånden.
+#ifndef BLE_LINK_MSGS_H
+#define BLE_LINK_MSGS_H
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Skema-beskeder uden ArduinoJson: faste structs og encode/decode mod
+ * det kompakte felt-id-format (se python/blgen.py). Sendes med
+ * BleLink::sendMsg(m) og modtages via BleLink::onReceiveMsg(cb):
+ *
+ *   bleLink.onReceiveMsg([](uint8_t id, const uint8_t* p, size_t n) {
+ *     if (id == blmsg::Echo::kId) { blmsg::Echo m; if (blmsg::decode(m, p, n)) ... }
+ *   });
+ *
+ * encode() returnerer antal bytes (0 = cap for lille; kMaxSize er altid nok).
+ * decode() returnerer false ved afkortet input; felter, der ikke står i
+ * input, beholder deres nuværende værdi.
+ */
+namespace blmsg {
+
+// --- helpers (little endian, som ESP32) ---
+template <typename T>
+inline bool putFix(uint8_t* b, size_t cap, size_t& o, uint8_t tag, T v) {
+  if (o + 1 + sizeof(T) > cap) return false;
+  b[o++] = tag;
+  memcpy(b + o, &v, sizeof(T));
+  o += sizeof(T);
+  return true;
+}
+
+inline bool putLen(uint8_t* b, size_t cap, size_t& o, uint8_t tag, const void* p, size_t n) {
+  if (o + 2 + n > cap) return false;
+  b[o++] = tag;
+  b[o++] = (uint8_t)n;
+  memcpy(b + o, p, n);
+  o += n;
+  return true;
+}
+
+// Næste felt: tag og værdiens placering; false = afkortet input
+inline bool next(const uint8_t* p, size_t n, size_t& o,
+                 uint8_t& tag, const uint8_t*& v, size_t& len) {
+  tag = p[o++];
+  switch (tag & 3) {
+    case 0:  len = 1; break;
+    case 1:  len = 2; break;
+    case 2:  len = 4; break;
+    default: if (o >= n) return false; len = p[o++]; break;
+  }
+  if (o + len > n) return false;
+  v  = p + o;
+  o += len;
+  return true;
+}
+
+template <typename T>
+inline void getFix(T& x, const uint8_t* v) { memcpy(&x, v, sizeof(T)); }
+
+inline void getStr(char* dst, size_t cap, const uint8_t* v, size_t len) {
+  size_t k = len < cap - 1 ? len : cap - 1;
+  memcpy(dst, v, k);
+  dst[k] = '\0';
+}
+
+inline void getBytes(uint8_t* dst, uint8_t& dstLen, size_t cap, const uint8_t* v, size_t len) {
+  size_t k = len < cap ? len : cap;
+  memcpy(dst, v, k);
+  dstLen = (uint8_t)k;
+}
+
+
+// --- Echo ---
+struct Echo {
+  static constexpr uint8_t kId      = 1;
+  static constexpr size_t  kMaxSize = 66;   // kodet, uden besked-id
+  char msg[65] = {0};
+};
+
+inline size_t encode(const Echo& m, uint8_t* b, size_t cap) {
+  size_t o = 0;
+  if (!putLen(b, cap, o, 0x07, m.msg, strnlen(m.msg, 64))) return 0;
+  return o;
+}
+
+inline bool decode(Echo& m, const uint8_t* p, size_t n) {
+  size_t o = 0, len = 0;
+  uint8_t tag = 0;
+  const uint8_t* v = nullptr;
+  while (o < n) {
+    if (!next(p, n, o, tag, v, len)) return false;
+    switch (tag) {
+      case 0x07: getStr(m.msg, sizeof(m.msg), v, len); break;
+      default: break;                    // ukendt felt: spring over
+    }
+  }
+  return true;
+}
+
+// --- EchoReply ---
+struct EchoReply {
+  static constexpr uint8_t kId      = 2;
+  static constexpr size_t  kMaxSize = 84;   // kodet, uden besked-id
+  char from[17] = {0};
+  char echo[65] = {0};
+};
+
+inline size_t encode(const EchoReply& m, uint8_t* b, size_t cap) {
+  size_t o = 0;
+  if (!putLen(b, cap, o, 0x07, m.from, strnlen(m.from, 16))) return 0;
+  if (!putLen(b, cap, o, 0x0B, m.echo, strnlen(m.echo, 64))) return 0;
+  return o;
+}
+
+inline bool decode(EchoReply& m, const uint8_t* p, size_t n) {
+  size_t o = 0, len = 0;
+  uint8_t tag = 0;
+  const uint8_t* v = nullptr;
+  while (o < n) {
+    if (!next(p, n, o, tag, v, len)) return false;
+    switch (tag) {
+      case 0x07: getStr(m.from, sizeof(m.from), v, len); break;
+      case 0x0B: getStr(m.echo, sizeof(m.echo), v, len); break;
+      default: break;                    // ukendt felt: spring over
+    }
+  }
+  return true;
+}
+
+// --- Status ---
+struct Status {
+  static constexpr uint8_t kId      = 3;
+  static constexpr size_t  kMaxSize = 55;   // kodet, uden besked-id
+  uint32_t uptime_ms = 0;
+  char     note[49] = {0};
+};
+
+inline size_t encode(const Status& m, uint8_t* b, size_t cap) {
+  size_t o = 0;
+  if (!putFix(b, cap, o, 0x06, m.uptime_ms)) return 0;
+  if (!putLen(b, cap, o, 0x0B, m.note, strnlen(m.note, 48))) return 0;
+  return o;
+}
+
+inline bool decode(Status& m, const uint8_t* p, size_t n) {
+  size_t o = 0, len = 0;
+  uint8_t tag = 0;
+  const uint8_t* v = nullptr;
+  while (o < n) {
+    if (!next(p, n, o, tag, v, len)) return false;
+    switch (tag) {
+      case 0x06: getFix(m.uptime_ms, v); break;
+      case 0x0B: getStr(m.note, sizeof(m.note), v, len); break;
+      default: break;                    // ukendt felt: spring over
+    }
+  }
+  return true;
+}
+
+// --- Heap ---
+struct Heap {
+  static constexpr uint8_t kId      = 4;
+  static constexpr size_t  kMaxSize = 42;   // kodet, uden besked-id
+  uint32_t free = 0;
+  uint32_t min_free = 0;
+  uint32_t largest = 0;
+  bool     traced = false;
+  uint32_t allocs = 0;
+  uint32_t frees = 0;
+  uint32_t live = 0;
+  uint32_t peak = 0;
+  uint32_t dropped = 0;
+};
+
+inline size_t encode(const Heap& m, uint8_t* b, size_t cap) {
+  size_t o = 0;
+  if (!putFix(b, cap, o, 0x06, m.free)) return 0;
+  if (!putFix(b, cap, o, 0x0A, m.min_free)) return 0;
+  if (!putFix(b, cap, o, 0x0E, m.largest)) return 0;
+  if (!putFix<uint8_t>(b, cap, o, 0x10, m.traced ? 1 : 0)) return 0;
+  if (!putFix(b, cap, o, 0x16, m.allocs)) return 0;
+  if (!putFix(b, cap, o, 0x1A, m.frees)) return 0;
+  if (!putFix(b, cap, o, 0x1E, m.live)) return 0;
+  if (!putFix(b, cap, o, 0x22, m.peak)) return 0;
+  if (!putFix(b, cap, o, 0x26, m.dropped)) return 0;
+  return o;
+}
+
+inline bool decode(Heap& m, const uint8_t* p, size_t n) {
+  size_t o = 0, len = 0;
+  uint8_t tag = 0;
+  const uint8_t* v = nullptr;
+  while (o < n) {
+    if (!next(p, n, o, tag, v, len)) return false;
+    switch (tag) {
+      case 0x06: getFix(m.free, v); break;
+      case 0x0A: getFix(m.min_free, v); break;
+      case 0x0E: getFix(m.largest, v); break;
+      case 0x10: m.traced = *v != 0; break;
+      case 0x16: getFix(m.allocs, v); break;
+      case 0x1A: getFix(m.frees, v); break;
+      case 0x1E: getFix(m.live, v); break;
+      case 0x22: getFix(m.peak, v); break;
+      case 0x26: getFix(m.dropped, v); break;
+      default: break;                    // ukendt felt: spring over
+    }
+  }
+  return true;
+}
+
+// Beskednavn til log/diagnose (nullptr = ukendt id)
+inline const char* name(uint8_t id) {
+  switch (id) {
+    case Echo::kId: return "Echo";
+    case EchoReply::kId: return "EchoReply";
+    case Status::kId: return "Status";
+    case Heap::kId: return "Heap";
+    default: return nullptr;
+  }
+}
+
+} // namespace blmsg
+
+#endif // BLE_LINK_MSGS_H
@@ -0,0 +1,264 @@
+#include "BleLinkOta.h"
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+
+static bool parseSha(const char* hex, uint8_t out[BleLinkOta::kShaLen]) {
+  if (!hex || strlen(hex) != 2 * BleLinkOta::kShaLen) return false;
+  for (size_t i = 0; i < 2 * BleLinkOta::kShaLen; ++i) {
+    char c = hex[i];
+    uint8_t v;
+    if (c >= '0' && c <= '9')      v = c - '0';
+    else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+    else return false;
+    out[i / 2] = (i & 1) ? (out[i / 2] | v) : (v << 4);
+  }
+  return true;
+}
+
+BleLinkOta::BleLinkOta() {
+  mbedtls_md_init(&_md);
+  mbedtls_md_setup(&_md, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0);
+  _reset();
+}
+
+BleLinkOta::~BleLinkOta() { mbedtls_md_free(&_md); }
+
+void BleLinkOta::begin(SendFn send, KickFn kick) {
+  _send = std::move(send);
+  _kick = std::move(kick);
+}
+
+void BleLinkOta::_reset() {
+  for (Buf& b : _buf) {
+    b.len = 0;
+    b.st  = kFree;
+  }
+  _cur     = 1;                        // første _take() giver buffer 0 = første _wr
+  _wr      = 0;
+  _stalled = false;
+  _gapSent = false;
+  _rxOff   = 0;
+  _acked   = 0;
+  _limit   = 0;
+  _wrOff   = 0;
+  _result  = kNone;
+}
+
+void BleLinkOta::start(uint32_t size, const char* shaHex, uint32_t nowMs) {
+  uint8_t sha[kShaLen];
+  if (!_flash) return _reply("failed", "noflash");
+  if (size == 0 || !parseSha(shaHex, sha)) return _reply("failed", "args");
+
+  bool same = size == _size && memcmp(sha, _sha, kShaLen) == 0;
+  if (same && (_state == State::Receiving || _state == State::Verified)) {
+    if (_state == State::Receiving) _stats.resumes++;   // genoptag: værten fortsætter fra "off"
+    _lastRx  = nowMs;
+    _gapSent = false;
+    return status();
+  }
+
+  {
+    std::lock_guard<std::mutex> g(_wlock);
+    if (_state == State::Receiving || _state == State::Verified) _flash->abort();
+    _reset();
+    _size   = size;
+    _lastRx = nowMs;
+    memcpy(_sha, sha, kShaLen);
+    mbedtls_md_starts(&_md);
+    _state = _flash->begin(size) ? State::Receiving : State::Failed;
+    if (_state == State::Receiving) _take(0);
+  }
+  if (_state == State::Failed) return _reply("failed", "flash");
+  status();
+}
+
+void BleLinkOta::status() {
+  if (_state != State::Receiving) return _reply(stateName(_state));
+  char line[112];
+  uint32_t room = _room();
+  int n = snprintf(line, sizeof(line),
+                   "{\"_bl\":\"ota\",\"st\":\"recv\",\"off\":%lu,\"size\":%lu,\"room\":%lu,\"block\":%u}\n",
+                   (unsigned long)_rxOff, (unsigned long)_size, (unsigned long)room, (unsigned)kBlock);
+  if (_send && _send(line, (size_t)n)) _limit = _rxOff + room;
+}
+
+bool BleLinkOta::apply() {
+  if (_state != State::Verified) {
+    _reply(stateName(_state), "state");
+    return false;
+  }
+  bool ok;
+  {
+    std::lock_guard<std::mutex> g(_wlock);
+    ok = _flash->commit();
+    _state = ok ? State::Applied : State::Failed;
+  }
+  _reply(ok ? "applied" : "failed", ok ? nullptr : "commit");
+  return ok;
+}
+
+void BleLinkOta::cancel() {
+  {
+    std::lock_guard<std::mutex> g(_wlock);
+    if (_state == State::Receiving || _state == State::Verified) _flash->abort();
+    _reset();
+    _state = State::Idle;
+  }
+  _reply("idle");
+}
+
+// Billedets bytes kommer i rækkefølge; huller og dubletter efter
+// tilbagespoling håndteres her, så værten bare kan sende igen fra "off".
+void BleLinkOta::onFrame(const uint8_t* p, size_t n, uint32_t nowMs) {
+  if (_state != State::Receiving || n < 4) return;
+  uint32_t off = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+  const uint8_t* d = p + 4;
+  size_t len = n - 4;
+  _stats.frames++;
+  _lastRx = nowMs;
+
+  if (off + len <= _rxOff) {           // allerede modtaget
+    _stats.dups++;
+    return;
+  }
+  if (_stalled) return;                // poll() spoler tilbage, når en buffer er fri
+  if (off > _rxOff) {                  // hul: én tilbagespoling pr. hul
+    if (!_gapSent) {
+      _stats.gaps++;
+      _ack(true);
+    }
+    return;
+  }
+
+  d   += _rxOff - off;                 // delvist overlap: kun det nye
+  len -= _rxOff - off;
+  if (len > _size - _rxOff) len = _size - _rxOff;
+  _gapSent = false;
+
+  while (len > 0) {
+    if (_buf[_cur].st != kFilling && !_take(_rxOff)) {
+      _stalled = true;                 // værten sendte ud over pladsen: resten kasseres
+      _stats.stalls++;
+      break;
+    }
+    Buf&   b = _buf[_cur];
+    size_t k = kBlock - b.len < len ? kBlock - b.len : len;
+    memcpy(b.data + b.len, d, k);
+    b.len        += k;
+    d            += k;
+    len          -= k;
+    _rxOff       += k;
+    _stats.bytes += k;
+    if (b.len == kBlock || _rxOff == _size) _seal();
+  }
+  if (_rxOff - _acked >= kAckBytes || _rxOff == _size) _ack(false);
+}
+
+void BleLinkOta::poll(uint32_t nowMs) {
+  uint8_t r = _result.exchange(kNone);
+  if (r == kOk) {
+    _state = State::Verified;
+    _reply("verified");
+  } else if (r != kNone) {
+    {
+      std::lock_guard<std::mutex> g(_wlock);
+      _flash->abort();
+      _state = State::Failed;
+    }
+    _reply("failed", r == kErrHash ? "hash" : "flash");
+  }
+
+  if (_state != State::Receiving) return;
+  if (_stalled && _take(_rxOff)) {
+    _stalled = false;
+    _ack(true);                        // værten sender igen fra _rxOff
+  } else if (!_stalled && _limit < _size && _rxOff + _room() >= _limit + kAckBytes) {
+    _ack(false);                       // buffer frigivet eller køen tømt: mere kredit
+  }
+  if (nowMs - _lastRx >= kIdleMs) cancel();
+}
+
+bool BleLinkOta::service() {
+  Buf& b = _buf[_wr];
+  if (b.st != kReady) return false;
+  std::lock_guard<std::mutex> g(_wlock);
+  if (b.st != kReady) return false;    // annulleret imens
+
+  auto t0 = std::chrono::steady_clock::now();
+  mbedtls_md_update(&_md, b.data, b.len);
+  bool ok = _flash && _flash->write(b.off, b.data, b.len);
+  _wrOff = b.off + b.len;
+  _stats.blocks++;
+  _stats.flashUs += (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - t0).count();
+  b.len = 0;
+  b.st  = kFree;
+  _wr  ^= 1;
+
+  if (!ok) {
+    _result = kErrFlash;
+  } else if (_wrOff == _size) {
+    uint8_t h[kShaLen];
+    mbedtls_md_finish(&_md, h);
+    _result = memcmp(h, _sha, kShaLen) == 0 ? kOk : kErrHash;
+  }
+  return true;
+}
+
+// --- helpers ---
+
+void BleLinkOta::_seal() {
+  _buf[_cur].st = kReady;
+  if (_kick) _kick();
+  else service();
+}
+
+bool BleLinkOta::_take(uint32_t off) {
+  uint8_t next = _cur ^ 1;
+  if (_buf[next].st != kFree) return false;
+  _cur = next;
+  _buf[next].off = off;
+  _buf[next].len = 0;
+  _buf[next].st  = kFilling;
+  return true;
+}
+
+uint32_t BleLinkOta::_room() const {
+  uint32_t room = _buf[_cur].st == kFilling ? (uint32_t)(kBlock - _buf[_cur].len) : 0;
+  if (_buf[_cur ^ 1].st == kFree) room += kBlock;
+  if (_rxRoom) {
+    uint32_t rx = _rxRoom();
+    if (rx < room) room = rx;
+  }
+  return room;
+}
+
+void BleLinkOta::_ack(bool gap) {
+  char line[64];
+  uint32_t room = _room();
+  int n = snprintf(line, sizeof(line), "{\"_bl\":\"ota_ack\",\"off\":%lu,\"room\":%lu%s}\n",
+                   (unsigned long)_rxOff, (unsigned long)room, gap ? ",\"gap\":1" : "");
+  if (!_send || !_send(line, (size_t)n)) return;   // næste ack dækker (eller værtens timeout)
+  _acked = _rxOff;
+  _limit = _rxOff + room;
+  if (gap) _gapSent = true;
+}
+
+void BleLinkOta::_reply(const char* st, const char* err) {
+  char line[64];
+  int n = err ? snprintf(line, sizeof(line), "{\"_bl\":\"ota\",\"st\":\"%s\",\"err\":\"%s\"}\n", st, err)
+              : snprintf(line, sizeof(line), "{\"_bl\":\"ota\",\"st\":\"%s\"}\n", st);
+  if (_send) _send(line, (size_t)n);
+}
+
+const char* BleLinkOta::stateName(State s) {
+  switch (s) {
+    case State::Receiving: return "recv";
+    case State::Verified:  return "verified";
+    case State::Failed:    return "failed";
+    case State::Applied:   return "applied";
+    default:               return "idle";
+  }
+}
@@ -0,0 +1,164 @@
+#ifndef BLE_LINK_OTA_H
+#define BLE_LINK_OTA_H
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <mbedtls/md.h>
+
+/**
+ * BleLinkOtaFlash — hvor firmwarebilledet skrives hen.
+ *
+ * write() kaldes i rækkefølge med hele blokke (kBlock, sidste kan være
+ * kortere) fra skrive-konteksten, aldrig fra loop(). BleLinkOtaEsp skriver
+ * til den næste OTA-partition; BleLinkOtaFile til en fil, så hele forløbet
+ * kan køres på Linux (examples/ota_native).
+ */
+class BleLinkOtaFlash {
+public:
+  virtual ~BleLinkOtaFlash() {}
+  virtual bool begin(uint32_t size) = 0;                              // ny overførsel
+  virtual bool write(uint32_t offset, const uint8_t* p, size_t n) = 0;
+  virtual bool commit() = 0;                                          // verificeret: boot herfra
+  virtual void abort() = 0;
+};
+
+/**
+ * BleLinkOta — firmwareopdatering over BleLink.
+ *
+ * Værten (python/ota.py) sender billedet som frames af typen kFrameType,
+ * [offset u32 LE][data], med write without response. Data lægges i to
+ * blokbuffere: mens den ene fyldes fra linket, skriver skrive-konteksten
+ * (en task på ESP32, en tråd på Linux) den anden til flash og opdaterer den
+ * løbende SHA-256 — flash-skrivning og modtagelse overlapper.
+ *
+ * Flow control med kredit: {"_bl":"ota_ack","off":N,"room":R} siger, at N
+ * bytes er modtaget i sammenhæng, og at der er plads til R mere i bufferne;
+ * værten sender højst til N + R. Der kvitteres mindst hver kAckBytes, og når
+ * der er blevet mindst kAckBytes mere plads (fx en buffer frigivet).
+ * Med setRxRoom() begrænses R også af, hvad modtagerens kø kan rumme, så
+ * frames i flugten ikke skal vente på plads der (BleLink: RX-køen).
+ *
+ * Hul i offset (tabt frame), eller data ud over pladsen, giver
+ * {"_bl":"ota_ack","off":N,"room":R,"gap":1}: værten spoler tilbage til N. Modtaget
+ * data bevares over et disconnect; ota_begin med samme størrelse og hash
+ * genoptager fra det sammenhængende offset.
+ *
+ *   {"_bl":"ota_begin","size":S,"sha":"<hex>"} -> {"_bl":"ota","st":"recv","off":N,"room":R,..}
+ *   {"_bl":"ota_status"}                       -> {"_bl":"ota","st":..}
+ *   {"_bl":"ota_apply"}                        -> {"_bl":"ota","st":"applied"}
+ *   {"_bl":"ota_abort"}                        -> {"_bl":"ota","st":"idle"}
+ * Når sidste blok er skrevet: {"_bl":"ota","st":"verified"} eller
+ * {"_bl":"ota","st":"failed","err":"hash|flash"}.
+ *
+ * Uden Arduino/NimBLE (kun mbedtls og std): svar sendes som færdige linjer
+ * via SendFn, tid gives udefra, skrive-konteksten vækkes via KickFn.
+ */
+class BleLinkOta {
+public:
+  static constexpr uint8_t  kFrameType = 0x04;
+  static constexpr size_t   kBlock     = 4096;        // flash-sektor; to buffere
+  static constexpr uint32_t kAckBytes  = 1024;
+  static constexpr uint32_t kIdleMs    = 300000;      // afbrudt overførsel opgives efter 5 min
+  static constexpr size_t   kShaLen    = 32;
+
+  enum class State : uint8_t { Idle, Receiving, Verified, Failed, Applied };
+
+  // Linje inkl. '\n'; false = kunne ikke sendes nu (prøv igen senere)
+  using SendFn = std::function<bool(const char* line, size_t len)>;
+  // En blok er klar: kald service() i skrive-konteksten
+  using KickFn = std::function<void()>;
+  // Billedbytes, der kan ligge i kø før onFrame() lige nu
+  using RoomFn = std::function<uint32_t()>;
+
+  struct Stats {
+    uint32_t frames  = 0;
+    uint32_t bytes   = 0;       // accepteret (uden dubletter)
+    uint32_t dups    = 0;       // frames helt før det modtagne (efter tilbagespoling)
+    uint32_t gaps    = 0;       // huller -> tilbagespoling
+    uint32_t stalls  = 0;       // data ud over pladsen -> tilbagespoling
+    uint32_t blocks  = 0;       // skrevet til flash
+    uint32_t flashUs = 0;       // skrivning + hash i skrive-konteksten
+    uint32_t resumes = 0;       // ota_begin midt i en overførsel
+  };
+
+  BleLinkOta();
+  ~BleLinkOta();
+
+  // kick == nullptr: service() kaldes straks (ingen overlap; fx til test)
+  void begin(SendFn send, KickFn kick = nullptr);
+  void setFlash(BleLinkOtaFlash* flash) { _flash = flash; }
+  void setRxRoom(RoomFn room) { _rxRoom = std::move(room); }
+  bool hasFlash() const { return _flash != nullptr; }
+
+  // Kontrol fra loop()
+  void start(uint32_t size, const char* shaHex, uint32_t nowMs);
+  void status();
+  bool apply();                 // true = committet; kalderen genstarter
+  void cancel();
+  // Afvis en kontrolbesked uden at ændre tilstanden: {"_bl":"ota","st":..,"err":err}
+  void refuse(const char* err) { _reply(stateName(_state), err); }
+
+  // Frame kFrameType fra loop()
+  void onFrame(const uint8_t* p, size_t n, uint32_t nowMs);
+  // Fra loop(): svar fra skrive-konteksten, genoptagelse efter stall, frist
+  void poll(uint32_t nowMs);
+
+  // Skrive-konteksten: skriv næste klare blok. false = intet at gøre
+  bool service();
+
+  State    state() const    { return _state; }
+  uint32_t received() const { return _rxOff; }
+  uint32_t size() const     { return _size; }
+  Stats    stats() const    { return _stats; }
+
+  static const char* stateName(State s);
+
+private:
+  enum : uint8_t { kFree, kFilling, kReady };
+  enum : uint8_t { kNone, kOk, kErrHash, kErrFlash };
+
+  struct Buf {
+    uint8_t              data[kBlock];
+    uint32_t             off = 0;      // billedets offset for data[0]
+    size_t               len = 0;
+    std::atomic<uint8_t> st{kFree};
+  };
+
+  void _reset();
+  void _ack(bool gap);
+  void _reply(const char* st, const char* err = nullptr);
+  void _seal();                  // aktuel buffer -> skrive-konteksten
+  bool _take(uint32_t off);      // ny aktuel buffer; false = begge optaget
+  uint32_t _room() const;        // ledig plads efter _rxOff (buffere, evt. RX-køen)
+
+  SendFn            _send;
+  KickFn            _kick;
+  RoomFn            _rxRoom;
+  BleLinkOtaFlash*  _flash = nullptr;
+
+  Buf               _buf[2];
+  uint8_t           _cur    = 0;     // buffer der fyldes (loop)
+  uint8_t           _wr     = 0;     // næste buffer der skrives (skrive-konteksten)
+  bool              _stalled = false;
+  bool              _gapSent = false;
+
+  State             _state  = State::Idle;
+  uint32_t          _size   = 0;
+  uint32_t          _rxOff  = 0;     // sammenhængende modtaget
+  uint32_t          _acked  = 0;
+  uint32_t          _limit  = 0;     // _rxOff + room i seneste kvittering
+  uint32_t          _lastRx = 0;
+  uint32_t          _wrOff  = 0;     // skrevet til flash (skrive-konteksten)
+  uint8_t           _sha[kShaLen] = {0};
+
+  mbedtls_md_context_t _md;
+  std::atomic<uint8_t> _result{kNone};
+  std::mutex           _wlock;       // flash og hash: service() mod start/cancel/apply
+  Stats                _stats;
+};
+
+#endif // BLE_LINK_OTA_H
@@ -0,0 +1,29 @@
+#include "BleLinkOtaEsp.h"
+
+bool BleLinkOtaEsp::begin(uint32_t size) {
+  abort();
+  _part = esp_ota_get_next_update_partition(nullptr);
+  if (!_part || size > _part->size) return false;
+  if (esp_ota_begin(_part, OTA_WITH_SEQUENTIAL_WRITES, &_h) != ESP_OK) {
+    _h = 0;
+    return false;
+  }
+  return true;
+}
+
+bool BleLinkOtaEsp::write(uint32_t /*offset*/, const uint8_t* p, size_t n) {
+  // BleLinkOta skriver i rækkefølge; esp_ota_write fører selv offset
+  return _h && esp_ota_write(_h, p, n) == ESP_OK;
+}
+
+bool BleLinkOtaEsp::commit() {
+  if (!_h) return false;
+  esp_err_t err = esp_ota_end(_h);     // tjekker billedets format og checksum
+  _h = 0;
+  return err == ESP_OK && esp_ota_set_boot_partition(_part) == ESP_OK;
+}
+
+void BleLinkOtaEsp::abort() {
+  if (_h) esp_ota_abort(_h);
+  _h = 0;
+}
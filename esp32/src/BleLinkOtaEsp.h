@@ -0,0 +1,28 @@
+#ifndef BLE_LINK_OTA_ESP_H
+#define BLE_LINK_OTA_ESP_H
+
+#pragma once
+#include <esp_ota_ops.h>
+#include "BleLinkOta.h"
+
+/**
+ * BleLinkOtaEsp — BleLinkOta-backend til ESP32's næste OTA-partition.
+ *
+ * Sektorer slettes løbende under skrivningen (OTA_WITH_SEQUENTIAL_WRITES),
+ * så ota_begin ikke blokerer loop() i sekunder; sletning og skrivning sker i
+ * skrive-tasken, mens næste blok modtages. commit() validerer billedet
+ * (esp_ota_end) og sætter boot-partitionen; BleLink genstarter bagefter.
+ */
+class BleLinkOtaEsp : public BleLinkOtaFlash {
+public:
+  bool begin(uint32_t size) override;
+  bool write(uint32_t offset, const uint8_t* p, size_t n) override;
+  bool commit() override;
+  void abort() override;
+
+private:
+  const esp_partition_t* _part = nullptr;
+  esp_ota_handle_t       _h    = 0;
+};
+
+#endif // BLE_LINK_OTA_ESP_H
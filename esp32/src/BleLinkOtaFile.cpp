@@ -0,0 +1,36 @@
+#include "BleLinkOtaFile.h"
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+BleLinkOtaFile::BleLinkOtaFile(const char* path, uint32_t writeDelayUs) : _delayUs(writeDelayUs) {
+  strncpy(_path, path, sizeof(_path) - 1);
+  _path[sizeof(_path) - 1] = '\0';
+  snprintf(_part, sizeof(_part), "%s.part", _path);
+}
+
+bool BleLinkOtaFile::begin(uint32_t /*size*/) {
+  abort();
+  _f = fopen(_part, "wb");
+  return _f != nullptr;
+}
+
+bool BleLinkOtaFile::write(uint32_t offset, const uint8_t* p, size_t n) {
+  if (!_f || fseek(_f, (long)offset, SEEK_SET) != 0) return false;
+  if (_delayUs) std::this_thread::sleep_for(std::chrono::microseconds(_delayUs));
+  return fwrite(p, 1, n, _f) == n;
+}
+
+bool BleLinkOtaFile::commit() {
+  if (!_f) return false;
+  bool ok = fclose(_f) == 0;
+  _f = nullptr;
+  return ok && rename(_part, _path) == 0;
+}
+
+void BleLinkOtaFile::abort() {
+  if (!_f) return;
+  fclose(_f);
+  _f = nullptr;
+  remove(_part);
+}
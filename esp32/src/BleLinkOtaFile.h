@@ -0,0 +1,33 @@
+#ifndef BLE_LINK_OTA_FILE_H
+#define BLE_LINK_OTA_FILE_H
+
+#pragma once
+#include <stdio.h>
+#include "BleLinkOta.h"
+
+/**
+ * BleLinkOtaFile — BleLinkOta-backend, der skriver billedet til en fil.
+ *
+ * Til test uden ESP32 (examples/ota_native): billedet skrives til
+ * "<path>.part" og omdøbes til path ved commit(). writeDelayUs simulerer
+ * flashens skrivetid pr. blok (ESP32: 4 KB sektor slet + skriv, ca. 30-50 ms),
+ * så dobbeltbufferens overlap kan ses på en hurtig disk.
+ */
+class BleLinkOtaFile : public BleLinkOtaFlash {
+public:
+  explicit BleLinkOtaFile(const char* path, uint32_t writeDelayUs = 0);
+  ~BleLinkOtaFile() override { abort(); }
+
+  bool begin(uint32_t size) override;
+  bool write(uint32_t offset, const uint8_t* p, size_t n) override;
+  bool commit() override;
+  void abort() override;
+
+private:
+  char     _path[256];
+  char     _part[262];
+  uint32_t _delayUs;
+  FILE*    _f = nullptr;
+};
+
+#endif // BLE_LINK_OTA_FILE_H
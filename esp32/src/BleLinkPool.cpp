@@ -0,0 +1,115 @@
+#include "BleLinkPool.h"
+
+constexpr size_t BleLinkPool::kSize[];
+constexpr size_t BleLinkPool::kCount[];
+
+BleLinkPool::BleLinkPool() {
+  _base[0] = _slab0; _base[1] = _slab1; _base[2] = _slab2; _base[3] = _slab3;
+
+  // Byg free-lists: hver fri blok peger på den næste i samme slab
+  for (size_t c = 0; c < kClasses; ++c) {
+    _free[c] = nullptr;
+    for (size_t i = kCount[c]; i-- > 0; ) {
+      FreeNode* n = reinterpret_cast<FreeNode*>(_base[c] + i * kSize[c]);
+      n->next  = _free[c];
+      _free[c] = n;
+    }
+  }
+}
+
+char* BleLinkPool::acquire(size_t need, size_t* cap) {
+  if (need > maxSize()) return _acquireBig(need, cap);
+  char* out = nullptr;
+  portENTER_CRITICAL(&_mux);
+  for (size_t c = 0; c < kClasses; ++c) {
+    if (kSize[c] < need) continue;
+    if (!_free[c]) continue;           // klassen er tom -> prøv større
+    FreeNode* n = _free[c];
+    _free[c] = n->next;
+    out = reinterpret_cast<char*>(n);
+    if (cap) *cap = kSize[c];
+
+    if (++_stats.inUse[c] > _stats.peak[c]) _stats.peak[c] = _stats.inUse[c];
+    _stats.acquired[c]++;
+    if (c > 0 && kSize[c - 1] >= need) _stats.fallbacks++;
+    break;
+  }
+  if (!out) _stats.misses++;
+  portEXIT_CRITICAL(&_mux);
+  return out;
+}
+
+void BleLinkPool::release(char* p) {
+  if (!p) return;
+  int c = _classOf(p);
+  if (c < 0) {
+    _releaseBig(p);                    // ellers ikke vores blok
+    return;
+  }
+
+  portENTER_CRITICAL(&_mux);
+  FreeNode* n = reinterpret_cast<FreeNode*>(p);
+  n->next  = _free[c];
+  _free[c] = n;
+  if (_stats.inUse[c]) _stats.inUse[c]--;
+  portEXIT_CRITICAL(&_mux);
+}
+
+// Over maxSize(): en plads reserveres under låsen, malloc/free sker udenfor
+char* BleLinkPool::_acquireBig(size_t need, size_t* cap) {
+  int slot = -1;
+  portENTER_CRITICAL(&_mux);
+  if (need > kMaxLen) {
+    _stats.tooLarge++;
+  } else {
+    for (size_t i = 0; i < kBig && slot < 0; ++i) {
+      if (!_bigUsed[i]) { _bigUsed[i] = true; slot = (int)i; }
+    }
+    if (slot < 0) _stats.misses++;
+  }
+  portEXIT_CRITICAL(&_mux);
+  if (slot < 0) return nullptr;
+
+  char* out = static_cast<char*>(malloc(need));
+  portENTER_CRITICAL(&_mux);
+  if (out) {
+    _big[slot] = out;
+    _stats.big++;
+  } else {
+    _bigUsed[slot] = false;
+    _stats.misses++;
+  }
+  portEXIT_CRITICAL(&_mux);
+  if (out && cap) *cap = need;
+  return out;
+}
+
+bool BleLinkPool::_releaseBig(char* p) {
+  bool ours = false;
+  portENTER_CRITICAL(&_mux);
+  for (size_t i = 0; i < kBig; ++i) {
+    if (_bigUsed[i] && _big[i] == p) {
+      _big[i]     = nullptr;
+      _bigUsed[i] = false;
+      ours        = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&_mux);
+  if (ours) free(p);
+  return ours;
+}
+
+BleLinkPool::Stats BleLinkPool::stats() const {
+  portENTER_CRITICAL(&_mux);
+  Stats s = _stats;
+  portEXIT_CRITICAL(&_mux);
+  return s;
+}
+
+int BleLinkPool::_classOf(const char* p) const {
+  for (size_t c = 0; c < kClasses; ++c) {
+    if (p >= _base[c] && p < _base[c] + kCount[c] * kSize[c]) return (int)c;
+  }
+  return -1;
+}
@@ -0,0 +1,72 @@
+#ifndef BLE_LINK_POOL_H
+#define BLE_LINK_POOL_H
+
+#pragma once
+#include <Arduino.h>
+
+/**
+ * BleLinkPool — fast pulje af TX-buffere i størrelsesklasser (slabs).
+ *
+ * Hver klasse er ét statisk array af ens blokke; frie blokke kædes sammen
+ * via en intrusiv free-list (de første bytes i en fri blok peger på den næste).
+ * Er en klasse tom, prøves næste større klasse, og er alle tomme, tælles et
+ * "miss" og acquire() returnerer nullptr. Kun beskeder over maxSize() lånes
+ * fra heapen (højst kBig ad gangen, op til kMaxLen bytes), så store svar
+ * stadig kan sendes; almindelig trafik kalder aldrig malloc.
+ *
+ * Trådsikker (kritisk sektion), så sendJson/sendRaw kan kaldes fra flere tasks.
+ */
+class BleLinkPool {
+public:
+  static constexpr size_t kClasses = 4;
+  static constexpr size_t kSize[kClasses]  = {   32,  128,  512, 2048 };
+  static constexpr size_t kCount[kClasses] = {   16,    8,    4,    2 };
+  static constexpr size_t kBig    = 2;        // samtidige heap-blokke over maxSize()
+  static constexpr size_t kMaxLen = 0xFFFF;   // største besked (TX-køernes længdefelt)
+
+  struct Stats {
+    uint16_t inUse[kClasses]   = {0};  // blokke udlånt lige nu
+    uint16_t peak[kClasses]    = {0};  // højeste samtidige udlån
+    uint32_t acquired[kClasses] = {0}; // antal udlån fra klassen
+    uint32_t fallbacks = 0;            // udlån fra en større klasse end ønsket
+    uint32_t misses    = 0;            // ingen ledig blok
+    uint32_t big       = 0;            // udlån fra heapen (over maxSize())
+    uint32_t tooLarge  = 0;            // afvist: over kMaxLen
+  };
+
+  BleLinkPool();
+
+  // Lån en blok med plads til mindst `need` bytes. nullptr ved miss
+  // eller need > kMaxLen (tælles i tooLarge).
+  // `cap` (valgfri) får blokkens faktiske størrelse.
+  char* acquire(size_t need, size_t* cap = nullptr);
+
+  // Aflever en blok fra acquire(). nullptr ignoreres.
+  void release(char* p);
+
+  // Kopi af tællerne (taget under lås)
+  Stats stats() const;
+
+  static size_t maxSize() { return kSize[kClasses - 1]; }
+
+private:
+  struct FreeNode { FreeNode* next; };
+
+  int   _classOf(const char* p) const;
+  char* _acquireBig(size_t need, size_t* cap);
+  bool  _releaseBig(char* p);
+
+  alignas(void*) char _slab0[kCount[0] * kSize[0]];
+  alignas(void*) char _slab1[kCount[1] * kSize[1]];
+  alignas(void*) char _slab2[kCount[2] * kSize[2]];
+  alignas(void*) char _slab3[kCount[3] * kSize[3]];
+
+  char*     _base[kClasses];
+  char*     _big[kBig]     = {nullptr};
+  bool      _bigUsed[kBig] = {false};   // reserveret (malloc sker uden for låsen)
+  FreeNode* _free[kClasses];
+  Stats     _stats;
+  mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif // BLE_LINK_POOL_H
@@ -0,0 +1,64 @@
+#include "BleLinkProto.h"
+#if BLELINK_ENABLE_PROTO
+
+bool BleLinkProto::encodedSize(const pb_msgdesc_t* fields, const void* msg, size_t* size) {
+  size_t n = 0;
+  if (!pb_get_encoded_size(&n, fields, msg)) return false;
+  *size = kHeader + n;
+  return true;
+}
+
+size_t BleLinkProto::encode(uint8_t* out, size_t cap, uint16_t type,
+                            const pb_msgdesc_t* fields, const void* msg) {
+  if (cap < kHeader) return 0;
+  out[0] = type & 0xFF;
+  out[1] = type >> 8;
+  pb_ostream_t os = pb_ostream_from_buffer(out + kHeader, cap - kHeader);
+  if (!pb_encode(&os, fields, msg)) {
+    _stats.encodeErr++;
+    _stats.lastType  = type;
+    _stats.lastError = PB_GET_ERROR(&os);
+    return 0;
+  }
+  _stats.tx++;
+  return kHeader + os.bytes_written;
+}
+
+bool BleLinkProto::dispatch(const uint8_t* p, size_t n) {
+  if (n < kHeader) {
+    _stats.decodeErr++;
+    return false;
+  }
+  uint16_t type = p[0] | (p[1] << 8);
+  for (uint8_t i = 0; i < _count; ++i) {
+    if (_h[i].type != type) continue;
+    pb_istream_t in = pb_istream_from_buffer(p + kHeader, n - kHeader);
+    if (!_h[i].decode(&in)) {
+      _stats.decodeErr++;
+      _stats.lastType  = type;
+      _stats.lastError = PB_GET_ERROR(&in);
+      return false;
+    }
+    _stats.rx++;
+    return true;
+  }
+  _stats.unknown++;
+  return false;
+}
+
+// Samme type igen erstatter handleren
+bool BleLinkProto::_add(uint16_t type, Decoder d) {
+  for (uint8_t i = 0; i < _count; ++i) {
+    if (_h[i].type == type) {
+      _h[i].decode = std::move(d);
+      return true;
+    }
+  }
+  if (_count == kHandlers) return false;
+  _h[_count].type   = type;
+  _h[_count].decode = std::move(d);
+  _count++;
+  return true;
+}
+
+#endif // BLELINK_ENABLE_PROTO
@@ -0,0 +1,74 @@
+#ifndef BLE_LINK_PROTO_H
+#define BLE_LINK_PROTO_H
+
+#pragma once
+#include "BleLinkFeatures.h"
+#if BLELINK_ENABLE_PROTO
+#include <Arduino.h>
+#include <functional>
+#include <pb.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+
+/**
+ * BleLinkProto — protobuf-beskeder (nanopb) over BleLinks binære frames.
+ *
+ * Frame-payload (type 0x02): [beskedtype u16 LE][protobuf-bytes]
+ * Beskedtypen vælges af appen og skal matche værten (send_proto/on_proto).
+ *
+ * Afsendelse koder med pb_encode direkte ind i TX-bufferen (ingen
+ * mellemkopi); modtagelse dekoder til en struct på stakken og kalder den
+ * typede handler for beskedtypen. Fejl tælles i stats() (med seneste
+ * fejltekst) og skrives ikke til Serial: en værts fejlkodede frames må
+ * ikke kunne fylde konsollen eller blokere NimBLE-tasken.
+ */
+class BleLinkProto {
+public:
+  static constexpr uint8_t kHandlers = 8;
+  static constexpr size_t  kHeader   = 2;   // beskedtype
+
+  struct Stats {
+    uint32_t rx = 0, tx = 0;
+    uint32_t unknown   = 0;   // ingen handler for typen
+    uint32_t decodeErr = 0;
+    uint32_t encodeErr = 0;
+    uint16_t    lastType  = 0;        // beskedtype for seneste kode-/dekodefejl
+    const char* lastError = nullptr;  // nanopb's fejltekst (statisk streng)
+  };
+
+  // Typet handler: T er nanopb-structen, fields dens *_fields
+  template <class T>
+  bool on(uint16_t type, const pb_msgdesc_t* fields, std::function<void(const T&)> cb) {
+    return _add(type, [fields, cb](pb_istream_t* in) {
+      T m = {};
+      if (!pb_decode(in, fields, &m)) return false;
+      cb(m);
+      return true;
+    });
+  }
+
+  // Kodet størrelse inkl. beskedtype; false = kan ikke kodes
+  static bool encodedSize(const pb_msgdesc_t* fields, const void* msg, size_t* size);
+  // Kod [type][protobuf] i out (cap bytes); returnerer længden, 0 = fejl
+  size_t encode(uint8_t* out, size_t cap, uint16_t type, const pb_msgdesc_t* fields, const void* msg);
+  // Dekod én frame-payload og kald handleren; false = ukendt type eller fejl
+  bool dispatch(const uint8_t* p, size_t n);
+
+  Stats stats() const { return _stats; }
+
+private:
+  using Decoder = std::function<bool(pb_istream_t* in)>;
+  struct Handler {
+    uint16_t type = 0;
+    Decoder  decode;
+  };
+
+  bool _add(uint16_t type, Decoder d);
+
+  Handler _h[kHandlers];
+  uint8_t _count = 0;
+  Stats   _stats;
+};
+
+#endif // BLELINK_ENABLE_PROTO
+#endif // BLE_LINK_PROTO_H
@@ -0,0 +1,143 @@
+#include "BleLinkRegs.h"
+
+bool BleLinkRegs::defineInt(uint8_t id, int32_t init, bool writable) {
+  Value v; v.i = init;
+  return _define(id, Type::Int, v, writable);
+}
+
+bool BleLinkRegs::defineFloat(uint8_t id, float init, bool writable) {
+  Value v; v.f = init;
+  return _define(id, Type::Float, v, writable);
+}
+
+bool BleLinkRegs::defineBool(uint8_t id, bool init, bool writable) {
+  Value v; v.b = init;
+  return _define(id, Type::Bool, v, writable);
+}
+
+bool BleLinkRegs::setInt(uint8_t id, int32_t x) { Value v; v.i = x; return _set(id, Type::Int, v); }
+bool BleLinkRegs::setFloat(uint8_t id, float x) { Value v; v.f = x; return _set(id, Type::Float, v); }
+bool BleLinkRegs::setBool(uint8_t id, bool x)   { Value v; v.b = x; return _set(id, Type::Bool, v); }
+
+int32_t BleLinkRegs::getInt(uint8_t id) const {
+  if (id >= kMax) return 0;
+  portENTER_CRITICAL(&_mux);
+  int32_t x = _regs[id].v.i;
+  portEXIT_CRITICAL(&_mux);
+  return x;
+}
+
+float BleLinkRegs::getFloat(uint8_t id) const {
+  if (id >= kMax) return 0;
+  portENTER_CRITICAL(&_mux);
+  float x = _regs[id].v.f;
+  portEXIT_CRITICAL(&_mux);
+  return x;
+}
+
+bool BleLinkRegs::getBool(uint8_t id) const {
+  if (id >= kMax) return false;
+  portENTER_CRITICAL(&_mux);
+  bool x = _regs[id].v.b;
+  portEXIT_CRITICAL(&_mux);
+  return x;
+}
+
+void BleLinkRegs::read(JsonArrayConst ids, JsonObject out) const {
+  if (ids.isNull() || ids.size() == 0) {
+    for (uint8_t id = 0; id < kMax; ++id) put(id, out);
+    return;
+  }
+  for (JsonVariantConst id : ids) put(id.as<uint8_t>(), out);
+}
+
+// Nøgler skal være hele decimaltal: "3x" eller "" er ikke register 3/0
+uint64_t BleLinkRegs::write(JsonObjectConst in, JsonArray ok, JsonArray err, JsonObject stored) {
+  uint64_t changed = 0;
+  for (JsonPairConst kv : in) {
+    const char* key = kv.key().c_str();
+    char*       end = nullptr;
+    long        id  = strtol(key, &end, 10);
+    if (end == key || *end != '\0') {
+      err.add(key);
+      continue;
+    }
+    if (id < 0 || id >= kMax || !_regs[id].writable) {
+      err.add(id);
+      continue;
+    }
+    Value v;
+    JsonVariantConst x = kv.value();
+    switch (_regs[id].type) {
+      case Type::Int:   v.i = x.as<int32_t>(); break;
+      case Type::Float: v.f = x.as<float>();   break;
+      default:          v.b = x.as<bool>();    break;
+    }
+    portENTER_CRITICAL(&_mux);
+    if (!_same(_regs[id].type, _regs[id].v, v)) changed |= 1ULL << id;
+    _regs[id].v = v;
+    portEXIT_CRITICAL(&_mux);
+    ok.add(id);
+    put((uint8_t)id, stored);          // gemt efter typens coercion (1.7 -> 1 i et Int)
+  }
+  return changed;
+}
+
+uint64_t BleLinkRegs::takeDirty() {
+  portENTER_CRITICAL(&_mux);
+  uint64_t d = _dirty;
+  _dirty = 0;
+  portEXIT_CRITICAL(&_mux);
+  return d;
+}
+
+void BleLinkRegs::markDirty(uint64_t mask) {
+  portENTER_CRITICAL(&_mux);
+  _dirty |= mask;
+  portEXIT_CRITICAL(&_mux);
+}
+
+// Skriv ét register som "id": værdi (udefinerede springes over)
+void BleLinkRegs::put(uint8_t id, JsonObject out) const {
+  if (id >= kMax || _regs[id].type == Type::None) return;
+  portENTER_CRITICAL(&_mux);
+  Reg r = _regs[id];
+  portEXIT_CRITICAL(&_mux);
+
+  char key[4];
+  snprintf(key, sizeof(key), "%u", (unsigned)id);
+  switch (r.type) {
+    case Type::Int:   out[key] = r.v.i; break;
+    case Type::Float: out[key] = r.v.f; break;
+    default:          out[key] = r.v.b; break;
+  }
+}
+
+bool BleLinkRegs::_define(uint8_t id, Type t, Value init, bool writable) {
+  if (id >= kMax) return false;
+  portENTER_CRITICAL(&_mux);
+  _regs[id].type     = t;
+  _regs[id].writable = writable;
+  _regs[id].v        = init;
+  portEXIT_CRITICAL(&_mux);
+  return true;
+}
+
+bool BleLinkRegs::_set(uint8_t id, Type t, Value v) {
+  if (id >= kMax || _regs[id].type != t) return false;
+  portENTER_CRITICAL(&_mux);
+  if (!_same(t, _regs[id].v, v)) {
+    _regs[id].v = v;
+    _dirty |= 1ULL << id;
+  }
+  portEXIT_CRITICAL(&_mux);
+  return true;
+}
+
+bool BleLinkRegs::_same(Type t, const Value& a, const Value& b) {
+  switch (t) {
+    case Type::Int:   return a.i == b.i;
+    case Type::Float: return a.f == b.f;
+    default:          return a.b == b.b;
+  }
+}
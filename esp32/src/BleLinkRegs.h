@@ -0,0 +1,65 @@
+#ifndef BLE_LINK_REGS_H
+#define BLE_LINK_REGS_H
+
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+/**
+ * BleLinkRegs — typet registerkort (id 0..63) eksponeret over BleLink.
+ *
+ * Appen definerer registre og sætter værdier; værten læser og skriver
+ * mange registre i én frame, og ændringer fra appen pushes samlet:
+ *
+ *   {"_bl":"reg_r","ids":[1,2]}    -> {"_bl":"reg","v":{"1":..,"2":..}}  (ingen ids = alle)
+ *   {"_bl":"reg_w","v":{"3":12}}   -> {"_bl":"reg_wack","ok":[3],"err":[],"v":{"3":12}}
+ *   ændringer fra appen            -> {"_bl":"reg_n","v":{"1":..}}
+ *
+ * Værdier er 32 bit (int32/float/bool) og læses/skrives under spinlock,
+ * så app-tasken og NimBLE-tasken kan bruge kortet samtidig. En skrivning
+ * konverteres til registrets type; reg_wack's "v" er de gemte værdier.
+ */
+class BleLinkRegs {
+public:
+  enum class Type : uint8_t { None, Int, Float, Bool };
+  static constexpr uint8_t kMax = 64;
+
+  bool defineInt  (uint8_t id, int32_t init, bool writable = false);
+  bool defineFloat(uint8_t id, float   init, bool writable = false);
+  bool defineBool (uint8_t id, bool    init, bool writable = false);
+
+  // App-siden: ændrede værdier markeres til notifikation
+  bool setInt  (uint8_t id, int32_t v);
+  bool setFloat(uint8_t id, float v);
+  bool setBool (uint8_t id, bool v);
+
+  int32_t getInt  (uint8_t id) const;
+  float   getFloat(uint8_t id) const;
+  bool    getBool (uint8_t id) const;
+  Type    type    (uint8_t id) const { return id < kMax ? _regs[id].type : Type::None; }
+
+  // Værts-siden (kaldes af BleLink)
+  void     read(JsonArrayConst ids, JsonObject out) const;
+  uint64_t write(JsonObjectConst in, JsonArray ok, JsonArray err, JsonObject stored);   // returnerer ændrede id'er
+  uint64_t takeDirty();
+  void     markDirty(uint64_t mask);
+  void     put(uint8_t id, JsonObject out) const;
+
+private:
+  union Value { int32_t i; float f; bool b; };
+  struct Reg {
+    Type  type     = Type::None;
+    bool  writable = false;
+    Value v        = {0};
+  };
+
+  bool _define(uint8_t id, Type t, Value init, bool writable);
+  bool _set(uint8_t id, Type t, Value v);
+  static bool _same(Type t, const Value& a, const Value& b);
+
+  Reg      _regs[kMax];
+  uint64_t _dirty = 0;
+  mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif // BLE_LINK_REGS_H
@@ -0,0 +1,198 @@
+#include "BleLinkRxQueue.h"
+#include <cstdlib>
+#include <cstring>
+
+constexpr size_t BleLinkRxQueue::kCap[];
+
+BleLinkRxQueue::BleLinkRxQueue() {
+  uint8_t* bufs[kPrios] = { _buf0, _buf1 };
+  for (uint8_t p = 0; p < kPrios; ++p) {
+    _r[p].buf = bufs[p];
+    _r[p].cap = kCap[p];
+  }
+}
+
+BleLinkRxQueue::~BleLinkRxQueue() {
+  Unit u;
+  while (front(u)) pop(u, u.tUs);     // heap-enheder frigives
+}
+
+BleLinkRxQueue::Prio BleLinkRxQueue::classify(bool line, const uint8_t* p, size_t n, size_t* skip) {
+  *skip = 0;
+  if (!line || n == 0 || p[0] != (uint8_t)kUrgent) return kNormal;
+  if (n > 1 && p[1] == '{') *skip = 1;   // send_urgent(): markøren er ikke en del af JSON'en
+  return kHigh;
+}
+
+bool BleLinkRxQueue::push(Prio prio, uint8_t kind, const uint8_t* p, size_t n, uint32_t nowUs) {
+  if (prio >= kPrios) prio = kNormal;
+  Ring&    r    = _r[prio];
+  uint8_t* heap = nullptr;
+
+  // Store enheder: kopi på heapen, ringen holder kun en reference
+  if (_size(n) > r.cap / 4) {
+    if ((uint64_t)n > 0xFFFFFFFEu) return false;
+    portENTER_CRITICAL(&_mux);
+    bool room = _heapBytes == 0 || _heapBytes + n + 1 <= kHeapMax;
+    if (room) _heapBytes += n + 1;
+    portEXIT_CRITICAL(&_mux);
+    if (!room) return false;
+    heap = (uint8_t*)malloc(n + 1);
+    if (!heap) {
+      portENTER_CRITICAL(&_mux);
+      _heapBytes -= n + 1;
+      portEXIT_CRITICAL(&_mux);
+      return false;
+    }
+    memcpy(heap, p, n);
+    heap[n] = '\0';
+  }
+  size_t body = heap ? kExt : n;
+  size_t s    = _size(body);
+  size_t at   = 0;
+  bool   ok   = true;
+
+  // Reservér plads (kun producenten flytter tail)
+  portENTER_CRITICAL(&_mux);
+  if (r.st.depth == 0) r.head = r.tail = r.used = 0;
+  if (s > r.cap) {
+    ok = false;
+  } else if (r.st.depth == 0 || r.tail > r.head) {
+    if (r.cap - r.tail >= s) {
+      at = r.tail;
+    } else if (r.head >= s) {               // for lidt plads i enden: start forfra
+      if (r.cap - r.tail >= 2) memcpy(r.buf + r.tail, &kWrap, 2);
+      r.used += r.cap - r.tail;
+      r.tail  = 0;
+      at      = 0;
+    } else {
+      ok = false;
+    }
+  } else if (r.tail < r.head && r.head - r.tail >= s) {
+    at = r.tail;
+  } else {
+    ok = false;                              // tail == head: fuld
+  }
+  if (!ok && heap) _heapBytes -= n + 1;
+  portEXIT_CRITICAL(&_mux);
+  if (!ok) {
+    free(heap);
+    return false;
+  }
+
+  // Kopiér uden lås: forbrugeren læser ikke ledig plads
+  uint8_t* e = r.buf + at;
+  uint16_t len = (uint16_t)body;
+  memcpy(e, &len, 2);
+  e[2] = kind;
+  e[3] = heap ? 1 : 0;
+  memcpy(e + 4, &nowUs, 4);
+  if (heap) {
+    uint32_t n32 = (uint32_t)n;
+    memcpy(e + kHdr, &heap, sizeof(heap));
+    memcpy(e + kHdr + sizeof(heap), &n32, 4);
+  } else {
+    memcpy(e + kHdr, p, n);
+  }
+  e[kHdr + body] = '\0';
+
+  portENTER_CRITICAL(&_mux);
+  r.tail  = at + s == r.cap ? 0 : at + s;
+  r.used += s;
+  r.st.depth++;
+  if (heap) r.st.ext++;
+  if (r.st.depth > r.st.peakDepth) r.st.peakDepth = r.st.depth;
+  portEXIT_CRITICAL(&_mux);
+  return true;
+}
+
+void BleLinkRxQueue::noteDrop(Prio prio) {
+  if (prio >= kPrios) prio = kNormal;
+  portENTER_CRITICAL(&_mux);
+  _r[prio].st.drops++;
+  portEXIT_CRITICAL(&_mux);
+}
+
+bool BleLinkRxQueue::front(Unit& out) {
+  bool found = false;
+  portENTER_CRITICAL(&_mux);
+  for (uint8_t p = 0; p < kPrios && !found; ++p) {
+    Ring& r = _r[p];
+    if (r.st.depth == 0) continue;
+    uint16_t len = kWrap;
+    if (r.cap - r.head >= 2) memcpy(&len, r.buf + r.head, 2);
+    if (len == kWrap) {                      // producenten startede forfra
+      r.used -= r.cap - r.head;
+      r.head  = 0;
+      memcpy(&len, r.buf, 2);
+    }
+    const uint8_t* e = r.buf + r.head;
+    out.prio = (Prio)p;
+    out.kind = e[2];
+    out.ext  = e[3] != 0;
+    memcpy(&out.tUs, e + 4, 4);
+    if (out.ext) {
+      uint8_t* heap = nullptr;
+      uint32_t n32  = 0;
+      memcpy(&heap, e + kHdr, sizeof(heap));
+      memcpy(&n32, e + kHdr + sizeof(heap), 4);
+      out.data = heap;
+      out.len  = n32;
+    } else {
+      out.data = e + kHdr;
+      out.len  = len;
+    }
+    found = true;
+  }
+  portEXIT_CRITICAL(&_mux);
+  return found;
+}
+
+void BleLinkRxQueue::pop(const Unit& u, uint32_t tStartUs) {
+  Ring&    r  = _r[u.prio];
+  size_t   s  = _size(u.ext ? kExt : u.len);
+  uint32_t us = tStartUs - u.tUs;
+  if (u.ext) free((void*)u.data);
+  portENTER_CRITICAL(&_mux);
+  if (u.ext) _heapBytes -= u.len + 1;
+  r.head  = r.head + s == r.cap ? 0 : r.head + s;
+  r.used -= s;
+  r.st.depth--;
+  r.st.dispatched++;
+  r.st.avgUs = r.st.avgUs ? (r.st.avgUs * 7 + us) / 8 : us;   // EWMA, alfa = 1/8
+  if (us > r.st.maxUs) r.st.maxUs = us;
+  portEXIT_CRITICAL(&_mux);
+}
+
+size_t BleLinkRxQueue::depth() const {
+  portENTER_CRITICAL(&_mux);
+  size_t n = _r[0].st.depth + _r[1].st.depth;
+  portEXIT_CRITICAL(&_mux);
+  return n;
+}
+
+// Konservativt: én enhed trækkes fra for spild ved wrap
+size_t BleLinkRxQueue::room(Prio prio, size_t unit) const {
+  if (prio >= kPrios || unit == 0) return 0;
+  const Ring& r = _r[prio];
+  size_t s = _size(unit);
+  portENTER_CRITICAL(&_mux);
+  size_t free = r.st.depth == 0 ? r.cap : r.cap - r.used;
+  portEXIT_CRITICAL(&_mux);
+  return free > s ? (free - s) / s * unit : 0;
+}
+
+BleLinkRxQueue::Stats BleLinkRxQueue::stats(uint8_t prio) const {
+  Stats s;
+  if (prio >= kPrios) return s;
+  portENTER_CRITICAL(&_mux);
+  s = _r[prio].st;
+  portEXIT_CRITICAL(&_mux);
+  return s;
+}
+
+void BleLinkRxQueue::resetMax() {
+  portENTER_CRITICAL(&_mux);
+  for (uint8_t p = 0; p < kPrios; ++p) _r[p].st.maxUs = 0;
+  portEXIT_CRITICAL(&_mux);
+}
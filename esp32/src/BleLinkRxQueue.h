@@ -0,0 +1,104 @@
+#ifndef BLE_LINK_RX_QUEUE_H
+#define BLE_LINK_RX_QUEUE_H
+
+#pragma once
+#include <Arduino.h>
+
+/**
+ * BleLinkRxQueue — modtagne linjer/frames i køer pr. prioritet.
+ *
+ * NimBLE-tasken deler RX op og lægger hver enhed i sin prioritets kø;
+ * BleLink::loop() dispatcher dem. En stor konfigurationsupload kan derfor
+ * ikke forsinke en nødstop-kommando: front() giver altid højeste prioritet
+ * først, også når der ligger andet og venter.
+ *
+ *   High   — linjer med '!' foran
+ *   Normal — resten, i modtagerækkefølge (FIFO), uanset størrelse
+ *
+ * Kun '!' må springe køen over: en lille linje efter en stor upload venter
+ * på den, som værten sendte dem. classify() fjerner kun markøren foran en
+ * JSON-linje ("!{"); rå linjer leveres, som de blev sendt.
+ *
+ * Hver kø er en byte-ring: [len u16][kind u8][ext u8][tUs u32][data][\0].
+ * Enheder over en fjerdedel af ringen kopieres til heapen, og ringen holder
+ * kun [ptr][len u32] — så køen bevarer rækkefølgen, og en linje kan være
+ * længere end ringen (som før køerne). Heap-udlånet er samlet højst
+ * kHeapMax, men én enhed tages altid, når intet andet er udlånt.
+ *
+ * Én producent (NimBLE) og én forbruger (loop); data kopieres uden for låsen,
+ * og pladsen frigives først ved pop(), så front().data er gyldig til da.
+ * push() tæller ikke drops: kalderen kan vente på plads og kalder noteDrop(),
+ * når den giver op.
+ */
+class BleLinkRxQueue {
+public:
+  enum Prio : uint8_t { kHigh = 0, kNormal = 1 };
+  static constexpr uint8_t kPrios = 2;
+  static constexpr size_t  kCap[kPrios] = { 512, 6144 };   // bytes pr. kø
+  static constexpr size_t  kHeapMax     = 16384;            // samlet heap-udlån
+  static constexpr uint8_t kLine        = 0xFF;   // kind for tekstlinjer (ellers frame-type)
+  static constexpr char    kUrgent      = '!';
+
+  struct Unit {
+    Prio           prio = kNormal;
+    uint8_t        kind = kLine;
+    bool           ext  = false;     // data ligger på heapen (frigives af pop())
+    const uint8_t* data = nullptr;   // linjer er NUL-terminerede
+    size_t         len  = 0;
+    uint32_t       tUs  = 0;         // modtaget (micros)
+  };
+
+  struct Stats {
+    uint16_t depth      = 0;
+    uint16_t peakDepth  = 0;
+    uint32_t drops      = 0;         // opgivet af kalderen (noteDrop)
+    uint32_t dispatched = 0;
+    uint32_t ext        = 0;         // enheder lagt på heapen
+    uint32_t avgUs      = 0;         // modtaget -> dispatch, glidende gennemsnit
+    uint32_t maxUs      = 0;         // siden resetMax()
+  };
+
+  BleLinkRxQueue();
+  ~BleLinkRxQueue();
+
+  // Prioritet for en enhed; for "!{"-linjer springes markøren over (*skip = 1)
+  static Prio classify(bool line, const uint8_t* p, size_t n, size_t* skip);
+
+  // false = ingen plads lige nu (prøv igen, eller noteDrop())
+  bool push(Prio prio, uint8_t kind, const uint8_t* p, size_t n, uint32_t nowUs);
+  void noteDrop(Prio prio);
+  // Forreste enhed med højeste prioritet; false = alle køer tomme
+  bool front(Unit& out);
+  // Frigiv enheden fra front(); tStartUs = da dispatch begyndte
+  void pop(const Unit& u, uint32_t tStartUs);
+
+  size_t depth() const;
+  // Payload-bytes, der lige nu er plads til som enheder á unit bytes
+  size_t room(Prio prio, size_t unit) const;
+  Stats  stats(uint8_t prio) const;
+  void   resetMax();
+
+private:
+  struct Ring {
+    uint8_t* buf   = nullptr;
+    size_t   cap   = 0;
+    size_t   head  = 0;     // forbrugeren
+    size_t   tail  = 0;     // producenten
+    size_t   used  = 0;     // bytes inkl. spild ved wrap
+    Stats    st;
+  };
+
+  static constexpr size_t   kHdr  = 8;
+  static constexpr size_t   kExt  = sizeof(uint8_t*) + 4;   // [ptr][len u32]
+  static constexpr uint16_t kWrap = 0xFFFF;
+  static size_t _size(size_t n) { return (kHdr + n + 1 + 3) & ~(size_t)3; }
+
+  alignas(4) uint8_t _buf0[kCap[0]];
+  alignas(4) uint8_t _buf1[kCap[1]];
+  Ring   _r[kPrios];
+  size_t _heapBytes = 0;
+
+  mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif // BLE_LINK_RX_QUEUE_H
@@ -0,0 +1,80 @@
+#include "BleLinkSchedule.h"
+
+void BleLinkSchedule::begin() {
+  if (!_mtx) _mtx = xSemaphoreCreateMutex();
+}
+
+bool BleLinkSchedule::add(uint16_t id, uint32_t atMs, JsonVariantConst cmd) {
+  size_t len  = measureJson(cmd);
+  size_t need = len + 1;               // + '\0'
+  if (!_mtx || len == 0 || need > kArena) return false;
+
+  xSemaphoreTake(_mtx, portMAX_DELAY);
+  if (_count < kMaxEntries && _used + need > kArena) _compact();
+  bool ok = _count < kMaxEntries && _used + need <= kArena;
+  if (ok) {
+    serializeJson(cmd, _arena + _used, need);
+
+    // indsæt sorteret efter tid (wrap-sikker sammenligning)
+    size_t i = _count;
+    while (i > 0 && (int32_t)(_entries[i - 1].at - atMs) > 0) {
+      _entries[i] = _entries[i - 1];
+      --i;
+    }
+    _entries[i] = Entry{ atMs, id, (uint16_t)_used, (uint16_t)len };
+    _count++;
+    _used += need;
+  }
+  xSemaphoreGive(_mtx);
+  return ok;
+}
+
+size_t BleLinkSchedule::poll(uint32_t nowMs, const DispatchCb& dispatch, Report* out, size_t cap) {
+  if (!_mtx) return 0;
+  size_t n = 0;
+  while (n < cap) {
+    JsonDocument cmd;
+    xSemaphoreTake(_mtx, portMAX_DELAY);
+    if (_count == 0 || (int32_t)(nowMs - _entries[0].at) < 0) {
+      xSemaphoreGive(_mtx);
+      break;
+    }
+    Entry e = _entries[0];
+    deserializeJson(cmd, (const char*)(_arena + e.off), e.len);  // kopierer ud af arenaen
+    for (size_t i = 1; i < _count; ++i) _entries[i - 1] = _entries[i];
+    _count--;
+    if (_count == 0) _used = 0;
+    xSemaphoreGive(_mtx);
+
+    dispatch(cmd);                     // uden lås: handleren må gerne sende
+    out[n++] = Report{ e.id, (int32_t)(millis() - e.at) };
+  }
+  return n;
+}
+
+void BleLinkSchedule::clear() {
+  if (!_mtx) return;
+  xSemaphoreTake(_mtx, portMAX_DELAY);
+  _count = 0;
+  _used  = 0;
+  xSemaphoreGive(_mtx);
+}
+
+// Skub levende kommandoer sammen i starten af arenaen (kaldes under lås)
+void BleLinkSchedule::_compact() {
+  // flyt altid den levende blok med laveste offset først
+  size_t pos = 0;
+  bool moved[kMaxEntries] = {false};
+  for (size_t k = 0; k < _count; ++k) {
+    size_t best = _count;
+    for (size_t i = 0; i < _count; ++i) {
+      if (!moved[i] && (best == _count || _entries[i].off < _entries[best].off)) best = i;
+    }
+    Entry& e = _entries[best];
+    if (e.off != pos) memmove(_arena + pos, _arena + e.off, e.len + 1);
+    e.off = (uint16_t)pos;
+    pos += e.len + 1;
+    moved[best] = true;
+  }
+  _used = pos;
+}
@@ -0,0 +1,57 @@
+#ifndef BLE_LINK_SCHEDULE_H
+#define BLE_LINK_SCHEDULE_H
+
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+
+/**
+ * BleLinkSchedule — kø af tidsstemplede kommandoer, der udføres lokalt.
+ *
+ * Værten uploader en batch {"_bl":"sched","cmds":[{"id":..,"at":..,"cmd":{..}}]}
+ * hvor "at" er enhedens millis() (værten kender offset via {"_bl":"time"}).
+ * Kommandoerne ligger serialiseret i en fast arena (ingen heap pr. kommando)
+ * og er sorteret efter tid, så poll() kun kigger på forreste element.
+ *
+ * add() kaldes fra NimBLE-tasken, poll() fra loop(); begge tager mutex'en.
+ */
+class BleLinkSchedule {
+public:
+  static constexpr size_t kMaxEntries = 32;
+  static constexpr size_t kArena      = 2048;
+
+  struct Report { uint16_t id; int32_t lateMs; };
+
+  using DispatchCb = std::function<void(const JsonDocument& cmd)>;
+
+  void begin();
+
+  // Læg én kommando i køen. false = kø/arena fuld.
+  bool add(uint16_t id, uint32_t atMs, JsonVariantConst cmd);
+
+  // Udfør alle forfaldne kommandoer (i tidsorden) via dispatch.
+  // Rapporter skrives i out (højst cap); returnerer antal.
+  size_t poll(uint32_t nowMs, const DispatchCb& dispatch, Report* out, size_t cap);
+
+  void   clear();
+  size_t size() const { return _count; }
+
+private:
+  struct Entry {
+    uint32_t at;
+    uint16_t id;
+    uint16_t off;
+    uint16_t len;
+  };
+
+  void _compact();
+
+  Entry    _entries[kMaxEntries];
+  size_t   _count = 0;
+  char     _arena[kArena];
+  size_t   _used  = 0;    // bump-pointer i arenaen
+  SemaphoreHandle_t _mtx = nullptr;
+};
+
+#endif // BLE_LINK_SCHEDULE_H
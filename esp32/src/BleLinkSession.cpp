@@ -0,0 +1,58 @@
+#include "BleLinkSession.h"
+#include <esp_system.h>
+
+void BleLinkSession::fresh(ReleaseFn rel, void* ctx) {
+  reclaim(rel, ctx);
+  uint8_t tok[kTokenLen];
+  esp_fill_random(tok, sizeof(tok));
+  static const char* d = "0123456789abcdef";
+  for (size_t i = 0; i < kTokenLen; ++i) {
+    _tokHex[2 * i]     = d[tok[i] >> 4];
+    _tokHex[2 * i + 1] = d[tok[i] & 15];
+  }
+  _tokHex[2 * kTokenLen] = '\0';
+  _tx = 0;
+  _rx = 0;
+  _stats.fresh++;
+}
+
+bool BleLinkSession::matches(const char* tokenHex) const {
+  return _tokHex[0] && tokenHex && strcmp(tokenHex, _tokHex) == 0;
+}
+
+char* BleLinkSession::retain(char* buf, uint16_t len) {
+  char* evicted = nullptr;
+  if (_count == kWindow) {
+    evicted = _win[_head].buf;
+    _head = (_head + 1) % kWindow;
+    _count--;
+  }
+  Sent& s = _win[(_head + _count) % kWindow];
+  s.buf = buf;
+  s.len = len;
+  s.seq = ++_tx;
+  _count++;
+  return evicted;
+}
+
+bool BleLinkSession::canResume(uint32_t hostRx) {
+  if (hostRx == _tx) return true;                 // intet mistet
+  if (hostRx < _tx && _count > 0 && _win[_head].seq <= hostRx + 1) return true;
+  _stats.gaps++;                                  // for gammelt (eller fra en anden session)
+  return false;
+}
+
+void BleLinkSession::resend(uint32_t hostRx, const SendFn& send) {
+  for (uint8_t i = 0; i < _count; ++i) {
+    const Sent& s = _win[(_head + i) % kWindow];
+    if (s.seq <= hostRx) continue;
+    send(s.buf, s.len);
+    _stats.resent++;
+  }
+}
+
+void BleLinkSession::reclaim(ReleaseFn rel, void* ctx) {
+  for (uint8_t i = 0; i < _count; ++i) rel(ctx, _win[(_head + i) % kWindow].buf);
+  _head  = 0;
+  _count = 0;
+}
@@ -0,0 +1,77 @@
+#ifndef BLE_LINK_SESSION_H
+#define BLE_LINK_SESSION_H
+
+#pragma once
+#include <Arduino.h>
+#include <functional>
+
+/**
+ * BleLinkSession — sessionstilstand, der overlever en reconnect.
+ *
+ * Første {"_bl":"hello"} efter connect giver værten et token. Præsenterer
+ * værten det igen efter en afbrydelse (inden for grace-perioden), genoptages
+ * sessionen: TX-køerne er bevaret, og de seneste sendte enheder (linjer/
+ * frames) ligger i et lille vindue, så dem værten ikke nåede at få, kan
+ * sendes igen. Begge sider tæller enheder pr. session (hello/sec_hello
+ * tælles ikke), og hello-svaret fortæller modparten, hvor langt vi kom:
+ *
+ *   {"_bl":"hello","tok":"<hex>","rx":<enheder værten har modtaget>}
+ *     -> {"_bl":"hello","tok":"<hex>","resumed":true|false,"rx":<enheder vi har modtaget>}
+ *
+ * Vinduet ejer pool-buffere; alt kaldes under BleLinks TX-lås.
+ */
+class BleLinkSession {
+public:
+  static constexpr size_t  kTokenLen = 8;
+  static constexpr uint8_t kWindow   = 4;   // sendte enheder gemt til genudsendelse
+
+  using ReleaseFn = void (*)(void* ctx, char* buf);
+  using SendFn    = std::function<void(const char* buf, size_t len)>;
+
+  struct Stats {
+    uint32_t fresh   = 0;   // nye sessioner
+    uint32_t resumed = 0;
+    uint32_t resent  = 0;   // enheder sendt igen ved genoptagelse
+    uint32_t gaps    = 0;   // genoptagelse afvist: vinduet rakte ikke tilbage
+  };
+
+  // Nyt token, tællere nulstilles, vinduet frigives
+  void fresh(ReleaseFn rel, void* ctx);
+  bool matches(const char* tokenHex) const;
+  const char* token() const { return _tokHex; }
+
+  void     noteRx() { _rx++; }
+  uint32_t rxSeq() const { return _rx; }
+  uint32_t txSeq() const { return _tx; }
+
+  // Efter afsendelse: buf bliver i vinduet. Returnerer en udskudt buffer,
+  // som kalderen skal frigive (nullptr = ingen)
+  char* retain(char* buf, uint16_t len);
+  // Kan alt efter hostRx sendes igen fra vinduet? (false tælles som gap)
+  bool  canResume(uint32_t hostRx);
+  // Send enhederne efter hostRx igen (i rækkefølge)
+  void  resend(uint32_t hostRx, const SendFn& send);
+  // Frigiv vinduet (presset pulje eller sessionen slut)
+  void  reclaim(ReleaseFn rel, void* ctx);
+  bool  retained() const { return _count > 0; }
+
+  Stats stats() const { return _stats; }
+  void  noteResumed() { _stats.resumed++; }
+
+private:
+  struct Sent {
+    char*    buf = nullptr;
+    uint16_t len = 0;
+    uint32_t seq = 0;
+  };
+
+  Sent     _win[kWindow];
+  uint8_t  _head  = 0;
+  uint8_t  _count = 0;
+  char     _tokHex[2 * kTokenLen + 1] = {0};
+  uint32_t _tx = 0;
+  uint32_t _rx = 0;
+  Stats    _stats;
+};
+
+#endif // BLE_LINK_SESSION_H
@@ -0,0 +1,101 @@
+#include "BleLinkTest.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void BleLinkTest::start(Mode m, uint32_t totalBytes, uint16_t lineSize, uint32_t nowMs) {
+  _mode     = m;
+  _t0       = nowMs;
+  _total    = totalBytes;
+  _lineSize = lineSize < kMinLine ? kMinLine : (lineSize > kMaxLine ? kMaxLine : lineSize);
+  _seq      = 0;
+  _lastSeq  = -1;
+  _res      = Result{};
+  _res.mode = m;
+}
+
+BleLinkTest::Result BleLinkTest::stop(uint32_t nowMs) {
+  _res.ms = nowMs - _t0;
+  _mode   = Mode::Off;
+  return _res;
+}
+
+bool BleLinkTest::onLine(const char* line, size_t len) {
+  if (_mode == Mode::Off || _mode == Mode::Source) return false;
+  if (len < 10 || line[0] != '~' || line[1] != 'T') return false;
+
+  if (_mode == Mode::Echo) {
+    size_t n = len < kMaxLine - 1 ? len : kMaxLine - 1;
+    memcpy(_line, line, n);
+    _line[n++] = '\n';
+    if (_send && _send(_line, n)) {
+      _res.lines++;
+      _res.bytes += n;
+    }
+    return true;
+  }
+
+  // Sink: tæl, CRC og find huller i seq
+  char hex[9];
+  memcpy(hex, line + 2, 8);
+  hex[8] = '\0';
+  int64_t seq = (int64_t)strtoul(hex, nullptr, 16);
+  if (_lastSeq >= 0 && seq > _lastSeq + 1) _res.lost += (uint32_t)(seq - _lastSeq - 1);
+  if (seq > _lastSeq) _lastSeq = seq;
+
+  _res.lines++;
+  _res.bytes += len + 1;
+  _res.crc = crc32(_res.crc, (const uint8_t*)line, len);
+  return true;
+}
+
+bool BleLinkTest::poll(size_t maxLines) {
+  if (_mode != Mode::Source || !_send) return false;
+  for (size_t i = 0; i < maxLines; ++i) {
+    if (_res.bytes >= _total) return true;
+    uint32_t left = _total - _res.bytes;
+    size_t   n    = left < _lineSize ? (left < kMinLine ? kMinLine : left) : _lineSize;
+
+    snprintf(_line, sizeof(_line), "~T%08lx", (unsigned long)_seq);
+    memset(_line + 10, 'x', n - 11);
+    _line[n - 1] = '\n';
+    if (!_send(_line, n)) return false;  // ingen buffer nu -> næste loop()
+
+    _seq++;
+    _res.lines++;
+    _res.bytes += n;
+  }
+  return _res.bytes >= _total;
+}
+
+const char* BleLinkTest::modeName(Mode m) {
+  switch (m) {
+    case Mode::Source: return "source";
+    case Mode::Sink:   return "sink";
+    case Mode::Echo:   return "echo";
+    default:           return "off";
+  }
+}
+
+BleLinkTest::Mode BleLinkTest::modeFromName(const char* s) {
+  if (!s)                       return Mode::Off;
+  if (strcmp(s, "source") == 0) return Mode::Source;
+  if (strcmp(s, "sink") == 0)   return Mode::Sink;
+  if (strcmp(s, "echo") == 0)   return Mode::Echo;
+  return Mode::Off;
+}
+
+// CRC32 (samme som zlib.crc32), nibble-tabel: lille og hurtig nok til testen
+uint32_t BleLinkTest::crc32(uint32_t crc, const uint8_t* p, size_t n) {
+  static const uint32_t T[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+  };
+  uint32_t c = ~crc;
+  while (n--) {
+    c ^= *p++;
+    c = (c >> 4) ^ T[c & 15];
+    c = (c >> 4) ^ T[c & 15];
+  }
+  return ~c;
+}
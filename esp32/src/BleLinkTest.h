@@ -0,0 +1,70 @@
+#ifndef BLE_LINK_TEST_H
+#define BLE_LINK_TEST_H
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+/**
+ * BleLinkTest — indbygget throughput-test, styret af {"_bl":"test",...}.
+ *
+ *   source: enheden sender n bytes som linjer på size bytes (inkl. '\n')
+ *   sink:   enheden tæller og CRC32-summer indkommende testlinjer
+ *   echo:   enheden sender hver testlinje retur med det samme
+ *
+ * Testlinjer har formen "~T<seq 8 hex><fyld>\n" og når aldrig brugerens
+ * callbacks. Klassen afhænger kun af stdint/functional (ingen Arduino/NimBLE),
+ * så den kan genbruges i andre transporter; tid og afsendelse gives udefra.
+ * Driveren på værten er python/throughput.py.
+ */
+class BleLinkTest {
+public:
+  enum class Mode : uint8_t { Off, Source, Sink, Echo };
+
+  // line er inkl. '\n'; false = kunne ikke sendes nu (prøv igen senere)
+  using SendFn = std::function<bool(const char* line, size_t len)>;
+
+  struct Result {
+    Mode     mode  = Mode::Off;
+    uint32_t lines = 0;
+    uint32_t bytes = 0;
+    uint32_t lost  = 0;      // sink: huller i seq
+    uint32_t crc   = 0;      // sink: CRC32 (zlib) over linjernes indhold uden '\n'
+    uint32_t ms    = 0;
+  };
+
+  static constexpr size_t kMinLine = 12;   // "~T" + 8 hex + 1 fyld + '\n'
+  static constexpr size_t kMaxLine = 512;
+
+  void begin(SendFn send) { _send = std::move(send); }
+
+  void start(Mode m, uint32_t totalBytes, uint16_t lineSize, uint32_t nowMs);
+  Result stop(uint32_t nowMs);
+
+  bool active() const { return _mode != Mode::Off; }
+  Mode mode() const   { return _mode; }
+
+  // Indkommende linje (uden '\n'). true = testtrafik, forbrugt her.
+  bool onLine(const char* line, size_t len);
+
+  // Source: send op til maxLines linjer. true når hele mængden er sendt.
+  bool poll(size_t maxLines);
+
+  static const char* modeName(Mode m);
+  static Mode modeFromName(const char* s);
+  static uint32_t crc32(uint32_t crc, const uint8_t* p, size_t n);
+
+private:
+  SendFn   _send;
+  Mode     _mode      = Mode::Off;
+  uint32_t _t0        = 0;
+  uint32_t _total     = 0;
+  uint16_t _lineSize  = 64;
+  uint32_t _seq       = 0;
+  int64_t  _lastSeq   = -1;
+  Result   _res;
+  char     _line[kMaxLine];
+};
+
+#endif // BLE_LINK_TEST_H
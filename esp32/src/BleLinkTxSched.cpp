@@ -0,0 +1,163 @@
+#include "BleLinkTxSched.h"
+#include "BleLinkPool.h"
+
+BleLinkTxSched::BleLinkTxSched() {
+  for (uint8_t c = 0; c < kChannels; ++c) _st[c].quantum = kDefaultQuantum;
+}
+
+bool BleLinkTxSched::push(uint8_t ch, char* buf, uint16_t len, uint32_t nowMs) {
+  if (ch >= kChannels || !buf) return false;
+  bool ok = false;
+  portENTER_CRITICAL(&_mux);
+  Queue& q = _q[ch];
+  if (q.count < kDepth) {
+    Item& it = q.items[(q.head + q.count) % kDepth];
+    it.buf  = buf;
+    it.len  = len;
+    it.ch   = ch;
+    it.tEnq = nowMs;
+    q.count++;
+    _total++;
+    _st[ch].depth = q.count;
+    if (q.count > _st[ch].peakDepth) _st[ch].peakDepth = q.count;
+    ok = true;
+  }
+  portEXIT_CRITICAL(&_mux);
+  return ok;
+}
+
+bool BleLinkTxSched::pop(uint32_t nowMs, Item& out) {
+  bool found = false;
+  portENTER_CRITICAL(&_mux);
+  _refill(nowMs);
+  _updateRates(nowMs);
+
+  // Mindst én kø er ikke-tom, og hvert besøg øger dens deficit,
+  // så løkken ender altid med et fund eller et rate-stop.
+  while (_total > 0) {
+    Queue& q = _q[_cur];
+    if (q.count == 0) {
+      _deficit[_cur] = 0;              // tomme køer sparer ikke op
+      _advance();
+      continue;
+    }
+    if (!_granted) {
+      _deficit[_cur] += _st[_cur].quantum;
+      _granted = true;
+    }
+    Item& h = q.items[q.head];
+    if (h.len > _deficit[_cur]) {
+      _advance();                      // deficit gemmes til næste runde
+      continue;
+    }
+    // Loft nået: vent på tokens. En linje over spanden (heap-lån op til
+    // kMaxLen) sendes, når spanden er fuld, og efterlader gæld, så snittet holdes.
+    if (_rateBps && _tokens < (int32_t)h.len && _tokens < (int32_t)_burst()) break;
+
+    out = h;
+    q.head = (q.head + 1) % kDepth;
+    q.count--;
+    _total--;
+    _deficit[_cur] -= h.len;
+    if (_rateBps) _tokens -= h.len;
+
+    ChannelStats& st = _st[_cur];
+    st.msgs++;
+    st.bytes += h.len;
+    st.depth  = q.count;
+    uint32_t wait = nowMs - h.tEnq;
+    if (wait > st.maxWaitMs) st.maxWaitMs = wait;
+    _winBytes[_cur] += h.len;
+    found = true;
+    break;
+  }
+  portEXIT_CRITICAL(&_mux);
+  return found;
+}
+
+void BleLinkTxSched::clear(void (*release)(void* ctx, char* buf), void* ctx) {
+  for (uint8_t c = 0; c < kChannels; ++c) {
+    Item it;
+    bool have = true;
+    while (have) {
+      portENTER_CRITICAL(&_mux);
+      Queue& q = _q[c];
+      have = q.count > 0;
+      if (have) {
+        it = q.items[q.head];
+        q.head = (q.head + 1) % kDepth;
+        q.count--;
+        _total--;
+        _st[c].depth = q.count;
+      }
+      _deficit[c] = 0;
+      portEXIT_CRITICAL(&_mux);
+      if (have && release) release(ctx, it.buf);
+    }
+  }
+}
+
+void BleLinkTxSched::noteDrop(uint8_t ch) {
+  if (ch >= kChannels) return;
+  portENTER_CRITICAL(&_mux);
+  _st[ch].drops++;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void BleLinkTxSched::setWeight(uint8_t ch, uint16_t quantumBytes) {
+  if (ch >= kChannels) return;
+  portENTER_CRITICAL(&_mux);
+  _st[ch].quantum = quantumBytes ? quantumBytes : 1;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void BleLinkTxSched::setRateLimit(uint32_t bytesPerSec) {
+  portENTER_CRITICAL(&_mux);
+  _rateBps    = bytesPerSec;
+  _tokens     = 0;
+  _lastRefill = millis();
+  portEXIT_CRITICAL(&_mux);
+}
+
+size_t BleLinkTxSched::depth() const {
+  portENTER_CRITICAL(&_mux);
+  size_t n = _total;
+  portEXIT_CRITICAL(&_mux);
+  return n;
+}
+
+BleLinkTxSched::ChannelStats BleLinkTxSched::stats(uint8_t ch) const {
+  ChannelStats s;
+  if (ch >= kChannels) return s;
+  portENTER_CRITICAL(&_mux);
+  s = _st[ch];
+  portEXIT_CRITICAL(&_mux);
+  return s;
+}
+
+// Spanden rummer mindst én puljeblok; længere linjer går i gæld
+uint32_t BleLinkTxSched::_burst() const {
+  uint32_t burst = _rateBps / 4;
+  return burst < BleLinkPool::maxSize() ? BleLinkPool::maxSize() : burst;
+}
+
+// Token bucket; _tokens kan være negativ efter en linje over spanden
+void BleLinkTxSched::_refill(uint32_t nowMs) {
+  if (!_rateBps) return;
+  uint32_t dt = nowMs - _lastRefill;
+  if (dt == 0) return;
+  _lastRefill = nowMs;
+  int64_t t = (int64_t)_tokens + (int64_t)((uint64_t)_rateBps * dt / 1000);
+  _tokens = t > (int64_t)_burst() ? (int32_t)_burst() : (int32_t)t;
+}
+
+// Båndbredde pr. kanal, målt i vinduer på ~1 s
+void BleLinkTxSched::_updateRates(uint32_t nowMs) {
+  uint32_t dt = nowMs - _winStart;
+  if (dt < 1000) return;
+  for (uint8_t c = 0; c < kChannels; ++c) {
+    _st[c].rateBps = (uint32_t)((uint64_t)_winBytes[c] * 1000 / dt);
+    _winBytes[c] = 0;
+  }
+  _winStart = nowMs;
+}
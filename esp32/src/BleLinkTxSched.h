@@ -0,0 +1,96 @@
+#ifndef BLE_LINK_TX_SCHED_H
+#define BLE_LINK_TX_SCHED_H
+
+#pragma once
+#include <Arduino.h>
+
+/**
+ * BleLinkTxSched — TX-køer pr. kanal med deficit round robin (DRR).
+ *
+ * Hver kanal har sin egen FIFO af færdige linjer (buffere fra BleLinkPool).
+ * pop() vælger næste linje efter DRR: ved hvert besøg får kanalen sin
+ * quantum (vægt i bytes) lagt til sit deficit og må sende, så længe
+ * forreste linje kan betales af deficit'et. En travl producent kan derfor
+ * ikke udsulte de andre; båndbredden fordeles efter vægtene.
+ *
+ * Valgfrit globalt loft (bytes/s) via token bucket. Spanden rummer
+ * max(rate/4, BleLinkPool::maxSize()); en længere linje (heap-lån op til
+ * kMaxLen) sendes, når spanden er fuld, og de næste venter, til gælden er betalt.
+ * push/pop er korte og beskyttet af en spinlock; selve afsendelsen sker udenfor.
+ */
+class BleLinkTxSched {
+public:
+  static constexpr uint8_t  kChannels = 4;
+  // Linjer pr. kanal. Alle køer (4 x 8 = 32 pladser) kan rumme flere linjer,
+  // end BleLinkPool har blokke (30 + 2 på heap), og hver linje i kø holder en
+  // blok: push kan altså løbe fra acquire. Det er med vilje — køen begrænser
+  // én kanal, puljen alle tilsammen — så når begge er ved at være fulde, er
+  // det acquire, der fejler først (SendPolicy), ikke push.
+  static constexpr size_t   kDepth    = 8;
+  static constexpr uint16_t kDefaultQuantum = 256;
+
+  struct Item {
+    char*    buf  = nullptr;
+    uint16_t len  = 0;
+    uint8_t  ch   = 0;
+    uint32_t tEnq = 0;
+  };
+
+  struct ChannelStats {
+    uint32_t msgs      = 0;   // sendte linjer
+    uint32_t bytes     = 0;   // sendte bytes
+    uint32_t drops     = 0;   // afvist (kø eller pulje fuld)
+    uint16_t depth     = 0;   // i kø lige nu
+    uint16_t peakDepth = 0;
+    uint32_t maxWaitMs = 0;   // længste tid i kø
+    uint32_t rateBps   = 0;   // målt over seneste ~1 s
+    uint16_t quantum   = kDefaultQuantum;
+  };
+
+  BleLinkTxSched();
+
+  // Læg en linje i kø. false = kanalens kø er fuld (buf ejes stadig af kalderen)
+  bool push(uint8_t ch, char* buf, uint16_t len, uint32_t nowMs);
+
+  // Næste linje efter DRR og rate-loft. false = intet klar lige nu.
+  bool pop(uint32_t nowMs, Item& out);
+
+  // Tøm alle køer; bufferne afleveres via release
+  void clear(void (*release)(void* ctx, char* buf), void* ctx);
+
+  void noteDrop(uint8_t ch);
+  void setWeight(uint8_t ch, uint16_t quantumBytes);
+  void setRateLimit(uint32_t bytesPerSec);   // 0 = intet loft
+
+  size_t       depth() const;
+  ChannelStats stats(uint8_t ch) const;
+
+private:
+  struct Queue {
+    Item    items[kDepth];
+    uint8_t head  = 0;
+    uint8_t count = 0;
+  };
+
+  void _advance() { _cur = (_cur + 1) % kChannels; _granted = false; }
+  void _refill(uint32_t nowMs);
+  uint32_t _burst() const;
+  void _updateRates(uint32_t nowMs);
+
+  Queue        _q[kChannels];
+  uint32_t     _deficit[kChannels] = {0};
+  ChannelStats _st[kChannels];
+  uint32_t     _winBytes[kChannels] = {0};
+  uint32_t     _winStart = 0;
+  uint8_t      _cur      = 0;
+  bool         _granted  = false;
+  size_t       _total    = 0;
+
+  uint32_t     _rateBps  = 0;       // 0 = intet loft
+  int32_t      _tokens   = 0;       // < 0: gæld efter en linje over spanden
+  uint32_t     _lastRefill = 0;
+
+  mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif // BLE_LINK_TX_SCHED_H
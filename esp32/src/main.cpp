@@ -1,8 +1,140 @@
 #include <Arduino.h>
 #include "BleLink.h"
+#include "BleLinkHeap.h"
+#include "BleLinkOtaEsp.h"
+#include "BleLinkMsgs.h"
+#include "blelink_demo.pb.h"   // genereret af nanopb fra proto/blelink_demo.proto
 
 BleLink bleLink("BLE-LINK-TEST");
 
+// Krypto-benchmark: {"op":"bench_crypto","size":240,"n":500} -> µs pr. seal
+// (AES-128-CCM via hardware-acceleratoren) mod memcpy af samme blok
+static void benchCrypto(uint32_t n, uint16_t size) {
+  static const uint8_t key[BleLinkCrypto::kKeyLen] = {0};
+  static uint8_t in[512], out[512 + BleLinkCrypto::kOverhead];
+  if (n == 0) n = 1;
+  if (size > sizeof(in)) size = sizeof(in);
+
+  BleLinkCrypto c;
+  uint8_t hn[BleLinkCrypto::kNonceLen] = {0}, dn[BleLinkCrypto::kNonceLen], auth[BleLinkCrypto::kAuthLen];
+  c.setKey(key);
+  c.begin(hn, dn, auth);
+
+  uint32_t t0 = micros();
+  for (uint32_t i = 0; i < n; ++i) c.seal(in, size, out, sizeof(out));
+  uint32_t sealUs = micros() - t0;
+
+  t0 = micros();
+  for (uint32_t i = 0; i < n; ++i) memcpy(out, in, size);
+  uint32_t copyUs = micros() - t0;
+
+  JsonDocument r;
+  r["from"]    = "esp32";
+  r["event"]   = "bench_crypto";
+  r["n"]       = n;
+  r["size"]    = size;
+  r["seal_us"] = (float)sealUs / n;
+  r["copy_us"] = (float)copyUs / n;
+  r["seal_MBps"] = sealUs ? (float)size * n / sealUs : 0;   // bytes/µs = MB/s
+  bleLink.sendJson(r);
+}
+
+// Protobuf-beskedtyper på linket (skal matche værten)
+static constexpr uint16_t kPbReading = 1;
+static constexpr uint16_t kPbSetRate = 2;
+static uint32_t g_readingMs = 0;           // 0 = ingen Reading-strøm
+
+// Historik: et sample hvert 3. sekund, også uden forbindelse; 16 KB rækker
+// til godt en time (python history.py BLE-LINK-TEST --since 3600)
+struct HistSample {
+  float    temp;
+  uint32_t freeHeap;
+};
+static constexpr uint32_t kHistEveryMs = 3000;
+
+static blmsg::Heap heapMsg() {
+  BleLinkHeapSnapshot s = BleLinkHeap::snapshot();
+  blmsg::Heap h;
+  h.free     = s.freeHeap;
+  h.min_free = s.minFreeHeap;
+  h.largest  = s.largestBlock;
+  h.traced   = BleLinkHeap::tracing();
+  h.allocs   = s.allocs;
+  h.frees    = s.frees;
+  h.live     = s.liveBytes;
+  h.peak     = s.peakLive;
+  h.dropped  = bleLink.txDropped();
+  return h;
+}
+
+static void heapJson(const blmsg::Heap& h, JsonDocument& j) {
+  j["from"]    = "esp32";
+  j["event"]   = "heap";
+  j["free"]    = h.free;
+  j["minFree"] = h.min_free;
+  j["largest"] = h.largest;
+  j["traced"]  = h.traced;
+  j["allocs"]  = h.allocs;
+  j["frees"]   = h.frees;
+  j["live"]    = h.live;
+  j["peak"]    = h.peak;
+  j["dropped"] = h.dropped;
+}
+
+// Codec-benchmark: samme Heap-besked n gange gennem ArduinoJson og gennem
+// den genererede codec; svarer med bytes og µs pr. besked (python/bench_codec.py)
+static void benchCodec(uint32_t n) {
+  if (n == 0) n = 1;
+  blmsg::Heap h = heapMsg(), back;
+  char    txt[256];
+  uint8_t bin[blmsg::Heap::kMaxSize];
+  size_t  txtLen = 0, binLen = 0;
+
+  uint32_t t0 = micros();
+  for (uint32_t i = 0; i < n; ++i) {
+    JsonDocument j;
+    heapJson(h, j);
+    txtLen = serializeJson(j, txt, sizeof(txt));
+  }
+  uint32_t jsonEnc = micros() - t0;
+
+  t0 = micros();
+  for (uint32_t i = 0; i < n; ++i) {
+    JsonDocument j;
+    deserializeJson(j, txt, txtLen);
+    back.free     = j["free"];
+    back.min_free = j["minFree"];
+    back.largest  = j["largest"];
+    back.traced   = j["traced"];
+    back.allocs   = j["allocs"];
+    back.frees    = j["frees"];
+    back.live     = j["live"];
+    back.peak     = j["peak"];
+    back.dropped  = j["dropped"];
+  }
+  uint32_t jsonDec = micros() - t0;
+
+  t0 = micros();
+  for (uint32_t i = 0; i < n; ++i) binLen = blmsg::encode(h, bin, sizeof(bin));
+  uint32_t binEnc = micros() - t0;
+
+  t0 = micros();
+  for (uint32_t i = 0; i < n; ++i) blmsg::decode(back, bin, binLen);
+  uint32_t binDec = micros() - t0;
+
+  JsonDocument r;
+  r["from"]  = "esp32";
+  r["event"] = "bench_codec";
+  r["n"]     = n;
+  r["json"]["bytes"]  = txtLen;
+  r["json"]["enc_us"] = (float)jsonEnc / n;
+  r["json"]["dec_us"] = (float)jsonDec / n;
+  r["bin"]["bytes"]   = binLen + 1;          // + besked-id
+  r["bin"]["enc_us"]  = (float)binEnc / n;
+  r["bin"]["dec_us"]  = (float)binDec / n;
+  bleLink.sendJson(r);
+}
+
 void setup() {
   Serial.begin(115200);
   while (!Serial) delay(10);
@@ -22,6 +154,34 @@ void setup() {
       reply["echo"] = doc["msg"] | "";
       bleLink.sendJson(reply);  // ESP32 -> Python
     }
+
+    // Soak-test: {"op":"heap"} -> heap-telemetri (se python/soak.py);
+    // {"op":"heap","bin":true} -> samme som skema-besked blmsg::Heap
+    if (strcmp(op, "heap") == 0) {
+      blmsg::Heap h = heapMsg();
+      if (doc["bin"] | false) {
+        bleLink.sendMsg(h);
+      } else {
+        JsonDocument reply;
+        heapJson(h, reply);
+        bleLink.sendJson(reply);
+      }
+    }
+
+    if (strcmp(op, "bench_codec") == 0) benchCodec(doc["n"] | (uint32_t)1000);
+    if (strcmp(op, "bench_crypto") == 0) benchCrypto(doc["n"] | (uint32_t)500, doc["size"] | (uint16_t)240);
+  });
+
+  // Modtag skema-beskeder (BleLinkMsgs.h, genereret fra schema/blelink.bls)
+  bleLink.onReceiveMsg([](uint8_t id, const uint8_t* p, size_t n){
+    if (id == blmsg::Echo::kId) {
+      blmsg::Echo in;
+      if (!blmsg::decode(in, p, n)) return;
+      blmsg::EchoReply out;
+      strcpy(out.from, "esp32");
+      strcpy(out.echo, in.msg);          // samme max-længde
+      bleLink.sendMsg(out);
+    }
   });
 
   // Modtag rå tekst fra Python
@@ -29,9 +189,47 @@ void setup() {
     Serial.printf("[RX:RAW ] %s\n", line.c_str());
     if (line == "PING") {
       bleLink.sendRaw("PONG");  // ESP32 -> Python (rå tekst)
+      bleLink.log('I', "PING besvaret");
     }
   });
 
+  // Protobuf: SetRate{sensor, interval_ms} starter/stopper en Reading-strøm
+  bleLink.onProto<SetRate>(kPbSetRate, SetRate_fields, [](const SetRate& m){
+    Serial.printf("[RX:PB  ] SetRate sensor=%u interval=%u ms\n",
+                  (unsigned)m.sensor, (unsigned)m.interval_ms);
+    g_readingMs = m.interval_ms;
+  });
+
+  // Forbindelsesløs status til flåde-dashboards (python: BroadcastScanner)
+  // v1: uint32 uptime_s, uint16 fri heap i KB (little endian)
+  bleLink.setBroadcast(1, [](uint8_t* buf, size_t cap) -> size_t {
+    if (cap < 6) return 0;
+    uint32_t up = millis() / 1000;
+    uint16_t kb = ESP.getFreeHeap() / 1024;
+    memcpy(buf, &up, 4);
+    memcpy(buf + 4, &kb, 2);
+    return 6;
+  }, 1000);
+
+  // Registerkort: 0 = uptime (s, læs), 1 = blink-periode (ms, læs/skriv)
+  bleLink.regs().defineInt(0, 0);
+  bleLink.regs().defineInt(1, 500, true);
+
+  bleLink.history().begin(sizeof(HistSample));
+
+#ifdef BLELINK_DEMO_SECURE
+  // Demo-nøgle 00 01 .. 0f — i produktion en hemmelig nøgle pr. enhed
+  static const uint8_t psk[BleLinkCrypto::kKeyLen] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+  bleLink.setPsk(psk);
+
+  // Firmwareopdatering kun over den krypterede session:
+  // python ota.py BleLink-Device firmware.bin --psk 000102030405060708090a0b0c0d0e0f
+  static BleLinkOtaEsp otaFlash;
+  bleLink.setOtaFlash(&otaFlash);
+#endif
+
   bleLink.setup();
 }
 
@@ -50,5 +248,24 @@ void loop() {
     bleLink.sendJson(j);
   }
 
+  static uint32_t lastReading = 0;
+  if (g_readingMs && millis() - lastReading >= g_readingMs && bleLink.isConnected()) {
+    lastReading = millis();
+    Reading r = Reading_init_zero;
+    r.sensor = 0;
+    r.value  = temperatureRead();
+    r.ts_ms  = millis();
+    bleLink.sendProto(kPbReading, Reading_fields, &r);
+  }
+
+  bleLink.regs().setInt(0, millis() / 1000);   // pushes til værten ved ændring
+
+  static uint32_t lastHist = 0;
+  if (millis() - lastHist >= kHistEveryMs) {
+    lastHist = millis();
+    HistSample h = { temperatureRead(), ESP.getFreeHeap() };
+    bleLink.history().add(millis(), &h);
+  }
+
   delay(5);
 }
@@ -0,0 +1,95 @@
+"""
+Sammenlign den genererede codec (blelink_msgs) med den dynamiske JSON-sti.
+
+  python bench_codec.py                 # kun værten (ingen enhed)
+  python bench_codec.py --device BLE-LINK-TEST --n 2000
+
+Værten: encode/decode af samme beskeder via json.dumps/loads og via de
+genererede klasser. Med --device køres også {"op":"bench_codec"} på
+ESP32'en (ArduinoJson vs. BleLinkMsgs.h på samme Heap-besked).
+"""
+import argparse
+import asyncio
+import json
+import timeit
+
+import blelink_msgs as M
+
+HEAP = M.Heap(free=187_432, min_free=151_220, largest=110_580, traced=True,
+              allocs=12_345, frees=12_301, live=4_096, peak=9_120, dropped=0)
+STATUS = M.Status(uptime_ms=123_456_789, note="periodic status from esp32")
+
+
+def _heap_dict(h: M.Heap) -> dict:
+    return {"from": "esp32", "event": "heap", "free": h.free, "minFree": h.min_free,
+            "largest": h.largest, "traced": h.traced, "allocs": h.allocs, "frees": h.frees,
+            "live": h.live, "peak": h.peak, "dropped": h.dropped}
+
+
+def _heap_from_dict(d: dict) -> M.Heap:
+    return M.Heap(d["free"], d["minFree"], d["largest"], d["traced"], d["allocs"],
+                  d["frees"], d["live"], d["peak"], d["dropped"])
+
+
+def _status_dict(s: M.Status) -> dict:
+    return {"from": "esp32", "event": "status", "uptime_ms": s.uptime_ms, "note": s.note}
+
+
+def _status_from_dict(d: dict) -> M.Status:
+    return M.Status(d["uptime_ms"], d["note"])
+
+
+def _us(fn, n: int) -> float:
+    return min(timeit.repeat(fn, number=n, repeat=5)) / n * 1e6
+
+
+def bench_host(n: int) -> None:
+    print(f"Vært (Python), µs pr. besked, bedste af 5 x {n}:")
+    print(f"  {'besked':<8} {'sti':<6} {'bytes':>6} {'encode':>8} {'decode':>8}")
+    cases = (("Heap", HEAP, _heap_dict, _heap_from_dict),
+             ("Status", STATUS, _status_dict, _status_from_dict))
+    for name, msg, to_d, from_d in cases:
+        txt = (json.dumps(to_d(msg), separators=(",", ":")) + "\n").encode()
+        binary = bytes((msg.ID,)) + msg.encode()
+        assert from_d(json.loads(txt)) == msg and M.decode(binary) == msg
+
+        je = _us(lambda: (json.dumps(to_d(msg), separators=(",", ":")) + "\n").encode(), n)
+        jd = _us(lambda: from_d(json.loads(txt)), n)
+        be = _us(lambda: bytes((msg.ID,)) + msg.encode(), n)
+        bd = _us(lambda: M.decode(binary), n)
+        print(f"  {name:<8} {'json':<6} {len(txt):>6} {je:>8.2f} {jd:>8.2f}")
+        print(f"  {'':<8} {'skema':<6} {len(binary) + 4:>6} {be:>8.2f} {bd:>8.2f}   (inkl. frame-header)")
+
+
+async def bench_device(device: str, n: int) -> None:
+    from ble_link import BleLink      # kræver bleak; værts-delen gør ikke
+    link = BleLink(device)
+    got: asyncio.Future = asyncio.get_running_loop().create_future()
+    link.on_receive_json(lambda o: got.set_result(o)
+                         if o.get("event") == "bench_codec" and not got.done() else None)
+    await link.connect()
+    try:
+        await link.send_json({"op": "bench_codec", "n": n})
+        r = await asyncio.wait_for(got, 60.0)
+    finally:
+        await link.disconnect()
+
+    print(f"\nEnhed (ESP32, Heap), µs pr. besked over {r['n']}:")
+    print(f"  {'sti':<6} {'bytes':>6} {'encode':>8} {'decode':>8}")
+    for key, label in (("json", "json"), ("bin", "skema")):
+        x = r[key]
+        print(f"  {label:<6} {x['bytes']:>6} {x['enc_us']:>8.2f} {x['dec_us']:>8.2f}")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="Genereret codec vs. JSON")
+    ap.add_argument("--device", default=None, help="kør også benchmark på enheden")
+    ap.add_argument("--n", type=int, default=2000)
+    args = ap.parse_args()
+    bench_host(args.n)
+    if args.device:
+        asyncio.run(bench_device(args.device, args.n))
+
+
+if __name__ == "__main__":
+    main()
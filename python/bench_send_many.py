@@ -0,0 +1,66 @@
+"""
+Sammenlign konfigurationstid: N sekventielle send_json() mod send_many().
+
+  python bench_send_many.py --count 50 --rounds 5
+
+Demo-firmwaren modtager beskederne i onReceiveJson (og printer dem); der
+ventes på et echo til sidst, så tiden dækker hele vejen til enheden.
+"""
+import argparse
+import asyncio
+import statistics
+import time
+
+from ble_link import BleLink
+
+
+def _config(n: int):
+    return [{"op": "cfg", "key": f"param{i}", "value": i * 10} for i in range(n)]
+
+
+async def _fence(link: BleLink, done: asyncio.Event, tag: str) -> None:
+    """Echo-rundtur, så vi ved at enheden har behandlet alt før."""
+    done.clear()
+    await link.send_json({"op": "echo", "msg": tag})
+    await asyncio.wait_for(done.wait(), 10.0)
+
+
+async def bench(args: argparse.Namespace) -> None:
+    link = BleLink(args.device)
+    done = asyncio.Event()
+    link.on_receive_json(lambda o: done.set() if o.get("echo", "").startswith("fence") else None)
+    await link.connect()
+
+    msgs = _config(args.count)
+    seq, many, writes = [], [], 0
+    for r in range(args.rounds):
+        t0 = time.perf_counter()
+        for m in msgs:
+            await link.send_json(m, response=True)
+        await _fence(link, done, f"fence-s{r}")
+        seq.append(time.perf_counter() - t0)
+
+        t0 = time.perf_counter()
+        writes = await link.send_many(msgs, response=True)
+        await _fence(link, done, f"fence-m{r}")
+        many.append(time.perf_counter() - t0)
+
+    await link.disconnect()
+
+    s, m = statistics.median(seq), statistics.median(many)
+    print(f"{args.count} beskeder, median af {args.rounds} runder:")
+    print(f"  sekventiel send_json: {s * 1000:8.1f} ms  ({args.count} writes)")
+    print(f"  send_many:            {m * 1000:8.1f} ms  ({writes} writes)")
+    print(f"  speedup:              {s / m:8.1f}x")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="send_many vs. sekventielle sends")
+    ap.add_argument("--device", default="BLE-LINK-TEST")
+    ap.add_argument("--count", type=int, default=40)
+    ap.add_argument("--rounds", type=int, default=5)
+    asyncio.run(bench(ap.parse_args()))
+
+
+if __name__ == "__main__":
+    main()
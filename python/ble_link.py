@@ -1,6 +1,14 @@
 import asyncio
+import hashlib
+import hmac
 import json
-from typing import Callable, Optional, Dict, Any
+import logging
+import os
+import time
+from collections import deque
+from contextlib import contextmanager
+from dataclasses import dataclass, field
+from typing import Callable, Optional, Dict, Any, List
 from bleak import BleakScanner, BleakClient
 from bleak.exc import BleakError
 
@@ -9,6 +17,23 @@ SERVICE_UUID = "6E400001-B5A3-F393-E0A9-E50E24DCCA9E"
 TX_UUID      = "6E400003-B5A3-F393-E0A9-E50E24DCCA9E"  # notify ESP32->host
 RX_UUID      = "6E400002-B5A3-F393-E0A9-E50E24DCCA9E"  # write  host->ESP32
 
+# Broadcast (manufacturer data, skal matche ESP32)
+BC_COMPANY_ID = 0xFFFF
+BC_MAGIC      = 0xB1
+
+# Binære frames mellem tekstlinjerne: [0x00][type][len u16 LE][payload]
+FRAME_START  = 0x00
+FRAME_HEADER = 4
+FRAME_MSG    = 0x01     # skema-besked: [id][felter] (blelink_msgs.py)
+FRAME_PROTO  = 0x02     # protobuf: [beskedtype u16 LE][protobuf-bytes]
+FRAME_SECURE = 0x03     # krypteret linje/frame: [tæller u32 LE][ciphertext][tag 8 B]
+FRAME_OTA    = 0x04     # firmwarebillede: [offset u32 LE][data] (ota.py)
+FRAME_HIST   = 0x05     # historik: [id u16][seq u32][n u16][rec u8][poster] (history.py)
+
+# Sessioner (genoptagelse efter reconnect, se esp32/src/BleLinkSession.h)
+RESUME_S      = 30.0    # enhedens frist (BL_RESUME_MS); derefter ny session
+RESEND_WINDOW = 256     # sendte enheder gemt til gensendelse
+
 
 class BleLink:
     """
@@ -19,24 +44,138 @@ class BleLink:
       - on_receive(cb: (type, payload) -> None)  # kompatibilitet
         * Hvis JSON indeholder 'type', kaldes cb(type, payload)
         * Ellers cb(None, obj)
+      - on_message(cb: Message -> None)  # alle linjer; JSON dekodes først ved msg.json
+        (erstatter de tre ovenfor; linjer, ingen læser som JSON, dekodes aldrig)
 
     Afsendelse:
       - await send_json(dict)
       - await send_raw(str)
       - await send(command, payload=None)  # convenience wrapper
+      - await send_many([dict | str, ...])  # flere beskeder pr. write
+      Alle sends går gennem én writer-task, der fletter køede linjer til
+      MTU-store writes uden at bryde beskedgrænser (tx_metrics()).
+
+    Skema-beskeder (binære frames, genereret af blgen.py):
+      - await send_msg(blelink_msgs.Echo(msg="hej"))
+      - on_msg(blelink_msgs.EchoReply, cb: EchoReply -> None)
+
+    Protobuf (nanopb på ESP32; beskedtypen er et u16 valgt af appen):
+      - await send_proto(2, SetRate(sensor=0, interval_ms=100))
+      - on_proto(1, Reading, cb: Reading -> None)
+
+    Kryptering (AES-CCM med forhåndsdelt nøgle, ingen BLE-pairing):
+      - BleLink(name, psk=bytes.fromhex("..."))  # 16 bytes, samme som setPsk()
+      Efter connect laves et handshake; derefter krypteres alt begge veje,
+      og klartekst fra enheden ignoreres. Kræver pakken cryptography.
+
+    Sessioner (genoptagelse efter reconnect):
+      Efter connect (og handshake) sendes {"_bl":"hello"}; enheden giver et
+      token. Tabes linket, og kaldes connect() igen inden for RESUME_S,
+      genoptages sessionen i én round trip: det, modparten ikke nåede at få,
+      sendes igen begge veje, og køede send_*() fortsætter i rækkefølge
+      (deres awaits venter hen over afbrydelsen). Ellers startes en ny
+      session, og ventende sends fejler.
+      - BleLink(name, resume=False)             # altid ny session
+      - session_epoch                           # tælles op ved hver ny session
+      - session_stats()
+
+    Kontrolbeskeder ({"_bl": ...}) er reserveret til biblioteket og når
+    aldrig brugerens callbacks.
+
+    Planlagt udførsel på enheden (fjerner round trips fra sekvenser):
+      - await sync_clock()                      # offset host -> enhedens millis()
+      - await schedule([(0.0, cmd), (0.25, cmd2)], start_in=0.5)   # [ScheduledCmd, ...]
+      - on_schedule_report(cb: list[dict] -> None)   # samlede udførselsrapporter
+
+    Forbindelsestid (pr. fase, også for forsøg der fejler/gentages):
+      - on_connect_event(cb: ConnectPhase -> None)   # én hændelse pr. fase
+      - connect_metrics()                       # dict fase -> ConnectPhaseStats
+      - last_connect                            # faserne fra seneste connect()
+
+    Fjern-diagnose (uden seriel-kabel):
+      - await get_device_stats()                # tællere, køer, MTU, heap, loop()-tid
+      - start_stats_poller(interval, cb) / stop_stats_poller()
+
+    Log fra enheden (BleLink::log):
+      - on_log(cb: LogRecord -> None)
+
+    Firmwareopdatering (BleLinkOta på enheden): se ota.py (OtaUploader).
+    Historik på enheden (BleLinkHistory, range-forespørgsler): se history.py.
+
+    Transport: default rigtig BLE (bleak). fleet_sim.SimTransport forbinder i
+    stedet til simulerede enheder over TCP (load-test uden hardware):
+      - BleLink(name, transport=SimTransport("127.0.0.1", 7500))
+
+    Lavniveau (bruges af fx throughput.py):
+      - await control_request(msg, reply_op) / await wait_control(op)
+      - on_test_traffic(cb: str -> None)        # "~T..."-testlinjer
     """
 
-    def __init__(self, device_name: str):
+    def __init__(self, device_name: str, psk: Optional[bytes] = None, resume: bool = True,
+                 transport: Optional["BleakTransport"] = None):
+        if psk is not None and len(psk) != _SecureSession.KEY_LEN:
+            raise ValueError("psk skal være 16 bytes")
         self.device_name = device_name
+        self.psk = psk
+        self._transport = transport or BleakTransport()
         self._client: Optional[BleakClient] = None
         self._tx_char = None
         self._rx_char = None
         self._rxbuf = bytearray()
+        self._sec: Optional[_SecureSession] = None   # aktiv krypteret session
+        self._sec_rxbuf = bytearray()
+        self.plain_dropped = 0          # klartekst ignoreret pga. psk
 
         # callbacks
         self._cb_json: Optional[Callable[[Dict[str, Any]], None]] = None
         self._cb_raw:  Optional[Callable[[str], None]] = None
         self._cb_pair: Optional[Callable[[Optional[str], Any], None]] = None
+        self._cb_sched: Optional[Callable[[List[Dict[str, Any]]], None]] = None
+        self._cb_test:  Optional[Callable[[str], None]] = None
+        self._cb_log:   Optional[Callable[["LogRecord"], None]] = None
+        self._cb_msg:   Optional[Callable[["Message"], None]] = None
+
+        # binære frames: handler pr. frame-type, skema-beskeder pr. besked-id
+        self._frame_handlers: Dict[int, Callable[[bytes], None]] = {
+            FRAME_MSG: self._on_msg_frame,
+            FRAME_PROTO: self._on_proto_frame,
+            FRAME_SECURE: self._on_secure_frame,
+        }
+        self._msg_handlers: Dict[int, tuple] = {}
+        self._proto_handlers: Dict[int, tuple] = {}
+
+        # kontrolbeskeder: ventende svar pr. op og faste handlere pr. op
+        self._ctl_waiters: Dict[str, List[asyncio.Future]] = {}
+        self._ctl_handlers: Dict[str, Callable[[Dict[str, Any]], None]] = {
+            "sched_done": self._on_sched_done,
+            "log": self._on_log,
+            "rx_drop": self._on_rx_drop,
+        }
+        self.rx_dropped = 0                      # enhedens RX-kø fuld (rx_drop), i alt
+
+        # ur-synk: enhedens millis() ~= host_ms + _clock_offset_ms
+        self._clock_offset_ms: Optional[float] = None
+        self.clock_rtt_ms: Optional[float] = None
+        self._sched_id = 0
+
+        # send-pipeline: én writer-task ejer RX-karakteristikken
+        self._txq: Optional[asyncio.Queue] = None
+        self._writer_task: Optional[asyncio.Task] = None
+        self._txm = _TxCounters()
+
+        self._stats_task: Optional[asyncio.Task] = None
+
+        # forbindelsestid pr. fase (se _phase)
+        self._cb_conn: Optional[Callable[["ConnectPhase"], None]] = None
+        self._conn_stats: Dict[str, ConnectPhaseStats] = {}
+        self._conn_attempt = 0
+        self.last_connect: List[ConnectPhase] = []
+        self.connections = 0            # tælles op ved hver ny forbindelse
+
+        # session: token + tællere overlever en afbrydelse (se _hello)
+        self.resume = resume
+        self._sess = _Session()
+        self._sess_expiry: Optional[asyncio.TimerHandle] = None
 
     # ---------- public API ----------
 
@@ -46,13 +185,83 @@ class BleLink:
     def on_receive_raw(self, cb: Callable[[str], None]) -> None:
         self._cb_raw = cb
 
+    def on_message(self, cb: Optional[Callable[["Message"], None]]) -> None:
+        """Alle (ikke-kontrol) linjer som Message; JSON dekodes først ved msg.json."""
+        self._cb_msg = cb
+
     def on_receive(self, cb: Callable[[Optional[str], Any], None]) -> None:
         """Kompat: cb(type, payload). type=None hvis ikke tilstede i JSON."""
         self._cb_pair = cb
 
+    def on_schedule_report(self, cb: Callable[[List[Dict[str, Any]]], None]) -> None:
+        """cb([{"id":..., "late_ms":...}, ...]) — én batch pr. loop() på enheden."""
+        self._cb_sched = cb
+
+    def on_log(self, cb: Callable[["LogRecord"], None]) -> None:
+        """
+        Log-linjer fra enheden som LogRecord. Tabte linjer (ringen løb fuld)
+        meldes som én LogRecord med dropped > 0 før de efterfølgende.
+        """
+        self._cb_log = cb
+
+    def on_msg(self, cls: Any, cb: Optional[Callable[[Any], None]]) -> None:
+        """
+        cb(besked) for skema-beskeder af typen cls (fx blelink_msgs.Status);
+        beskeden dekodes kun, hvis der er en handler. None fjerner handleren.
+        """
+        if cb is None:
+            self._msg_handlers.pop(cls.ID, None)
+        else:
+            self._msg_handlers[cls.ID] = (cls, cb)
+
+    def on_proto(self, type_id: int, cls: Any, cb: Optional[Callable[[Any], None]]) -> None:
+        """
+        cb(besked) for protobuf-beskeder med beskedtypen type_id; cls er den
+        genererede klasse (protoc --python_out), dekodet med cls.FromString.
+        """
+        if cb is None:
+            self._proto_handlers.pop(type_id, None)
+        else:
+            self._proto_handlers[type_id] = (cls, cb)
+
+    def on_frame(self, ftype: int, cb: Optional[Callable[[bytes], None]]) -> None:
+        """Lavniveau: cb(payload) for binære frames af typen ftype."""
+        if cb is None:
+            self._frame_handlers.pop(ftype, None)
+        else:
+            self._frame_handlers[ftype] = cb
+
+    def on_connect_event(self, cb: Optional[Callable[["ConnectPhase"], None]]) -> None:
+        """cb kaldes efter hver fase af connect() (scan, connect, services, ...)."""
+        self._cb_conn = cb
+
+    def on_test_traffic(self, cb: Optional[Callable[[str], None]]) -> None:
+        """Testlinjer ("~T...") fra throughput-testen; None slår det fra."""
+        self._cb_test = cb
+
     def is_connected(self) -> bool:
         return bool(self._client and self._client.is_connected)
 
+    @property
+    def write_size(self) -> int:
+        """Bytes pr. write (MTU - 3); fx til frames, der skal fylde én write."""
+        return self._write_limit()
+
+    @property
+    def secure(self) -> bool:
+        """True under en krypteret session (efter sec_hello)."""
+        return self._sec is not None
+
+    @property
+    def session_epoch(self) -> int:
+        """Tælles op ved hver ny session (ikke ved genoptagelse)."""
+        return self._sess.epoch
+
+    def session_stats(self) -> Dict[str, int]:
+        s = self._sess
+        return {"epoch": s.epoch, "resumes": s.resumes, "resent": s.resent,
+                "tx_seq": s.tx_seq, "rx_seq": s.rx_seq}
+
     async def connect(
         self,
         attempts: int = 3,
@@ -62,22 +271,30 @@ class BleLink:
     ) -> None:
         """
         Robust connect: prøv flere gange med lille pause imellem.
+        Hver fase tidsmåles (on_connect_event / connect_metrics / last_connect).
         """
         last_err: Exception | None = None
-        for i in range(1, max(1, attempts) + 1):
-            try:
-                await self._connect_once(timeout=timeout, scan_timeout=scan_timeout)
-                return
-            except (BleakError, RuntimeError) as e:
-                last_err = e
-                if i < attempts:
-                    print(f"[BleLink] connect-forsøg {i} fejlede: {e}")
-                    await asyncio.sleep(max(0.0, delay))
-        raise RuntimeError(f"BleLink: Kunne ikke forbinde efter {attempts} forsøg") from last_err
+        self.last_connect = []
+        with self._phase("total"):
+            for i in range(1, max(1, attempts) + 1):
+                self._conn_attempt = i
+                try:
+                    await self._connect_once(timeout=timeout, scan_timeout=scan_timeout)
+                    return
+                except (BleakError, RuntimeError) as e:
+                    last_err = e
+                    if i < attempts:
+                        print(f"[BleLink] connect-forsøg {i} fejlede: {e}")
+                        with self._phase("retry_wait"):
+                            await asyncio.sleep(max(0.0, delay))
+            raise RuntimeError(f"BleLink: Kunne ikke forbinde efter {attempts} forsøg") from last_err
 
     async def disconnect(self) -> None:
+        self.stop_stats_poller()
+        self._drop_session()            # bevidst afbrydelse: ingen genoptagelse
         if not self._client:
             return
+        await self._stop_writer()
         try:
             if self._tx_char:
                 await self._client.stop_notify(self._tx_char)
@@ -92,20 +309,93 @@ class BleLink:
             self._tx_char = None
             self._rx_char = None
             self._rxbuf.clear()
+            self._sec = None
+            self._sec_rxbuf.clear()
 
     # ---- send ----
     async def send_json(self, obj: Dict[str, Any], response: bool = True) -> None:
-        if not (self._client and self._client.is_connected and self._rx_char):
-            raise RuntimeError("Ikke forbundet.")
         raw = (json.dumps(obj, separators=(",", ":")) + "\n").encode("utf-8")
-        await self._client.write_gatt_char(self._rx_char, raw, response=response)
+        await self._enqueue(raw, response)
 
     async def send_raw(self, text: str, response: bool = True) -> None:
-        if not (self._client and self._client.is_connected and self._rx_char):
-            raise RuntimeError("Ikke forbundet.")
         if not text.endswith("\n"):
             text += "\n"
-        await self._client.write_gatt_char(self._rx_char, text.encode("utf-8"), response=response)
+        await self._enqueue(text.encode("utf-8"), response)
+
+    async def send_urgent(self, obj: Dict[str, Any], response: bool = True) -> None:
+        """
+        Som send_json, men høj prioritet på enheden ('!' foran linjen): den
+        dispatches før ventende trafik (fx nødstop under upload).
+        """
+        raw = ("!" + json.dumps(obj, separators=(",", ":")) + "\n").encode("utf-8")
+        await self._enqueue(raw, response)
+
+    async def send_frame(self, ftype: int, payload: bytes, response: bool = True) -> None:
+        if len(payload) > 0xFFFF:
+            raise ValueError("frame for stor")
+        head = bytes((FRAME_START, ftype)) + len(payload).to_bytes(2, "little")
+        await self._enqueue(head + payload, response)
+
+    async def send_msg(self, msg: Any, response: bool = True) -> None:
+        """Send en skema-besked (blelink_msgs) som binær frame."""
+        await self.send_frame(FRAME_MSG, bytes((msg.ID,)) + msg.encode(), response)
+
+    async def send_proto(self, type_id: int, msg: Any, response: bool = True) -> None:
+        """Send en protobuf-besked (alt med SerializeToString) som binær frame."""
+        payload = type_id.to_bytes(2, "little") + msg.SerializeToString()
+        await self.send_frame(FRAME_PROTO, payload, response)
+
+    async def send_many(self, msgs: List[Any], response: bool = True,
+                        max_bytes: Optional[int] = None) -> int:
+        """
+        Send mange små beskeder med få writes: beskederne pakkes i envelopes
+        {"_bl":"batch","m":[...]} (dict -> JSON, str -> rå linje), som ESP32
+        pakker ud og dispatcher i rækkefølge til de normale handlere.
+        max_bytes: største envelope (default én write, dvs. MTU-3).
+        Returnerer antal envelopes.
+        """
+        self._require_connected()
+        if max_bytes is None:
+            max_bytes = self._write_limit()
+
+        head, tail = b'{"_bl":"batch","m":[', b']}\n'
+        lines: List[bytes] = []
+        parts: List[bytes] = []
+        size = len(head) + len(tail)
+
+        def flush() -> None:
+            nonlocal parts, size
+            if parts:
+                lines.append(head + b",".join(parts) + tail if len(parts) > 1 else _single(parts[0]))
+            parts, size = [], len(head) + len(tail)
+
+        for m in msgs:
+            if isinstance(m, str):
+                m = m.rstrip("\n")
+            p = json.dumps(m, separators=(",", ":")).encode("utf-8")
+            extra = len(p) + (1 if parts else 0)
+            if parts and size + extra > max_bytes:
+                flush()
+                extra = len(p)
+            parts.append(p)
+            size += extra
+        flush()
+
+        futs = [self._enqueue_nowait(line, response) for line in lines]
+        await asyncio.gather(*futs)
+        return len(lines)
+
+    def tx_metrics(self) -> "TxMetrics":
+        """Snapshot af send-pipelinens tællere (siden connect)."""
+        m = self._txm
+        return TxMetrics(
+            messages=m.messages, bytes=m.bytes, writes=m.writes,
+            queue_depth=self._txq.qsize() if self._txq else 0,
+            max_queue_depth=m.max_queue_depth,
+            wait_avg_ms=(m.wait_total_ms / m.messages) if m.messages else 0.0,
+            wait_max_ms=m.wait_max_ms,
+            bytes_per_s=m.bytes / max(1e-9, time.monotonic() - m.since),
+        )
 
     async def send(self, command: str, payload: Optional[Dict[str, Any]] = None, response: bool = True) -> None:
         """
@@ -114,50 +404,613 @@ class BleLink:
         """
         await self.send_json({"command": command, "payload": (payload or {})}, response=response)
 
+    # ---- planlagt udførsel ----
+    async def sync_clock(self, samples: int = 5, timeout: float = 2.0) -> float:
+        """
+        NTP-agtig synk mod enhedens millis(): vælg målingen med kortest RTT.
+        Returnerer offset i ms (device_ms = host_ms + offset).
+        """
+        best_rtt, best_off = None, 0.0
+        for _ in range(max(1, samples)):
+            t0 = _host_ms()
+            reply = await self._request({"_bl": "time"}, "time", timeout)
+            t1 = _host_ms()
+            rtt = t1 - t0
+            if best_rtt is None or rtt < best_rtt:
+                best_rtt, best_off = rtt, reply["ms"] - (t0 + t1) / 2.0
+        self._clock_offset_ms, self.clock_rtt_ms = best_off, best_rtt
+        return best_off
+
+    def device_ms(self, host_ms: Optional[float] = None) -> int:
+        """Host-tid (ms, monotonic) -> enhedens millis() (uint32)."""
+        if self._clock_offset_ms is None:
+            raise RuntimeError("Kald sync_clock() først.")
+        h = _host_ms() if host_ms is None else host_ms
+        return int(h + self._clock_offset_ms) & 0xFFFFFFFF
+
+    async def schedule(self, steps: List[tuple], start_in: float = 0.5,
+                       timeout: float = 2.0) -> List["ScheduledCmd"]:
+        """
+        Upload en sekvens i én besked. steps = [(t_sek, cmd_dict), ...] relativt
+        til nu + start_in. Enheden udfører cmd via onReceiveJson til tiden.
+        Returnerer ét ScheduledCmd pr. step (samme rækkefølge): er enhedens kø
+        fuld, afvises resten (accepted=False), mens de accepterede stadig udføres.
+        """
+        if self._clock_offset_ms is None:
+            await self.sync_clock()
+        t0 = _host_ms() + start_in * 1000.0
+        cmds, out = [], []
+        for t, cmd in steps:
+            self._sched_id = (self._sched_id + 1) & 0xFFFF
+            at = self.device_ms(t0 + t * 1000.0)
+            out.append(ScheduledCmd(self._sched_id, at))
+            cmds.append({"id": self._sched_id, "at": at, "cmd": cmd})
+        ack = await self._request({"_bl": "sched", "cmds": cmds}, "sched_ack", timeout)
+        rej = set(ack.get("rej", []))
+        for c in out:
+            c.accepted = c.id not in rej
+        return out
+
+    async def clear_schedule(self) -> None:
+        await self.send_json({"_bl": "sched_clear"})
+
+    # ---- fjern-diagnose ----
+    async def get_device_stats(self, timeout: float = 3.0) -> Dict[str, Any]:
+        """Hent enhedens snapshot ({"_bl":"stats"}) som et læsbart dict."""
+        r = await self._request({"_bl": "stats"}, "stats", timeout)
+        rx, tx, q = r.get("rx", [0, 0]), r.get("tx", [0, 0, 0]), r.get("q", {})
+        heap, loop = r.get("heap", [0, 0, 0]), r.get("loop", [0, 0, 0])
+        return {
+            "uptime_ms": r.get("up"),
+            "rx_msgs": rx[0], "rx_bytes": rx[1], "rx_parsed": rx[2] if len(rx) > 2 else None,
+            "rx_cycles": rx[3] if len(rx) > 3 else None,   # CPU-cykler pr. dispatchet enhed
+            "tx_msgs": tx[0], "tx_bytes": tx[1], "tx_dropped": tx[2],
+            "tx_busy": tx[3] if len(tx) > 3 else None,     # notify afvist af stakken, sendt igen
+            "connects": r.get("con"),
+            "mtu": r.get("mtu"),
+            "sched_queue": q.get("sched"),
+            "rx_buffer": q.get("rxbuf"),
+            "tx_queue": q.get("tx"),
+            "tx_channels": [
+                dict(zip(("msgs", "bytes", "drops", "depth", "max_wait_ms", "bytes_per_s"), c))
+                for c in r.get("ch", [])
+            ],
+            "pool_in_use": q.get("pool"),
+            "pool_misses": r.get("pmiss"),
+            "pool_heap": r.get("pbig", [0, 0])[0],        # store beskeder lånt fra heapen
+            "tx_too_large": r.get("pbig", [0, 0])[1],     # afvist: over 64 KB
+            "heap_free": heap[0], "heap_min_free": heap[1], "heap_largest": heap[2],
+            "loop_count": loop[0], "loop_avg_us": loop[1], "loop_max_us": loop[2],
+            "crypto": dict(zip(("sessions", "sealed", "opened", "rejected", "plain_dropped"),
+                               r["sec"])) if "sec" in r else None,
+            "session": dict(zip(("fresh", "resumed", "resent", "gaps"),
+                                r["ses"])) if "ses" in r else None,
+            # protobuf-frames (BleLinkProto); fejl tælles her i stedet for Serial
+            "proto": dict(zip(("rx", "tx", "unknown", "decode_errors", "encode_errors"),
+                              r["pb"])) if "pb" in r else None,
+            "proto_last_error": dict(zip(("type", "error"), r["pberr"])) if "pberr" in r else None,
+            # RX-køer pr. prioritet; latens = modtaget -> dispatch i loop()
+            "rx_queues": {
+                name: dict(zip(("dispatched", "drops", "depth", "avg_us", "max_us", "heap"), c))
+                for name, c in zip(("high", "normal"), r.get("rxq", []))
+            },
+            # adaptive forbindelsesparametre (kun når enableConnPolicy er slået til)
+            "conn_policy": dict(zip(("mode", "requests", "deferred", "max_interval"),
+                                    r["cp"])) if "cp" in r else None,
+            # firmwareopdatering i gang eller afsluttet (ota.py)
+            "ota": dict(zip(("state", "off", "size", "gaps", "stalls", "blocks", "flash_ms"),
+                            r["ota"])) if "ota" in r else None,
+            # historik-ringen (history.py); kun når appen har kaldt history().begin()
+            "history": dict(zip(("records", "capacity", "queries", "frames", "sent",
+                                 "cancelled", "lost"), r["hist"])) if "hist" in r else None,
+        }
+
+    def start_stats_poller(self, interval: float, cb: Callable[[Dict[str, Any]], None]) -> None:
+        """Kald cb(stats) hvert interval sek., indtil stop_stats_poller()/disconnect()."""
+        self.stop_stats_poller()
+
+        async def poll() -> None:
+            while self.is_connected():
+                try:
+                    cb(await self.get_device_stats())
+                except (asyncio.TimeoutError, RuntimeError) as e:
+                    print(f"[BleLink] stats-poll fejlede: {e}")
+                await asyncio.sleep(interval)
+
+        self._stats_task = asyncio.get_running_loop().create_task(poll())
+
+    def stop_stats_poller(self) -> None:
+        if self._stats_task:
+            self._stats_task.cancel()
+            self._stats_task = None
+
+    def connect_metrics(self) -> Dict[str, "ConnectPhaseStats"]:
+        """Tid pr. forbindelsesfase over alle connect()-kald (kopi)."""
+        return {k: ConnectPhaseStats(**vars(v)) for k, v in self._conn_stats.items()}
+
+    # ---- kontrolbeskeder (lavniveau) ----
+    def on_control(self, op: str, cb: Optional[Callable[[Dict[str, Any]], None]]) -> None:
+        """Fast handler for pushede kontrolbeskeder med _bl == op (None fjerner)."""
+        if cb is None:
+            self._ctl_handlers.pop(op, None)
+        else:
+            self._ctl_handlers[op] = cb
+
+    async def control_request(self, msg: Dict[str, Any], reply_op: Any,
+                              timeout: float = 3.0) -> Dict[str, Any]:
+        """Send en kontrolbesked og vent på første svar med _bl == reply_op."""
+        return await self._request(msg, reply_op, timeout)
+
+    async def wait_control(self, op: str, timeout: float) -> Dict[str, Any]:
+        """Vent på næste kontrolbesked med _bl == op (uden at sende noget)."""
+        return await self._request(None, op, timeout)
+
     # ---------- intern ----------
 
+    def _require_connected(self) -> None:
+        if not (self._client and self._client.is_connected and self._rx_char and self._txq):
+            raise RuntimeError("Ikke forbundet.")
+
+    def _write_limit(self) -> int:
+        return max(20, getattr(self._client, "mtu_size", 23) - 3)
+
+    def _enqueue_nowait(self, data: bytes, response: bool) -> asyncio.Future:
+        self._require_connected()
+        fut = asyncio.get_running_loop().create_future()
+        self._txq.put_nowait(_TxItem(data, response, fut, time.monotonic()))
+        depth = self._txq.qsize()
+        if depth > self._txm.max_queue_depth:
+            self._txm.max_queue_depth = depth
+        return fut
+
+    async def _enqueue(self, data: bytes, response: bool) -> None:
+        await self._enqueue_nowait(data, response)
+
+    async def _start_writer(self, keep_queue: bool = False) -> None:
+        """
+        keep_queue: genoptaget session, de køede linjer sendes videre.
+        En tidligere writer stoppes først, så der aldrig er to om køen.
+        """
+        await self._pause_writer()
+        if not (keep_queue and self._txq):
+            self._fail_pending()
+            self._txq = asyncio.Queue()
+            self._txm = _TxCounters()
+        self._writer_task = asyncio.get_running_loop().create_task(self._writer())
+
+    async def _pause_writer(self) -> None:
+        """Stop writer-tasken, men behold køen (til genoptagelse)."""
+        task, self._writer_task = self._writer_task, None
+        if task:
+            task.cancel()
+            try:
+                await task
+            except (asyncio.CancelledError, Exception):
+                pass
+
+    async def _stop_writer(self) -> None:
+        await self._pause_writer()
+        self._fail_pending()
+        self._txq = None
+
+    def _fail_pending(self) -> None:
+        """Ventende sends (kø og gensendelsesvindue) fejler."""
+        items = list(self._sess.window)
+        self._sess.window.clear()
+        q = self._txq
+        while q and not q.empty():
+            items.append(q.get_nowait())
+        for item in items:
+            if not item.fut.done():
+                item.fut.set_exception(RuntimeError("Ikke forbundet."))
+
+    async def _write_direct(self, data: bytes) -> None:
+        """Skriv uden om køen (handshake/hello og gensendelse, før writeren starter)."""
+        if self._sec:
+            data = self._sec.seal(data)
+        limit = self._write_limit()
+        for i in range(0, len(data), limit):
+            await self._client.write_gatt_char(self._rx_char, data[i:i + limit], response=True)
+
+    async def _writer(self) -> None:
+        """
+        Eneste der skriver til RX: tager linjer fra køen og fletter
+        efterfølgende små linjer (samme response-flag) til writes på
+        højst MTU-3 bytes. Linjer deles kun, hvis de selv er større end
+        én write — og deles aldrig med andres bytes imellem.
+
+        Med kryptering forsegles hver linje først her, så tælleren følger
+        skriverækkefølgen (også ved gensendelse i en ny session). Hver linje
+        får et sekvensnummer og lægges i sessionens gensendelsesvindue.
+        """
+        pending: Optional[_TxItem] = None
+        while True:
+            first = pending or await self._txq.get()
+            pending = None
+            limit = self._write_limit()
+            over = _SecureSession.OVERHEAD if self._sec else 0
+            batch, size = [first], len(first.data) + over
+            while size < limit and not self._txq.empty():
+                nxt = self._txq.get_nowait()
+                if nxt.response != first.response or size + len(nxt.data) + over > limit:
+                    pending = nxt
+                    break
+                batch.append(nxt)
+                size += len(nxt.data) + over
+
+            now = time.monotonic()
+            for it in batch:
+                w = (now - it.t_enq) * 1000.0
+                self._txm.wait_total_ms += w
+                self._txm.wait_max_ms = max(self._txm.wait_max_ms, w)
+
+            for it in batch:
+                self._sess.tx_seq += 1
+                it.seq = self._sess.tx_seq
+                self._sess.window.append(it)
+            seal = self._sec.seal if self._sec else bytes
+            data = b"".join(seal(it.data) for it in batch)
+            try:
+                for i in range(0, len(data), limit):
+                    await self._client.write_gatt_char(self._rx_char, data[i:i + limit],
+                                                       response=first.response)
+                    self._txm.writes += 1
+            except asyncio.CancelledError:
+                if pending:
+                    self._requeue(pending)
+                raise                       # batch ligger i vinduet (se _fail_pending)
+            except Exception as e:
+                if self._sess.token and not self.is_connected():
+                    # linket er tabt: batch og kø venter på genoptagelse (connect())
+                    if pending:
+                        self._requeue(pending)
+                    self._writer_task = None
+                    self._park_session()
+                    return
+                for it in batch:
+                    if not it.fut.done():
+                        it.fut.set_exception(e)
+                continue
+            self._txm.messages += len(batch)
+            self._txm.bytes += len(data)
+            for it in batch:
+                if not it.fut.done():
+                    it.fut.set_result(None)
+
+    def _requeue(self, item: "_TxItem") -> None:
+        """Læg et element forrest i køen igen (asyncio.Queue har ingen appendleft)."""
+        rest = [item]
+        while not self._txq.empty():
+            rest.append(self._txq.get_nowait())
+        for it in rest:
+            self._txq.put_nowait(it)
+
+    async def _request(self, msg: Optional[Dict[str, Any]], reply_op: Any,
+                       timeout: float, direct: bool = False) -> Dict[str, Any]:
+        """
+        Send en kontrolbesked og vent på første svar med _bl == reply_op
+        (eller et af dem, hvis reply_op er en tuple). direct = uden om køen
+        og sessionens tællere (handshake/hello).
+        """
+        ops = reply_op if isinstance(reply_op, tuple) else (reply_op,)
+        fut = asyncio.get_running_loop().create_future()
+        for op in ops:
+            self._ctl_waiters.setdefault(op, []).append(fut)
+        try:
+            if msg is not None and direct:
+                await self._write_direct((json.dumps(msg, separators=(",", ":")) + "\n").encode())
+            elif msg is not None:
+                await self.send_json(msg)
+            return await asyncio.wait_for(fut, timeout)
+        finally:
+            for op in ops:
+                waiters = self._ctl_waiters.get(op, [])
+                if fut in waiters:
+                    waiters.remove(fut)
+
+    def _on_control(self, obj: Dict[str, Any]) -> None:
+        op = obj.get("_bl")
+        waiters = self._ctl_waiters.get(op)
+        while waiters:
+            fut = waiters.pop(0)
+            if not fut.done():
+                fut.set_result(obj)
+                return
+        handler = self._ctl_handlers.get(op)
+        if handler:
+            handler(obj)
+
+    def _on_log(self, obj: Dict[str, Any]) -> None:
+        if not self._cb_log:
+            return
+        entries = obj.get("e", [])
+        dropped = obj.get("d", 0)
+        if dropped:
+            ms = entries[0][0] if entries else 0
+            self._cb_log(LogRecord(ms, "W", f"{dropped} log-linjer tabt på enheden", dropped))
+        for ms, level, text in entries:
+            self._cb_log(LogRecord(ms, level, text))
+
+    def _on_rx_drop(self, obj: Dict[str, Any]) -> None:
+        # enhedens RX-kø var fuld i BL_RX_WAIT_MS: enheder er tabt (ikke talt i rx)
+        n = int(obj.get("n", 0))
+        if n > self.rx_dropped:
+            print(f"[BleLink] enheden tabte {n - self.rx_dropped} enheder (RX-kø fuld)")
+        self.rx_dropped = n
+
+    def _on_sched_done(self, obj: Dict[str, Any]) -> None:
+        if self._cb_sched:
+            self._cb_sched([{"id": r[0], "late_ms": r[1]} for r in obj.get("r", [])])
+
+    @contextmanager
+    def _phase(self, name: str):
+        """Tidsmål en fase af connect(); fejl registreres og sendes videre."""
+        t0 = time.monotonic()
+        try:
+            yield
+        except BaseException as e:
+            self._record_phase(name, t0, e)
+            raise
+        self._record_phase(name, t0, None)
+
+    def _record_phase(self, name: str, t0: float, err: Optional[BaseException]) -> None:
+        ev = ConnectPhase(attempt=self._conn_attempt, phase=name,
+                          ms=(time.monotonic() - t0) * 1000.0, ok=err is None,
+                          error=None if err is None else (str(err) or type(err).__name__))
+        self.last_connect.append(ev)
+        st = self._conn_stats.setdefault(name, ConnectPhaseStats())
+        st.count += 1
+        st.failures += 0 if ev.ok else 1
+        st.total_ms += ev.ms
+        st.min_ms = ev.ms if st.count == 1 else min(st.min_ms, ev.ms)
+        st.max_ms = max(st.max_ms, ev.ms)
+        st.last_ms = ev.ms
+        if self._cb_conn:
+            try:
+                self._cb_conn(ev)
+            except Exception as e:          # callbackens fejl må ikke vælte connect()
+                print(f"[BleLink] on_connect_event: {e}")
+
     async def _connect_once(self, timeout: float, scan_timeout: float) -> None:
-        dev = await BleakScanner.find_device_by_name(self.device_name, timeout=scan_timeout)
-        if not dev:
-            raise RuntimeError(f"Enhed '{self.device_name}' ikke fundet (scan timeout).")
+        with self._phase("scan"):
+            dev = await self._transport.find_device_by_name(self.device_name, scan_timeout)
+            if not dev:
+                raise RuntimeError(f"Enhed '{self.device_name}' ikke fundet (scan timeout).")
 
-        client = BleakClient(dev, timeout=timeout)
-        await client.connect()
+        # Bleak opdager services under connect() på de fleste backends;
+        # "services" er derfor kun opslaget i den færdige tabel
+        client = self._transport.client(dev, timeout)
+        with self._phase("connect"):
+            await client.connect()
         self._client = client
 
         # Find præcis NUS-service → karakteristika (undgår “multiple char with same UUID”)
         self._tx_char = self._rx_char = None
-        for svc in client.services:
-            if str(svc.uuid).lower() == SERVICE_UUID.lower():
-                t = svc.get_characteristic(TX_UUID)
-                r = svc.get_characteristic(RX_UUID)
-                if t and r:
-                    self._tx_char, self._rx_char = t, r
-                    break
-        if not (self._tx_char and self._rx_char):
-            await client.disconnect()
-            self._client = None
-            raise RuntimeError("Kunne ikke finde NUS TX/RX i samme service.")
+        with self._phase("services"):
+            for svc in client.services:
+                if str(svc.uuid).lower() == SERVICE_UUID.lower():
+                    t = svc.get_characteristic(TX_UUID)
+                    r = svc.get_characteristic(RX_UUID)
+                    if t and r:
+                        self._tx_char, self._rx_char = t, r
+                        break
+            if not (self._tx_char and self._rx_char):
+                await client.disconnect()
+                self._client = None
+                raise RuntimeError("Kunne ikke finde NUS TX/RX i samme service.")
+
+        await self._pause_writer()          # en tidligere forbindelses writer
+        if self._sess_expiry:
+            self._sess_expiry.cancel()
+            self._sess_expiry = None
+        self._rxbuf.clear()
+        self._sec = None
+        self._sec_rxbuf.clear()
+        with self._phase("notify"):
+            await client.start_notify(self._tx_char, self._on_notify)
+        try:
+            if self.psk:
+                with self._phase("handshake"):
+                    await self._handshake(timeout)
+            with self._phase("hello"):
+                resumed = await self._hello(min(timeout, 3.0))
+        except Exception:
+            await self.disconnect()
+            raise
+        await self._start_writer(keep_queue=resumed)
+        self.connections += 1
+
+    async def _handshake(self, timeout: float) -> None:
+        """
+        sec_hello: udveksl nonces, tjek at enheden kender psk, afled sessionsnøgle.
+        Nøglen sættes i selve svarets handler (under _parse), så krypterede
+        frames, der følger lige efter svaret i samme notifikation, kan åbnes.
+        """
+        hn = os.urandom(_SecureSession.NONCE_LEN)
+        fut = asyncio.get_running_loop().create_future()
+
+        def on_reply(r: Dict[str, Any]) -> None:
+            if fut.done():
+                return
+            if "err" in r:
+                fut.set_exception(RuntimeError(f"Enheden afviste kryptering: {r['err']}"))
+                return
+            try:
+                dn = bytes.fromhex(r.get("dn", ""))
+                auth = bytes.fromhex(r.get("auth", ""))
+            except ValueError:
+                dn = auth = b""
+            if len(dn) != _SecureSession.NONCE_LEN or not hmac.compare_digest(
+                    auth, _SecureSession.derive(self.psk, b"BLa", hn, dn)[:_SecureSession.AUTH_LEN]):
+                fut.set_exception(RuntimeError("Enheden kender ikke psk (auth passer ikke)."))
+                return
+            self._sec = _SecureSession(
+                _SecureSession.derive(self.psk, b"BLk", hn, dn)[:_SecureSession.KEY_LEN])
+            fut.set_result(None)
+
+        self.on_control("sec_hello", on_reply)
+        try:
+            await self._write_direct((json.dumps({"_bl": "sec_hello", "hn": hn.hex()},
+                                                 separators=(",", ":")) + "\n").encode())
+            await asyncio.wait_for(fut, timeout)
+        except asyncio.TimeoutError:
+            raise RuntimeError("Intet svar på sec_hello.") from None
+        finally:
+            self.on_control("sec_hello", None)
+
+    async def _hello(self, timeout: float) -> bool:
+        """
+        Genoptag sessionen (token + hvor meget vi har modtaget) eller start en
+        ny. Ved genoptagelse sender enheden selv det, vi mangler; vi sender
+        det, enheden mangler, før writeren starter. True = genoptaget.
+        """
+        s = self._sess
+        msg: Dict[str, Any] = {"_bl": "hello", "rx": s.rx_seq}
+        if self.resume and s.token:
+            msg["tok"] = s.token
+        try:
+            r = await self._request(msg, "hello", timeout, direct=True)
+        except asyncio.TimeoutError:
+            print("[BleLink] intet svar på hello (firmware uden sessioner?)")
+            self._new_session(None)
+            return False
+        if not r.get("resumed"):
+            self._new_session(r.get("tok"))
+            return False
+
+        dev_rx = int(r.get("rx", 0))
+        lost = [it for it in s.window if it.seq > dev_rx]
+        if lost and lost[0].seq != dev_rx + 1:
+            print(f"[BleLink] gensendelsesvinduet rækker ikke tilbage til {dev_rx + 1}")
+        for it in lost:
+            await self._write_direct(it.data)
+            s.resent += 1
+        for it in s.window:
+            if not it.fut.done():
+                it.fut.set_result(None)
+        s.resumes += 1
+        return True
+
+    def _new_session(self, token: Optional[str]) -> None:
+        self._fail_pending()
+        self._sess.reset(token)
+
+    def _park_session(self) -> None:
+        """Linket er tabt: giv op, hvis connect() ikke kommer inden for RESUME_S."""
+        if not self._sess_expiry:
+            self._sess_expiry = asyncio.get_running_loop().call_later(RESUME_S, self._drop_session)
+
+    def _drop_session(self) -> None:
+        if self._sess_expiry:
+            self._sess_expiry.cancel()
+            self._sess_expiry = None
+        if self._writer_task is None:       # ellers ejer writeren køen stadig
+            self._fail_pending()
+        self._sess.token = None
 
-        await client.start_notify(self._tx_char, self._on_notify)
+    def crypto_stats(self) -> Dict[str, int]:
+        sec = self._sec
+        return {"active": int(sec is not None),
+                "sealed": sec.sealed if sec else 0,
+                "opened": sec.opened if sec else 0,
+                "rejected": sec.rejected if sec else 0,
+                "plain_dropped": self.plain_dropped}
+
+    def _on_msg_frame(self, payload: bytes) -> None:
+        if not payload:
+            return
+        h = self._msg_handlers.get(payload[0])
+        if h:
+            cls, cb = h
+            cb(cls.decode(memoryview(payload)[1:]))
+
+    def _on_proto_frame(self, payload: bytes) -> None:
+        if len(payload) < 2:
+            return
+        h = self._proto_handlers.get(payload[0] | payload[1] << 8)
+        if h:
+            cls, cb = h
+            cb(cls.FromString(payload[2:]))
+
+    def _on_secure_frame(self, payload: bytes) -> None:
+        plain = self._sec.open(payload) if self._sec else None
+        if plain is not None:
+            self._sec_rxbuf.extend(plain)
+            self._parse(self._sec_rxbuf, inner=True)
 
     def _on_notify(self, _handle: int, data: bytearray) -> None:
         self._rxbuf.extend(data)
-        while True:
+        self._parse(self._rxbuf, inner=False)
+
+    def _parse(self, buf: bytearray, inner: bool) -> None:
+        """Del buf i hele linjer/frames og dispatch dem. inner = dekrypteret indhold."""
+        strict = self.psk is not None and not inner   # kun handshake i klartekst
+        while buf:
+            # binær frame (tekstlinjer indeholder aldrig 0x00)
+            if buf[0] == FRAME_START:
+                if len(buf) < FRAME_HEADER:
+                    break
+                n = buf[2] | buf[3] << 8
+                if len(buf) < FRAME_HEADER + n:
+                    break
+                ftype = buf[1]
+                payload = bytes(buf[FRAME_HEADER:FRAME_HEADER + n])
+                del buf[:FRAME_HEADER + n]
+                if inner and ftype == FRAME_SECURE:
+                    continue                    # aldrig kryptering i kryptering
+                if strict and ftype != FRAME_SECURE:
+                    self.plain_dropped += 1
+                    continue
+                if ftype != FRAME_SECURE:
+                    self._sess.rx_seq += 1      # indholdet af krypterede tælles
+                handler = self._frame_handlers.get(ftype)
+                if handler:
+                    try:
+                        handler(payload)
+                    except Exception as e:
+                        print(f"[BleLink] frame 0x{ftype:02x}: {e}")
+                continue
+
             try:
-                idx = self._rxbuf.index(0x0A)  # '\n'
+                idx = buf.index(0x0A)  # '\n'
             except ValueError:
                 break
-            line = self._rxbuf[:idx]
-            del self._rxbuf[:idx+1]
-            txt = line.decode("utf-8", errors="ignore").strip()
-            if not txt:
+            line = bytes(buf[:idx]).strip()
+            del buf[:idx+1]
+            if strict and not _is_sec_hello(line):
+                self.plain_dropped += 1
+                continue
+            # enheden sætter "_bl" først; handshakes tælles ikke i sessionen.
+            # En ny session tæller fra hello-svaret (det, der følger det, kan
+            # nå frem, før _hello() kører videre)
+            if line.startswith((b'{"_bl":"hello"', b'{"_bl":"sec_hello"')):
+                self._sess.rx_mark = self._sess.rx_seq
+            else:
+                self._sess.rx_seq += 1
+            if not line:
                 continue
+            if self._cb_test and line.startswith(b"~T"):
+                self._cb_test(line.decode("utf-8", errors="ignore"))
+                continue
+            self._dispatch_line(Message(line))
 
-            # prøv JSON først
-            delivered = False
+    def _dispatch_line(self, msg: "Message") -> None:
+        """Kontrolbesked, on_message eller json/pair/raw. JSON dekodes kun, hvis nogen skal bruge det."""
+        # 0) reserverede kontrolbeskeder håndteres internt
+        if msg.control_op is not None:
+            try:
+                self._on_control(msg.json)
+            except Exception as e:
+                print(f"[BleLink] kontrolbesked {msg.control_op}: {e}")
+            return
+        if self._cb_msg:
+            self._cb_msg(msg)
+            return
+
+        delivered = False
+        if (self._cb_json or self._cb_pair) and msg.is_json:
+            obj = msg.json
             try:
-                obj = json.loads(txt)
                 # 1) json-callback
                 if self._cb_json:
                     self._cb_json(obj)
@@ -171,9 +1024,580 @@ class BleLink:
             except Exception:
                 pass
 
-            # 3) raw fallback (ikke-JSON eller ingen callbacks ovenfor)
-            if not delivered and self._cb_raw:
-                self._cb_raw(txt)
+        # 3) raw fallback (ikke-JSON eller ingen callbacks ovenfor)
+        if not delivered and self._cb_raw:
+            self._cb_raw(msg.text)
+
+
+class BleakTransport:
+    """
+    Hvordan BleLink finder og forbinder til enheden: rigtig BLE via bleak.
+    Andre transporter (fx fleet_sim.SimTransport) leverer samme to metoder
+    og en klient med BleakClients API (connect, services, write_gatt_char,
+    start_notify, ...).
+    """
+
+    async def find_device_by_name(self, name: str, timeout: float) -> Any:
+        return await BleakScanner.find_device_by_name(name, timeout=timeout)
+
+    def client(self, device: Any, timeout: float) -> Any:
+        return BleakClient(device, timeout=timeout)
+
+    def scanner(self, cb: Callable[[Any, Any], None]) -> Any:
+        return BleakScanner(detection_callback=cb)
+
+
+def _is_sec_hello(line: bytes) -> bool:
+    return Message(line).control_op == "sec_hello"
+
+
+_UNSET = object()
+_NOT_JSON = object()
+
+
+class Message:
+    """
+    Én modtaget linje (on_message). raw er de rå bytes (uden '\\n');
+    JSON dekodes først, når json/is_json læses, og kun én gang.
+    Kontrolbeskeder genkendes uden at dekode andet: kun linjer med "_bl".
+    """
+    __slots__ = ("raw", "_obj", "_text")
+    parses = 0                  # antal JSON-dekodninger i alt (alle links)
+
+    def __init__(self, raw: bytes):
+        self.raw = raw
+        self._obj: Any = _UNSET
+        self._text: Optional[str] = None
+
+    @property
+    def text(self) -> str:
+        if self._text is None:
+            self._text = self.raw.decode("utf-8", errors="ignore")
+        return self._text
+
+    @property
+    def is_json(self) -> bool:
+        if self._obj is _UNSET:
+            Message.parses += 1
+            try:
+                self._obj = json.loads(self.raw)
+            except ValueError:
+                self._obj = _NOT_JSON
+        return self._obj is not _NOT_JSON
+
+    @property
+    def json(self) -> Any:
+        """Dekodet JSON; ValueError hvis linjen ikke er JSON."""
+        if not self.is_json:
+            raise ValueError("ikke JSON")
+        return self._obj
+
+    @property
+    def control_op(self) -> Optional[str]:
+        """Værdien af "_bl" for kontrolbeskeder, ellers None."""
+        if self._obj is _UNSET and b'"_bl"' not in self.raw:
+            return None
+        if not self.is_json or not isinstance(self._obj, dict):
+            return None
+        op = self._obj.get("_bl")
+        return op if isinstance(op, str) else None
+
+    def __repr__(self) -> str:
+        return f"Message({self.raw!r})"
+
+
+class _SecureSession:
+    """
+    AES-128-CCM-session (se esp32/src/BleLinkCrypto.h): nonce = [retning]
+    [tæller u32 LE][0 x 8], retning 2 = vært->enhed, 1 = enhed->vært.
+    """
+    KEY_LEN, NONCE_LEN, AUTH_LEN, TAG_LEN = 16, 8, 8, 8
+    OVERHEAD = FRAME_HEADER + 4 + TAG_LEN   # pr. forseglet linje/frame
+    MAX_PLAIN = 2048 - 4 - TAG_LEN          # enhedens BL_FRAME_MAX_RX minus tæller og tag
+    DIR_TX, DIR_RX = 2, 1
+
+    def __init__(self, key: bytes):
+        from cryptography.hazmat.primitives.ciphers.aead import AESCCM
+        self._aead = AESCCM(key, tag_length=self.TAG_LEN)
+        self.tx_ctr = 0
+        self.rx_ctr = 0
+        self.sealed = self.opened = self.rejected = 0
+
+    @staticmethod
+    def derive(psk: bytes, label: bytes, hn: bytes, dn: bytes) -> bytes:
+        return hmac.new(psk, label + hn + dn, hashlib.sha256).digest()
+
+    @staticmethod
+    def _nonce(direction: int, ctr: int) -> bytes:
+        return bytes((direction,)) + ctr.to_bytes(4, "little") + bytes(8)
+
+    def seal(self, data: bytes) -> bytes:
+        """
+        Én linje/frame -> krypteret frame (type 0x03). Over MAX_PLAIN deles
+        klarteksten i flere frames; enheden samler dem i én strøm.
+        """
+        out = bytearray()
+        for i in range(0, max(len(data), 1), self.MAX_PLAIN):
+            self.tx_ctr += 1
+            ctr = self.tx_ctr.to_bytes(4, "little")
+            body = ctr + self._aead.encrypt(self._nonce(self.DIR_TX, self.tx_ctr),
+                                            bytes(data[i:i + self.MAX_PLAIN]), None)
+            self.sealed += 1
+            out += bytes((FRAME_START, FRAME_SECURE)) + len(body).to_bytes(2, "little") + body
+        return bytes(out)
+
+    def open(self, payload: bytes) -> Optional[bytes]:
+        """Krypteret frame-payload -> klartekst (None = afvist)."""
+        from cryptography.exceptions import InvalidTag
+        if len(payload) < 4 + self.TAG_LEN:
+            self.rejected += 1
+            return None
+        ctr = int.from_bytes(payload[:4], "little")
+        if ctr <= self.rx_ctr:
+            self.rejected += 1          # replay / gammel tæller
+            return None
+        try:
+            plain = self._aead.decrypt(self._nonce(self.DIR_RX, ctr), payload[4:], None)
+        except InvalidTag:
+            self.rejected += 1
+            return None
+        self.rx_ctr = ctr
+        self.opened += 1
+        return plain
+
+
+_LOG_LEVELS = {"E": logging.ERROR, "W": logging.WARNING, "I": logging.INFO, "D": logging.DEBUG}
+
+
+@dataclass
+class LogRecord:
+    """Én log-linje fra enheden."""
+    device_ms: int          # enhedens millis() da linjen blev logget
+    level: str              # "E", "W", "I", "D"
+    text: str
+    dropped: int = 0        # > 0: resumé af tabte linjer
+
+    @property
+    def levelno(self) -> int:
+        """Niveau som i Pythons logging-modul."""
+        return _LOG_LEVELS.get(self.level, logging.INFO)
+
+
+@dataclass
+class _TxItem:
+    data: bytes
+    response: bool
+    fut: asyncio.Future
+    t_enq: float
+    seq: int = 0                # sessionens sekvensnummer (sat af writeren)
+
+
+@dataclass
+class _Session:
+    """Sessionstilstand, der overlever en afbrydelse (token + tællere)."""
+    token: Optional[str] = None
+    epoch: int = 0              # tælles op ved hver ny session
+    tx_seq: int = 0             # linjer/frames skrevet til enheden
+    rx_seq: int = 0             # linjer/frames modtaget fra enheden
+    rx_mark: int = 0            # rx_seq da hello-svaret kom
+    window: deque = field(default_factory=lambda: deque(maxlen=RESEND_WINDOW))
+    resumes: int = 0
+    resent: int = 0
+
+    def reset(self, token: Optional[str]) -> None:
+        self.token = token
+        self.epoch += 1
+        self.tx_seq = 0
+        self.rx_seq -= self.rx_mark
+        self.rx_mark = 0
+        self.window.clear()
+
+
+@dataclass
+class ScheduledCmd:
+    """Én planlagt kommando fra schedule()."""
+    id: int                 # går igen i on_schedule_report
+    at: int                 # enhedens millis() for udførslen
+    accepted: bool = True   # False = afvist (enhedens kø eller arena fuld)
+
+
+@dataclass
+class ConnectPhase:
+    """Én fase af et connect-forsøg (on_connect_event / last_connect)."""
+    attempt: int            # forsøg nr. i connect() (1..attempts)
+    phase: str              # scan, connect, services, notify, handshake, hello,
+                            # retry_wait eller total (hele connect()-kaldet)
+    ms: float
+    ok: bool
+    error: Optional[str] = None
+
+
+@dataclass
+class ConnectPhaseStats:
+    """Samlet tid for én fase over alle connect()-kald (connect_metrics())."""
+    count: int = 0
+    failures: int = 0
+    total_ms: float = 0.0
+    min_ms: float = 0.0
+    max_ms: float = 0.0
+    last_ms: float = 0.0
+
+    @property
+    def avg_ms(self) -> float:
+        return self.total_ms / self.count if self.count else 0.0
+
+
+@dataclass
+class _TxCounters:
+    messages: int = 0
+    bytes: int = 0
+    writes: int = 0
+    max_queue_depth: int = 0
+    wait_total_ms: float = 0.0
+    wait_max_ms: float = 0.0
+    since: float = field(default_factory=time.monotonic)
+
+
+@dataclass
+class TxMetrics:
+    """Send-pipelinens nøgletal (BleLink.tx_metrics())."""
+    messages: int
+    bytes: int
+    writes: int             # GATT-writes; < messages når linjer flettes
+    queue_depth: int
+    max_queue_depth: int
+    wait_avg_ms: float      # tid fra send_*() til write starter
+    wait_max_ms: float
+    bytes_per_s: float
+
+
+def _single(part: bytes) -> bytes:
+    """Ét element fra send_many sendes som almindelig linje (uden envelope)."""
+    obj = json.loads(part)
+    if isinstance(obj, str):
+        return (obj + "\n").encode("utf-8")
+    return part + b"\n"
+
+
+def apply_merge_patch(target: Any, patch: Any) -> Any:
+    """RFC 7386: returnér target med patch anvendt (target ændres ikke)."""
+    if not isinstance(patch, dict):
+        return patch
+    out = dict(target) if isinstance(target, dict) else {}
+    for k, v in patch.items():
+        if v is None:
+            out.pop(k, None)
+        else:
+            out[k] = apply_merge_patch(out.get(k), v)
+    return out
+
+
+def make_merge_patch(old: Any, new: Any) -> Any:
+    """
+    Mindste RFC 7386-patch, der fører old over i new ({} = ingen ændring).
+    Bemærk: merge patch kan ikke sætte en værdi til null (null = slet).
+    """
+    if not (isinstance(old, dict) and isinstance(new, dict)):
+        return new
+    patch: Dict[str, Any] = {}
+    for k in old:
+        if k not in new:
+            patch[k] = None
+    for k, v in new.items():
+        if k not in old:
+            patch[k] = v
+        elif isinstance(v, dict) and isinstance(old[k], dict):
+            sub = make_merge_patch(old[k], v)
+            if sub:
+                patch[k] = sub
+        elif v != old[k]:
+            patch[k] = v
+    return patch
+
+
+class ConfigSync:
+    """
+    Hold enhedens versionerede konfiguration (BleLinkConfig) i synk med
+    kun diffs:
+
+      cfg = ConfigSync(link)
+      await cfg.load()                       # hent doc + version
+      await cfg.update({**cfg.doc, "rate": 20})
+      await cfg.patch({"filter": {"alpha": 0.3}})
+
+    Afviser enheden patchen (version passer ikke — fx ændret af en anden
+    vært eller af appen), hentes enhedens dokument igen, og samme patch
+    lægges på den friske udgave og sendes med den nye version (rebases).
+    Kun hvis også det afvises, sendes hele det rebasede dokument (cfg_set).
+    Andres ændringer overskrives altså ikke med værtens gamle kopi.
+
+    Store dokumenter (over ~768 B serialiseret) kommer i cfg_part-dele før
+    svaret; load() samler dem.
+    """
+
+    def __init__(self, link: BleLink, timeout: float = 3.0):
+        self.link = link
+        self.timeout = timeout
+        self.doc: Dict[str, Any] = {}
+        self.version: Optional[int] = None
+        self.full_syncs = 0
+        self.rebases = 0
+        self._parts: List[str] = []
+        self._parts_v: Optional[int] = None
+
+    async def load(self) -> Dict[str, Any]:
+        # Delene går til den ConfigSync, der henter lige nu (én handler pr. link)
+        self.link.on_control("cfg_part", self._on_part)
+        self._parts, self._parts_v = [], None
+        r = await self.link.control_request({"_bl": "cfg_get"}, "cfg", self.timeout)
+        if "parts" in r:
+            if self._parts_v != r["v"] or len(self._parts) != r["parts"]:
+                raise RuntimeError("konfigurationen kom ikke helt frem")
+            self.doc = json.loads("".join(self._parts))
+        else:
+            self.doc = r.get("doc") or {}
+        self.version = r["v"]
+        return self.doc
+
+    def _on_part(self, obj: Dict[str, Any]) -> None:
+        # i = 0 eller ny version: enheden er startet forfra
+        if obj.get("i") == 0 or obj.get("v") != self._parts_v:
+            self._parts, self._parts_v = [], obj.get("v")
+        if obj.get("i") == len(self._parts):
+            self._parts.append(obj.get("d", ""))
+
+    async def update(self, new_doc: Dict[str, Any]) -> int:
+        """Send forskellen mellem nuværende og new_doc. Returnerer ny version."""
+        if self.version is None:
+            await self.load()
+        return await self._send_patch(make_merge_patch(self.doc, new_doc))
+
+    async def patch(self, patch: Dict[str, Any]) -> int:
+        """Send en merge patch direkte. Returnerer ny version."""
+        if self.version is None:
+            await self.load()
+        return await self._send_patch(patch)
+
+    async def full_sync(self, doc: Optional[Dict[str, Any]] = None) -> int:
+        doc = self.doc if doc is None else doc
+        r = await self.link.control_request({"_bl": "cfg_set", "doc": doc}, "cfg_ack", self.timeout)
+        self.doc, self.version = doc, r["v"]
+        self.full_syncs += 1
+        return self.version
+
+    async def _send_patch(self, patch: Dict[str, Any]) -> int:
+        if not patch:
+            return self.version
+        if await self._try_patch(patch):
+            return self.version
+        # Enhedens version er flyttet: læg patchen på dens dokument, ikke vores
+        await self.load()
+        self.rebases += 1
+        if await self._try_patch(patch):
+            return self.version
+        return await self.full_sync(apply_merge_patch(self.doc, patch))
+
+    async def _try_patch(self, patch: Dict[str, Any]) -> bool:
+        r = await self.link.control_request(
+            {"_bl": "cfg_patch", "base": self.version, "p": patch},
+            ("cfg_ack", "cfg_nak"), self.timeout)
+        if r["_bl"] == "cfg_nak":
+            return False
+        self.doc, self.version = apply_merge_patch(self.doc, patch), r["v"]
+        return True
+
+
+class RegisterCache:
+    """
+    Værts-cache for enhedens registerkort (BleLinkRegs).
+
+      regs = RegisterCache(link)
+      vals = await regs.read([1, 2, 5])       # kun ukendte id'er hentes (én frame)
+      await regs.write({3: 12, 4: 1.5})       # bulk-skriv (én frame)
+      regs.on_change(lambda changes: ...)     # enhedens push-notifikationer
+
+    Enheden pusher alle ændringer ({"_bl":"reg_n"}), så cachede værdier er
+    gyldige, så længe sessionen består (også hen over en genoptaget
+    reconnect); ved ny session tømmes cachen.
+    """
+
+    def __init__(self, link: BleLink, timeout: float = 3.0):
+        self.link = link
+        self.timeout = timeout
+        self.values: Dict[int, Any] = {}
+        self.hits = 0
+        self.misses = 0
+        self._epoch = link.session_epoch
+        self._cb: Optional[Callable[[Dict[int, Any]], None]] = None
+        link.on_control("reg_n", self._on_notify)
+
+    def on_change(self, cb: Callable[[Dict[int, Any]], None]) -> None:
+        self._cb = cb
+
+    async def read(self, ids: Optional[List[int]] = None, refresh: bool = False) -> Dict[int, Any]:
+        """Læs registre (None = alle). Cachede værdier koster ingen round trip."""
+        self._check_epoch()
+        if ids is None:
+            await self._fetch(None)
+            return dict(self.values)
+        missing = list(ids) if refresh else [i for i in ids if i not in self.values]
+        self.hits += len(ids) - len(missing)
+        self.misses += len(missing)
+        if missing:
+            await self._fetch(missing)
+        return {i: self.values[i] for i in ids if i in self.values}
+
+    async def write(self, values: Dict[int, Any]) -> List[int]:
+        """Skriv flere registre i én frame. Returnerer de accepterede id'er."""
+        self._check_epoch()
+        r = await self.link.control_request(
+            {"_bl": "reg_w", "v": {str(k): v for k, v in values.items()}},
+            "reg_wack", self.timeout)
+        ok = r.get("ok", [])
+        stored = r.get("v", {})                 # enhedens værdi efter typens coercion
+        for i in ok:
+            self.values[i] = stored.get(str(i), values[i])
+        if r.get("err"):
+            raise RuntimeError(f"Registre afvist (ukendt/skrivebeskyttet): {r['err']}")
+        return ok
+
+    def invalidate(self) -> None:
+        self.values.clear()
+
+    def _check_epoch(self) -> None:
+        if self._epoch != self.link.session_epoch:
+            self._epoch = self.link.session_epoch
+            self.values.clear()
+
+    async def _fetch(self, ids: Optional[List[int]]) -> None:
+        msg: Dict[str, Any] = {"_bl": "reg_r"}
+        if ids:
+            msg["ids"] = ids
+        r = await self.link.control_request(msg, "reg", self.timeout)
+        self.values.update({int(k): v for k, v in r.get("v", {}).items()})
+
+    def _on_notify(self, obj: Dict[str, Any]) -> None:
+        self._check_epoch()
+        changes = {int(k): v for k, v in obj.get("v", {}).items()}
+        self.values.update(changes)
+        if self._cb and changes:
+            self._cb(changes)
+
+
+def _host_ms() -> float:
+    return time.monotonic() * 1000.0
+
+
+@dataclass
+class Broadcast:
+    """Én afkodet broadcast-pakke fra en enhed."""
+    address: str
+    name: Optional[str]
+    rssi: int
+    version: int
+    seq: int
+    payload: bytes
+    received_at: float      # time.monotonic()
+
+
+@dataclass
+class BroadcastStats:
+    """Opdateringsstatistik pr. enhed (målt på værten)."""
+    packets: int = 0        # modtagne pakker (inkl. gentagelser af samme seq)
+    updates: int = 0        # nye seq-værdier
+    missed: int = 0         # overspringede seq-værdier
+    last_update: float = 0.0
+    gaps: List[float] = field(default_factory=list)  # sek. mellem nye seq
+    latency: List[float] = field(default_factory=list)  # sek. fra opdatering til afkodning (stamped)
+
+    @property
+    def mean_gap(self) -> float:
+        return sum(self.gaps) / len(self.gaps) if self.gaps else 0.0
+
+    @property
+    def mean_latency(self) -> float:
+        return sum(self.latency) / len(self.latency) if self.latency else 0.0
+
+
+def decode_broadcast(data: bytes) -> Optional[tuple]:
+    """Manufacturer data (uden company id) -> (version, seq, payload) eller None."""
+    if len(data) < 3 or data[0] != BC_MAGIC:
+        return None
+    return data[1], data[2], bytes(data[3:])
+
+
+def broadcast_stamp(t: Optional[float] = None) -> bytes:
+    """Tidsstempel til starten af en payload: vægur i ms (mod 2^32), u32 LE."""
+    return (int((time.time() if t is None else t) * 1000.0) & 0xFFFFFFFF).to_bytes(4, "little")
+
+
+class BroadcastScanner:
+    """
+    Forbindelsesløs modtagelse af status fra alle BleLink-enheder i nærheden
+    (ESP32: setBroadcast). Der forbindes aldrig.
+
+      scanner = BroadcastScanner(lambda b: print(b.name, b.payload))
+      await scanner.run(30.0)      # eller start()/stop()
+      scanner.stats                # {address: BroadcastStats}
+
+    `stats[addr].gaps` er tiden mellem to nye seq-værdier set fra værten — det
+    er enhedens interval plus advertising- og scan-kadence, ikke latens.
+    Med stamped=True starter payloaden med broadcast_stamp() fra opdateringen
+    (enhed og vært deler vægur, fx fleet_sim.py), og `stats[addr].latency` er
+    tiden fra enheden opdaterede payloaden, til værten afkodede den.
+    """
+
+    def __init__(self, cb: Callable[[Broadcast], None], name_prefix: Optional[str] = None,
+                 transport: Optional[BleakTransport] = None, stamped: bool = False):
+        self._cb = cb
+        self._prefix = name_prefix
+        self._stamped = stamped
+        self._last_seq: Dict[str, int] = {}
+        self.stats: Dict[str, BroadcastStats] = {}
+        self._scanner = (transport or BleakTransport()).scanner(self._on_adv)
+
+    async def start(self) -> None:
+        await self._scanner.start()
+
+    async def stop(self) -> None:
+        await self._scanner.stop()
+
+    async def run(self, duration: float) -> None:
+        await self.start()
+        try:
+            await asyncio.sleep(duration)
+        finally:
+            await self.stop()
+
+    def _on_adv(self, dev, adv) -> None:
+        data = adv.manufacturer_data.get(BC_COMPANY_ID)
+        if data is None:
+            return
+        name = adv.local_name or dev.name
+        if self._prefix and not (name or "").startswith(self._prefix):
+            return
+        dec = decode_broadcast(data)
+        if not dec:
+            return
+        version, seq, payload = dec
+        now = time.monotonic()
+
+        st = self.stats.setdefault(dev.address, BroadcastStats())
+        st.packets += 1
+        prev = self._last_seq.get(dev.address)
+        if prev == seq:
+            return                              # samme opdatering set igen
+        if prev is not None:
+            st.missed += ((seq - prev) & 0xFF) - 1
+            st.gaps.append(now - st.last_update)
+        st.updates += 1
+        st.last_update = now
+        self._last_seq[dev.address] = seq
+        if self._stamped and len(payload) >= 4:
+            sent = int.from_bytes(payload[:4], "little")
+            st.latency.append(((int(time.time() * 1000.0) - sent) & 0xFFFFFFFF) / 1000.0)
+
+        self._cb(Broadcast(dev.address, name, adv.rssi, version, seq, payload, now))
 
 
 # ---------- lille demo ----------
@@ -0,0 +1,222 @@
+"""
+GENERERET af python/blgen.py fra schema/blelink.bls — ret ikke i hånden.
+
+Skema-beskeder til BleLink.send_msg() / BleLink.on_msg(). Wire-formatet
+er beskrevet i blgen.py; ukendte felter springes over ved decode.
+"""
+import struct
+from dataclasses import dataclass
+from typing import Dict, Optional, Type
+
+_WT_LEN = (1, 2, 4)
+
+
+@dataclass
+class Echo:
+    ID = 1
+    msg: str = ""
+
+    def encode(self) -> bytes:
+        out = bytearray()
+        v = self.msg.encode('utf-8')[:64]
+        out += bytes((0x07, len(v))) + v
+        return bytes(out)
+
+    @classmethod
+    def decode(cls, b) -> "Echo":
+        m = cls()
+        o, n = 0, len(b)
+        while o < n:
+            tag = b[o]
+            o += 1
+            wt = tag & 3
+            if wt == 3:
+                if o >= n:
+                    raise ValueError("Echo: afkortet felt")
+                ln = b[o]
+                o += 1
+            else:
+                ln = _WT_LEN[wt]
+            if o + ln > n:
+                raise ValueError("Echo: afkortet felt")
+            if tag == 0x07:
+                m.msg = bytes(b[o:o + ln]).decode('utf-8', 'ignore')
+            o += ln
+        return m
+
+
+@dataclass
+class EchoReply:
+    ID = 2
+    from_: str = ""
+    echo: str = ""
+
+    def encode(self) -> bytes:
+        out = bytearray()
+        v = self.from_.encode('utf-8')[:16]
+        out += bytes((0x07, len(v))) + v
+        v = self.echo.encode('utf-8')[:64]
+        out += bytes((0x0B, len(v))) + v
+        return bytes(out)
+
+    @classmethod
+    def decode(cls, b) -> "EchoReply":
+        m = cls()
+        o, n = 0, len(b)
+        while o < n:
+            tag = b[o]
+            o += 1
+            wt = tag & 3
+            if wt == 3:
+                if o >= n:
+                    raise ValueError("EchoReply: afkortet felt")
+                ln = b[o]
+                o += 1
+            else:
+                ln = _WT_LEN[wt]
+            if o + ln > n:
+                raise ValueError("EchoReply: afkortet felt")
+            if tag == 0x07:
+                m.from_ = bytes(b[o:o + ln]).decode('utf-8', 'ignore')
+            elif tag == 0x0B:
+                m.echo = bytes(b[o:o + ln]).decode('utf-8', 'ignore')
+            o += ln
+        return m
+
+
+_Status_uptime_ms = struct.Struct('<I')
+
+@dataclass
+class Status:
+    ID = 3
+    uptime_ms: int = 0
+    note: str = ""
+
+    def encode(self) -> bytes:
+        out = bytearray()
+        out.append(0x06)
+        out += _Status_uptime_ms.pack(self.uptime_ms)
+        v = self.note.encode('utf-8')[:48]
+        out += bytes((0x0B, len(v))) + v
+        return bytes(out)
+
+    @classmethod
+    def decode(cls, b) -> "Status":
+        m = cls()
+        o, n = 0, len(b)
+        while o < n:
+            tag = b[o]
+            o += 1
+            wt = tag & 3
+            if wt == 3:
+                if o >= n:
+                    raise ValueError("Status: afkortet felt")
+                ln = b[o]
+                o += 1
+            else:
+                ln = _WT_LEN[wt]
+            if o + ln > n:
+                raise ValueError("Status: afkortet felt")
+            if tag == 0x06:
+                m.uptime_ms = _Status_uptime_ms.unpack_from(b, o)[0]
+            elif tag == 0x0B:
+                m.note = bytes(b[o:o + ln]).decode('utf-8', 'ignore')
+            o += ln
+        return m
+
+
+_Heap_ST = struct.Struct('<BIBIBIB?BIBIBIBIBI')
+_Heap_TAGS = (6, 10, 14, 16, 22, 26, 30, 34, 38)
+_Heap_free = struct.Struct('<I')
+_Heap_min_free = struct.Struct('<I')
+_Heap_largest = struct.Struct('<I')
+_Heap_traced = struct.Struct('<?')
+_Heap_allocs = struct.Struct('<I')
+_Heap_frees = struct.Struct('<I')
+_Heap_live = struct.Struct('<I')
+_Heap_peak = struct.Struct('<I')
+_Heap_dropped = struct.Struct('<I')
+
+@dataclass
+class Heap:
+    ID = 4
+    free: int = 0
+    min_free: int = 0
+    largest: int = 0
+    traced: bool = False
+    allocs: int = 0
+    frees: int = 0
+    live: int = 0
+    peak: int = 0
+    dropped: int = 0
+
+    def encode(self) -> bytes:
+        return _Heap_ST.pack(
+            0x06, self.free,
+            0x0A, self.min_free,
+            0x0E, self.largest,
+            0x10, self.traced,
+            0x16, self.allocs,
+            0x1A, self.frees,
+            0x1E, self.live,
+            0x22, self.peak,
+            0x26, self.dropped,
+        )
+
+    @classmethod
+    def decode(cls, b) -> "Heap":
+        if len(b) == 42:        # alle felter i skema-orden
+            t = _Heap_ST.unpack(b)
+            if t[0::2] == _Heap_TAGS:
+                return cls(*t[1::2])
+        m = cls()
+        o, n = 0, len(b)
+        while o < n:
+            tag = b[o]
+            o += 1
+            wt = tag & 3
+            if wt == 3:
+                if o >= n:
+                    raise ValueError("Heap: afkortet felt")
+                ln = b[o]
+                o += 1
+            else:
+                ln = _WT_LEN[wt]
+            if o + ln > n:
+                raise ValueError("Heap: afkortet felt")
+            if tag == 0x06:
+                m.free = _Heap_free.unpack_from(b, o)[0]
+            elif tag == 0x0A:
+                m.min_free = _Heap_min_free.unpack_from(b, o)[0]
+            elif tag == 0x0E:
+                m.largest = _Heap_largest.unpack_from(b, o)[0]
+            elif tag == 0x10:
+                m.traced = _Heap_traced.unpack_from(b, o)[0]
+            elif tag == 0x16:
+                m.allocs = _Heap_allocs.unpack_from(b, o)[0]
+            elif tag == 0x1A:
+                m.frees = _Heap_frees.unpack_from(b, o)[0]
+            elif tag == 0x1E:
+                m.live = _Heap_live.unpack_from(b, o)[0]
+            elif tag == 0x22:
+                m.peak = _Heap_peak.unpack_from(b, o)[0]
+            elif tag == 0x26:
+                m.dropped = _Heap_dropped.unpack_from(b, o)[0]
+            o += ln
+        return m
+
+
+MESSAGES: Dict[int, Type] = {
+    1: Echo,
+    2: EchoReply,
+    3: Status,
+    4: Heap,
+}
+
+
+def decode(data: bytes) -> Optional[object]:
+    """[besked-id][felter] -> besked-objekt (None = ukendt id)."""
+    if not data:
+        return None
+    cls = MESSAGES.get(data[0])
+    return cls.decode(memoryview(data)[1:]) if cls else None
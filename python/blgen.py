@@ -0,0 +1,467 @@
+"""
+blgen — generér BleLink-beskedcodecs fra et skema (schema/blelink.bls).
+
+Output:
+  - C++ header (ArduinoJson-fri encode/decode til firmwaren)
+  - Python-modul (dataclasses med encode/decode)
+
+Wire-format for en besked (payload i en BleLink-frame af type 0x01):
+  [besked-id u8] { [tag u8] [værdi] }*
+  tag = felt-id << 2 | wire-type
+    wire-type 0: 1 byte (bool, u8, i8)
+    wire-type 1: 2 bytes LE (u16, i16)
+    wire-type 2: 4 bytes LE (u32, i32, f32)
+    wire-type 3: [len u8] + len bytes (str, bytes)
+Ukendte felter (eller kendt id med anden wire-type) springes over, så
+nyere afsendere kan tilføje felter uden at bryde ældre modtagere.
+
+Brug:
+  python blgen.py                       # schema/blelink.bls -> standardstierne
+  python blgen.py skema.bls --cpp X.h --py x.py
+"""
+import argparse
+import keyword
+import os
+import re
+import struct
+import sys
+from dataclasses import dataclass, field
+from typing import List
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+DEFAULT_SCHEMA = os.path.join(ROOT, "schema", "blelink.bls")
+DEFAULT_CPP = os.path.join(ROOT, "esp32", "src", "BleLinkMsgs.h")
+DEFAULT_PY = os.path.join(ROOT, "python", "blelink_msgs.py")
+
+# type -> (wire-type, C++-type, struct-kode)
+SCALARS = {
+    "bool": (0, "bool", "?"),
+    "u8":   (0, "uint8_t", "B"),
+    "i8":   (0, "int8_t", "b"),
+    "u16":  (1, "uint16_t", "H"),
+    "i16":  (1, "int16_t", "h"),
+    "u32":  (2, "uint32_t", "I"),
+    "i32":  (2, "int32_t", "i"),
+    "f32":  (2, "float", "f"),
+}
+WT_SIZE = {0: 1, 1: 2, 2: 4}
+
+
+@dataclass
+class Field:
+    name: str
+    kind: str          # skalar-navn, "str" eller "bytes"
+    fid: int
+    size: int = 0      # max længde for str/bytes
+
+    @property
+    def wt(self) -> int:
+        return SCALARS[self.kind][0] if self.kind in SCALARS else 3
+
+    @property
+    def tag(self) -> int:
+        return self.fid << 2 | self.wt
+
+    @property
+    def fixed(self) -> bool:
+        return self.kind in SCALARS
+
+    @property
+    def max_wire(self) -> int:
+        return 1 + (WT_SIZE[self.wt] if self.fixed else 1 + self.size)
+
+    @property
+    def pyname(self) -> str:
+        return self.name + "_" if keyword.iskeyword(self.name) else self.name
+
+
+@dataclass
+class Message:
+    name: str
+    mid: int
+    fields: List[Field] = field(default_factory=list)
+
+    @property
+    def max_size(self) -> int:
+        return sum(f.max_wire for f in self.fields)
+
+
+# ---------- parser ----------
+
+_RE_MSG = re.compile(r"^message\s+([A-Za-z_]\w*)\s*=\s*(\d+)\s*\{\s*(.*)$")
+_RE_FIELD = re.compile(r"^([A-Za-z_]\w*)\s*:\s*([a-z0-9]+)(?:\[(\d+)\])?\s*=\s*(\d+)$")
+
+
+def parse(text: str, path: str = "<skema>") -> List[Message]:
+    msgs: List[Message] = []
+    cur = None
+
+    def fail(ln: int, why: str):
+        raise SystemExit(f"{path}:{ln}: {why}")
+
+    # "{ felt }" på samme linje splittes, så én-linjes beskeder også virker
+    lines = []
+    for ln, raw in enumerate(text.splitlines(), 1):
+        s = raw.split("#", 1)[0].strip()
+        m = _RE_MSG.match(s)
+        if m:
+            lines.append((ln, f"message {m.group(1)} = {m.group(2)} {{"))
+            s = m.group(3).strip()
+        if s.endswith("}") and s != "}":
+            lines.append((ln, s[:-1].strip()))
+            s = "}"
+        if s:
+            lines.append((ln, s))
+
+    for ln, s in lines:
+        m = _RE_MSG.match(s)
+        if m:
+            if cur:
+                fail(ln, "manglende '}'")
+            mid = int(m.group(2))
+            if not 1 <= mid <= 255:
+                fail(ln, "besked-id skal være 1..255")
+            if any(x.mid == mid or x.name == m.group(1) for x in msgs):
+                fail(ln, f"besked {m.group(1)} / id {mid} findes allerede")
+            cur = Message(m.group(1), mid)
+        elif s == "}":
+            if not cur:
+                fail(ln, "'}' uden besked")
+            if not cur.fields:
+                fail(ln, f"{cur.name}: en besked skal have mindst ét felt")
+            msgs.append(cur)
+            cur = None
+        else:
+            m = _RE_FIELD.match(s)
+            if not m or not cur:
+                fail(ln, f"kan ikke læse: {s!r}")
+            name, kind, size, fid = m.group(1), m.group(2), m.group(3), int(m.group(4))
+            if kind in SCALARS:
+                if size:
+                    fail(ln, f"{kind} tager ingen længde")
+            elif kind in ("str", "bytes"):
+                if not size or not 1 <= int(size) <= 255:
+                    fail(ln, f"{kind} kræver længde 1..255, fx {kind}[32]")
+            else:
+                fail(ln, f"ukendt type {kind}")
+            if not 1 <= fid <= 63:
+                fail(ln, "felt-id skal være 1..63")
+            if any(f.fid == fid or f.name == name for f in cur.fields):
+                fail(ln, f"felt {name} / id {fid} findes allerede i {cur.name}")
+            cur.fields.append(Field(name, kind, fid, int(size or 0)))
+    if cur:
+        fail(len(text.splitlines()), "manglende '}'")
+    return msgs
+
+
+# ---------- C++ ----------
+
+_CPP_HEAD = """\
+// GENERERET af python/blgen.py fra {src} — ret ikke i hånden.
+#ifndef BLE_LINK_MSGS_H
+#define BLE_LINK_MSGS_H
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * Skema-beskeder uden ArduinoJson: faste structs og encode/decode mod
+ * det kompakte felt-id-format (se python/blgen.py). Sendes med
+ * BleLink::sendMsg(m) og modtages via BleLink::onReceiveMsg(cb):
+ *
+ *   bleLink.onReceiveMsg([](uint8_t id, const uint8_t* p, size_t n) {{
+ *     if (id == blmsg::Echo::kId) {{ blmsg::Echo m; if (blmsg::decode(m, p, n)) ... }}
+ *   }});
+ *
+ * encode() returnerer antal bytes (0 = cap for lille; kMaxSize er altid nok).
+ * decode() returnerer false ved afkortet input; felter, der ikke står i
+ * input, beholder deres nuværende værdi.
+ */
+namespace blmsg {{
+
+// --- helpers (little endian, som ESP32) ---
+template <typename T>
+inline bool putFix(uint8_t* b, size_t cap, size_t& o, uint8_t tag, T v) {{
+  if (o + 1 + sizeof(T) > cap) return false;
+  b[o++] = tag;
+  memcpy(b + o, &v, sizeof(T));
+  o += sizeof(T);
+  return true;
+}}
+
+inline bool putLen(uint8_t* b, size_t cap, size_t& o, uint8_t tag, const void* p, size_t n) {{
+  if (o + 2 + n > cap) return false;
+  b[o++] = tag;
+  b[o++] = (uint8_t)n;
+  memcpy(b + o, p, n);
+  o += n;
+  return true;
+}}
+
+// Næste felt: tag og værdiens placering; false = afkortet input
+inline bool next(const uint8_t* p, size_t n, size_t& o,
+                 uint8_t& tag, const uint8_t*& v, size_t& len) {{
+  tag = p[o++];
+  switch (tag & 3) {{
+    case 0:  len = 1; break;
+    case 1:  len = 2; break;
+    case 2:  len = 4; break;
+    default: if (o >= n) return false; len = p[o++]; break;
+  }}
+  if (o + len > n) return false;
+  v  = p + o;
+  o += len;
+  return true;
+}}
+
+template <typename T>
+inline void getFix(T& x, const uint8_t* v) {{ memcpy(&x, v, sizeof(T)); }}
+
+inline void getStr(char* dst, size_t cap, const uint8_t* v, size_t len) {{
+  size_t k = len < cap - 1 ? len : cap - 1;
+  memcpy(dst, v, k);
+  dst[k] = '\\0';
+}}
+
+inline void getBytes(uint8_t* dst, uint8_t& dstLen, size_t cap, const uint8_t* v, size_t len) {{
+  size_t k = len < cap ? len : cap;
+  memcpy(dst, v, k);
+  dstLen = (uint8_t)k;
+}}
+"""
+
+_CPP_TAIL = """
+}} // namespace blmsg
+
+#endif // BLE_LINK_MSGS_H
+"""
+
+
+def gen_cpp(msgs: List[Message], src: str) -> str:
+    out = [_CPP_HEAD.format(src=src)]
+    for m in msgs:
+        w = max(len(_cpp_type(f)) for f in m.fields)
+        out.append(f"\n// --- {m.name} ---")
+        out.append(f"struct {m.name} {{")
+        out.append(f"  static constexpr uint8_t kId      = {m.mid};")
+        out.append(f"  static constexpr size_t  kMaxSize = {m.max_size};   // kodet, uden besked-id")
+        for f in m.fields:
+            t = _cpp_type(f).ljust(w)
+            if f.kind == "str":
+                out.append(f"  {t} {f.name}[{f.size + 1}] = {{0}};")
+            elif f.kind == "bytes":
+                out.append(f"  {t} {f.name}[{f.size}] = {{0}};")
+                out.append(f"  {'uint8_t'.ljust(w)} {f.name}_len = 0;")
+            else:
+                out.append(f"  {t} {f.name} = {'false' if f.kind == 'bool' else '0'};")
+        out.append("};\n")
+
+        out.append(f"inline size_t encode(const {m.name}& m, uint8_t* b, size_t cap) {{")
+        out.append("  size_t o = 0;")
+        for f in m.fields:
+            out.append(f"  if (!{_cpp_put(f)}) return 0;")
+        out.append("  return o;")
+        out.append("}\n")
+
+        out.append(f"inline bool decode({m.name}& m, const uint8_t* p, size_t n) {{")
+        out.append("  size_t o = 0, len = 0;")
+        out.append("  uint8_t tag = 0;")
+        out.append("  const uint8_t* v = nullptr;")
+        out.append("  while (o < n) {")
+        out.append("    if (!next(p, n, o, tag, v, len)) return false;")
+        out.append("    switch (tag) {")
+        for f in m.fields:
+            out.append(f"      case 0x{f.tag:02X}: {_cpp_get(f)} break;")
+        out.append("      default: break;                    // ukendt felt: spring over")
+        out.append("    }")
+        out.append("  }")
+        out.append("  return true;")
+        out.append("}")
+
+    out.append("\n// Beskednavn til log/diagnose (nullptr = ukendt id)")
+    out.append("inline const char* name(uint8_t id) {")
+    out.append("  switch (id) {")
+    for m in msgs:
+        out.append(f"    case {m.name}::kId: return \"{m.name}\";")
+    out.append("    default: return nullptr;")
+    out.append("  }")
+    out.append("}")
+    out.append(_CPP_TAIL.format())
+    return "\n".join(out)
+
+
+def _cpp_type(f: Field) -> str:
+    if f.kind == "str":
+        return "char"
+    if f.kind == "bytes":
+        return "uint8_t"
+    return SCALARS[f.kind][1]
+
+
+def _cpp_put(f: Field) -> str:
+    if f.kind == "str":
+        return f"putLen(b, cap, o, 0x{f.tag:02X}, m.{f.name}, strnlen(m.{f.name}, {f.size}))"
+    if f.kind == "bytes":
+        return (f"putLen(b, cap, o, 0x{f.tag:02X}, m.{f.name}, "
+                f"m.{f.name}_len < {f.size} ? m.{f.name}_len : {f.size})")
+    if f.kind == "bool":
+        return f"putFix<uint8_t>(b, cap, o, 0x{f.tag:02X}, m.{f.name} ? 1 : 0)"
+    return f"putFix(b, cap, o, 0x{f.tag:02X}, m.{f.name})"
+
+
+def _cpp_get(f: Field) -> str:
+    if f.kind == "str":
+        return f"getStr(m.{f.name}, sizeof(m.{f.name}), v, len);"
+    if f.kind == "bytes":
+        return f"getBytes(m.{f.name}, m.{f.name}_len, sizeof(m.{f.name}), v, len);"
+    if f.kind == "bool":
+        return f"m.{f.name} = *v != 0;"
+    return f"getFix(m.{f.name}, v);"
+
+
+# ---------- Python ----------
+
+_PY_HEAD = '''\
+"""
+GENERERET af python/blgen.py fra {src} — ret ikke i hånden.
+
+Skema-beskeder til BleLink.send_msg() / BleLink.on_msg(). Wire-formatet
+er beskrevet i blgen.py; ukendte felter springes over ved decode.
+"""
+import struct
+from dataclasses import dataclass
+from typing import Dict, Optional, Type
+
+_WT_LEN = (1, 2, 4)'''
+
+
+def gen_py(msgs: List[Message], src: str) -> str:
+    out = [_PY_HEAD.format(src=src)]
+    for m in msgs:
+        out.append(_py_message(m))
+    out.append("\n\nMESSAGES: Dict[int, Type] = {")
+    for m in msgs:
+        out.append(f"    {m.mid}: {m.name},")
+    out.append("}")
+    out.append('''
+
+def decode(data: bytes) -> Optional[object]:
+    """[besked-id][felter] -> besked-objekt (None = ukendt id)."""
+    if not data:
+        return None
+    cls = MESSAGES.get(data[0])
+    return cls.decode(memoryview(data)[1:]) if cls else None
+''')
+    return "\n".join(out)
+
+
+def _py_message(m: Message) -> str:
+    n = m.name
+    fixed_only = all(f.fixed for f in m.fields)
+    out = ["\n"]
+    # faste felter kodes i én struct.pack; i ren-faste beskeder også hele decode
+    if fixed_only:
+        fmt = "<" + "".join("B" + SCALARS[f.kind][2] for f in m.fields)
+        out.append(f"_{n}_ST = struct.Struct({fmt!r})")
+        out.append(f"_{n}_TAGS = {tuple(f.tag for f in m.fields)!r}")
+    for f in m.fields:
+        if f.fixed:
+            out.append(f"_{n}_{f.name} = struct.Struct('<{SCALARS[f.kind][2]}')")
+
+    out.append("\n@dataclass" if len(out) > 1 else "@dataclass")
+    out.append(f"class {n}:")
+    out.append(f"    ID = {m.mid}")
+    for f in m.fields:
+        if f.kind == "str":
+            out.append(f"    {f.pyname}: str = \"\"")
+        elif f.kind == "bytes":
+            out.append(f"    {f.pyname}: bytes = b\"\"")
+        elif f.kind == "bool":
+            out.append(f"    {f.pyname}: bool = False")
+        elif f.kind == "f32":
+            out.append(f"    {f.pyname}: float = 0.0")
+        else:
+            out.append(f"    {f.pyname}: int = 0")
+
+    # encode
+    out.append("")
+    out.append("    def encode(self) -> bytes:")
+    if fixed_only:
+        out.append(f"        return _{n}_ST.pack(")
+        for f in m.fields:
+            out.append(f"            0x{f.tag:02X}, self.{f.pyname},")
+        out.append("        )")
+    else:
+        out.append("        out = bytearray()")
+        for f in m.fields:
+            if f.kind == "str":
+                out.append(f"        v = self.{f.pyname}.encode('utf-8')[:{f.size}]")
+                out.append(f"        out += bytes((0x{f.tag:02X}, len(v))) + v")
+            elif f.kind == "bytes":
+                out.append(f"        v = bytes(self.{f.pyname}[:{f.size}])")
+                out.append(f"        out += bytes((0x{f.tag:02X}, len(v))) + v")
+            else:
+                out.append(f"        out.append(0x{f.tag:02X})")
+                out.append(f"        out += _{n}_{f.name}.pack(self.{f.pyname})")
+        out.append("        return bytes(out)")
+
+    # decode
+    out.append("")
+    out.append("    @classmethod")
+    out.append(f"    def decode(cls, b) -> \"{n}\":")
+    if fixed_only:
+        out.append(f"        if len(b) == {struct.calcsize(fmt)}:        # alle felter i skema-orden")
+        out.append(f"            t = _{n}_ST.unpack(b)")
+        out.append(f"            if t[0::2] == _{n}_TAGS:")
+        out.append("                return cls(*t[1::2])")
+    out.append("        m = cls()")
+    out.append("        o, n = 0, len(b)")
+    out.append("        while o < n:")
+    out.append("            tag = b[o]")
+    out.append("            o += 1")
+    out.append("            wt = tag & 3")
+    out.append("            if wt == 3:")
+    out.append("                if o >= n:")
+    out.append(f"                    raise ValueError(\"{n}: afkortet felt\")")
+    out.append("                ln = b[o]")
+    out.append("                o += 1")
+    out.append("            else:")
+    out.append("                ln = _WT_LEN[wt]")
+    out.append("            if o + ln > n:")
+    out.append(f"                raise ValueError(\"{n}: afkortet felt\")")
+    kw = "if"
+    for f in m.fields:
+        out.append(f"            {kw} tag == 0x{f.tag:02X}:")
+        if f.kind == "str":
+            out.append(f"                m.{f.pyname} = bytes(b[o:o + ln]).decode('utf-8', 'ignore')")
+        elif f.kind == "bytes":
+            out.append(f"                m.{f.pyname} = bytes(b[o:o + ln])")
+        else:
+            out.append(f"                m.{f.pyname} = _{n}_{f.name}.unpack_from(b, o)[0]")
+        kw = "elif"
+    out.append("            o += ln")
+    out.append("        return m")
+    return "\n".join(out)
+
+
+def main(argv=None) -> int:
+    ap = argparse.ArgumentParser(description="Generér BleLink-codecs fra skema")
+    ap.add_argument("schema", nargs="?", default=DEFAULT_SCHEMA)
+    ap.add_argument("--cpp", default=DEFAULT_CPP, help="C++ header (default: %(default)s)")
+    ap.add_argument("--py", default=DEFAULT_PY, help="Python-modul (default: %(default)s)")
+    args = ap.parse_args(argv)
+
+    with open(args.schema, encoding="utf-8") as fh:
+        msgs = parse(fh.read(), args.schema)
+    src = os.path.relpath(args.schema, ROOT).replace(os.sep, "/")
+    for path, text in ((args.cpp, gen_cpp(msgs, src)), (args.py, gen_py(msgs, src))):
+        with open(path, "w", encoding="utf-8", newline="\n") as fh:
+            fh.write(text)
+        print(f"[blgen] {len(msgs)} beskeder -> {path}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,123 @@
+"""
+Enhedens versionerede konfiguration (enheden: esp32/src/BleLinkConfig.h).
+
+  python config.py BLE-LINK-TEST get
+  python config.py BLE-LINK-TEST set cfg.json                  # hele dokumentet (cfg_set)
+  python config.py BLE-LINK-TEST patch '{"filter":{"alpha":0.3}}'
+  python config.py BLE-LINK-TEST check --size 6000             # round-trip over 2 KB
+  python config.py SIM-000 --sim 127.0.0.1:7500 check          # mod fleet_sim.py serve
+
+check sætter et dokument på --size bytes (med citationstegn, backslashes og
+ikke-ASCII, så escaping og UTF-8-grænser i cfg_part-delene bliver prøvet),
+henter det igen med en ny ConfigSync, patcher én nøgle og henter igen. Begge
+gange skal dokumentet komme uændret tilbage. Derefter en konflikt: en anden
+ConfigSync patcher én nøgle mellem vores load og patch, så enhedens version
+flytter sig; vores patch skal rebases på enhedens dokument (uden cfg_set), og
+begge ændringer skal stå i dokumentet bagefter. Med --psk køres det krypteret,
+så også deling af store linjer i flere krypterede frames prøves.
+"""
+import argparse
+import asyncio
+import json
+import time
+from typing import Any, Dict, Optional
+
+from ble_link import BleLink, ConfigSync
+
+
+def _transport(spec: Optional[str]) -> Any:
+    if not spec:
+        return None
+    from fleet_sim import SimTransport
+    host, _, port = spec.rpartition(":")
+    return SimTransport(host or "127.0.0.1", int(port))
+
+
+def make_doc(size: int) -> Dict[str, Any]:
+    """Et dokument på ca. size bytes serialiseret (uden mellemrum)."""
+    doc: Dict[str, Any] = {"rate": 10, "filter": {"alpha": 0.25, "on": True}}
+    i = 0
+    while len(json.dumps(doc, separators=(",", ":"), ensure_ascii=False).encode()) < size:
+        doc[f"k{i:04d}"] = f'værdi "{i}" \\ æøå € {"x" * (i % 40)}'
+        i += 1
+    return doc
+
+
+async def check(link: BleLink, size: int, timeout: float) -> Dict[str, Any]:
+    doc = make_doc(size)
+    nbytes = len(json.dumps(doc, separators=(",", ":"), ensure_ascii=False).encode())
+    t0 = time.monotonic()
+    await ConfigSync(link, timeout).full_sync(doc)
+    t_set = time.monotonic() - t0
+
+    t0 = time.monotonic()
+    got = await ConfigSync(link, timeout).load()
+    t_get = time.monotonic() - t0
+
+    cfg = ConfigSync(link, timeout)
+    await cfg.load()
+    await cfg.patch({"k0000": "ændret", "filter": {"alpha": 0.5}})
+    again = await ConfigSync(link, timeout).load()
+
+    # Konflikt: versionen flytter sig mellem load og patch
+    ours, other = ConfigSync(link, timeout), ConfigSync(link, timeout)
+    await ours.load()
+    await other.load()
+    await other.patch({"k0001": "fra en anden vært"})
+    await ours.patch({"k0002": "fra os"})
+    final = await ConfigSync(link, timeout).load()
+    conflict_ok = (final.get("k0001") == "fra en anden vært" and final.get("k0002") == "fra os"
+                   and final == ours.doc and ours.rebases == 1 and ours.full_syncs == 0)
+    return {"bytes": nbytes, "keys": len(doc),
+            "get_ok": got == doc, "patch_ok": again == cfg.doc, "conflict_ok": conflict_ok,
+            "set_ms": round(t_set * 1000), "get_ms": round(t_get * 1000)}
+
+
+async def main_async(args: argparse.Namespace) -> int:
+    link = BleLink(args.device, psk=bytes.fromhex(args.psk) if args.psk else None,
+                   transport=_transport(args.sim))
+    await link.connect()
+    try:
+        cfg = ConfigSync(link, args.timeout)
+        if args.cmd == "get":
+            doc = await cfg.load()
+            res: Dict[str, Any] = {"v": cfg.version, "doc": doc}
+        elif args.cmd == "set":
+            with open(args.file) as f:
+                res = {"v": await cfg.full_sync(json.load(f))}
+        elif args.cmd == "patch":
+            res = {"v": await cfg.patch(json.loads(args.patch))}
+        else:
+            res = await check(link, args.size, args.timeout)
+    finally:
+        await link.disconnect()
+
+    if args.json:
+        print(json.dumps(res, ensure_ascii=False))
+    else:
+        for k, v in res.items():
+            print(f"{k:>10}: {json.dumps(v, ensure_ascii=False) if isinstance(v, dict) else v}")
+    ok = all(res.get(k, True) for k in ("get_ok", "patch_ok", "conflict_ok"))
+    return 0 if ok else 1
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="BleLink konfiguration (cfg_get/cfg_patch/cfg_set)")
+    ap.add_argument("device")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    sub.add_parser("get")
+    s = sub.add_parser("set")
+    s.add_argument("file", help="JSON-fil med hele dokumentet")
+    p = sub.add_parser("patch")
+    p.add_argument("patch", help="RFC 7386 merge patch som JSON")
+    c = sub.add_parser("check")
+    c.add_argument("--size", type=int, default=6000, help="dokumentets størrelse i bytes")
+    ap.add_argument("--timeout", type=float, default=10.0)
+    ap.add_argument("--sim", default=None, help="host:port for fleet_sim-protokol")
+    ap.add_argument("--psk", default=None, help="16-byte nøgle som hex: kør krypteret")
+    ap.add_argument("--json", action="store_true", help="ét JSON-objekt som output")
+    raise SystemExit(asyncio.run(main_async(ap.parse_args())))
+
+
+if __name__ == "__main__":
+    main()
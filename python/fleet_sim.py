@@ -0,0 +1,630 @@
+"""
+Simuleret enhedsflåde til load-test af værtssiden uden hardware.
+
+Én proces kører mange simulerede BleLink-enheder (samme linje/frame-protokol
+og kontrolbeskeder som firmwaren: hello, time, stats, cfg_*) bag én TCP-port.
+BleLink forbinder med SimTransport i stedet for bleak, så gatewayens kode er
+uændret.
+
+  python fleet_sim.py serve --devices 50 --rate 10 --burst 3 --latency-ms 15
+  python fleet_sim.py load  --devices 50 --duration 30      # anden terminal
+  python fleet_sim.py scan  --duration 10                   # broadcast, uden forbindelse
+
+Hver enhed har sin egen trafikprofil (status-rate, burst, linjestørrelse) og
+link (MTU, bytes/s, latens, chunk-størrelse — firmwaren sender MTU - 3 ad gangen).
+--jitter varierer profilerne mellem enhederne. load rapporterer beskeder/s,
+latens (status-linjens tidsstempel -> callback) og gatewayens CPU-forbrug.
+
+SimDevice er en håndholdt kopi af firmwarens adfærd (BleLink.cpp) og skal
+holdes i trit med den i hånden, når kontrolbeskeder eller TX-stien ændres.
+esp32/examples/fleet_native kører firmwarens egen kerne (pulje, DRR-køer,
+RX-køer, sessionsvindue) bag samme TCP-protokol; load virker mod begge.
+
+Broadcast (setBroadcast): en enhed uden forbindelse annoncerer hver --adv-ms
+(+ 0..10 ms advDelay) og opdaterer sin payload hver --bc-ms; en scanner
+misser hver annoncering med sandsynlighed --adv-loss (scan-vindue,
+kollisioner). Payloaden starter med broadcast_stamp() fra opdateringen, så
+scan måler tiden fra opdatering til afkodning på værten, ikke kun
+afstanden mellem opdateringer. Kun fleet_sim.py annoncerer; fleet_native ikke.
+
+TCP-protokol (intern): [type u8][len u16 LE][payload]
+  LIST -> NAMES (JSON-liste), OPEN navn -> ACCEPT mtu u16 | REJECT,
+  WRITE_REQ data -> ACK, WRITE_CMD data, NOTIFY data,
+  SCAN -> ADV [rssi i8][navnelængde u8][navn][company id u16 LE][manufacturer data] ...
+"""
+import argparse
+import asyncio
+import json
+import os
+import random
+import struct
+import time
+from dataclasses import dataclass, field
+from typing import Any, Callable, Dict, List, Optional
+
+# TCP-pakketyper
+P_LIST, P_NAMES, P_OPEN, P_ACCEPT, P_REJECT = 0x01, 0x02, 0x03, 0x04, 0x05
+P_WRITE_REQ, P_WRITE_CMD, P_ACK, P_NOTIFY = 0x06, 0x07, 0x08, 0x09
+P_SCAN, P_ADV = 0x0A, 0x0B
+
+DEFAULT_PORT = 7500
+FRAME_START, FRAME_HEADER = 0x00, 4
+CFG_PART = 768                  # firmwarens BL_CFG_PART
+
+
+async def _read_packet(reader: asyncio.StreamReader) -> tuple:
+    head = await reader.readexactly(3)
+    kind, n = head[0], head[1] | head[2] << 8
+    return kind, await reader.readexactly(n) if n else b""
+
+
+def _packet(kind: int, data: bytes = b"") -> bytes:
+    return struct.pack("<BH", kind, len(data)) + data
+
+
+# ---------- enhedssiden ----------
+
+@dataclass
+class Profile:
+    """Trafikprofil for én simuleret enhed."""
+    rate_hz: float = 10.0       # status-bursts pr. sekund
+    burst: int = 1              # linjer pr. burst
+    size: int = 80              # ca. linjestørrelse i bytes
+
+
+@dataclass
+class LinkModel:
+    """Linkets egenskaber set fra enheden."""
+    mtu: int = 247
+    chunk: int = 0              # bytes pr. notifikation; 0 = MTU - 3 (firmwarens _sendLine)
+    rate_Bps: int = 20_000      # notifikations-throughput
+    latency_ms: float = 10.0    # envejs
+
+
+@dataclass
+class AdvModel:
+    """Broadcast uden forbindelse (firmwarens setBroadcast)."""
+    interval_ms: float = 100.0  # advertising-interval
+    refresh_ms: float = 1000.0  # payload-opdatering (setBroadcast-interval), 0 = fra
+    loss: float = 0.3           # sandsynlighed for at en scanner misser én annoncering
+    rssi: int = -60
+
+
+@dataclass
+class SimDevice:
+    """
+    Én simuleret enhed: deler RX i linjer/frames som BleLink.cpp, svarer på
+    kontrolbeskeder og app-kommandoer ({"op":"echo"}, "PING") og sender
+    status-linjer efter sin profil, mens en vært er forbundet.
+    """
+    name: str
+    profile: Profile = field(default_factory=Profile)
+    link: LinkModel = field(default_factory=LinkModel)
+    adv: AdvModel = field(default_factory=AdvModel)
+    t0: float = field(default_factory=time.monotonic)
+    connects: int = 0
+    rx_msgs: int = 0
+    tx_msgs: int = 0
+    _writer: Optional[asyncio.StreamWriter] = None
+    _txq: Optional[asyncio.Queue] = None
+    _rxbuf: bytearray = field(default_factory=bytearray)
+    _token: str = ""
+    _seq: int = 0
+    cfg: Dict[str, Any] = field(default_factory=dict)
+    cfg_v: int = 0
+    bc_seq: int = 0
+    bc_payload: bytes = b""
+
+    def millis(self) -> int:
+        return int((time.monotonic() - self.t0) * 1000)
+
+    # -- broadcast (som loop() og _applyAdvertising) --
+    async def refresh_broadcast(self) -> None:
+        """Ny payload hvert refresh_ms, kun uden forbindelse (som loop())."""
+        from ble_link import broadcast_stamp
+        while self.adv.refresh_ms > 0:
+            if self._writer is None:
+                self.bc_seq = (self.bc_seq + 1) & 0xFF
+                self.bc_payload = broadcast_stamp() + struct.pack("<I", self.millis() // 1000)
+            await asyncio.sleep(self.adv.refresh_ms / 1000.0)
+
+    async def advertise(self, emit: Callable[["SimDevice", bytes], None]) -> None:
+        """Én annoncering pr. interval_ms + advDelay, kun uden forbindelse."""
+        from ble_link import BC_MAGIC
+        while self.adv.refresh_ms > 0:
+            if self._writer is None and self.bc_payload:
+                emit(self, bytes((BC_MAGIC, 1, self.bc_seq)) + self.bc_payload)
+            await asyncio.sleep((self.adv.interval_ms + random.uniform(0.0, 10.0)) / 1000.0)
+
+    # -- forbindelse --
+    async def serve(self, writer: asyncio.StreamWriter, reader: asyncio.StreamReader) -> None:
+        self._writer, self._txq = writer, asyncio.Queue()
+        self._rxbuf.clear()
+        self.connects += 1
+        hello = asyncio.Event()
+        tasks = [asyncio.create_task(self._pump_tx(hello)),
+                 asyncio.create_task(self._status(hello))]
+        try:
+            while True:
+                kind, data = await _read_packet(reader)
+                if kind in (P_WRITE_REQ, P_WRITE_CMD):
+                    await asyncio.sleep(self.link.latency_ms / 1000.0)
+                    self._on_write(data, hello)
+                    if kind == P_WRITE_REQ:
+                        writer.write(_packet(P_ACK))
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            for t in tasks:
+                t.cancel()
+            self._writer = self._txq = None
+
+    def _send(self, line: Any) -> None:
+        if self._txq is None:
+            return
+        if isinstance(line, dict):
+            line = json.dumps(line, separators=(",", ":"))
+        self._txq.put_nowait(line.encode() + b"\n")
+
+    async def _pump_tx(self, hello: asyncio.Event) -> None:
+        """Som firmwaren: TX holdes til hello (højst 3 s), linjer sendes i chunks."""
+        try:
+            await asyncio.wait_for(hello.wait(), 3.0)
+        except asyncio.TimeoutError:
+            pass
+        loop = asyncio.get_running_loop()
+        lat = self.link.latency_ms / 1000.0
+        while True:
+            unit = await self._txq.get()
+            self.tx_msgs += 1
+            chunk = self.link.chunk or self.link.mtu - 3
+            for i in range(0, len(unit), chunk):
+                part = unit[i:i + chunk]
+                loop.call_later(lat, self._notify, self._writer, part)
+                await asyncio.sleep(len(part) / self.link.rate_Bps)
+
+    @staticmethod
+    def _notify(w: asyncio.StreamWriter, part: bytes) -> None:
+        if not w.is_closing():
+            w.write(_packet(P_NOTIFY, part))
+
+    async def _status(self, hello: asyncio.Event) -> None:
+        await hello.wait()
+        p = self.profile
+        pad = "x" * max(0, p.size - 70)
+        while p.rate_hz > 0:
+            for _ in range(p.burst):
+                self._seq += 1
+                self._send({"event": "status", "dev": self.name, "seq": self._seq,
+                            "t": time.time() * 1000.0, "pad": pad})
+            await asyncio.sleep(1.0 / p.rate_hz)
+
+    # -- modtagelse (linjer og frames som parseUnits) --
+    def _on_write(self, data: bytes, hello: asyncio.Event) -> None:
+        buf = self._rxbuf
+        buf.extend(data)
+        while buf:
+            if buf[0] == FRAME_START:
+                if len(buf) < FRAME_HEADER or len(buf) < FRAME_HEADER + (buf[2] | buf[3] << 8):
+                    break
+                n = buf[2] | buf[3] << 8
+                del buf[:FRAME_HEADER + n]      # frames ignoreres af simulatoren
+                self.rx_msgs += 1
+                continue
+            try:
+                idx = buf.index(0x0A)
+            except ValueError:
+                break
+            line = bytes(buf[:idx])
+            del buf[:idx + 1]
+            self.rx_msgs += 1
+            self._on_line(line, hello)
+
+    def _on_line(self, line: bytes, hello: asyncio.Event) -> None:
+        try:
+            obj = json.loads(line)
+        except ValueError:
+            if line.strip() == b"PING":
+                self._send("PONG")
+            return
+        if not isinstance(obj, dict):
+            return
+        op = obj.get("_bl")
+        if op == "hello":
+            # simulatoren genoptager ikke: altid ny session
+            self._token = os.urandom(8).hex()
+            self._send({"_bl": "hello", "tok": self._token, "resumed": False, "rx": 0})
+            hello.set()
+        elif op == "time":
+            self._send({"_bl": "time", "ms": self.millis()})
+        elif op == "stats":
+            self._send({"_bl": "stats", "up": self.millis(), "rx": [self.rx_msgs, 0, 0],
+                        "tx": [self.tx_msgs, 0, 0], "con": self.connects, "mtu": self.link.mtu,
+                        "q": {"tx": self._txq.qsize() if self._txq else 0}})
+        elif op == "cfg_get":
+            self._send_config()
+        elif op in ("cfg_patch", "cfg_set"):
+            from ble_link import apply_merge_patch
+            if op == "cfg_set":
+                self.cfg = obj.get("doc") or {}
+            elif obj.get("base", 0) != self.cfg_v:
+                self._send({"_bl": "cfg_nak", "v": self.cfg_v})
+                return
+            else:
+                self.cfg = apply_merge_patch(self.cfg, obj.get("p"))
+            self.cfg_v += 1
+            self._send({"_bl": "cfg_ack", "v": self.cfg_v})
+        elif op is None and obj.get("op") == "echo":
+            self._send({"from": self.name, "echo": obj.get("msg", "")})
+
+    def _send_config(self) -> None:
+        """Som BleLink::_pumpConfig(): store dokumenter i cfg_part-dele."""
+        text = json.dumps(self.cfg, separators=(",", ":"), ensure_ascii=False).encode()
+        if len(text) <= CFG_PART:
+            self._send({"_bl": "cfg", "v": self.cfg_v, "doc": self.cfg})
+            return
+        off = i = 0
+        while off < len(text):
+            end = min(off + CFG_PART, len(text))
+            while end < len(text) and text[end] & 0xC0 == 0x80:
+                end -= 1                        # klip ikke et UTF-8-tegn over
+            self._send({"_bl": "cfg_part", "v": self.cfg_v, "i": i, "d": text[off:end].decode()})
+            off, i = end, i + 1
+        self._send({"_bl": "cfg", "v": self.cfg_v, "parts": i})
+
+
+class Fleet:
+    """Mange SimDevice bag én TCP-port."""
+
+    def __init__(self, devices: List[SimDevice]):
+        self.devices = {d.name: d for d in devices}
+        self._scanners: List[asyncio.StreamWriter] = []
+        self._tasks: List[asyncio.Task] = []
+
+    async def serve(self, host: str, port: int) -> asyncio.AbstractServer:
+        for d in self.devices.values():
+            self._tasks += [asyncio.create_task(d.refresh_broadcast()),
+                            asyncio.create_task(d.advertise(self._emit_adv))]
+        return await asyncio.start_server(self._on_conn, host, port)
+
+    def _emit_adv(self, dev: SimDevice, data: bytes) -> None:
+        from ble_link import BC_COMPANY_ID
+        if not self._scanners:
+            return
+        name = dev.name.encode()
+        pkt = _packet(P_ADV, struct.pack("<bB", dev.adv.rssi, len(name)) + name
+                      + struct.pack("<H", BC_COMPANY_ID) + data)
+        for w in self._scanners:
+            if not w.is_closing() and random.random() >= dev.adv.loss:
+                w.write(pkt)
+
+    async def _on_conn(self, reader: asyncio.StreamReader, writer: asyncio.StreamWriter) -> None:
+        try:
+            kind, data = await _read_packet(reader)
+            if kind == P_LIST:
+                writer.write(_packet(P_NAMES, json.dumps(sorted(self.devices)).encode()))
+            elif kind == P_OPEN:
+                dev = self.devices.get(data.decode())
+                if dev is None or dev._writer is not None:   # ukendt eller optaget
+                    writer.write(_packet(P_REJECT))
+                else:
+                    writer.write(_packet(P_ACCEPT, struct.pack("<H", dev.link.mtu)))
+                    await dev.serve(writer, reader)
+            elif kind == P_SCAN:
+                self._scanners.append(writer)
+                try:
+                    await reader.read()             # til scanneren lukker
+                finally:
+                    self._scanners.remove(writer)
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            writer.close()
+
+
+def make_fleet(n: int, prefix: str, profile: Profile, link: LinkModel,
+               jitter: float, seed: int = 1, adv: Optional[AdvModel] = None) -> List[SimDevice]:
+    """n enheder; jitter (0..1) varierer rate/burst/latens pr. enhed."""
+    adv = adv or AdvModel()
+    rnd = random.Random(seed)
+
+    def vary(x: float) -> float:
+        return x * (1.0 + rnd.uniform(-jitter, jitter))
+
+    return [SimDevice(f"{prefix}{i:03d}",
+                      Profile(vary(profile.rate_hz), max(1, round(vary(profile.burst))), profile.size),
+                      LinkModel(link.mtu, link.chunk, link.rate_Bps, vary(link.latency_ms)),
+                      AdvModel(adv.interval_ms, adv.refresh_ms, adv.loss, adv.rssi))
+            for i in range(n)]
+
+
+# ---------- værtssiden: transport til BleLink ----------
+
+class _SimChar:
+    def __init__(self, uuid: str):
+        self.uuid = uuid
+
+
+class _SimService:
+    def __init__(self):
+        from ble_link import SERVICE_UUID, TX_UUID, RX_UUID
+        self.uuid = SERVICE_UUID
+        self._chars = {TX_UUID: _SimChar(TX_UUID), RX_UUID: _SimChar(RX_UUID)}
+
+    def get_characteristic(self, uuid: str) -> Optional[_SimChar]:
+        return self._chars.get(uuid)
+
+
+class _SimAdv:
+    """Én annoncering; både `device` og `advertisement_data` i bleaks callback."""
+
+    def __init__(self, name: str, rssi: int, company: int, data: bytes):
+        self.address = self.name = self.local_name = name
+        self.rssi = rssi
+        self.manufacturer_data = {company: data}
+
+
+class SimScanner:
+    """BleakScanner-lignende scanner mod en kørende `fleet_sim.py serve`."""
+
+    def __init__(self, host: str, port: int, cb: Callable[[Any, Any], None]):
+        self._addr, self._cb = (host, port), cb
+        self._writer: Optional[asyncio.StreamWriter] = None
+        self._task: Optional[asyncio.Task] = None
+
+    async def start(self) -> None:
+        reader, self._writer = await asyncio.open_connection(*self._addr)
+        self._writer.write(_packet(P_SCAN))
+        self._task = asyncio.get_running_loop().create_task(self._rx(reader))
+
+    async def stop(self) -> None:
+        if self._task:
+            self._task.cancel()
+        if self._writer:
+            self._writer.close()
+        self._writer = self._task = None
+
+    async def _rx(self, reader: asyncio.StreamReader) -> None:
+        try:
+            while True:
+                kind, data = await _read_packet(reader)
+                if kind != P_ADV:
+                    continue
+                rssi, n = struct.unpack_from("<bB", data)
+                name = data[2:2 + n].decode()
+                company = struct.unpack_from("<H", data, 2 + n)[0]
+                adv = _SimAdv(name, rssi, company, bytes(data[4 + n:]))
+                self._cb(adv, adv)
+        except (asyncio.IncompleteReadError, ConnectionError, asyncio.CancelledError):
+            pass
+
+
+class SimClient:
+    """BleakClient-lignende klient mod én simuleret enhed (se BleakTransport)."""
+
+    def __init__(self, host: str, port: int, name: str, timeout: float):
+        self._addr, self._name, self._timeout = (host, port), name, timeout
+        self._reader: Optional[asyncio.StreamReader] = None
+        self._writer: Optional[asyncio.StreamWriter] = None
+        self._notify: Optional[Callable[[int, bytearray], None]] = None
+        self._acks: List[asyncio.Future] = []
+        self._rx_task: Optional[asyncio.Task] = None
+        self.services = [_SimService()]
+        self.mtu_size = 23
+
+    @property
+    def is_connected(self) -> bool:
+        return self._writer is not None and not self._writer.is_closing()
+
+    async def connect(self) -> None:
+        self._reader, self._writer = await asyncio.wait_for(
+            asyncio.open_connection(*self._addr), self._timeout)
+        self._writer.write(_packet(P_OPEN, self._name.encode()))
+        kind, data = await asyncio.wait_for(_read_packet(self._reader), self._timeout)
+        if kind != P_ACCEPT:
+            self._writer.close()
+            self._writer = None
+            raise RuntimeError(f"Simuleret enhed '{self._name}' afviste forbindelsen.")
+        self.mtu_size = struct.unpack("<H", data)[0]
+        self._rx_task = asyncio.get_running_loop().create_task(self._rx())
+
+    async def disconnect(self) -> None:
+        if self._rx_task:
+            self._rx_task.cancel()
+        if self._writer:
+            self._writer.close()
+        self._writer = None
+
+    async def write_gatt_char(self, char: Any, data: bytes, response: bool = True) -> None:
+        if not self.is_connected:
+            raise RuntimeError("Ikke forbundet (sim).")
+        if not response:
+            self._writer.write(_packet(P_WRITE_CMD, bytes(data)))
+            return
+        fut = asyncio.get_running_loop().create_future()
+        self._acks.append(fut)
+        self._writer.write(_packet(P_WRITE_REQ, bytes(data)))
+        await fut
+
+    async def start_notify(self, char: Any, cb: Callable[[int, bytearray], None]) -> None:
+        self._notify = cb
+
+    async def stop_notify(self, char: Any) -> None:
+        self._notify = None
+
+    async def _rx(self) -> None:
+        try:
+            while True:
+                kind, data = await _read_packet(self._reader)
+                if kind == P_NOTIFY and self._notify:
+                    self._notify(0, bytearray(data))
+                elif kind == P_ACK and self._acks:
+                    fut = self._acks.pop(0)
+                    if not fut.done():
+                        fut.set_result(None)
+        except (asyncio.IncompleteReadError, ConnectionError, asyncio.CancelledError):
+            pass
+        finally:
+            for fut in self._acks:
+                if not fut.done():
+                    fut.set_exception(RuntimeError("Forbindelsen lukket (sim)."))
+            self._acks.clear()
+            if self._writer:
+                self._writer.close()
+            self._writer = None
+
+
+class SimTransport:
+    """Transport for BleLink(transport=...): enheder i en kørende `fleet_sim.py serve`."""
+
+    def __init__(self, host: str = "127.0.0.1", port: int = DEFAULT_PORT):
+        self.host, self.port = host, port
+
+    async def list_devices(self, timeout: float = 5.0) -> List[str]:
+        reader, writer = await asyncio.wait_for(asyncio.open_connection(self.host, self.port), timeout)
+        try:
+            writer.write(_packet(P_LIST))
+            kind, data = await asyncio.wait_for(_read_packet(reader), timeout)
+            return json.loads(data) if kind == P_NAMES else []
+        finally:
+            writer.close()
+
+    async def find_device_by_name(self, name: str, timeout: float) -> Optional[str]:
+        return name if name in await self.list_devices(timeout) else None
+
+    def client(self, device: str, timeout: float) -> SimClient:
+        return SimClient(self.host, self.port, device, timeout)
+
+    def scanner(self, cb: Callable[[Any, Any], None]) -> SimScanner:
+        return SimScanner(self.host, self.port, cb)
+
+
+# ---------- kommandoer ----------
+
+async def run_serve(args: argparse.Namespace) -> None:
+    devices = make_fleet(args.devices, args.prefix,
+                         Profile(args.rate, args.burst, args.size),
+                         LinkModel(args.mtu, args.chunk, args.link_bps, args.latency_ms),
+                         args.jitter, adv=AdvModel(args.adv_ms, args.bc_ms, args.adv_loss))
+    server = await Fleet(devices).serve(args.host, args.port)
+    print(f"[fleet] {len(devices)} enheder ({devices[0].name}..{devices[-1].name}) "
+          f"på {args.host}:{args.port}")
+    async with server:
+        await server.serve_forever()
+
+
+def _pct(xs: List[float], p: float) -> float:
+    if not xs:
+        return 0.0
+    xs = sorted(xs)
+    return xs[min(len(xs) - 1, int(round(p / 100.0 * (len(xs) - 1))))]
+
+
+async def run_load(args: argparse.Namespace) -> Dict[str, Any]:
+    from ble_link import BleLink
+
+    transport = SimTransport(args.host, args.port)
+    names = (await transport.list_devices())[:args.devices]
+    lat: List[float] = []
+    count = 0
+
+    def on_json(obj: Dict[str, Any]) -> None:
+        nonlocal count
+        if obj.get("event") == "status":
+            count += 1
+            lat.append(time.time() * 1000.0 - obj["t"])
+
+    links = []
+    for name in names:
+        link = BleLink(name, transport=transport)
+        link.on_receive_json(on_json)
+        links.append(link)
+    t_conn = time.monotonic()
+    await asyncio.gather(*(l.connect(attempts=1) for l in links))
+    t_conn = time.monotonic() - t_conn
+
+    lat.clear()
+    count = 0
+    cpu0, t0 = time.process_time(), time.monotonic()
+    await asyncio.sleep(args.duration)
+    cpu, wall = time.process_time() - cpu0, time.monotonic() - t0
+    await asyncio.gather(*(l.disconnect() for l in links))
+    return {
+        "devices": len(links),
+        "connect_s": round(t_conn, 2),
+        "msgs_per_s": round(count / wall),
+        "latency_ms": {f"p{p}": round(_pct(lat, p), 1) for p in (50, 90, 99)},
+        "gateway_cpu_pct": round(100.0 * cpu / wall, 1),
+    }
+
+
+async def run_scan(args: argparse.Namespace) -> Dict[str, Any]:
+    """Broadcast fra alle enheder uden forbindelse: opdateringer, tab og latens."""
+    from ble_link import BroadcastScanner
+
+    scanner = BroadcastScanner(lambda b: None, transport=SimTransport(args.host, args.port),
+                               stamped=True)
+    await scanner.run(args.duration)
+    stats = list(scanner.stats.values())
+    lat = [x for st in stats for x in st.latency]
+    gaps = [x for st in stats for x in st.gaps]
+    return {
+        "devices": len(stats),
+        "packets": sum(st.packets for st in stats),
+        "updates": sum(st.updates for st in stats),
+        "missed": sum(st.missed for st in stats),
+        "gap_ms": round(1000.0 * sum(gaps) / len(gaps), 1) if gaps else 0.0,
+        "latency_ms": {f"p{p}": round(1000.0 * _pct(lat, p), 1) for p in (50, 90, 99)},
+    }
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="Simuleret BleLink-enhedsflåde")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    for name in ("serve", "load", "scan"):
+        p = sub.add_parser(name)
+        p.add_argument("--host", default="127.0.0.1")
+        p.add_argument("--port", type=int, default=DEFAULT_PORT)
+        p.add_argument("--devices", type=int, default=20)
+    s = sub.choices["serve"]
+    s.add_argument("--prefix", default="SIM-")
+    s.add_argument("--rate", type=float, default=10.0, help="status-bursts/s pr. enhed")
+    s.add_argument("--burst", type=int, default=1, help="linjer pr. burst")
+    s.add_argument("--size", type=int, default=80, help="linjestørrelse (bytes)")
+    s.add_argument("--mtu", type=int, default=247)
+    s.add_argument("--chunk", type=int, default=0, help="bytes pr. notifikation (0 = MTU - 3)")
+    s.add_argument("--link-bps", type=int, default=20_000, help="notifikations-bytes/s")
+    s.add_argument("--latency-ms", type=float, default=10.0)
+    s.add_argument("--jitter", type=float, default=0.2, help="variation mellem enheder (0..1)")
+    s.add_argument("--adv-ms", type=float, default=100.0, help="advertising-interval")
+    s.add_argument("--bc-ms", type=float, default=1000.0, help="broadcast-opdatering (0 = fra)")
+    s.add_argument("--adv-loss", type=float, default=0.3, help="scannerens tab pr. annoncering")
+    for name in ("load", "scan"):
+        l = sub.choices[name]
+        l.add_argument("--duration", type=float, default=20.0)
+        l.add_argument("--json", action="store_true", help="ét JSON-objekt som output")
+    args = ap.parse_args()
+    if args.cmd == "serve":
+        asyncio.run(run_serve(args))
+    elif args.cmd == "scan":
+        res = asyncio.run(run_scan(args))
+        if args.json:
+            print(json.dumps(res))
+        else:
+            lat = res["latency_ms"]
+            print(f"{res['devices']} enheder: {res['updates']} opdateringer ({res['missed']} misset), "
+                  f"{res['gap_ms']} ms mellem opdateringer, opdatering->afkodning "
+                  f"p50/p90/p99 {lat['p50']}/{lat['p90']}/{lat['p99']} ms")
+    else:
+        res = asyncio.run(run_load(args))
+        if args.json:
+            print(json.dumps(res))
+        else:
+            lat = res["latency_ms"]
+            print(f"{res['devices']} enheder: {res['msgs_per_s']} beskeder/s, "
+                  f"latens p50/p90/p99 {lat['p50']}/{lat['p90']}/{lat['p99']} ms, "
+                  f"gateway-CPU {res['gateway_cpu_pct']} %")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,360 @@
+"""
+Gateway med enhederne fordelt over flere processer.
+
+Én event loop kan ikke følge med, når 30+ enheder alle skal igennem
+_on_notify og json.loads: én kerne er mættet, resten står stille. Her kører
+hver worker-proces sin egen loop med en andel (shard) af enhederne; moderen
+står for discovery og fletter workernes output til én strøm.
+
+  python gateway.py run --prefix BLE-LINK --workers 4 > beskeder.ndjson
+  python gateway.py run --sim 127.0.0.1:7500 --workers 4          # fleet_sim.py serve
+  python gateway.py bench --sim 127.0.0.1:7500,127.0.0.1:7501 --workers 1,2,4 --duration 15
+
+- Discovery: moderen scanner (BLE: navne med --prefix; sim: LIST mod hver
+  endpoint) og tildeler nye enheder til den mindst belastede worker. Workers
+  scanner ikke selv — de forbinder direkte til adressen fra discovery.
+  Enheder, en worker giver op på, tildeles igen ved næste scanning.
+- Workers dekoder selv (JSON parses i workeren) og sender beskederne i batches
+  (højst --batch stk. eller hver --batch-ms) som ét pickle pr. batch over en
+  pipe, så prisen pr. besked for IPC er lille.
+- Output: én NDJSON-linje pr. besked {"dev":..,"t":..,"msg":..} (t = modtaget,
+  time.time()), eller on_batch-callback ved brug som bibliotek.
+
+bench kører samme flåde med hvert antal workers og viser beskeder/s og CPU
+pr. worker; kør flere `fleet_sim.py serve` (én pr. port, forskellige --prefix),
+hvis én simulator-proces bliver flaskehalsen. CPU tælles over hele kørslen
+(inkl. --warmup, hvor der forbindes).
+"""
+import argparse
+import asyncio
+import json
+import multiprocessing as mp
+import pickle
+import sys
+import time
+from multiprocessing.connection import Connection, wait
+from typing import Any, Callable, Dict, List, Optional, Tuple
+
+# Beskeder worker -> moder: (type, data)
+W_BATCH, W_UP, W_DOWN, W_STATS = "batch", "up", "down", "stats"
+
+Batch = List[Tuple[str, float, Any]]     # (enhed, modtaget, JSON-objekt eller tekst)
+
+
+# ---------- discovery (i moderprocessen) ----------
+
+class Discovery:
+    """Finder enheder: navn -> adresse, som en worker kan forbinde direkte til."""
+
+    def __init__(self, prefix: str = "", sim: Optional[List[Tuple[str, int]]] = None,
+                 scan_timeout: float = 5.0):
+        self.prefix = prefix
+        self.sim = sim
+        self.scan_timeout = scan_timeout
+
+    async def scan(self) -> Dict[str, Any]:
+        if self.sim is not None:
+            from fleet_sim import SimTransport
+            found: Dict[str, Any] = {}
+            for host, port in self.sim:
+                try:
+                    names = await SimTransport(host, port).list_devices(self.scan_timeout)
+                except OSError:
+                    continue
+                found.update({n: (host, port, n) for n in names if n.startswith(self.prefix)})
+            return found
+        from bleak import BleakScanner
+        devs = await BleakScanner.discover(timeout=self.scan_timeout)
+        return {d.name: d.address for d in devs if d.name and d.name.startswith(self.prefix)}
+
+
+class _RoutedTransport:
+    """Worker-transport: adresser kommer fra moderens discovery, ingen scanning."""
+
+    def __init__(self) -> None:
+        self.addrs: Dict[str, Any] = {}
+
+    async def find_device_by_name(self, name: str, timeout: float) -> Any:
+        return self.addrs.get(name)
+
+    def client(self, device: Any, timeout: float) -> Any:
+        if isinstance(device, tuple):
+            from fleet_sim import SimClient
+            host, port, name = device
+            return SimClient(host, port, name, timeout)
+        from bleak import BleakClient
+        return BleakClient(device, timeout=timeout)
+
+
+# ---------- worker ----------
+
+class _Worker:
+    def __init__(self, idx: int, cmd: Connection, out: Connection, batch_max: int, batch_ms: float):
+        self.idx = idx
+        self.cmd, self.out = cmd, out
+        self.batch_max, self.batch_s = batch_max, batch_ms / 1000.0
+        self.transport = _RoutedTransport()
+        self.links: Dict[str, Any] = {}
+        self.batch: Batch = []
+        self.msgs = 0
+        self.batches = 0
+
+    def _post(self, kind: str, data: Any) -> None:
+        self.out.send_bytes(pickle.dumps((kind, data), protocol=pickle.HIGHEST_PROTOCOL))
+
+    def _flush(self) -> None:
+        if self.batch:
+            self._post(W_BATCH, self.batch)
+            self.batches += 1
+            self.batch = []
+
+    def _on_message(self, name: str, msg: Any) -> None:
+        self.batch.append((name, time.time(), msg.json if msg.is_json else msg.text))
+        self.msgs += 1
+        if len(self.batch) >= self.batch_max:
+            self._flush()
+
+    async def _device(self, name: str) -> None:
+        from ble_link import BleLink
+        link = BleLink(name, transport=self.transport)
+        link.on_message(lambda m: self._on_message(name, m))
+        self.links[name] = link
+        try:
+            while True:
+                try:
+                    await link.connect()
+                except Exception as e:
+                    self._post(W_DOWN, (name, str(e)))
+                    return
+                self._post(W_UP, name)
+                while link.is_connected():
+                    await asyncio.sleep(1.0)
+                # linket tabt: connect igen genoptager sessionen (hello med token)
+        finally:
+            self.links.pop(name, None)
+            await link.disconnect()
+
+    async def _flusher(self) -> None:
+        while True:
+            await asyncio.sleep(self.batch_s)
+            self._flush()
+
+    async def run(self) -> None:
+        tasks: Dict[str, asyncio.Task] = {}
+        flusher = asyncio.create_task(self._flusher())
+        cpu0 = time.process_time()
+        while True:
+            kind, *arg = await asyncio.to_thread(self.cmd.recv)
+            if kind == "add":
+                name, addr = arg
+                self.transport.addrs[name] = addr
+                t = tasks.get(name)
+                if t is None or t.done():
+                    tasks[name] = asyncio.create_task(self._device(name))
+            elif kind == "stop":
+                break
+        for t in tasks.values():
+            t.cancel()
+        await asyncio.gather(*tasks.values(), return_exceptions=True)
+        flusher.cancel()
+        self._flush()
+        self._post(W_STATS, {"worker": self.idx, "msgs": self.msgs, "batches": self.batches,
+                             "cpu_s": time.process_time() - cpu0})
+
+
+def _worker_main(idx: int, cmd: Connection, out: Connection, batch_max: int, batch_ms: float) -> None:
+    try:
+        asyncio.run(_Worker(idx, cmd, out, batch_max, batch_ms).run())
+    except KeyboardInterrupt:
+        pass
+    finally:
+        out.close()
+
+
+# ---------- moderprocessen ----------
+
+class Gateway:
+    """
+    Fordeler enheder over `workers` processer og fletter deres output.
+    on_batch kaldes i moderprocessen med hver batch (i ankomstrækkefølge pr.
+    worker; batches fra forskellige workers flettes, som de kommer).
+    """
+
+    def __init__(self, discovery: Discovery, workers: int = 0,
+                 on_batch: Optional[Callable[[Batch], None]] = None,
+                 batch_max: int = 256, batch_ms: float = 20.0, rescan: float = 30.0):
+        self.discovery = discovery
+        self.n = workers or mp.cpu_count()
+        self.on_batch = on_batch
+        self.batch_max, self.batch_ms = batch_max, batch_ms
+        self.rescan = rescan
+        self.assigned: Dict[str, int] = {}       # enhed -> worker
+        self.found: Dict[str, Any] = {}          # seneste scanning: enhed -> adresse
+        self.dead: set = set()                   # workers, hvis pipe er lukket
+        self.up: Dict[str, bool] = {}
+        self.worker_stats: List[Dict[str, Any]] = []
+        self.msgs = 0
+
+    def _load(self, w: int) -> int:
+        return sum(1 for x in self.assigned.values() if x == w)
+
+    def _assign(self, found: Dict[str, Any], cmds: List[Connection]) -> None:
+        live = [w for w in range(self.n) if w not in self.dead]
+        for name, addr in sorted(found.items()):
+            if name in self.assigned or not live:
+                continue
+            w = min(live, key=self._load)
+            self.assigned[name] = w
+            cmds[w].send(("add", name, addr))
+
+    def _handle(self, kind: str, data: Any) -> None:
+        if kind == W_BATCH:
+            self.msgs += len(data)
+            if self.on_batch:
+                self.on_batch(data)
+        elif kind == W_UP:
+            self.up[data] = True
+        elif kind == W_DOWN:
+            name, err = data
+            self.up.pop(name, None)
+            self.assigned.pop(name, None)        # prøves igen ved næste scanning
+            print(f"[gateway] {name}: {err}", file=sys.stderr)
+        elif kind == W_STATS:
+            self.worker_stats.append(data)
+
+    def _drain(self, outs: List[Connection], timeout: float) -> List[Connection]:
+        """Læs alt, der er klar (blokerer højst timeout). Returnerer lukkede pipes."""
+        closed = []
+        for conn in wait(outs, timeout):
+            try:
+                self._handle(*pickle.loads(conn.recv_bytes()))
+            except EOFError:
+                closed.append(conn)
+        return closed
+
+    def _worker_died(self, w: int, cmds: List[Connection]) -> None:
+        """Worker w er væk: dens enheder fordeles på de resterende."""
+        self.dead.add(w)
+        orphans = [name for name, x in self.assigned.items() if x == w]
+        for name in orphans:
+            del self.assigned[name]
+            self.up.pop(name, None)
+        print(f"[gateway] worker {w} stoppede; {len(orphans)} enheder flyttes", file=sys.stderr)
+        self._assign({n: a for n, a in self.found.items() if n in orphans}, cmds)
+
+    async def run(self, duration: Optional[float] = None) -> None:
+        ctx = mp.get_context("spawn")
+        cmds, outs, procs = [], [], []
+        for i in range(self.n):
+            cmd_r, cmd_w = ctx.Pipe(duplex=False)
+            out_r, out_w = ctx.Pipe(duplex=False)
+            p = ctx.Process(target=_worker_main, args=(i, cmd_r, out_w, self.batch_max, self.batch_ms),
+                            daemon=True)
+            p.start()
+            out_w.close()
+            cmds.append(cmd_w)
+            outs.append(out_r)
+            procs.append(p)
+        out_idx = {conn: i for i, conn in enumerate(outs)}
+
+        end = time.monotonic() + duration if duration else None
+        next_scan = 0.0
+        try:
+            while end is None or time.monotonic() < end:
+                if time.monotonic() >= next_scan:
+                    self.found = await self.discovery.scan()
+                    self._assign(self.found, cmds)
+                    next_scan = time.monotonic() + self.rescan
+                for conn in await asyncio.to_thread(self._drain, outs, 0.1):
+                    outs.remove(conn)             # ellers er den altid "klar" og loopet spinner
+                    self._worker_died(out_idx[conn], cmds)
+                if not outs:
+                    raise RuntimeError("alle gateway-workers er stoppet")
+        finally:
+            for i, c in enumerate(cmds):
+                if i not in self.dead:
+                    try:
+                        c.send(("stop",))
+                    except OSError:
+                        pass
+            while outs:                           # resten + W_STATS, til workerne lukker
+                closed = await asyncio.to_thread(self._drain, outs, 1.0)
+                for conn in closed:
+                    outs.remove(conn)
+                if not closed and not any(p.is_alive() for p in procs):
+                    break
+            for p in procs:
+                p.join(5.0)
+
+
+def _endpoints(spec: str) -> List[Tuple[str, int]]:
+    out = []
+    for ep in spec.split(","):
+        host, _, port = ep.strip().rpartition(":")
+        out.append((host or "127.0.0.1", int(port)))
+    return out
+
+
+async def run_bench(args: argparse.Namespace) -> List[Dict[str, Any]]:
+    rows = []
+    for n in [int(x) for x in args.workers.split(",")]:
+        t_measure = time.monotonic() + args.warmup      # forbind alle, før der tælles
+        counted = 0
+
+        def count(batch: Batch) -> None:
+            nonlocal counted
+            if time.monotonic() >= t_measure:
+                counted += len(batch)
+
+        gw = Gateway(Discovery(args.prefix, _endpoints(args.sim) if args.sim else None),
+                     n, count, args.batch, args.batch_ms)
+        t0 = time.monotonic()
+        await gw.run(args.warmup + args.duration)
+        wall = time.monotonic() - t0
+        rows.append({"workers": n, "devices": len(gw.up), "msgs_per_s": round(counted / args.duration),
+                     "worker_cpu_pct": [round(s["cpu_s"] / wall * 100.0) for s in gw.worker_stats]})
+    return rows
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="BleLink-gateway over flere processer")
+    ap.add_argument("cmd", choices=["run", "bench"])
+    ap.add_argument("--prefix", default="", help="kun enheder hvis navn starter med dette")
+    ap.add_argument("--sim", default=None, help="fleet_sim-endpoints host:port[,host:port...]")
+    ap.add_argument("--workers", default="0", help="run: antal (0 = antal kerner); bench: liste, fx 1,2,4")
+    ap.add_argument("--batch", type=int, default=256, help="højst beskeder pr. batch")
+    ap.add_argument("--batch-ms", type=float, default=20.0, help="batch sendes senest efter")
+    ap.add_argument("--rescan", type=float, default=30.0, help="sekunder mellem scanninger")
+    ap.add_argument("--duration", type=float, default=None)
+    ap.add_argument("--warmup", type=float, default=5.0, help="bench: tid til at forbinde")
+    ap.add_argument("--json", action="store_true", help="bench: ét JSON-objekt som output")
+    args = ap.parse_args()
+
+    if args.cmd == "bench":
+        args.duration = args.duration or 15.0
+        rows = asyncio.run(run_bench(args))
+        if args.json:
+            print(json.dumps(rows))
+        else:
+            for r in rows:
+                print(f"{r['workers']:>2} workers: {r['msgs_per_s']:>7} beskeder/s "
+                      f"({r['devices']} enheder), CPU pr. worker {r['worker_cpu_pct']} %")
+        return
+
+    out = sys.stdout
+
+    def emit(batch: Batch) -> None:
+        for dev, t, msg in batch:
+            out.write(json.dumps({"dev": dev, "t": t, "msg": msg}, separators=(",", ":")) + "\n")
+        out.flush()
+
+    gw = Gateway(Discovery(args.prefix, _endpoints(args.sim) if args.sim else None),
+                 int(args.workers), emit, args.batch, args.batch_ms, args.rescan)
+    try:
+        asyncio.run(gw.run(args.duration))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,240 @@
+"""
+Hent historik fra enheden (enheden: esp32/src/BleLinkHistory.h).
+
+  python history.py BLE-LINK-TEST --since 3600 --fmt "<fI"      # seneste time
+  python history.py BLE-LINK-TEST --from 0 --to 600000 --csv out.csv
+  python history.py HIST-NATIVE --since 3600 --sim 127.0.0.1:7601  # examples/history_native
+
+Enheden gemmer faste poster [t u32][data] i en ring. Værten spørger med et
+tidsinterval og en sidestørrelse ({"_bl":"hist"}); svaret kommer som store
+frames med mange poster hver (FRAME_HIST) og sluttes af {"_bl":"hist_end"}
+med cursor til næste side. Mangler der poster i en side (tabt frame), hentes
+siden igen fra samme cursor. Afbrydes hentningen (Ctrl-C, --cancel-after),
+sendes hist_cancel, så enheden holder op med at sende.
+
+Rapporterer poster/s, goodput, sider og poster, der blev overskrevet, før
+de nåede at blive sendt ("lost").
+"""
+import argparse
+import asyncio
+import csv
+import json
+import struct
+import time
+from typing import Any, AsyncIterator, Dict, List, Optional, Tuple
+
+from ble_link import BleLink, FRAME_HIST
+
+HDR = struct.Struct("<HIHB")            # id, seq, n, recSize
+NO_LIMIT = 0xFFFFFFFF
+
+Record = Tuple[int, Any]                # (t, data som bytes eller tuple efter fmt)
+
+
+class HistoryReader:
+    """
+    Range-forespørgsler mod enhedens historik over en forbundet BleLink.
+
+      hist = HistoryReader(link, fmt="<fI")           # struct-format for data
+      recs = await hist.fetch(since_s=3600)           # [(t, (temp, heap)), ...]
+      async for page in hist.pages(t_from, t_to): ...
+
+    Tiden er enhedens (appens valg i history().add(); millis() i demoen).
+    """
+
+    def __init__(self, link: BleLink, fmt: Optional[str] = None, page: int = 2000,
+                 timeout: float = 3.0, retries: int = 3):
+        self.link = link
+        self.fmt = struct.Struct(fmt) if fmt else None
+        self.page = page
+        self.timeout = timeout          # sekunder uden frames før siden opgives
+        self.retries = retries
+        self._qid = 0
+        self._active: Optional[int] = None
+        self._recs: List[Record] = []
+        self._end: Optional[Dict[str, Any]] = None
+        self._event = asyncio.Event()
+        self.stats = {"pages": 0, "frames": 0, "bytes": 0, "records": 0,
+                      "lost": 0, "retries": 0, "cancelled": False}
+        link.on_frame(FRAME_HIST, self._on_frame)
+        link.on_control("hist_end", self._on_end)
+
+    async def info(self) -> Dict[str, Any]:
+        """Ringens tilstand: n, cap, rec, seq/end og ældste/nyeste tid (t0/t1)."""
+        return await self.link.control_request({"_bl": "hist_info"}, "hist_info", self.timeout)
+
+    async def pages(self, t_from: int = 0, t_to: int = NO_LIMIT,
+                    since_s: Optional[float] = None) -> AsyncIterator[List[Record]]:
+        """Én liste poster pr. side, indtil intervallet er hentet."""
+        if since_s is not None:
+            now = (await self.link.control_request({"_bl": "time"}, "time", self.timeout))["ms"]
+            t_from = max(0, now - int(since_s * 1000))
+        cursor: Optional[int] = None
+        while True:
+            end, recs = await self._page(t_from, t_to, cursor)
+            self.stats["pages"] += 1
+            self.stats["records"] += len(recs)
+            self.stats["lost"] += int(end.get("lost", 0))
+            self.stats["cancelled"] = bool(end.get("cancelled"))
+            yield recs
+            if not end.get("more"):
+                return
+            cursor = int(end["next"])
+
+    async def fetch(self, t_from: int = 0, t_to: int = NO_LIMIT,
+                    since_s: Optional[float] = None) -> List[Record]:
+        out: List[Record] = []
+        async for recs in self.pages(t_from, t_to, since_s):
+            out.extend(recs)
+        return out
+
+    @property
+    def received(self) -> int:
+        """Poster modtaget indtil nu, inkl. den igangværende side."""
+        return self.stats["records"] + (len(self._recs) if self._active is not None else 0)
+
+    async def cancel(self) -> None:
+        """
+        Stop den igangværende side fra en anden task: enheden svarer med
+        hist_end "cancelled", og pages() giver det modtagne og slutter.
+        (Annulleres selve hentningens task, sendes hist_cancel også.)
+        """
+        if self._active is not None:
+            await self.link.send_json({"_bl": "hist_cancel", "id": self._active})
+
+    # ---------- intern ----------
+
+    async def _page(self, t_from: int, t_to: int,
+                    cursor: Optional[int]) -> Tuple[Dict[str, Any], List[Record]]:
+        for _ in range(self.retries + 1):
+            self._qid = (self._qid + 1) & 0xFFFF
+            msg: Dict[str, Any] = {"_bl": "hist", "id": self._qid, "from": t_from,
+                                   "to": t_to, "max": self.page}
+            if cursor is not None:
+                msg["cur"] = cursor
+            self._active, self._recs, self._end = self._qid, [], None
+            try:
+                await self.link.send_json(msg)
+                while self._end is None:
+                    self._event.clear()
+                    try:
+                        await asyncio.wait_for(self._event.wait(), self.timeout)
+                    except asyncio.TimeoutError:
+                        raise RuntimeError("ingen historik-frames fra enheden")
+            except asyncio.CancelledError:
+                # fire-and-forget: enheden skal ikke blive ved med at sende
+                asyncio.get_running_loop().create_task(
+                    self.link.send_json({"_bl": "hist_cancel", "id": self._qid}))
+                raise
+            finally:
+                self._active = None
+            end = self._end
+            if end.get("cancelled") or len(self._recs) == int(end.get("n", 0)):
+                return end, self._recs
+            self.stats["retries"] += 1          # frame tabt undervejs: samme side igen
+        raise RuntimeError(f"siden mangler stadig poster efter {self.retries} forsøg")
+
+    def _on_frame(self, payload: bytes) -> None:
+        if len(payload) < HDR.size:
+            return
+        qid, _seq, n, rec = HDR.unpack_from(payload)
+        if qid != self._active:
+            return                              # forældet (annulleret/afløst side)
+        stride = 4 + rec
+        for i in range(n):
+            off = HDR.size + i * stride
+            t = int.from_bytes(payload[off:off + 4], "little")
+            data = payload[off + 4:off + stride]
+            self._recs.append((t, self.fmt.unpack(data) if self.fmt else data))
+        self.stats["frames"] += 1
+        self.stats["bytes"] += len(payload)
+        self._event.set()
+
+    def _on_end(self, obj: Dict[str, Any]) -> None:
+        if obj.get("id") == self._active:
+            self._end = obj
+            self._event.set()
+
+
+def _transport(spec: Optional[str]) -> Any:
+    if not spec:
+        return None
+    from fleet_sim import SimTransport
+    host, _, port = spec.rpartition(":")
+    return SimTransport(host or "127.0.0.1", int(port))
+
+
+async def main_async(args: argparse.Namespace) -> None:
+    link = BleLink(args.device, psk=bytes.fromhex(args.psk) if args.psk else None,
+                   transport=_transport(args.sim))
+    await link.connect()
+    hist = HistoryReader(link, fmt=args.fmt, page=args.page, timeout=args.timeout)
+    recs: List[Record] = []
+
+    async def read() -> None:
+        async for page in hist.pages(args.t_from, args.t_to,
+                                     args.since if args.t_from == 0 else None):
+            recs.extend(page)
+            if not args.json:
+                print(f"[hist] side {hist.stats['pages']}: {len(page)} poster (i alt {len(recs)})")
+
+    async def cancel_after(n: int) -> None:
+        while hist.received < n:
+            await asyncio.sleep(0.005)
+        await hist.cancel()
+
+    try:
+        info = await hist.info()
+        t0 = time.monotonic()
+        reader = asyncio.create_task(read())
+        stopper = asyncio.create_task(cancel_after(args.cancel_after)) if args.cancel_after else None
+        try:
+            await reader
+        finally:
+            if stopper:
+                stopper.cancel()
+        dur = time.monotonic() - t0
+    finally:
+        await link.disconnect()
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            w = csv.writer(f)
+            for t, d in recs:
+                w.writerow([t, *(d if isinstance(d, tuple) else (d.hex(),))])
+    res = {
+        "ring": {k: info.get(k) for k in ("n", "cap", "rec", "t0", "t1")},
+        "records": len(recs),
+        "t_first": recs[0][0] if recs else None,
+        "t_last": recs[-1][0] if recs else None,
+        "seconds": round(dur, 3),
+        "records_per_s": round(len(recs) / dur) if dur else 0,
+        "goodput_Bps": round(hist.stats["bytes"] / dur) if dur else 0,
+        **hist.stats,
+    }
+    if args.json:
+        print(json.dumps(res))
+    else:
+        for k, v in res.items():
+            print(f"{k:>14}: {v}")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="BleLink historik (range-forespørgsel)")
+    ap.add_argument("device")
+    ap.add_argument("--since", type=float, default=3600.0, help="sekunder tilbage fra enhedens nu")
+    ap.add_argument("--from", dest="t_from", type=int, default=0, help="enhedstid (i stedet for --since)")
+    ap.add_argument("--to", dest="t_to", type=int, default=NO_LIMIT)
+    ap.add_argument("--page", type=int, default=2000, help="poster pr. side")
+    ap.add_argument("--fmt", default=None, help="struct-format for postens data, fx '<fI'")
+    ap.add_argument("--timeout", type=float, default=3.0, help="sekunder uden frames før fejl")
+    ap.add_argument("--cancel-after", type=int, default=0, help="annullér efter så mange poster")
+    ap.add_argument("--csv", default=None, help="skriv posterne som CSV")
+    ap.add_argument("--sim", default=None, help="host:port for fleet_sim-protokol (fx examples/history_native)")
+    ap.add_argument("--psk", default=None, help="16-byte nøgle som hex: kør krypteret")
+    ap.add_argument("--json", action="store_true", help="ét JSON-objekt som output")
+    asyncio.run(main_async(ap.parse_args()))
+
+
+if __name__ == "__main__":
+    main()
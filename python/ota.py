@@ -0,0 +1,226 @@
+"""
+Firmwareopdatering over BleLink (enheden: esp32/src/BleLinkOta.h).
+
+  python ota.py BleLink-Device .pio/build/esp32dev-secure/firmware.bin --psk <32 hex-tegn>
+  python ota.py BleLink-Device firmware.bin --no-apply          # kun overfør + verificér
+  python ota.py OTA-NATIVE firmware.bin --sim 127.0.0.1:7600    # examples/ota_native, uden ESP32
+
+Billedet sendes som frames [offset u32 LE][data], én pr. write og uden
+response. Enheden kvitterer sammenhængende modtaget data ("off") og ledig
+plads i sine to skrivebuffere ("room"); der sendes højst til off + room, så
+linket holdes fuldt, mens enheden skriver til flash. Et hul (tabt frame)
+giver en kvittering med "gap", og der sendes igen derfra.
+Tabes forbindelsen, forbinder værktøjet igen, og ota_begin med samme hash
+fortsætter, hvor enheden slap. Til sidst tjekker enheden SHA-256 over hele
+billedet, og ota_apply sætter boot-partitionen og genstarter.
+Enheden tager kun imod et billede over en krypteret session (--psk), medmindre
+firmwaren har kaldt setOtaFlash(flash, true); ellers afviser den ota_begin.
+
+Rapporterer goodput, gensendte bytes, tilbagespolinger og genforbindelser.
+"""
+import argparse
+import asyncio
+import hashlib
+import json
+import time
+from typing import Any, Callable, Dict, Optional
+
+from ble_link import BleLink, FRAME_HEADER, FRAME_OTA, _SecureSession
+
+
+class OtaError(RuntimeError):
+    pass
+
+
+class OtaUploader:
+    """
+    Overfører et billede til en forbundet BleLink.
+
+      up = OtaUploader(link)
+      res = await up.upload(image, progress=lambda done, total: ...)
+      await up.apply()
+
+    upload() forbinder selv igen (højst retries gange), hvis linket tabes.
+    """
+
+    OFF_LEN = 4
+
+    def __init__(self, link: BleLink, window: Optional[int] = None,
+                 ack_timeout: float = 2.0, retries: int = 5):
+        self.link = link
+        self.window = window            # ekstra loft over ukvitterede bytes (None = kun kredit)
+        self.ack_timeout = ack_timeout
+        self.retries = retries
+        self._acked = 0
+        self._limit = 0                 # off + room fra seneste kvittering
+        self._rewind: Optional[int] = None
+        self._result: Optional[Dict[str, Any]] = None
+        self._event = asyncio.Event()
+        self.stats = {"sent": 0, "rewinds": 0, "timeouts": 0, "reconnects": 0, "resumed_at": []}
+
+    async def upload(self, image: bytes, progress: Optional[Callable[[int, int], None]] = None
+                     ) -> Dict[str, Any]:
+        sha = hashlib.sha256(image).hexdigest()
+        self.link.on_control("ota_ack", self._on_ack)
+        self.link.on_control("ota", self._on_state)
+        t0 = time.monotonic()
+        try:
+            for attempt in range(self.retries + 1):
+                try:
+                    await self._upload_once(image, sha, progress)
+                    break
+                except (asyncio.TimeoutError, RuntimeError) as e:
+                    if isinstance(e, OtaError) or attempt == self.retries:
+                        raise
+                    print(f"[ota] {e or 'timeout'}: forbinder igen")
+                    if self.link.is_connected():
+                        await self.link.disconnect()
+                    await self.link.connect()
+                    self.stats["reconnects"] += 1
+        finally:
+            self.link.on_control("ota_ack", None)
+            self.link.on_control("ota", None)
+        dur = time.monotonic() - t0
+        return {
+            "bytes": len(image), "sha256": sha, "seconds": round(dur, 2),
+            "goodput_Bps": round(len(image) / dur) if dur else 0,
+            "resent_bytes": max(0, self.stats["sent"] - len(image)),
+            **self.stats,
+        }
+
+    async def apply(self, timeout: float = 5.0) -> None:
+        r = await self.link.control_request({"_bl": "ota_apply"}, "ota", timeout)
+        if r.get("st") != "applied":
+            raise OtaError(f"ota_apply afvist: {r}")
+
+    async def abort(self, timeout: float = 3.0) -> None:
+        await self.link.control_request({"_bl": "ota_abort"}, "ota", timeout)
+
+    # ---------- intern ----------
+
+    async def _upload_once(self, image: bytes, sha: str,
+                           progress: Optional[Callable[[int, int], None]]) -> None:
+        size = len(image)
+        self._result = None
+        st = await self.link.control_request({"_bl": "ota_begin", "size": size, "sha": sha},
+                                             "ota", self.ack_timeout)
+        if st.get("st") == "verified":
+            return
+        if st.get("st") != "recv":
+            raise OtaError(f"ota_begin afvist: {st}")
+        off = self._acked = int(st["off"])
+        self._limit = off + int(st.get("room", 0))
+        self.stats["resumed_at"].append(off)
+        self._rewind = None
+        win = self.window or size
+        # én frame pr. write, også når den forsegles (tæller, tag og ydre header)
+        over = _SecureSession.OVERHEAD if self.link.secure else 0
+        chunk = max(16, self.link.write_size - FRAME_HEADER - self.OFF_LEN - over)
+
+        while True:
+            if self._result is not None:
+                res, self._result = self._result, None
+                if res.get("st") == "verified":
+                    return
+                if res.get("st") == "failed":
+                    raise OtaError(f"enheden afviste billedet: {res.get('err')}")
+            if self._rewind is not None:
+                off, self._rewind = self._rewind, None
+                self.stats["rewinds"] += 1
+            if off < min(size, self._limit) and off - self._acked < win:
+                n = min(chunk, min(size, self._limit) - off)
+                payload = off.to_bytes(self.OFF_LEN, "little") + image[off:off + n]
+                await asyncio.wait_for(self.link.send_frame(FRAME_OTA, payload, response=False),
+                                       self.ack_timeout)
+                off += n
+                self.stats["sent"] += n
+                continue
+
+            # ingen kredit (eller alt er sendt): vent på kvittering/resultat
+            self._event.clear()
+            try:
+                await asyncio.wait_for(self._event.wait(), self.ack_timeout)
+            except asyncio.TimeoutError:
+                if not self.link.is_connected():
+                    raise RuntimeError("forbindelsen tabt")
+                self.stats["timeouts"] += 1
+                st = await self.link.control_request({"_bl": "ota_status"}, "ota", self.ack_timeout)
+                if st.get("st") == "recv":
+                    off = self._acked = int(st["off"])   # kvitteringen blev væk
+                    self._limit = off + int(st.get("room", 0))
+                else:
+                    self._result = st
+            if progress:
+                progress(self._acked, size)
+
+    def _on_ack(self, obj: Dict[str, Any]) -> None:
+        off = int(obj.get("off", 0))
+        if obj.get("gap"):
+            self._acked = off
+            self._rewind = off
+        elif off >= self._acked:
+            self._acked = off
+        else:
+            return                      # forældet (før en tilbagespoling)
+        self._limit = off + int(obj.get("room", 0))
+        self._event.set()
+
+    def _on_state(self, obj: Dict[str, Any]) -> None:
+        if obj.get("st") in ("verified", "failed"):
+            self._result = obj
+            self._event.set()
+
+
+def _transport(spec: Optional[str]) -> Any:
+    if not spec:
+        return None
+    from fleet_sim import SimTransport
+    host, _, port = spec.rpartition(":")
+    return SimTransport(host or "127.0.0.1", int(port))
+
+
+async def main_async(args: argparse.Namespace) -> None:
+    with open(args.image, "rb") as f:
+        image = f.read()
+    link = BleLink(args.device, psk=bytes.fromhex(args.psk) if args.psk else None,
+                   transport=_transport(args.sim))
+    await link.connect()
+    last = [0.0]
+
+    def progress(done: int, total: int) -> None:
+        if not args.json and time.monotonic() - last[0] >= 1.0:
+            last[0] = time.monotonic()
+            print(f"[ota] {done}/{total} bytes ({100.0 * done / total:.0f} %)")
+
+    try:
+        up = OtaUploader(link, window=args.window, ack_timeout=args.timeout, retries=args.retries)
+        res = await up.upload(image, progress)
+        if not args.no_apply:
+            await up.apply()
+        res["applied"] = not args.no_apply
+    finally:
+        await link.disconnect()
+
+    if args.json:
+        print(json.dumps(res))
+    else:
+        for k, v in res.items():
+            print(f"{k:>14}: {v}")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="BleLink firmwareopdatering")
+    ap.add_argument("device")
+    ap.add_argument("image", help="firmwarebillede (.bin)")
+    ap.add_argument("--sim", default=None, help="host:port for fleet_sim-protokol (fx examples/ota_native)")
+    ap.add_argument("--window", type=int, default=None, help="højst så mange bytes ukvitteret (default: enhedens kredit)")
+    ap.add_argument("--timeout", type=float, default=2.0, help="sekunder uden kvittering før status")
+    ap.add_argument("--retries", type=int, default=5, help="genforbindelser ved tabt link")
+    ap.add_argument("--no-apply", action="store_true", help="overfør og verificér, men boot ikke")
+    ap.add_argument("--psk", default=None, help="16-byte nøgle som hex: kør krypteret")
+    ap.add_argument("--json", action="store_true", help="ét JSON-objekt som output")
+    asyncio.run(main_async(ap.parse_args()))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,132 @@
+"""
+Soak-test af BleLink: kør enheden gennem mange blandede beskeder, reconnects
+og overlange linjer, og følg heap-forløbet undervejs.
+
+Enheden skal køre demo-firmwaren bygget med [env:esp32dev-soak]
+(instrumenteret allokator, se esp32/src/BleLinkHeap.h). Den svarer på
+{"op":"heap"} med fri heap, største frie blok og allokeringstællere.
+
+Eksempel:
+  python soak.py --messages 10000000 --reconnect-every 50000 --csv soak.csv
+"""
+import argparse
+import asyncio
+import csv
+import random
+import string
+import time
+from typing import Any, Dict, List, Optional
+
+from ble_link import BleLink
+
+
+class HeapProbe:
+    """Sender {"op":"heap"} og venter på svaret fra enheden."""
+
+    def __init__(self, link: BleLink):
+        self._link = link
+        self._fut: Optional[asyncio.Future] = None
+        link.on_receive_json(self._on_json)
+
+    def _on_json(self, obj: Dict[str, Any]) -> None:
+        if obj.get("event") == "heap" and self._fut and not self._fut.done():
+            self._fut.set_result(obj)
+
+    async def sample(self, timeout: float = 5.0) -> Dict[str, Any]:
+        self._fut = asyncio.get_running_loop().create_future()
+        await self._link.send_json({"op": "heap"})
+        return await asyncio.wait_for(self._fut, timeout)
+
+
+def _text(n: int) -> str:
+    return "".join(random.choices(string.ascii_letters + string.digits, k=n))
+
+
+async def _one_message(link: BleLink, i: int, oversize_every: int, oversize_len: int) -> None:
+    if oversize_every and i % oversize_every == 0:
+        await link.send_raw(_text(oversize_len))        # overlang linje
+    elif i % 3 == 0:
+        await link.send_raw("PING")
+    else:
+        await link.send_json({"op": "echo", "msg": _text(random.randint(1, 200))})
+
+
+def _slope(xs: List[float], ys: List[float]) -> float:
+    """Mindste kvadraters hældning (y pr. x)."""
+    n = len(xs)
+    if n < 2:
+        return 0.0
+    mx, my = sum(xs) / n, sum(ys) / n
+    den = sum((x - mx) ** 2 for x in xs)
+    return sum((x - mx) * (y - my) for x, y in zip(xs, ys)) / den if den else 0.0
+
+
+async def soak(args: argparse.Namespace) -> None:
+    link = BleLink(args.device)
+    probe = HeapProbe(link)
+    await link.connect()
+
+    samples: List[Dict[str, Any]] = []
+    t0 = time.monotonic()
+    reconnects = 0
+
+    async def take(msgs: int) -> None:
+        h = await probe.sample()
+        h["msgs"] = msgs
+        h["t"] = round(time.monotonic() - t0, 1)
+        samples.append(h)
+        print(f"[soak] msgs={msgs} free={h['free']} largest={h['largest']} "
+              f"live={h['live']} allocs={h['allocs']} dropped={h['dropped']}")
+
+    await take(0)
+    for i in range(1, args.messages + 1):
+        await _one_message(link, i, args.oversize_every, args.oversize_len)
+        if args.reconnect_every and i % args.reconnect_every == 0:
+            await link.disconnect()
+            await asyncio.sleep(args.reconnect_pause)
+            await link.connect()
+            reconnects += 1
+        if i % args.sample_every == 0:
+            await take(i)
+    await take(args.messages)
+    await link.disconnect()
+
+    first, last = samples[0], samples[-1]
+    # besked-tælling: sendte + ca. et svar pr. echo/PING
+    handled = max(1, 2 * (last["msgs"] - first["msgs"]))
+    xs = [s["msgs"] / 1e6 for s in samples]
+    print("\n--- soak-rapport ---")
+    print(f"beskeder:            {args.messages}  reconnects: {reconnects}")
+    print(f"varighed:            {last['t']:.0f} s")
+    print(f"min fri heap:        {min(s['minFree'] for s in samples)} B")
+    print(f"min største blok:    {min(s['largest'] for s in samples)} B")
+    print(f"fri heap trend:      {_slope(xs, [s['free'] for s in samples]):+.0f} B pr. mio. beskeder")
+    print(f"største blok trend:  {_slope(xs, [s['largest'] for s in samples]):+.0f} B pr. mio. beskeder")
+    if last.get("traced"):
+        print(f"peak levende heap:   {max(s['peak'] for s in samples)} B")
+        print(f"allokeringer/besked: {(last['allocs'] - first['allocs']) / handled:.2f}")
+    else:
+        print("(firmware uden BLELINK_HEAP_TRACE: ingen allokeringstal)")
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            w = csv.DictWriter(f, fieldnames=list(samples[0].keys()), extrasaction="ignore")
+            w.writeheader()
+            w.writerows(samples)
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="BleLink heap soak-test")
+    ap.add_argument("--device", default="BLE-LINK-TEST")
+    ap.add_argument("--messages", type=int, default=1_000_000)
+    ap.add_argument("--sample-every", type=int, default=10_000)
+    ap.add_argument("--reconnect-every", type=int, default=100_000)
+    ap.add_argument("--reconnect-pause", type=float, default=1.0)
+    ap.add_argument("--oversize-every", type=int, default=1_000)
+    ap.add_argument("--oversize-len", type=int, default=4_096)
+    ap.add_argument("--csv", default=None, help="skriv heap-forløbet som CSV")
+    asyncio.run(soak(ap.parse_args()))
+
+
+if __name__ == "__main__":
+    main()
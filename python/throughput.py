@@ -0,0 +1,178 @@
+"""
+Throughput-test af BleLink mod den indbyggede testtilstand i firmwaren
+({"_bl":"test",...}, se esp32/src/BleLinkTest.h).
+
+  python throughput.py source --bytes 200000 --size 240   # enhed -> vært
+  python throughput.py sink   --bytes 200000 --size 240   # vært -> enhed
+  python throughput.py echo   --count 500 --size 64 --window 4
+  python throughput.py source --psk 000102030405060708090a0b0c0d0e0f   # krypteret
+  python throughput.py source --device TEST-NATIVE --sim 127.0.0.1:7602  # examples/loopback_native
+
+Rapporterer goodput, latens-percentiler (echo: round trip) og tab. Kør samme
+test med og uden --psk (firmware: env esp32dev-secure; native:
+loopback_native --psk) for at se prisen for krypteringen.
+"""
+import argparse
+import asyncio
+import json
+import time
+import zlib
+from typing import Any, Dict, List, Optional
+
+from ble_link import BleLink
+
+
+def _line(seq: int, size: int) -> str:
+    """Testlinje uden '\\n': "~T<seq 8 hex>" + fyld, i alt size-1 tegn."""
+    head = "~T%08x" % (seq & 0xFFFFFFFF)
+    return head + "x" * max(1, size - 1 - len(head))
+
+
+def _pct(xs: List[float], p: float) -> float:
+    if not xs:
+        return 0.0
+    xs = sorted(xs)
+    return xs[min(len(xs) - 1, int(round(p / 100.0 * (len(xs) - 1))))]
+
+
+def _latency(xs: List[float]) -> Dict[str, float]:
+    return {f"p{p}": round(_pct(xs, p), 2) for p in (50, 90, 99)} | {"max": round(max(xs, default=0.0), 2)}
+
+
+async def run_source(link: BleLink, nbytes: int, size: int, timeout: float) -> Dict:
+    arrivals: List[float] = []
+    seqs = set()
+    got = 0
+
+    def on_line(txt: str) -> None:
+        nonlocal got
+        arrivals.append(time.monotonic())
+        seqs.add(int(txt[2:10], 16))
+        got += len(txt) + 1
+
+    link.on_test_traffic(on_line)
+    t0 = time.monotonic()
+    await link.control_request({"_bl": "test", "mode": "source", "n": nbytes, "size": size}, "test_ack")
+    done = await link.wait_control("test_done", timeout)
+    await asyncio.sleep(0.2)                  # sidste notifikationer
+    link.on_test_traffic(None)
+
+    dur = (arrivals[-1] - t0) if arrivals else 0.0
+    gaps = [(b - a) * 1000.0 for a, b in zip(arrivals, arrivals[1:])]
+    return {
+        "mode": "source", "bytes": got, "lines": len(seqs),
+        "goodput_Bps": round(got / dur) if dur else 0,
+        "lost": max(0, done["lines"] - len(seqs)),
+        "interarrival_ms": _latency(gaps),
+        "device_ms": done["ms"],
+    }
+
+
+async def run_sink(link: BleLink, nbytes: int, size: int, timeout: float) -> Dict:
+    await link.control_request({"_bl": "test", "mode": "sink"}, "test_ack")
+    crc, sent, lines, sends = 0, 0, 0, []
+    t0 = time.monotonic()
+    while sent < nbytes:
+        txt = _line(lines, min(size, max(12, nbytes - sent)))
+        crc = zlib.crc32(txt.encode(), crc)
+        sent += len(txt) + 1
+        sends.append(link.send_raw(txt, response=False))
+        lines += 1
+    await asyncio.gather(*sends)              # writer-tasken fletter linjerne
+    done = await link.control_request({"_bl": "test", "mode": "stop"}, "test_done", timeout)
+    dur = time.monotonic() - t0
+    return {
+        "mode": "sink", "bytes": sent, "lines": lines,
+        "goodput_Bps": round(done["bytes"] / dur) if dur else 0,
+        "device_bytes": done["bytes"], "device_lines": done["lines"],
+        "lost": (lines - done["lines"]) + done["lost"],
+        "crc_ok": done["crc"] == crc,
+    }
+
+
+async def run_echo(link: BleLink, count: int, size: int, window: int, timeout: float) -> Dict:
+    sent_at: Dict[int, float] = {}
+    rtts: List[float] = []
+    slots = asyncio.Semaphore(window)
+
+    def on_line(txt: str) -> None:
+        t = sent_at.pop(int(txt[2:10], 16), None)
+        if t is not None:
+            rtts.append((time.monotonic() - t) * 1000.0)
+            slots.release()
+
+    link.on_test_traffic(on_line)
+    await link.control_request({"_bl": "test", "mode": "echo"}, "test_ack")
+    t0 = time.monotonic()
+    for seq in range(count):
+        try:
+            await asyncio.wait_for(slots.acquire(), timeout)
+        except asyncio.TimeoutError:
+            sent_at.clear()                   # tabt i luften: frigiv vinduet
+            slots = asyncio.Semaphore(window - 1)
+        sent_at[seq] = time.monotonic()
+        await link.send_raw(_line(seq, size), response=False)
+    end = time.monotonic() + timeout
+    while sent_at and time.monotonic() < end:
+        await asyncio.sleep(0.05)
+    dur = time.monotonic() - t0
+    await link.control_request({"_bl": "test", "mode": "stop"}, "test_done")
+    link.on_test_traffic(None)
+    return {
+        "mode": "echo", "lines": count, "received": len(rtts),
+        "goodput_Bps": round(len(rtts) * size / dur) if dur else 0,
+        "lost": count - len(rtts),
+        "rtt_ms": _latency(rtts),
+    }
+
+
+def _transport(spec: Optional[str]) -> Any:
+    if not spec:
+        return None
+    from fleet_sim import SimTransport
+    host, _, port = spec.rpartition(":")
+    return SimTransport(host or "127.0.0.1", int(port))
+
+
+async def main_async(args: argparse.Namespace) -> None:
+    link = BleLink(args.device, psk=bytes.fromhex(args.psk) if args.psk else None,
+                   transport=_transport(args.sim))
+    await link.connect()
+    try:
+        if args.mode == "source":
+            res = await run_source(link, args.bytes, args.size, args.timeout)
+        elif args.mode == "sink":
+            res = await run_sink(link, args.bytes, args.size, args.timeout)
+        else:
+            res = await run_echo(link, args.count, args.size, args.window, args.timeout)
+        res["mtu"] = (await link.get_device_stats()).get("mtu")
+        res["encrypted"] = link.psk is not None
+        # tid pr. forbindelsesfase (summeret over evt. gentagne forsøg)
+        res["connect_ms"] = {k: round(v.total_ms) for k, v in link.connect_metrics().items()}
+    finally:
+        await link.disconnect()
+
+    if args.json:
+        print(json.dumps(res))
+    else:
+        for k, v in res.items():
+            print(f"{k:>16}: {v}")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="BleLink throughput-test")
+    ap.add_argument("mode", choices=["source", "sink", "echo"])
+    ap.add_argument("--device", default="BLE-LINK-TEST")
+    ap.add_argument("--bytes", type=int, default=100_000, help="source/sink: mængde")
+    ap.add_argument("--size", type=int, default=128, help="linjestørrelse inkl. '\\n' (12..512)")
+    ap.add_argument("--count", type=int, default=200, help="echo: antal linjer")
+    ap.add_argument("--window", type=int, default=4, help="echo: linjer i luften")
+    ap.add_argument("--timeout", type=float, default=60.0)
+    ap.add_argument("--psk", default=None, help="16-byte nøgle som hex: kør krypteret")
+    ap.add_argument("--sim", default=None, help="host:port for fleet_sim-protokol (fx examples/loopback_native)")
+    ap.add_argument("--json", action="store_true", help="ét JSON-objekt som output")
+    asyncio.run(main_async(ap.parse_args()))
+
+
+if __name__ == "__main__":
+    main()